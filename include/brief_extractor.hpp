@@ -0,0 +1,84 @@
+#pragma once
+
+/*
+  BRIEF binary descriptors (Calonder et al., 2010) of the keypoints of
+  HarrisCorner: each of the 256 bits compares the intensities of a
+  fixed pair of pixels of the patch around the keypoint, so a
+  descriptor is 32 bytes that HammingMatcher compares by Hamming
+  distance.
+
+  The pixels are taken from a smoothed image, which smooth() makes from
+  a frame with a 5x5 binomial filter. HarrisCorner accepts the smoothed
+  image as well, so one smoothed image per frame serves both the
+  detection and the descriptors, and the frame is not read again to
+  describe its corners.
+ */
+
+#include <opencv2/opencv.hpp>
+
+#include <harris_corner.hpp>
+#include <harris_kernels.hpp>
+#include "my_utils_kk4.hpp"
+
+#include <vector>
+
+
+class BriefExtractor{
+public:
+
+    typedef HarrisCorner::Keypoint Keypoint;
+
+    BriefExtractor();
+
+    /*
+      smoothed = input_image filtered by [1 4 6 4 1] / 16 in both
+      directions, with the same type (CV_32FC1, or CV_8UC1 rounded to
+      nearest), and the border reflected as by cv::BORDER_REFLECT_101.
+      smoothed may be input_image.
+     */
+    void smooth(const cv::Mat& input_image, cv::Mat& smoothed);
+
+    /*
+      Row i of descriptors (keypoints.size() x kDescriptorBytes,
+      CV_8UC1) is the descriptor of keypoints[i] in smoothed_image,
+      normally made by smooth(). The pattern is scaled by the scale of
+      the keypoint, for those of detectKeypointsMultiScale(), and
+      samples outside the image are taken from its nearest border
+      pixel, so that every keypoint gets a descriptor.
+     */
+    void compute(const cv::Mat& smoothed_image,
+                 const std::vector<Keypoint>& keypoints,
+                 cv::Mat& descriptors);
+
+    harris_kernels::Isa getIsa()const{
+        return kernels_->isa;
+    }
+    // of smooth(); the best ISA of the running CPU by default
+    void setIsa(const harris_kernels::Isa isa);
+
+    static const int kDescriptorBytes = harris_kernels::kDescriptorBytes;
+    static const int kDescriptorBits = 8 * kDescriptorBytes;
+
+    // side of the square the sampled pixels lie in, at scale 1
+    static const int kPatchSize = 31;
+
+private:
+
+    // offsets of the two pixels of a bit from the keypoint
+    struct SamplePair{
+        int x1;
+        int y1;
+        int x2;
+        int y2;
+    };
+
+    const harris_kernels::KernelTable* kernels_;
+
+    std::vector<SamplePair> pattern_;           // kDescriptorBits pairs
+    std::vector<SamplePair> scaled_pattern_;    // at the scale of a keypoint
+    std::vector<int> offsets1_;                 // of the pairs, in image elements
+    std::vector<int> offsets2_;
+
+    std::vector<float> horizontal_;             // ring of 5 rows of smooth()
+    std::vector<float> row_buffer_;
+};
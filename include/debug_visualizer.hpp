@@ -0,0 +1,78 @@
+#pragma once
+
+/*
+  Images of the intermediate planes of a HarrisCorner for debug
+  windows, made lazily: only for the windows that are open, and only on
+  one frame in every refresh interval, from the planes the detector
+  keeps on those frames (HarrisCorner::setKeptPlanes()). On the other
+  frames, or with every window closed, the detector keeps nothing and
+  no image is made, so the debug windows cost nothing while nobody
+  looks at them.
+
+  Per frame, beginFrame() before the detection and render() after it,
+  on the thread that detects. A refresh counts only on a frame the
+  detector ran on, e.g. a detection frame of a HarrisTracker; until
+  then it stays due.
+ */
+
+#include <opencv2/opencv.hpp>
+
+#include <harris_corner.hpp>
+
+
+class DebugVisualizer{
+public:
+
+    typedef enum{
+        DISPLAY_NORMALIZED,     // CV_8UC1, the minimum to the maximum of the plane over 0 to 255
+        DISPLAY_COLOR_MAP       // CV_8UC3, the same through cv::COLORMAP_JET
+    }Display;
+
+    explicit DebugVisualizer(const int refresh_interval = kDefaultRefreshInterval);
+
+    // Makes harris_corner keep the planes of open_planes, a combination
+    // of HarrisCorner::planeBit()s of the open windows, if a refresh is
+    // due, and none otherwise. A window that was not open at the last
+    // refresh is refreshed at once.
+    void beginFrame(HarrisCorner& harris_corner, const unsigned open_planes);
+
+    // The images of the planes harris_corner kept for this frame, into
+    // views[plane] of an array of HarrisCorner::kNumPlanes, if detected
+    // says it ran since beginFrame(). Returns the mask of the refreshed
+    // ones, 0 between refreshes and on frames without a detection.
+    unsigned render(const HarrisCorner& harris_corner, cv::Mat* views,
+                    const bool detected = true);
+
+    int getRefreshInterval()const{
+        return refresh_interval_;
+    }
+    // in frames, 1 refreshes every frame
+    void setRefreshInterval(const int refresh_interval);
+
+    Display getDisplay()const{
+        return display_;
+    }
+    void setDisplay(const Display display){
+        display_ = display;
+    }
+
+    // images made since the construction
+    long getNumRenders()const{
+        return num_renders_;
+    }
+
+    static const int kDefaultRefreshInterval = 5;
+
+private:
+
+    int refresh_interval_;
+    Display display_;
+
+    long frame_idx_;
+    long refresh_frame_idx_;        // of the last refresh, < 0 before the first
+    unsigned shown_planes_;         // at the last refresh
+    unsigned pending_planes_;       // kept for the current frame, refreshed if detected
+
+    long num_renders_;
+    cv::Mat normalized_;            // of DISPLAY_COLOR_MAP
+};
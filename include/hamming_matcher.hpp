@@ -0,0 +1,98 @@
+#pragma once
+
+/*
+  Brute-force matching of binary descriptors, such as those of
+  BriefExtractor, by Hamming distance. The distances of a query
+  descriptor to all train descriptors come from one SIMD kernel (a
+  nibble table on SSE4.1 / AVX2, VPOPCNTDQ on AVX-512), from which
+  further kernels pick its nearest and second nearest train descriptor
+  and keep the nearest query descriptor of each train descriptor for
+  the cross-check, so the pairs are only visited once.
+ */
+
+#include <opencv2/opencv.hpp>
+
+#include <harris_kernels.hpp>
+#include "my_utils_kk4.hpp"
+
+#include <cstdint>
+#include <vector>
+
+
+class HammingMatcher{
+public:
+
+    struct Match{
+        int query_idx;          // row of the query descriptors
+        int train_idx;          // row of the train descriptors
+        int distance;           // in bits
+    };
+
+    HammingMatcher();
+
+    /*
+      The nearest train descriptor of each query descriptor (rows of
+      kDescriptorBytes, CV_8UC1), in query order, if it passes the
+      enabled tests:
+
+        - cross-check: the query descriptor is the nearest of the train
+          descriptor too,
+        - ratio test (Lowe): its distance is below the ratio times that
+          of the second nearest,
+        - its distance is at most the maximum distance.
+
+      Ties go to the lowest index on both sides.
+     */
+    void match(const cv::Mat& query_descriptors,
+               const cv::Mat& train_descriptors,
+               std::vector<Match>& matches);
+
+    bool getCrossCheck()const{
+        return cross_check_;
+    }
+    // on by default
+    void setCrossCheck(const bool cross_check);
+
+    double getRatio()const{
+        return ratio_;
+    }
+    // in (0, 1]; 1 turns the ratio test off. kDefaultRatio by default.
+    void setRatio(const double ratio);
+
+    int getMaxDistance()const{
+        return max_distance_;
+    }
+    // kDescriptorBits, i.e. no limit, by default
+    void setMaxDistance(const int max_distance);
+
+    harris_kernels::Isa getIsa()const{
+        return kernels_->isa;
+    }
+    // The best ISA of the running CPU is used by default.
+    void setIsa(const harris_kernels::Isa isa);
+
+    static const int kDescriptorBytes = harris_kernels::kDescriptorBytes;
+    static const int kDescriptorBits = 8 * kDescriptorBytes;
+
+    static constexpr double kDefaultRatio = 0.8;
+
+private:
+
+    const harris_kernels::KernelTable* kernels_;
+
+    bool cross_check_;
+    double ratio_;
+    int max_distance_;
+
+    std::vector<uint8_t> train_scratch_;        // train descriptors if not continuous
+    std::vector<uint16_t> distances_;           // of one query descriptor
+
+    // per query descriptor
+    std::vector<int> best_train_;
+    std::vector<uint16_t> best_distance_;
+    std::vector<uint16_t> second_distance_;
+
+    // per train descriptor
+    std::vector<int32_t> best_query_;
+    std::vector<uint16_t> best_query_distance_;
+};
@@ -0,0 +1,129 @@
+#pragma once
+
+/*
+  Throughput-oriented front end of HarrisCorner for offline jobs over
+  many frames, e.g. recorded footage, where frames per second matter
+  and the latency of a single frame does not.
+
+  Frames are either processed several at a time, one per thread, each
+  thread with a single-threaded HarrisCorner of its own, or one at a
+  time by a HarrisCorner that splits each frame into bands across all
+  threads. The results are the same either way, and are always
+  delivered in frame order.
+ */
+
+#include <harris_corner.hpp>
+#include "my_utils_kk4.hpp"
+
+#include <functional>
+#include <memory>
+#include <vector>
+
+
+class HarrisBatchDetector{
+public:
+
+    typedef HarrisCorner::Keypoint Keypoint;
+    typedef HarrisCorner::KeypointSelection KeypointSelection;
+
+    typedef enum{
+        PARALLEL_AUTO,          // chosen by chooseParallelism()
+        PARALLEL_FRAMES,        // one frame per thread
+        PARALLEL_TILES          // one frame at a time, split across threads
+    }Parallelism;
+
+    // Called with a frame to fill, whose buffer is recycled from an
+    // earlier frame. Returns false at the end of the input.
+    typedef std::function<bool(cv::Mat& frame)> FrameSource;
+
+    // Called in frame order with the index of the frame in the input
+    typedef std::function<void(const int frame_idx,
+                               const cv::Mat& frame,
+                               const std::vector<Keypoint>& keypoints)> KeypointSink;
+
+    // 0 threads means std::thread::hardware_concurrency()
+    HarrisBatchDetector(const double k = 0.04, const int window_size = 3,
+                        const int num_threads = 0);
+    ~HarrisBatchDetector();
+
+    HarrisBatchDetector(const HarrisBatchDetector&) = delete;
+    HarrisBatchDetector& operator=(const HarrisBatchDetector&) = delete;
+
+    // HarrisCorner::detectKeypoints() of every frame. keypoints[i] is
+    // the result of frames[i]; the capacity of the lists is reused.
+    void detectKeypoints(const std::vector<cv::Mat>& frames,
+                         std::vector<std::vector<Keypoint> >& keypoints,
+                         const double thresh,
+                         const int nms_window_size,
+                         const KeypointSelection& selection = KeypointSelection());
+
+    // Same for frames pulled from source until it returns false. The
+    // source and the sink run on the calling thread, between batches of
+    // frames detected in parallel.
+    void detectKeypoints(const FrameSource& source,
+                         const KeypointSink& sink,
+                         const double thresh,
+                         const int nms_window_size,
+                         const KeypointSelection& selection = KeypointSelection());
+
+    /*
+      Parallelism for num_frames frames of the given size. Frames in
+      parallel need no halo rows and no synchronization within a frame,
+      so they are preferred, unless there are fewer frames than threads,
+      or so many pixels would be in flight at once that splitting each
+      frame is the better use of the caches. Splitting needs enough
+      bands to keep every thread busy.
+     */
+    Parallelism chooseParallelism(const cv::Size& frame_size, const int num_frames)const;
+
+    Parallelism getParallelism()const{
+        return parallelism_;
+    }
+    void setParallelism(const Parallelism parallelism){
+        parallelism_ = parallelism;
+    }
+
+    // what the last call actually used
+    Parallelism getLastParallelism()const{
+        return last_parallelism_;
+    }
+
+    int getNumThreads()const{
+        return thread_pool_.getNumThreads();
+    }
+
+    void setIsa(const harris_kernels::Isa isa);
+    void setSubpixelRefinement(const bool subpixel_refinement);
+
+    // Above this many pixels of frames in flight, PARALLEL_AUTO splits
+    // frames instead.
+    static const long kMaxPixelsInFlight = 32L * 1024 * 1024;
+
+    // frames read ahead per thread by the FrameSource version
+    static const int kFramesPerThread = 2;
+
+private:
+
+    void detectBatch(cv::Mat const * const frames,
+                     std::vector<Keypoint>* keypoints,
+                     const int num_frames,
+                     const Parallelism parallelism,
+                     const double thresh,
+                     const int nms_window_size,
+                     const KeypointSelection& selection);
+
+    my_utils_kk4::ThreadPool thread_pool_;
+
+    // one single-threaded detector per thread of thread_pool_, and one
+    // with as many threads of its own for PARALLEL_TILES, which are
+    // started on first use
+    std::vector<std::unique_ptr<HarrisCorner> > frame_detectors_;
+    HarrisCorner tile_detector_;
+
+    Parallelism parallelism_;
+    Parallelism last_parallelism_;
+
+    // buffers of the FrameSource version
+    std::vector<cv::Mat> frame_buffers_;
+    std::vector<std::vector<Keypoint> > keypoint_buffers_;
+};
@@ -7,31 +7,677 @@
 
 #include <opencv2/opencv.hpp>
 
+#include <harris_kernels.hpp>
+#include "my_utils_kk4.hpp"
+
+#include <algorithm>
 #include <cassert>
 #include <cmath>
+#include <vector>
 
 
 class HarrisCorner{
 public:
 
-    HarrisCorner();
+    typedef enum{
+        NMS_NAIVE,              // compare against the whole window, O(w^2)
+        NMS_SEPARABLE           // van Herk/Gil-Werman running max, O(1)
+    }NmsMethod;
+
+    typedef enum{
+        PIPELINE_PLANES,        // calcResponse() then nonMaximumSuppression()
+        PIPELINE_STREAMING      // rolling row buffers, no full-frame intermediates
+    }PipelineMode;
+
+    typedef enum{
+        ANMS_NAIVE,             // against every other keypoint, O(n^2)
+        ANMS_GRID               // nearest stronger keypoints from a grid, about O(n log n)
+    }AnmsMethod;
+
+    // intermediate planes of a detection, see setKeptPlanes()
+    typedef enum{
+        PLANE_GRAD_X,           // central differences of calcResponse()
+        PLANE_GRAD_Y,
+        PLANE_SUM_XX,           // window sums of the tensor products
+        PLANE_SUM_YY,
+        PLANE_SUM_XY,
+        PLANE_RESPONSE          // of the response type
+    }Plane;
+
+    static const int kNumPlanes = PLANE_RESPONSE + 1;
+
+    // bit of a plane in a plane mask
+    static unsigned planeBit(const Plane plane){
+        return 1u << plane;
+    }
+
+    // e.g. "grad_x", for names and options
+    static const char* planeName(const Plane plane);
+
+    struct Keypoint{
+        float x;
+        float y;
+        float score;            // response (see setResponseType())
+        float scale;            // downsampling factor of the pyramid level, 1 at full size
+    };
+
+    struct KeypointSelection{
+        int max_corners;            // 0: no limit
+        int grid_cols;              // grid for max_corners_per_cell
+        int grid_rows;
+        int max_corners_per_cell;   // 0: no limit
+        bool adaptive_nms;          // max_corners by suppression radius instead of score
+
+        KeypointSelection()
+            : max_corners(0),
+              grid_cols(1),
+              grid_rows(1),
+              max_corners_per_cell(0),
+              adaptive_nms(false){
+        }
+    };
+
+    HarrisCorner(const double k = 0.04, const int window_size = 3,
+                 const int num_threads = 1);
     ~HarrisCorner();
 
+    // input_image is CV_32FC1, or CV_8UC1 for an integer pipeline with
+    // int16 gradients and exact int32 window sums that skips the
+    // conversion to float. 8-bit pixels are taken as value / 255, as
+    // converted by convertTo(..., CV_32F, 1.0 / 255.0), so responses
+    // and thresholds mean the same for both types.
     void calcResponse(const cv::Mat& input_image,
                       cv::Mat& harris_response);
-    
+
+    // calcResponse() of every response r whose responseBit(r) is in
+    // response_mask, from a single pass over the image: gradients and
+    // window sums are shared, and each response only adds its own
+    // arithmetic per pixel, in the same loop over the sums. Each of
+    // those responses[r] is the plane calcResponse() gives with
+    // setResponseType(r); the others are left as they are. responses
+    // is grown to harris_kernels::kNumResponses.
+    void calcResponses(const cv::Mat& input_image,
+                       const unsigned response_mask,
+                       std::vector<cv::Mat>& responses);
+
+    // calcResponse() followed by separable NMS, run according to the
+    // pipeline mode. Both modes give the same mask.
+    void detectCorners(const cv::Mat& input_image,
+                       cv::Mat& img_binary_result,
+                       const double thresh,
+                       const int nms_window_size);
+
+    // Same corners as detectCorners(), returned as a list without a
+    // dense mask, then thinned out according to selection. The
+    // capacity of keypoints is reused, so repeated calls on frames of
+    // the same size do not allocate once it has grown.
+    void detectKeypoints(const cv::Mat& input_image,
+                         std::vector<Keypoint>& keypoints,
+                         const double thresh,
+                         const int nms_window_size,
+                         const KeypointSelection& selection = KeypointSelection());
+
+    // The keypoints of detectKeypoints() that lie in rows
+    // [row_begin, row_end) of input_image, in the same order and not
+    // yet selected, from one band on the calling thread that reads
+    // only the rows they depend on. Concatenated over adjacent row
+    // ranges, they are exactly the keypoints of the whole image, so an
+    // image can be split across independent detectors.
+    void detectKeypointsRows(const cv::Mat& input_image,
+                             std::vector<Keypoint>& keypoints,
+                             const double thresh,
+                             const int nms_window_size,
+                             const int row_begin,
+                             const int row_end);
+
+    // Corners over an image pyramid of num_levels octaves, each level
+    // half the size of the previous one, so the whole pyramid costs
+    // about 4/3 of a single scale. A corner is kept if it is a maximum
+    // within its level, as in detectKeypoints(), and is not below the
+    // response of the adjacent levels around the same position. The
+    // response is scale-normalized by construction (gradients are
+    // taken in level pixels), so levels compare directly. Coordinates
+    // are in input image pixels. Levels that would be smaller than the
+    // windows are skipped. input_image must be CV_32FC1.
+    void detectKeypointsMultiScale(const cv::Mat& input_image,
+                                   std::vector<Keypoint>& keypoints,
+                                   const double thresh,
+                                   const int nms_window_size,
+                                   const int num_levels,
+                                   const KeypointSelection& selection = KeypointSelection());
+
+    void selectKeypoints(std::vector<Keypoint>& keypoints,
+                         const cv::Size& image_size,
+                         const KeypointSelection& selection);
+
+    // Adaptive non-maximal suppression (Brown, Szeliski and Winder,
+    // 2005): keeps the max_corners keypoints with the largest
+    // suppression radius, the distance to the nearest keypoint that
+    // still scores higher after its score is multiplied by robustness
+    // (0 < robustness <= 1), infinite for the strongest. The kept
+    // corners thus spread over the image instead of clumping where the
+    // response is strong. They are sorted by decreasing radius, ties in
+    // score order, so that any prefix is what a smaller max_corners
+    // keeps. Both methods give the same keypoints. Nothing changes if
+    // max_corners is 0 or there are no more keypoints than that.
+    void adaptiveNonMaximalSuppression(std::vector<Keypoint>& keypoints,
+                                       const int max_corners,
+                                       const double robustness = kAnmsRobustness,
+                                       const AnmsMethod method = ANMS_GRID);
+
+    class NmsContext;
+
+    // With the kernels of the best ISA of the running CPU; the NMS of
+    // the detections runs on those of setIsa(). NMS_SEPARABLE works in
+    // the buffers of context, which the caller keeps from call to call
+    // to avoid allocations; without one, they are allocated per call.
     static void nonMaximumSuppression(const cv::Mat& img_response,
                                       cv::Mat& img_binary_result,
                                       const double thresh,
-                                      const int window_size);
+                                      const int window_size,
+                                      const NmsMethod method = NMS_SEPARABLE,
+                                      my_utils_kk4::ThreadPool* thread_pool = nullptr,
+                                      NmsContext* context = nullptr);
+
+    double getK()const{
+        return k_;
+    }
+    void setK(const double k);
+
+    harris_kernels::Response getResponseType()const{
+        return response_type_;
+    }
+    // Response function of calcResponse() and of the detections,
+    // RESPONSE_HARRIS by default; k only applies to it. Thresholds and
+    // keypoint scores are in units of the chosen response.
+    void setResponseType(const harris_kernels::Response response_type);
+
+    int getWindowSize()const{
+        return window_size_;
+    }
+    void setWindowSize(const int window_size);
+
+    harris_kernels::Isa getIsa()const{
+        return kernels_->isa;
+    }
+    // The best ISA of the running CPU is used by default.
+    void setIsa(const harris_kernels::Isa isa);
+
+    PipelineMode getPipelineMode()const{
+        return pipeline_mode_;
+    }
+    void setPipelineMode(const PipelineMode pipeline_mode);
+
+    int getNumThreads()const{
+        return thread_pool_.getNumThreads();
+    }
+    // 0 means std::thread::hardware_concurrency()
+    void setNumThreads(const int num_threads);
+
+    bool getSubpixelRefinement()const{
+        return subpixel_refinement_;
+    }
+    // Refine the keypoints of detectKeypoints() and
+    // detectKeypointsMultiScale() to sub-pixel positions by fitting a
+    // quadratic to the 3x3 response around each of them. Off by default.
+    void setSubpixelRefinement(const bool subpixel_refinement);
+
+    bool getIncremental()const{
+        return incremental_;
+    }
+    // Incremental detectCorners() and detectKeypoints() for mostly
+    // static scenes: each frame is compared with the previous one per
+    // tile of kIncrementalTileSize pixels, and only the tiles that
+    // changed, and those within reach of the windows, are recomputed.
+    // The other tiles keep their cached response and corners, and the
+    // result is the same as a full recompute. A change of image size or
+    // type, k, window sizes, threshold or ISA recomputes everything. The
+    // pipeline mode does not apply. Off by default.
+    void setIncremental(const bool incremental);
+
+    // Fraction of the tiles whose response the last incremental
+    // detection recomputed
+    double getDirtyTileFraction()const{
+        return incremental_state_.dirty_tile_fraction;
+    }
+
+    unsigned getKeptPlanes()const{
+        return kept_planes_;
+    }
+    // Keep the intermediate planes of plane_mask, a combination of
+    // planeBit()s, of the following calcResponse(), calcResponses(),
+    // detectCorners() and detectKeypoints() calls, e.g. to look at
+    // them. A kept plane is stored row by row as the pipeline produces
+    // it, one write per pixel and nothing computed again, and the
+    // response plane of PIPELINE_PLANES and of the incremental mode is
+    // the one the detection uses. 0, none, by default.
+    void setKeptPlanes(const unsigned plane_mask);
+
+    // Read-only view of a kept plane of the last of those calls, not a
+    // copy, valid until the next one. Planes are CV_32FC1, except the
+    // gradients and sums of 8-bit input, which stay in its integers:
+    // CV_16SC1 and CV_32SC1, 255 and 255 * 255 times those of its float
+    // conversion. Empty if the plane was not kept, or in incremental
+    // mode for all but the response. Other detections leave the planes
+    // as they are.
+    const cv::Mat& getPlane(const Plane plane)const{
+        return planes_[plane];
+    }
+
+    // can be passed to nonMaximumSuppression()
+    my_utils_kk4::ThreadPool& getThreadPool(){
+        return thread_pool_;
+    }
+
+    // How many times an internal buffer has been (re)allocated. The
+    // buffers only grow, so this stays constant from frame to frame
+    // once they fit the resolution, window sizes and thread count.
+    // Growth of keypoint lists is not included.
+    unsigned long getWorkspaceAllocationCount()const;
+
+    // Running window sums are restarted from a direct sum at every
+    // multiple of this many rows / columns (in image coordinates) so
+    // that float round-off cannot build up across a large frame.
+    static const int kRunningSumRestartInterval = 32;
+
+    // Largest window_size for CV_8UC1 input, above which the int32
+    // window sums could overflow.
+    static const int kMaxWindowSizeU8 = 181;
+
+    // Tile size of the incremental mode. A multiple of
+    // kRunningSumRestartInterval, so that tiles can be recomputed on
+    // their own with the same sums as the whole image.
+    static const int kIncrementalTileSize = 64;
+
+    // that of Brown et al.: a neighbour suppresses only if it is
+    // clearly stronger
+    static constexpr double kAnmsRobustness = 0.9;
+
+    // mean number of keypoints per cell of the ANMS_GRID index
+    static const int kAnmsKeypointsPerCell = 2;
 
 private:
 
-    void calcM(const cv::Mat& grad_x,
-               const cv::Mat& grad_y,
-               cv::Mat& M,
-               const size_t row_idx,
-               const size_t col_idx);
+    // Rows of an image held in a cv::Mat used as a ring: image row i is
+    // stored in row i % capacity. A Mat with as many rows as the image
+    // is simply the image. The storage only grows, so narrower rows
+    // (e.g. pyramid levels) or fewer rows reuse it. A ring keeps the
+    // type it was first created with.
+    struct RowRing{
+        cv::Mat storage;
+        cv::Mat buffer;         // top-left capacity x cols of storage
+
+        void create(const int capacity, const int cols,
+                    unsigned long& num_allocations,
+                    const int type = CV_32FC1){
+            if(storage.cols < cols || storage.rows < capacity || storage.type() != type){
+                storage.create(std::max(capacity, storage.rows),
+                               std::max(cols, storage.cols), type);
+                num_allocations++;
+            }
+            buffer = storage(cv::Rect(0, 0, cols, capacity));
+        }
+        float* row(const int i){
+            return buffer.ptr<float>(i % buffer.rows);
+        }
+        float const * row(const int i)const{
+            return buffer.ptr<float>(i % buffer.rows);
+        }
+        template<typename T>
+        T* rowAs(const int i){
+            return buffer.ptr<T>(i % buffer.rows);
+        }
+    };
+
+    // tensor products of the gradients and their window sums, with
+    // elements of type T
+    template<typename T>
+    struct TensorWorkspace{
+        RowRing grad_xx;
+        RowRing grad_yy;
+        RowRing grad_xy;
+        std::vector<T> col_sum_xx;
+        std::vector<T> col_sum_yy;
+        std::vector<T> col_sum_xy;
+        std::vector<T> sum_xx;
+        std::vector<T> sum_yy;
+        std::vector<T> sum_xy;
+    };
+
+    // scratch buffers of the separable NMS
+    struct NmsWorkspace{
+        std::vector<float> padded_row;
+        std::vector<float> suffix_max;
+        std::vector<float> neg_inf_row;
+        RowRing suffix_rows;
+        std::vector<float> prefix_row;
+        std::vector<float> window_max_row;
+        std::vector<uint8_t> mask_row;
+        RowRing row_max;
+        unsigned long num_allocations;
+
+        NmsWorkspace()
+            : num_allocations(0){
+        }
+    };
+
+    // 3x3 response neighbourhoods of keypoints, gathered during NMS as a
+    // structure of arrays: samples[3 * j + i][m] is the response at
+    // (x + i - 1, y + j - 1) around keypoint m. The refinement then runs
+    // as one SIMD batch over them. Kept per band, like the keypoints, so
+    // that its capacity settles from frame to frame.
+    struct NeighborhoodBatch{
+        std::vector<float> samples[9];
+        std::vector<float> offset_x;
+        std::vector<float> offset_y;
+
+        void clear(){
+            for(std::vector<float>& v : samples){
+                v.clear();
+            }
+        }
+        size_t size()const{
+            return samples[0].size();
+        }
+        void move(const size_t from, const size_t to){
+            for(std::vector<float>& v : samples){
+                v[to] = v[from];
+            }
+        }
+        void resize(const size_t n){
+            for(std::vector<float>& v : samples){
+                v.resize(n);
+            }
+        }
+    };
+
+    // per-thread scratch buffers of calcResponse() and detectCorners()
+    struct BandWorkspace{
+        std::vector<float> grad_x_row;
+        std::vector<float> grad_y_row;
+        TensorWorkspace<float> tensor;
+        std::vector<int16_t> grad_x_row_s16;    // of 8-bit input
+        std::vector<int16_t> grad_y_row_s16;
+        TensorWorkspace<int32_t> tensor_s32;
+        RowRing response;
+        NmsWorkspace nms;
+        std::vector<float> pyramid_row;
+        unsigned long num_allocations;
+
+        // kept planes the band fills in its rows, [kept_row_begin,
+        // kept_row_end); null where not kept
+        cv::Mat* kept_planes[kNumPlanes];
+        int kept_row_begin;
+        int kept_row_end;
+
+        BandWorkspace()
+            : num_allocations(0),
+              kept_planes(),
+              kept_row_begin(0),
+              kept_row_end(0){
+        }
+    };
+
+    void detect(const cv::Mat& input_image,
+                cv::Mat* img_binary_result,
+                std::vector<Keypoint>* keypoints,
+                const double thresh,
+                const int nms_window_size);
+
+    // adjacent tiles [tile_begin, tile_end) of one tile row
+    struct TileRun{
+        int tile_row;
+        int tile_begin;
+        int tile_end;
+    };
+
+    // cache of the incremental mode, valid for the parameters it was
+    // computed with
+    struct IncrementalState{
+        bool valid;
+        double k;
+        harris_kernels::Response response_type;
+        int window_size;
+        const harris_kernels::KernelTable* kernels;
+        float thresh;
+        int nms_window_size;
+
+        cv::Mat input;                      // the previous frame
+        cv::Mat response;
+        std::vector<std::vector<Keypoint> > tile_keypoints;   // per tile, not refined
+
+        std::vector<uint8_t> input_dirty;   // per tile
+        std::vector<uint8_t> response_dirty;
+        std::vector<uint8_t> nms_dirty;
+        std::vector<TileRun> runs;          // of response_dirty tiles
+        std::vector<int> nms_tiles;         // nms_dirty tiles
+        std::vector<size_t> cursors;
+        double dirty_tile_fraction;
+
+        IncrementalState()
+            : valid(false),
+              k(0.0),
+              response_type(harris_kernels::RESPONSE_HARRIS),
+              window_size(0),
+              kernels(nullptr),
+              thresh(0.0f),
+              nms_window_size(0),
+              dirty_tile_fraction(0.0){
+        }
+    };
+
+    void detectIncremental(const cv::Mat& input_image,
+                           cv::Mat* img_binary_result,
+                           std::vector<Keypoint>* keypoints,
+                           const float thresh,
+                           const int nms_window_size);
+
+    void findChangedTiles(const cv::Mat& input_image,
+                          const int tile_row);
+
+    void calcResponseTiles(const cv::Mat& input_image,
+                           const TileRun& run,
+                           BandWorkspace& workspace);
+
+    void nonMaximumSuppressionTile(const int tile_idx,
+                                   const float thresh,
+                                   const int nms_window_size,
+                                   BandWorkspace& workspace);
+
+    void emitTileKeypoints(cv::Mat* img_binary_result,
+                           std::vector<Keypoint>* keypoints);
+
+    static void collectTileRuns(const std::vector<uint8_t>& dirty,
+                                const int tiles_x,
+                                const int tiles_y,
+                                std::vector<TileRun>& runs);
+
+    // a keypoint in the ANMS_GRID index, with its rank in score order
+    struct AnmsPoint{
+        float x;
+        float y;
+        int rank;
+    };
+
+    // a band of one pyramid level
+    struct PyramidTask{
+        int level;
+        int row_begin;
+        int row_end;
+    };
+
+    void prepareBandWorkspaces(const int cols,
+                               const int depth,
+                               const int nms_window_size,
+                               const int nms_rows);
+
+    int buildPyramid(const cv::Mat& input_image,
+                     const int num_levels,
+                     const int nms_window_size);
+
+    void downsampleRows(const cv::Mat& src,
+                        cv::Mat& dst,
+                        const int row_begin,
+                        const int row_end,
+                        float * const row_buffer)const;
+
+    bool isScaleMaximum(const Keypoint& keypoint,
+                        const int level,
+                        const int num_levels,
+                        const int half_nms_w_size)const;
+
+    void prepareBandKeypoints(const int num_bands);
+
+    void prepareKeptPlanes(const cv::Mat& input_image,
+                           const unsigned plane_mask,
+                           const cv::Mat* response);
+
+    template<typename T>
+    static void keepPlaneRow(BandWorkspace& workspace,
+                             const Plane plane,
+                             const int i_r,
+                             T const * const src);
+
+    void refineKeypoints(std::vector<Keypoint>& keypoints,
+                         NeighborhoodBatch& neighborhoods)const;
+
+    int calcBandRows(const int rows, const int halo)const;
+
+    void calcResponses(const cv::Mat& input_image,
+                       const unsigned response_mask,
+                       cv::Mat * const * responses);
+
+    void calcResponseBand(const cv::Mat& input_image,
+                          cv::Mat& harris_response,
+                          const int row_begin,
+                          const int row_end,
+                          BandWorkspace& workspace)const;
+
+    void calcResponsesBand(const cv::Mat& input_image,
+                           const unsigned response_mask,
+                           cv::Mat * const * responses,
+                           const int row_begin,
+                           const int row_end,
+                           BandWorkspace& workspace)const;
+
+    void detectCornersBand(const cv::Mat& input_image,
+                           cv::Mat* img_binary_result,
+                           std::vector<Keypoint>* keypoints,
+                           NeighborhoodBatch* neighborhoods,
+                           const float thresh,
+                           const int nms_window_size,
+                           const int row_begin,
+                           const int row_end,
+                           BandWorkspace& workspace)const;
+
+    void prepareTensorWorkspace(BandWorkspace& workspace,
+                                const int cols,
+                                const int depth)const;
+
+    template<typename T>
+    void prepareTensorSums(TensorWorkspace<T>& tensor,
+                           const int cols,
+                           const int type,
+                           unsigned long& num_allocations)const;
+
+    void calcTensorProductRow(const cv::Mat& input_image,
+                              const int i_r,
+                              BandWorkspace& workspace)const;
+
+    void calcTensorProductRowU8(const cv::Mat& input_image,
+                                const int i_r,
+                                BandWorkspace& workspace)const;
+
+    void calcResponseRow(BandWorkspace& workspace,
+                         const int i_r,
+                         const int rows,
+                         const int depth,
+                         float * const response)const;
+
+    void calcResponsesRow(BandWorkspace& workspace,
+                          const int i_r,
+                          const int rows,
+                          const int depth,
+                          const unsigned response_mask,
+                          float * const * responses)const;
+
+    template<typename T>
+    void calcWindowSums(TensorWorkspace<T>& tensor,
+                        const int i_r,
+                        const int rows)const;
+
+    void checkInputType(const cv::Mat& input_image)const;
+
+    static void nonMaximumSuppressionNaive(const cv::Mat& img_response,
+                                           cv::Mat& img_binary_result,
+                                           const double thresh,
+                                           const int window_size);
+
+    static void nonMaximumSuppressionSeparable(const cv::Mat& img_response,
+                                               cv::Mat& img_binary_result,
+                                               const double thresh,
+                                               const int window_size,
+                                               my_utils_kk4::ThreadPool* thread_pool,
+                                               const harris_kernels::KernelTable& kernels,
+                                               NmsContext& context);
+
+    static void nonMaximumSuppressionSeparableBand(const cv::Mat& img_response,
+                                                   cv::Mat* img_binary_result,
+                                                   std::vector<Keypoint>* keypoints,
+                                                   NeighborhoodBatch* neighborhoods,
+                                                   const float thresh,
+                                                   const int window_size,
+                                                   const int row_begin,
+                                                   const int row_end,
+                                                   NmsWorkspace& workspace,
+                                                   const harris_kernels::KernelTable& kernels);
+
+    static void prepareNmsWorkspace(NmsWorkspace& workspace,
+                                    const int cols,
+                                    const int window_size,
+                                    const int row_max_capacity);
+
+    static void calcRowMax(float const * const response_row,
+                           float * const row_max_row,
+                           const int cols,
+                           const int window_size,
+                           NmsWorkspace& workspace,
+                           const harris_kernels::KernelTable& kernels);
+
+    static void nonMaximumSuppressionBlock(const RowRing& response,
+                                           const int rows,
+                                           const int row_begin,
+                                           const int row_end,
+                                           const int block_begin,
+                                           const float thresh,
+                                           const int window_size,
+                                           NmsWorkspace& workspace,
+                                           const harris_kernels::KernelTable& kernels,
+                                           cv::Mat* img_binary_result,
+                                           std::vector<Keypoint>* keypoints,
+                                           NeighborhoodBatch* neighborhoods);
+
+    static void collectKeypoints(uint8_t const * const mask_row,
+                                 float const * const response_row,
+                                 const int i_r,
+                                 const int cols,
+                                 std::vector<Keypoint>& keypoints);
+
+    static void collectNeighborhoods(float const * const above_row,
+                                     float const * const response_row,
+                                     float const * const below_row,
+                                     const int cols,
+                                     std::vector<Keypoint>::const_iterator first,
+                                     std::vector<Keypoint>::const_iterator last,
+                                     NeighborhoodBatch& neighborhoods);
+
+    static float toFloatThreshold(const double thresh);
+
+    static void slidingWindowMax(float const * const src,
+                                 float * const dst,
+                                 const int length,
+                                 const int window_size,
+                                 float * const suffix_max);
 
     static bool nonMaximumSuppressionCheckRow(const float val,
                                               float const * const row_head_pointer,
@@ -40,9 +686,59 @@ private:
                                               const int window_max,
                                               const int img_cols);
 
-    
+
     double k_;
+    harris_kernels::Response response_type_;
     int window_size_;        // must be an odd number
 
+    const harris_kernels::KernelTable* kernels_;
+
+    PipelineMode pipeline_mode_;
+    bool subpixel_refinement_;
+    bool incremental_;
+
+    my_utils_kk4::ThreadPool thread_pool_;
+    std::vector<BandWorkspace> band_workspaces_;
+
+    cv::Mat response_;          // response plane of PIPELINE_PLANES
+
+    unsigned kept_planes_;
+    cv::Mat planes_[kNumPlanes];
+    bool response_plane_shared_;    // planes_[PLANE_RESPONSE] is a detection's own
+
+    std::vector<std::vector<Keypoint> > band_keypoints_;
+    std::vector<NeighborhoodBatch> band_neighborhoods_;
+    std::vector<Keypoint> keypoint_scratch_;
+    std::vector<int> cell_begin_scratch_;
+    std::vector<int> cell_fill_scratch_;
+    std::vector<AnmsPoint> anms_points_scratch_;    // ANMS_GRID index, by cell
+    std::vector<float> anms_radius_scratch_;        // squared
+    std::vector<int> anms_order_scratch_;
+
+    std::vector<cv::Mat> pyramid_images_;      // level 0 is not used
+    std::vector<cv::Mat> pyramid_responses_;
+    std::vector<PyramidTask> pyramid_tasks_;
+
+    IncrementalState incremental_state_;
+
+    unsigned long num_allocations_;    // of the buffers above
+
 };
 
+// scratch buffers of the static HarrisCorner::nonMaximumSuppression()
+class HarrisCorner::NmsContext{
+public:
+
+    NmsContext()
+        : num_allocations_(0){
+    }
+
+    // same as HarrisCorner::getWorkspaceAllocationCount()
+    unsigned long getWorkspaceAllocationCount()const;
+
+private:
+    friend class HarrisCorner;
+
+    std::vector<NmsWorkspace> workspaces_;     // one per thread
+    unsigned long num_allocations_;
+};
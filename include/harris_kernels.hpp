@@ -0,0 +1,180 @@
+#pragma once
+
+/*
+  Row kernels used by HarrisCorner.
+
+  Every kernel exists as a plain scalar implementation, which is the
+  reference, and as SSE4.1 / AVX2 implementations compiled in their
+  own translation units with the matching -m flags. The AVX-512 level
+  is the AVX2 table with the kernels that gain from AVX-512 replaced.
+  The best implementation supported by the running CPU is chosen at
+  runtime, so a single binary works on every x86-64 machine.
+ */
+
+#include <cstdint>
+
+
+namespace harris_kernels{
+
+// windowMaxRow is specialized for half window sizes [0, kNumWindowMaxKernels)
+const int kNumWindowMaxKernels = 16;
+
+// size of a binary descriptor (see BriefExtractor)
+const int kDescriptorBytes = 32;
+
+typedef enum{
+    ISA_SCALAR,
+    ISA_SSE41,
+    ISA_AVX2,
+    ISA_AVX512              // AVX2, plus AVX-512 VL and VPOPCNTDQ
+}Isa;
+
+// corner responses of the structure tensor (see harris_kernels_response.hpp)
+typedef enum{
+    RESPONSE_HARRIS,            // det - k * trace^2
+    RESPONSE_SHI_TOMASI,        // smaller eigenvalue
+    RESPONSE_NOBLE              // det / (trace + kNobleEpsilon)
+}Response;
+
+const int kNumResponses = 3;
+
+// combinations of responses, as masks of responseBit()
+const int kNumResponseMasks = 1 << kNumResponses;
+
+inline unsigned responseBit(const Response response){
+    return 1u << response;
+}
+
+// keeps Noble's response of flat regions at 0 instead of 0 / 0
+const float kNobleEpsilon = 1e-12f;
+
+struct KernelTable{
+
+    Isa isa;
+
+    // dst[i] = a[i] - b[i]
+    void (*subtract)(float const * a, float const * b, float * dst, int n);
+
+    // gxx = gx * gx, gyy = gy * gy, gxy = gx * gy
+    void (*tensorProducts)(float const * gx, float const * gy,
+                           float * gxx, float * gyy, float * gxy, int n);
+
+    // acc[i] += src[i]
+    void (*addRow)(float * acc, float const * src, int n);
+
+    // acc[i] -= src[i]
+    void (*subtractRow)(float * acc, float const * src, int n);
+
+    // dst[i] = v[i - half_w_size] + ... + v[i + half_w_size] for i in
+    // [begin, end). dst[begin] is a direct sum and the rest is a
+    // running sum starting from it. v must be readable on
+    // [begin - half_w_size - 1, end + half_w_size).
+    void (*runningSum)(float const * v, float * dst,
+                       int begin, int end, int half_w_size);
+
+    // dst[r][i] = response r of the sums at i, for every response r
+    // in the mask that is the index of the entry, in one pass over the
+    // sums. k is that of RESPONSE_HARRIS. The other entries of dst are
+    // not used.
+    void (*responses[kNumResponseMasks])(float const * sxx, float const * syy,
+                                         float const * sxy, float k,
+                                         float * const * dst, int n);
+
+    // dst[i] = max(a[i], b[i])
+    void (*maxRow)(float const * a, float const * b, float * dst, int n);
+
+    // dst[i] = (val[i] >= thresh && val[i] >= window_max[i]) ? 255 : 0
+    void (*nmsCompare)(float const * val, float const * window_max,
+                       float thresh, uint8_t * dst, int n);
+
+    // dst[i] = r0[i] + r4[i] + 4 * (r1[i] + r3[i]) + 6 * r2[i]
+    void (*binomialRows)(float const * r0, float const * r1, float const * r2,
+                         float const * r3, float const * r4, float * dst, int n);
+
+    // dst[i] = (v[2i - 2] + v[2i + 2] + 4 * (v[2i - 1] + v[2i + 1]) + 6 * v[2i]) / 256,
+    // i.e. the horizontal half of a pyrDown() step. v must be readable
+    // on [-2, 2 * n + 2).
+    void (*binomialDecimate)(float const * v, float * dst, int n);
+
+    // Sub-pixel offsets of n response maxima by a least-squares fit of
+    // a 2-D quadratic to their 3x3 neighbourhoods. samples[3 * j + i][m]
+    // is the response at (x + i - 1, y + j - 1) around maximum m. The
+    // offsets are clamped to [-0.5, 0.5], and are 0 where the fitted
+    // quadratic has no maximum.
+    void (*subpixelOffsets)(float const * const * samples,
+                            float * offset_x, float * offset_y, int n);
+
+    // Integer versions for 8-bit input. Gradients of 8-bit pixels fit
+    // int16, and window sums of their products fit int32 for windows
+    // up to 181 x 181, so everything up to the response is exact.
+
+    // dst[i] = a[i] - b[i]
+    void (*subtractU8)(uint8_t const * a, uint8_t const * b, int16_t * dst, int n);
+
+    // gxx = gx * gx, gyy = gy * gy, gxy = gx * gy
+    void (*tensorProductsS16)(int16_t const * gx, int16_t const * gy,
+                              int32_t * gxx, int32_t * gyy, int32_t * gxy, int n);
+
+    // acc[i] += src[i]
+    void (*addRowS32)(int32_t * acc, int32_t const * src, int n);
+
+    // acc[i] -= src[i]
+    void (*subtractRowS32)(int32_t * acc, int32_t const * src, int n);
+
+    // same as runningSum
+    void (*runningSumS32)(int32_t const * v, int32_t * dst,
+                          int begin, int end, int half_w_size);
+
+    // responses of the sums converted to float and multiplied by scale
+    void (*responsesS32[kNumResponseMasks])(int32_t const * sxx, int32_t const * syy,
+                                            int32_t const * sxy, float k, float scale,
+                                            float * const * dst, int n);
+
+    // dst[i] = max(src[i - h], ..., src[i + h]) for i in [0, n),
+    // ignoring elements outside [0, n), where h is the index of the
+    // entry (see harris_kernels_window.hpp)
+    void (*windowMaxRow[kNumWindowMaxKernels])(float const * src, float * dst, int n);
+
+    // dst[i] = Hamming distance between the descriptors query and
+    // train + kDescriptorBytes * i
+    void (*hammingDistances)(uint8_t const * query, uint8_t const * train,
+                             int n, uint16_t * dst);
+
+    // index of the first smallest of v[0, n), n > 0
+    int (*argminU16)(uint16_t const * v, int n);
+
+    // where v[i] < min[i]: min[i] = v[i] and min_idx[i] = idx
+    void (*updateMinU16)(uint16_t const * v, int32_t idx,
+                         uint16_t * min, int32_t * min_idx, int n);
+};
+
+const char* isaName(const Isa isa);
+
+const char* responseName(const Response response);
+
+bool isSupported(const Isa isa);
+
+Isa getBestIsa();
+
+// Throws std::runtime_error if isa is not supported on this CPU/build.
+const KernelTable& getKernels(const Isa isa);
+
+const KernelTable& getBestKernels();
+
+
+// implementations of each ISA. nullptr if the ISA was not compiled in.
+
+const KernelTable* getScalarKernels();
+const KernelTable* getSse41Kernels();
+const KernelTable* getAvx2Kernels();
+const KernelTable* getAvx512Kernels();
+
+// The AVX-512 table is the AVX2 one with this kernel, which is all the
+// AVX-512 translation unit exports: code built there may use zmm
+// registers anywhere, so it only runs once the CPU is known to support
+// it. nullptr if AVX-512 was not compiled in.
+typedef void (*HammingDistancesKernel)(uint8_t const * query, uint8_t const * train,
+                                       int n, uint16_t * dst);
+HammingDistancesKernel getAvx512HammingDistances();
+
+}
@@ -0,0 +1,59 @@
+#pragma once
+
+/*
+  Hamming distances of descriptors of 256 bits, one per 256-bit vector,
+  shared by the AVX2 and AVX-512 kernels, which only differ in how they
+  count the set bits of each 64-bit lane. The translation unit passes a
+  policy P with
+
+    static __m256i popcount(__m256i v);    // per 64-bit lane
+
+  Only for translation units built with AVX2.
+ */
+
+#include <harris_kernels.hpp>
+
+#include <immintrin.h>
+
+
+namespace harris_kernels{
+
+template<typename P>
+void hammingDistances256(uint8_t const * query, uint8_t const * train,
+                         int n, uint16_t * dst){
+
+    static_assert(kDescriptorBytes == 32, "one descriptor per 256-bit vector");
+
+    const __m256i q = _mm256_loadu_si256(reinterpret_cast<__m256i const *>(query));
+
+    auto lane_counts = [&](const int i){
+        return P::popcount(_mm256_xor_si256(
+                               q, _mm256_loadu_si256(reinterpret_cast<__m256i const *>(
+                                                         train + kDescriptorBytes * i))));
+    };
+
+    // the sum of the four lanes, in the low 64 bits
+    auto sum_lanes = [](const __m256i v){
+        const __m128i half = _mm_add_epi64(_mm256_castsi256_si128(v),
+                                           _mm256_extracti128_si256(v, 1));
+        return _mm_add_epi64(half, _mm_unpackhi_epi64(half, half));
+    };
+
+    int i = 0;
+
+    // four descriptors at once, their lane counts (<= 64) in the four
+    // 16-bit fields of each lane, whose sums (<= 256) cannot carry over
+    for(; i + 4 <= n; i += 4){
+        const __m256i fields =
+            _mm256_or_si256(_mm256_or_si256(lane_counts(i),
+                                            _mm256_slli_epi64(lane_counts(i + 1), 16)),
+                            _mm256_or_si256(_mm256_slli_epi64(lane_counts(i + 2), 32),
+                                            _mm256_slli_epi64(lane_counts(i + 3), 48)));
+        _mm_storel_epi64(reinterpret_cast<__m128i*>(dst + i), sum_lanes(fields));
+    }
+    for(; i < n; i++){
+        dst[i] = static_cast<uint16_t>(_mm_cvtsi128_si32(sum_lanes(lane_counts(i))));
+    }
+}
+
+}
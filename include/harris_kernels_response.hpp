@@ -0,0 +1,200 @@
+#pragma once
+
+/*
+  Corner responses of the window sums of the structure tensor
+  [sxx sxy; sxy syy], as compile-time policies, and the row kernels
+  that evaluate any combination of them in one pass over the sums.
+
+  Each policy is a struct with
+
+    static const Response kResponse;
+    template<typename Ops>
+    static typename Ops::Type eval(Type sxx, Type syy, Type sxy, Type k);
+
+  written once against the operations of a vector type, so that the
+  scalar reference and every ISA share the arithmetic. The kernels are
+  instantiated per response mask: a combination loads the sums once
+  and the compiler shares what the responses have in common, such as
+  the determinant and the trace.
+
+  The kernel translation units instantiate them with their own vector
+  type V, which provides, besides what harris_kernels_window.hpp asks
+  for,
+
+    static Type set1(float v);
+    static Type loadS32(int32_t const * p);   // unaligned, converted to float
+    static Type add(Type a, Type b);
+    static Type sub(Type a, Type b);
+    static Type mul(Type a, Type b);
+    static Type div(Type a, Type b);
+    static Type sqrt(Type a);
+
+  with IEEE single precision results, so that every ISA gives the
+  same response from the same sums.
+ */
+
+#include <harris_kernels.hpp>
+
+#include <cmath>
+
+
+namespace harris_kernels{
+
+namespace response{
+
+// det - k * trace^2
+struct HarrisPolicy{
+
+    static const Response kResponse = RESPONSE_HARRIS;
+
+    template<typename Ops>
+    static typename Ops::Type eval(const typename Ops::Type sxx,
+                                   const typename Ops::Type syy,
+                                   const typename Ops::Type sxy,
+                                   const typename Ops::Type k){
+        const typename Ops::Type det = Ops::sub(Ops::mul(sxx, syy), Ops::mul(sxy, sxy));
+        const typename Ops::Type trace = Ops::add(sxx, syy);
+        return Ops::sub(det, Ops::mul(Ops::mul(k, trace), trace));
+    }
+};
+
+// smaller eigenvalue, as cv::cornerMinEigenVal()
+struct ShiTomasiPolicy{
+
+    static const Response kResponse = RESPONSE_SHI_TOMASI;
+
+    template<typename Ops>
+    static typename Ops::Type eval(const typename Ops::Type sxx,
+                                   const typename Ops::Type syy,
+                                   const typename Ops::Type sxy,
+                                   const typename Ops::Type){
+        const typename Ops::Type half = Ops::set1(0.5f);
+        const typename Ops::Type a = Ops::mul(sxx, half);
+        const typename Ops::Type c = Ops::mul(syy, half);
+        const typename Ops::Type a_c = Ops::sub(a, c);
+        return Ops::sub(Ops::add(a, c),
+                        Ops::sqrt(Ops::add(Ops::mul(a_c, a_c), Ops::mul(sxy, sxy))));
+    }
+};
+
+// det / (trace + epsilon), the harmonic mean of the eigenvalues over 2
+struct NoblePolicy{
+
+    static const Response kResponse = RESPONSE_NOBLE;
+
+    template<typename Ops>
+    static typename Ops::Type eval(const typename Ops::Type sxx,
+                                   const typename Ops::Type syy,
+                                   const typename Ops::Type sxy,
+                                   const typename Ops::Type){
+        const typename Ops::Type det = Ops::sub(Ops::mul(sxx, syy), Ops::mul(sxy, sxy));
+        const typename Ops::Type trace = Ops::add(sxx, syy);
+        return Ops::div(det, Ops::add(trace, Ops::set1(kNobleEpsilon)));
+    }
+};
+
+// The operations of a vector type on single floats, for the ends of
+// rows. Templated on V only to keep the copies of different ISAs apart.
+template<typename V>
+struct ScalarOps{
+    typedef float Type;
+    static Type load(float const * p){ return *p; }
+    static Type loadS32(int32_t const * p){ return static_cast<float>(*p); }
+    static void store(float * p, const Type v){ *p = v; }
+    static Type set1(const float v){ return v; }
+    static Type add(const Type a, const Type b){ return a + b; }
+    static Type sub(const Type a, const Type b){ return a - b; }
+    static Type mul(const Type a, const Type b){ return a * b; }
+    static Type div(const Type a, const Type b){ return a / b; }
+    static Type sqrt(const Type a){ return std::sqrt(a); }
+};
+
+// dst[Policy::kResponse] + i = the response of Policy, if it is in Mask
+template<typename Policy, typename Ops, unsigned Mask>
+inline void storeResponse(const typename Ops::Type sxx,
+                          const typename Ops::Type syy,
+                          const typename Ops::Type sxy,
+                          const typename Ops::Type k,
+                          float * const * dst, const int i){
+
+    if(Mask & responseBit(Policy::kResponse)){
+        Ops::store(dst[Policy::kResponse] + i, Policy::template eval<Ops>(sxx, syy, sxy, k));
+    }
+}
+
+template<typename Ops, unsigned Mask>
+inline void storeResponses(const typename Ops::Type sxx,
+                           const typename Ops::Type syy,
+                           const typename Ops::Type sxy,
+                           const typename Ops::Type k,
+                           float * const * dst, const int i){
+
+    storeResponse<HarrisPolicy, Ops, Mask>(sxx, syy, sxy, k, dst, i);
+    storeResponse<ShiTomasiPolicy, Ops, Mask>(sxx, syy, sxy, k, dst, i);
+    storeResponse<NoblePolicy, Ops, Mask>(sxx, syy, sxy, k, dst, i);
+}
+
+// see KernelTable::responses
+template<typename V, unsigned Mask>
+void responsesRow(float const * sxx, float const * syy, float const * sxy,
+                  float k, float * const * dst, int n){
+
+    typedef ScalarOps<V> S;
+    const typename V::Type k_v = V::set1(k);
+
+    int i = 0;
+    for(; i + V::kWidth <= n; i += V::kWidth){
+        storeResponses<V, Mask>(V::load(sxx + i), V::load(syy + i), V::load(sxy + i),
+                                k_v, dst, i);
+    }
+    for(; i < n; i++){
+        storeResponses<S, Mask>(S::load(sxx + i), S::load(syy + i), S::load(sxy + i),
+                                k, dst, i);
+    }
+}
+
+// see KernelTable::responsesS32
+template<typename V, unsigned Mask>
+void responsesRowS32(int32_t const * sxx, int32_t const * syy, int32_t const * sxy,
+                     float k, float scale, float * const * dst, int n){
+
+    typedef ScalarOps<V> S;
+    const typename V::Type k_v = V::set1(k);
+    const typename V::Type scale_v = V::set1(scale);
+
+    int i = 0;
+    for(; i + V::kWidth <= n; i += V::kWidth){
+        storeResponses<V, Mask>(V::mul(V::loadS32(sxx + i), scale_v),
+                                V::mul(V::loadS32(syy + i), scale_v),
+                                V::mul(V::loadS32(sxy + i), scale_v),
+                                k_v, dst, i);
+    }
+    for(; i < n; i++){
+        storeResponses<S, Mask>(S::loadS32(sxx + i) * scale,
+                                S::loadS32(syy + i) * scale,
+                                S::loadS32(sxy + i) * scale,
+                                k, dst, i);
+    }
+}
+
+}
+
+}
+
+// the responses and responsesS32 entries of a KernelTable,
+// instantiated with vector type V
+#define HARRIS_KERNELS_RESPONSE_TABLE(V)                                \
+    {                                                                   \
+        response::responsesRow<V, 0>, response::responsesRow<V, 1>,     \
+        response::responsesRow<V, 2>, response::responsesRow<V, 3>,     \
+        response::responsesRow<V, 4>, response::responsesRow<V, 5>,     \
+        response::responsesRow<V, 6>, response::responsesRow<V, 7>      \
+    }
+
+#define HARRIS_KERNELS_RESPONSE_S32_TABLE(V)                            \
+    {                                                                   \
+        response::responsesRowS32<V, 0>, response::responsesRowS32<V, 1>, \
+        response::responsesRowS32<V, 2>, response::responsesRowS32<V, 3>, \
+        response::responsesRowS32<V, 4>, response::responsesRowS32<V, 5>, \
+        response::responsesRowS32<V, 6>, response::responsesRowS32<V, 7>  \
+    }
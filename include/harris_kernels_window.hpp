@@ -0,0 +1,171 @@
+#pragma once
+
+/*
+  Sliding window maximum along a row, specialized at compile time for
+  each window size up to 2 * kNumWindowMaxKernels - 1, the NMS window
+  sizes the camera tool offers.
+
+  The templates are shared by the kernel translation units. Each of
+  them instantiates windowMaxRow() with its own vector type V, which
+  provides
+
+    typedef ... Type;                       // a vector of kWidth floats
+    static const int kWidth;
+    static Type load(float const * p);      // unaligned
+    static void store(float * p, Type v);   // unaligned
+    static Type max(Type a, Type b);
+
+  V must be declared in an unnamed namespace, so that the
+  instantiations of different ISAs, compiled with different -m flags,
+  stay separate and the linker never mixes them up.
+ */
+
+#include <harris_kernels.hpp>
+
+#include <algorithm>
+#include <limits>
+
+
+namespace harris_kernels{
+
+namespace window_max{
+
+// below this many elements, the window maximum is taken directly.
+// Larger windows use a doubling scheme over chunks of kChunkSize.
+const int kMaxDirectWindowSize = 9;
+const int kChunkSize = 256;
+
+// largest power of two not above n
+constexpr int floorPow2(const int n){
+    return n < 2 ? 1 : 2 * floorPow2(n / 2);
+}
+
+// dst[i] = max(a[i], b[i])
+template<typename V>
+inline void maxRow(float const * a, float const * b, float * dst, int n){
+
+    int i = 0;
+    for(; i + V::kWidth <= n; i += V::kWidth){
+        V::store(dst + i, V::max(V::load(a + i), V::load(b + i)));
+    }
+    for(; i < n; i++){
+        dst[i] = a[i] < b[i] ? b[i] : a[i];
+    }
+}
+
+// dst[i] = max(src[i - half_w_size], ..., src[i + half_w_size]) for i
+// in [begin, end), ignoring elements outside [0, n). Templated on V
+// only to keep the copies of different ISAs apart.
+template<typename V>
+inline void border(float const * src, float * dst,
+                   int begin, int end, int n, int half_w_size){
+
+    for(int i = begin; i < end; i++){
+        const int j_end = std::min(n, i + half_w_size + 1);
+        float m = -std::numeric_limits<float>::infinity();
+        for(int j = std::max(0, i - half_w_size); j < j_end; j++){
+            m = m < src[j] ? src[j] : m;
+        }
+        dst[i] = m;
+    }
+}
+
+// dst[i] = max(src[i], ..., src[i + W - 1]) for i in [0, n), with no
+// bounds checks
+template<typename V, int W>
+inline void interiorDirect(float const * src, float * dst, int n){
+
+    int i = 0;
+    for(; i + V::kWidth <= n; i += V::kWidth){
+        typename V::Type m = V::load(src + i);
+        for(int j = 1; j < W; j++){
+            m = V::max(m, V::load(src + i + j));
+        }
+        V::store(dst + i, m);
+    }
+    for(; i < n; i++){
+        float m = src[i];
+        for(int j = 1; j < W; j++){
+            m = m < src[i + j] ? src[i + j] : m;
+        }
+        dst[i] = m;
+    }
+}
+
+/*
+  Same as interiorDirect(), in O(log W) vector passes: the maxima of
+  2, 4, ..., P consecutive elements are built by doubling, P being the
+  largest power of two not above W, and two overlapping windows of P
+  cover W.
+ */
+template<typename V, int W>
+inline void interiorDoubling(float const * src, float * dst, int n){
+
+    constexpr int P = floorPow2(W);
+    float buffers[2][kChunkSize + W];
+
+    for(int chunk_begin = 0; chunk_begin < n; chunk_begin += kChunkSize){
+
+        const int len = std::min(kChunkSize, n - chunk_begin);
+
+        // level[i] = max of s consecutive elements from chunk_begin + i
+        float const * level = src + chunk_begin;
+        int idx = 0;
+
+        for(int s = 1; s < P; s *= 2){
+            maxRow<V>(level, level + s, buffers[idx], len + W - 2 * s);
+            level = buffers[idx];
+            idx = 1 - idx;
+        }
+
+        maxRow<V>(level, level + W - P, dst + chunk_begin, len);
+    }
+}
+
+/*
+  dst[i] = max(src[i - HalfW], ..., src[i + HalfW]) for i in [0, n),
+  ignoring elements outside [0, n). The interior, where the window is
+  fully inside the row, runs without bounds checks; only the HalfW
+  elements at each end take the clipped loop.
+ */
+template<typename V, int HalfW>
+void windowMaxRow(float const * src, float * dst, int n){
+
+    constexpr int W = 2 * HalfW + 1;
+    const int interior_begin = std::min(HalfW, n);
+    const int interior_end = std::max(interior_begin, n - HalfW);
+
+    border<V>(src, dst, 0, interior_begin, n, HalfW);
+
+    // empty when the row is shorter than the window
+    if(interior_begin < interior_end){
+
+        float const * const interior_src = src + interior_begin - HalfW;
+        const int interior_n = interior_end - interior_begin;
+
+        if(W <= kMaxDirectWindowSize){
+            interiorDirect<V, W>(interior_src, dst + interior_begin, interior_n);
+        }else{
+            interiorDoubling<V, W>(interior_src, dst + interior_begin, interior_n);
+        }
+    }
+
+    border<V>(src, dst, interior_end, n, n, HalfW);
+}
+
+}
+
+}
+
+// the windowMaxRow entries of a KernelTable, instantiated with vector type V
+#define HARRIS_KERNELS_WINDOW_MAX_TABLE(V)                              \
+    {                                                                   \
+        window_max::windowMaxRow<V, 0>, window_max::windowMaxRow<V, 1>, \
+        window_max::windowMaxRow<V, 2>, window_max::windowMaxRow<V, 3>, \
+        window_max::windowMaxRow<V, 4>, window_max::windowMaxRow<V, 5>, \
+        window_max::windowMaxRow<V, 6>, window_max::windowMaxRow<V, 7>, \
+        window_max::windowMaxRow<V, 8>, window_max::windowMaxRow<V, 9>, \
+        window_max::windowMaxRow<V, 10>, window_max::windowMaxRow<V, 11>, \
+        window_max::windowMaxRow<V, 12>, window_max::windowMaxRow<V, 13>, \
+        window_max::windowMaxRow<V, 14>, window_max::windowMaxRow<V, 15> \
+    }
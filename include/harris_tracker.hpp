@@ -0,0 +1,166 @@
+#pragma once
+
+/*
+  Corners detected by a HarrisCorner every few frames and tracked in
+  between, for video in which they move little from frame to frame.
+
+  Tracking is a translation-only inverse compositional Lucas-Kanade
+  step per corner: the patch around a corner and its gradients are
+  taken once, from the frame it was detected in, so a tracked frame
+  only samples the new image at each corner and never computes a
+  response or a full gradient plane. Each search starts where the
+  corner's motion of the previous frame would take it.
+ */
+
+#include <harris_corner.hpp>
+#include "my_utils_kk4.hpp"
+
+#include <vector>
+
+
+class HarrisTracker{
+public:
+
+    typedef HarrisCorner::Keypoint Keypoint;
+    typedef HarrisCorner::KeypointSelection KeypointSelection;
+
+    struct Track{
+        Keypoint keypoint;      // position in the last frame, score of the detection
+        int id;                 // unique over the lifetime of the tracker
+        int age;                // frames tracked since the detection
+    };
+
+    // costs of the two kinds of frames, since the last resetStats()
+    struct Stats{
+        int detection_frames;
+        int tracking_frames;
+        double detection_seconds;   // includes taking the patches of new tracks
+        double tracking_seconds;    // includes failed tracking before a re-detection
+
+        Stats()
+            : detection_frames(0),
+              tracking_frames(0),
+              detection_seconds(0.0),
+              tracking_seconds(0.0){
+        }
+    };
+
+    // Detects with detector, which must outlive the tracker. Its
+    // parameters are used as they are at each detection, and its
+    // thread pool for tracking too.
+    explicit HarrisTracker(HarrisCorner& detector);
+    ~HarrisTracker();
+
+    HarrisTracker(const HarrisTracker&) = delete;
+    HarrisTracker& operator=(const HarrisTracker&) = delete;
+
+    /*
+      Corners of input_image, a frame of a video (CV_32FC1 or CV_8UC1),
+      as detectKeypoints() would find them on a detection frame, and as
+      the surviving corners of the last detection moved by tracking on
+      the others. A frame is a detection frame if it is the first, if
+      detection_interval frames have passed since the last detection, if
+      its size or type differs from the last frame, or if fewer than
+      min_tracks corners survive tracking. Corners that leave the image
+      or no longer match their patch are dropped.
+     */
+    void track(const cv::Mat& input_image,
+               std::vector<Track>& tracks,
+               const double thresh,
+               const int nms_window_size,
+               const KeypointSelection& selection = KeypointSelection());
+
+    // makes the next frame a detection frame
+    void reset();
+
+    int getDetectionInterval()const{
+        return detection_interval_;
+    }
+    // 1 detects on every frame
+    void setDetectionInterval(const int detection_interval);
+
+    int getMinTracks()const{
+        return min_tracks_;
+    }
+    void setMinTracks(const int min_tracks);
+
+    int getTrackWindowSize()const{
+        return track_window_size_;
+    }
+    // odd, up to kMaxTrackWindowSize; resets the tracker
+    void setTrackWindowSize(const int track_window_size);
+
+    int getMaxIterations()const{
+        return max_iterations_;
+    }
+    void setMaxIterations(const int max_iterations);
+
+    double getMaxResidual()const{
+        return max_residual_;
+    }
+    // Largest mean absolute difference between a tracked patch and its
+    // template, in intensities of float input (8-bit input / 255)
+    void setMaxResidual(const double max_residual);
+
+    bool getLastFrameDetected()const{
+        return last_frame_detected_;
+    }
+
+    const Stats& getStats()const{
+        return stats_;
+    }
+    void resetStats(){
+        stats_ = Stats();
+    }
+
+    static const int kMaxTrackWindowSize = 31;
+
+private:
+
+    void detect(const cv::Mat& input_image,
+                const double thresh,
+                const int nms_window_size,
+                const KeypointSelection& selection);
+
+    // Tracks tracks_[begin, end) into input_image; alive_ tells which
+    // survived.
+    void trackRange(const cv::Mat& input_image, const int begin, const int end);
+
+    // Takes the patch of tracks_[track_idx] at its position in
+    // input_image. False if it is too close to the border or too flat
+    // to track.
+    bool takeTemplate(const cv::Mat& input_image, const int track_idx);
+
+    // drops the tracks that did not survive, keeping the order
+    void compactTracks();
+
+    int templateStride()const{
+        return 3 * track_window_size_ * track_window_size_ + 3;
+    }
+
+    HarrisCorner& detector_;
+
+    int detection_interval_;
+    int min_tracks_;
+    int track_window_size_;
+    int max_iterations_;
+    float max_residual_;
+
+    int frames_since_detection_;    // -1 before the first detection
+    bool last_frame_detected_;
+    int next_id_;
+    cv::Size frame_size_;
+    int frame_type_;
+
+    std::vector<Track> tracks_;
+    std::vector<cv::Point2f> velocities_;   // motion in the last tracked frame
+    std::vector<uint8_t> alive_;
+
+    // per track, templateStride() floats: the template, its x and y
+    // gradients, then the inverse Gauss-Newton Hessian (xx, xy, yy)
+    std::vector<float> templates_;
+
+    std::vector<Keypoint> keypoints_;   // of the last detection
+
+    Stats stats_;
+};
@@ -0,0 +1,151 @@
+#pragma once
+
+/*
+  Holds the per-frame processing time of a detector within a budget by
+  trading quality for speed, on a ladder of settings from full quality
+  (level 0) down to the cheapest: a smaller processing scale, a larger
+  NMS window, a cap on the corners and a smaller centered ROI.
+
+  The governor is fed the measured time of every frame and moves one
+  level at a time, with hysteresis so that it settles instead of
+  oscillating:
+
+    - one level down once the smoothed time has been over the budget
+      for kFramesToStepDown frames in a row,
+    - one level up once it has been below kStepUpFraction of the budget
+      for the step-up hold of the level, kFramesToStepUp frames at
+      first. A level that was left for a better one and had to be
+      returned to within a hold doubles its hold, up to
+      kMaxStepUpHoldFactor times.
+
+  After a step, the smoothed time restarts from the next frame, and no
+  further step is taken for kSettleFrames frames while the cost of the
+  new level shows.
+ */
+
+#include <string>
+#include <vector>
+
+
+class LatencyGovernor{
+public:
+
+    // what to do with a frame
+    struct Settings{
+        double scale;               // processing scale, 1 at full resolution
+        int min_nms_window_size;    // odd; the NMS window is at least this
+        int max_corners;            // 0: no limit
+        double roi_fraction;        // size of the centered ROI relative to the frame
+
+        Settings()
+            : scale(1.0),
+              min_nms_window_size(1),
+              max_corners(0),
+              roi_fraction(1.0){
+        }
+        Settings(const double scale, const int min_nms_window_size,
+                 const int max_corners, const double roi_fraction)
+            : scale(scale),
+              min_nms_window_size(min_nms_window_size),
+              max_corners(max_corners),
+              roi_fraction(roi_fraction){
+        }
+    };
+
+    // a change of level, and what led to it
+    struct Decision{
+        long frame_idx;             // frames seen before it
+        int from_level;
+        int to_level;
+        double frame_ms;            // smoothed frame time
+        double budget_ms;
+
+        Decision()
+            : frame_idx(-1),
+              from_level(0),
+              to_level(0),
+              frame_ms(0.0),
+              budget_ms(0.0){
+        }
+    };
+
+    // with getDefaultLevels()
+    explicit LatencyGovernor(const double budget_ms = 1e3 / 30);
+
+    double getBudgetMs()const{
+        return budget_ms_;
+    }
+    // keeps the level, restarts the hysteresis
+    void setBudgetMs(const double budget_ms);
+
+    // best quality first, each level cheaper than the one before;
+    // back to level 0
+    void setLevels(const std::vector<Settings>& levels);
+    const std::vector<Settings>& getLevels()const{
+        return levels_;
+    }
+
+    static std::vector<Settings> getDefaultLevels();
+
+    // Feeds the processing time of a frame. Returns true if the level
+    // changed, which getLastDecision() then describes.
+    bool update(const double frame_seconds);
+
+    // back to level 0, with the hysteresis and the statistics cleared
+    void reset();
+
+    int getLevel()const{
+        return level_;
+    }
+    const Settings& getSettings()const{
+        return levels_[level_];
+    }
+
+    const Decision& getLastDecision()const{
+        return last_decision_;
+    }
+
+    // since the last reset()
+    long getNumDecisions()const{
+        return num_decisions_;
+    }
+    long getFramesAtLevel(const int level)const{
+        return frames_at_level_[level];
+    }
+
+    // e.g. "scale 0.5, NMS >= 5, max 500 corners, ROI 75%"
+    static std::string describe(const Settings& settings);
+
+    static constexpr double kSmoothing = 0.25;      // weight of the newest frame
+    static constexpr double kStepUpFraction = 0.7;
+    static const int kFramesToStepDown = 3;
+    static const int kFramesToStepUp = 30;
+    static const int kMaxStepUpHoldFactor = 16;
+    static const int kSettleFrames = 5;
+
+private:
+
+    void changeLevel(const int level);
+
+    // the hysteresis, not the level
+    void restart();
+
+    std::vector<Settings> levels_;
+    double budget_ms_;
+
+    int level_;
+    long frame_idx_;
+    double smoothed_ms_;            // < 0 until the first frame after a restart
+    int frames_over_;
+    int frames_under_;
+    int frames_to_settle_;
+
+    // per level, frames below the step-up fraction needed to leave it
+    // for a better one, and the frame it was last left that way at
+    std::vector<int> step_up_holds_;
+    std::vector<long> stepped_up_at_;
+
+    Decision last_decision_;
+    long num_decisions_;
+    std::vector<long> frames_at_level_;
+};
@@ -0,0 +1,169 @@
+#pragma once
+
+/*
+  Keypoints of the frames of several streams, e.g. cameras, detected on
+  one shared WorkStealingScheduler instead of one process per stream.
+
+  A frame is a task of its stream. A large frame splits into tile tasks,
+  bands of rows across the full width, which its worker queues at the
+  front of its deque for idle workers to steal, so a burst on one
+  stream uses the capacity the others leave. Each worker detects with a
+  single-threaded HarrisCorner of its own, and the keypoints of a frame
+  are exactly those of HarrisCorner::detectKeypoints() on all of it.
+ */
+
+#include <harris_corner.hpp>
+#include <work_stealing_scheduler.hpp>
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+
+class MultiStreamDetector{
+public:
+
+    typedef HarrisCorner::Keypoint Keypoint;
+    typedef HarrisCorner::KeypointSelection KeypointSelection;
+
+    // Called on a worker thread once a frame is done, with its index
+    // among the frames submitted to its stream, dropped ones included.
+    // Frames of a stream can finish out of order when several are in
+    // flight.
+    typedef std::function<void(const int stream_idx,
+                               const long frame_idx,
+                               const cv::Mat& frame,
+                               const std::vector<Keypoint>& keypoints)> KeypointSink;
+
+    // of one stream, since the last resetStats()
+    struct StreamStats{
+        long num_frames;                // detected
+        long num_dropped;               // refused by trySubmit()
+        double latency_seconds;         // total from submission to the sink
+        double max_latency_seconds;
+
+        StreamStats()
+            : num_frames(0),
+              num_dropped(0),
+              latency_seconds(0.0),
+              max_latency_seconds(0.0){
+        }
+    };
+
+    // 0 threads means std::thread::hardware_concurrency()
+    MultiStreamDetector(const double k = 0.04, const int window_size = 3,
+                        const int num_threads = 0);
+
+    // finishes the frames in flight
+    ~MultiStreamDetector();
+
+    MultiStreamDetector(const MultiStreamDetector&) = delete;
+    MultiStreamDetector& operator=(const MultiStreamDetector&) = delete;
+
+    // Queues detection of frame, the next frame of stream stream_idx
+    // (>= 0), for sink. The frame is shared, not copied, and must not
+    // be written to until its sink has been called. Waits while the
+    // stream has getMaxFramesInFlight() frames in flight. Not from a
+    // sink.
+    void submit(const int stream_idx,
+                const cv::Mat& frame,
+                const double thresh,
+                const int nms_window_size,
+                const KeypointSink& sink,
+                const KeypointSelection& selection = KeypointSelection());
+
+    // Same, but drops the frame and returns false instead of waiting,
+    // for live sources that must not fall behind.
+    bool trySubmit(const int stream_idx,
+                   const cv::Mat& frame,
+                   const double thresh,
+                   const int nms_window_size,
+                   const KeypointSink& sink,
+                   const KeypointSelection& selection = KeypointSelection());
+
+    // Blocks until every frame is done, then rethrows the first
+    // exception of a detection or a sink since the last call, if any.
+    void waitIdle();
+
+    int getNumThreads()const{
+        return scheduler_.getNumWorkers();
+    }
+
+    int getMaxFramesInFlight()const{
+        return max_frames_in_flight_;
+    }
+    // per stream
+    void setMaxFramesInFlight(const int max_frames_in_flight);
+
+    int getTileRows()const{
+        return tile_rows_.load();
+    }
+    // Frames of at least twice this many rows are split into tiles of
+    // this many rows. 0 never splits. Applies to frames that start
+    // after the call, also while others are in flight.
+    void setTileRows(const int tile_rows);
+
+    // These change every worker's detector, only while idle.
+    void setIsa(const harris_kernels::Isa isa);
+    void setResponseType(const harris_kernels::Response response_type);
+    void setSubpixelRefinement(const bool subpixel_refinement);
+
+    StreamStats getStreamStats(const int stream_idx)const;
+
+    // the task statistics and fairness of the streams
+    const WorkStealingScheduler& getScheduler()const{
+        return scheduler_;
+    }
+
+    void resetStats();
+
+    static const int kDefaultMaxFramesInFlight = 2;
+    static const int kDefaultTileRows = 256;
+
+private:
+
+    struct FrameJob;
+
+    struct StreamState{
+        int frames_in_flight;
+        long next_frame_idx;
+        StreamStats stats;
+
+        StreamState()
+            : frames_in_flight(0),
+              next_frame_idx(0){
+        }
+    };
+
+    bool submitFrame(const int stream_idx,
+                     const cv::Mat& frame,
+                     const double thresh,
+                     const int nms_window_size,
+                     const KeypointSink& sink,
+                     const KeypointSelection& selection,
+                     const bool wait);
+
+    // splits job into tiles and runs the first
+    void runFrame(const std::shared_ptr<FrameJob>& job, const int worker_idx);
+
+    // the last tile of a frame finishes it
+    void runTile(FrameJob& job, const int tile_idx, const int worker_idx);
+
+    void finishFrame(FrameJob& job, const int worker_idx);
+
+    // one single-threaded detector per worker
+    std::vector<std::unique_ptr<HarrisCorner> > detectors_;
+
+    int max_frames_in_flight_;
+    std::atomic<int> tile_rows_;    // read once per frame by the workers
+
+    mutable std::mutex mutex_;
+    std::condition_variable done_condition_;
+    std::vector<StreamState> streams_;
+
+    // last, so that its workers are joined before the rest goes
+    WorkStealingScheduler scheduler_;
+};
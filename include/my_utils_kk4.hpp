@@ -18,6 +18,16 @@
 #include <vector>
 #include <iostream>
 #include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <exception>
+#include <algorithm>
+#include <memory>
+#include <fstream>
+#include <cstdint>
+#include <cstdio>
 
 namespace my_utils_kk4{
 
@@ -211,6 +221,143 @@ private:
 };
 
 
+// Scoped spans for profiling, exported as a Chrome trace
+// (chrome://tracing or https://ui.perfetto.dev).
+//
+//   MY_UTILS_KK4_TRACE_SPAN("name");   // records until the end of the scope
+//
+// Every thread records into its own ring buffer without locking. A
+// span costs one atomic load while tracing is disabled at runtime, and
+// nothing if MY_UTILS_KK4_NO_TRACING is defined. Names must be string
+// literals (only the pointer is stored).
+class Tracer{
+public:
+
+    static Tracer& getInstance();
+
+    static bool isEnabled(){
+        return getInstance().enabled.load(std::memory_order_relaxed);
+    }
+    void setEnabled(const bool enabled);
+
+    // The label of the calling thread in the trace.
+    void setThreadName(const std::string& name);
+
+    void record(const char* name, const int64_t begin_ns, const int64_t end_ns);
+
+    // Writes the events still held by the ring buffers. Can be called
+    // while other threads are recording.
+    bool writeChromeTrace(const std::string& file_name);
+
+    static int64_t now();
+
+private:
+
+    struct Event{
+        std::atomic<const char*> name;
+        std::atomic<int64_t> begin_ns;
+        std::atomic<int64_t> end_ns;
+    };
+
+    struct ThreadBuffer{
+        std::unique_ptr<Event[]> events;
+        std::atomic<uint64_t> num_recorded;
+        int tid;
+        std::string thread_name;
+    };
+
+    Tracer();
+
+    ThreadBuffer& getThreadBuffer();
+
+    static std::string escapeJson(const std::string& str);
+
+    static const uint64_t kEventsPerThread = 1 << 16;   // power of 2
+
+    std::atomic<bool> enabled;
+    std::mutex registry_mutex;
+    std::vector<std::unique_ptr<ThreadBuffer> > thread_buffers;
+};
+
+class TraceSpan{
+public:
+    explicit TraceSpan(const char* name)
+        : name(Tracer::isEnabled() ? name : nullptr),
+          begin_ns(this->name ? Tracer::now() : 0){
+    }
+    ~TraceSpan(){
+        if(name){
+            Tracer::getInstance().record(name, begin_ns, Tracer::now());
+        }
+    }
+
+    TraceSpan(const TraceSpan&) = delete;
+    TraceSpan& operator=(const TraceSpan&) = delete;
+
+private:
+    const char* const name;
+    const int64_t begin_ns;
+};
+
+#define MY_UTILS_KK4_TRACE_CONCAT_(a, b) a##b
+#define MY_UTILS_KK4_TRACE_CONCAT(a, b) MY_UTILS_KK4_TRACE_CONCAT_(a, b)
+
+#ifdef MY_UTILS_KK4_NO_TRACING
+#define MY_UTILS_KK4_TRACE_SPAN(name) do{}while(0)
+#else
+#define MY_UTILS_KK4_TRACE_SPAN(name)                                   \
+    my_utils_kk4::TraceSpan MY_UTILS_KK4_TRACE_CONCAT(trace_span_, __LINE__)(name)
+#endif
+
+
+class ThreadPool{
+public:
+    ThreadPool(const int num_threads = 0);
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    int getNumThreads()const{
+        return static_cast<int>(workers.size()) + 1;
+    }
+    void setNumThreads(const int num_threads);
+
+    template<typename Func>
+    void parallelFor(const int num_tasks, const Func& func);
+
+private:
+    template<typename Func>
+    static void invokeTask(const void* func, const int task_idx, const int thread_idx);
+
+    void run(const int num_tasks,
+             void (*invoke)(const void*, int, int),
+             const void* func);
+    void startWorkers(const int num_threads);
+    void stopWorkers();
+    void workerLoop(const int thread_idx, unsigned long seen_generation);
+    void runTasks(const int thread_idx);
+
+    std::vector<std::thread> workers;
+
+    std::mutex call_mutex;      // serializes parallelFor() calls
+    std::mutex mutex;
+    std::condition_variable start_condition;
+    std::condition_variable done_condition;
+
+    // the task as a plain function pointer and an untyped pointer to
+    // the caller's functor, so that running a job never allocates
+    void (*job)(const void*, int, int);
+    const void* job_func;
+    int num_tasks;
+    std::atomic<int> next_task;
+    std::exception_ptr task_exception;
+    int busy_workers;
+    unsigned long generation;
+    bool quit;
+};
+
+
 // sources
 
 
@@ -555,6 +702,387 @@ inline double StopWatch::getResult()const{
 }
 
 
+//!
+/*!
+  Get the process-wide tracer.
+*/
+inline Tracer& Tracer::getInstance(){
+
+    static Tracer tracer;
+    return tracer;
+}
+
+inline Tracer::Tracer()
+    : enabled(false){
+}
+
+//!
+/*!
+  Current time in nanoseconds on the steady clock.
+*/
+inline int64_t Tracer::now(){
+
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+//!
+/*!
+  Start or stop recording spans.
+*/
+inline void Tracer::setEnabled(const bool enabled){
+
+    this->enabled.store(enabled, std::memory_order_relaxed);
+}
+
+//!
+/*!
+  Set the label of the calling thread in the trace.
+  @param name The label.
+*/
+inline void Tracer::setThreadName(const std::string& name){
+
+    ThreadBuffer& buffer = getThreadBuffer();
+    std::lock_guard<std::mutex> lock(registry_mutex);
+    buffer.thread_name = name;
+}
+
+inline Tracer::ThreadBuffer& Tracer::getThreadBuffer(){
+
+    // buffers live as long as the tracer so that events of finished
+    // threads can still be written
+    thread_local ThreadBuffer* thread_buffer = nullptr;
+
+    if(! thread_buffer){
+        std::unique_ptr<ThreadBuffer> buffer(new ThreadBuffer);
+        buffer->events.reset(new Event[kEventsPerThread]);
+        buffer->num_recorded = 0;
+
+        std::lock_guard<std::mutex> lock(registry_mutex);
+        buffer->tid = static_cast<int>(thread_buffers.size());
+        thread_buffer = buffer.get();
+        thread_buffers.push_back(std::move(buffer));
+    }
+
+    return *thread_buffer;
+}
+
+//!
+/*!
+  Record a span of the calling thread. The oldest span is overwritten
+  when the ring buffer of the thread is full.
+  @param name A string literal.
+  @param begin_ns Begin time from now().
+  @param end_ns End time from now().
+*/
+inline void Tracer::record(const char* name, const int64_t begin_ns, const int64_t end_ns){
+
+    ThreadBuffer& buffer = getThreadBuffer();
+
+    const uint64_t idx = buffer.num_recorded.load(std::memory_order_relaxed);
+    Event& event = buffer.events[idx & (kEventsPerThread - 1)];
+
+    // pairs with the acquire fence of writeChromeTrace(): a reader that
+    // sees any of the stores below also sees num_recorded == idx, which
+    // marks the slot as overwritten
+    std::atomic_thread_fence(std::memory_order_release);
+
+    event.name.store(name, std::memory_order_relaxed);
+    event.begin_ns.store(begin_ns, std::memory_order_relaxed);
+    event.end_ns.store(end_ns, std::memory_order_relaxed);
+
+    buffer.num_recorded.store(idx + 1, std::memory_order_release);
+}
+
+//!
+/*!
+  Escape a string for a JSON string literal.
+  @param str The string.
+
+  @return The escaped string, without the quotes.
+*/
+inline std::string Tracer::escapeJson(const std::string& str){
+
+    std::string ret;
+    ret.reserve(str.size());
+
+    for(const char c : str){
+        switch(c){
+        case '"':
+            ret += "\\\"";
+            break;
+        case '\\':
+            ret += "\\\\";
+            break;
+        case '\n':
+            ret += "\\n";
+            break;
+        case '\r':
+            ret += "\\r";
+            break;
+        case '\t':
+            ret += "\\t";
+            break;
+        default:
+            if(static_cast<unsigned char>(c) < 0x20){
+                char buf[8];
+                std::snprintf(buf, sizeof(buf), "\\u%04x", static_cast<unsigned char>(c));
+                ret += buf;
+            }else{
+                ret += c;
+            }
+        }
+    }
+
+    return ret;
+}
+
+//!
+/*!
+  Write the recorded spans in the Chrome trace event format.
+  @param file_name The output JSON file.
+
+  @return false if the file could not be written.
+*/
+inline bool Tracer::writeChromeTrace(const std::string& file_name){
+
+    std::ofstream ofs(file_name);
+    if(! ofs){
+        return false;
+    }
+
+    ofs << "{\"traceEvents\":[" << std::endl;
+
+    bool first = true;
+    auto separator = [&](){
+        const char* ret = first ? "" : ",\n";
+        first = false;
+        return ret;
+    };
+
+    std::lock_guard<std::mutex> lock(registry_mutex);
+
+    for(const std::unique_ptr<ThreadBuffer>& buffer : thread_buffers){
+
+        if(! buffer->thread_name.empty()){
+            ofs << separator()
+                << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << buffer->tid
+                << ",\"args\":{\"name\":\"" << escapeJson(buffer->thread_name) << "\"}}";
+        }
+
+        const uint64_t end = buffer->num_recorded.load(std::memory_order_acquire);
+        const uint64_t begin = end > kEventsPerThread ? end - kEventsPerThread : 0;
+
+        for(uint64_t i = begin; i < end; i++){
+
+            const Event& event = buffer->events[i & (kEventsPerThread - 1)];
+            const char* name = event.name.load(std::memory_order_relaxed);
+            const int64_t begin_ns = event.begin_ns.load(std::memory_order_relaxed);
+            const int64_t end_ns = event.end_ns.load(std::memory_order_relaxed);
+
+            // skip the slot if the owner thread has started to
+            // overwrite it while reading
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if(buffer->num_recorded.load(std::memory_order_relaxed) >= i + kEventsPerThread){
+                continue;
+            }
+
+            ofs << separator()
+                << "{\"name\":\"" << escapeJson(name)
+                << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << buffer->tid
+                << ",\"ts\":" << begin_ns / 1000 << "." << begin_ns / 100 % 10
+                << ",\"dur\":" << (end_ns - begin_ns) / 1000 << "." << (end_ns - begin_ns) / 100 % 10
+                << "}";
+        }
+    }
+
+    ofs << std::endl << "]}" << std::endl;
+
+    return static_cast<bool>(ofs);
+}
+
+
+//! 
+/*! 
+  Constructor.
+  @param num_threads The number of threads including the calling
+  thread. 0 means std::thread::hardware_concurrency().
+*/
+inline ThreadPool::ThreadPool(const int num_threads)
+    : job(nullptr),
+      job_func(nullptr),
+      num_tasks(0),
+      next_task(0),
+      busy_workers(0),
+      generation(0),
+      quit(false){
+
+    startWorkers(num_threads);
+}
+
+//! 
+/*! 
+  Destructor. Joins the worker threads.
+*/
+inline ThreadPool::~ThreadPool(){
+
+    stopWorkers();
+}
+
+//! 
+/*! 
+  Change the number of threads. Must not be called while parallelFor()
+  is running.
+  @param num_threads The number of threads including the calling
+  thread. 0 means std::thread::hardware_concurrency().
+*/
+inline void ThreadPool::setNumThreads(const int num_threads){
+
+    std::lock_guard<std::mutex> call_lock(call_mutex);
+
+    stopWorkers();
+    startWorkers(num_threads);
+}
+
+//! 
+/*! 
+  Run func(task_idx, thread_idx) for every task_idx in [0, num_tasks)
+  and wait until all of them finish. The calling thread takes part as
+  thread 0, so thread_idx is in [0, getNumThreads()) and can be used to
+  index per-thread scratch buffers. If a task throws, the remaining
+  tasks are skipped and the exception is rethrown here. Must not be
+  called from inside a task.
+  @param num_tasks The number of tasks.
+  @param func The task, callable as func(int task_idx, int thread_idx).
+  It is called by reference and never copied.
+*/
+template<typename Func>
+inline void ThreadPool::parallelFor(const int num_tasks, const Func& func){
+
+    run(num_tasks, &invokeTask<Func>, &func);
+}
+
+template<typename Func>
+inline void ThreadPool::invokeTask(const void* func, const int task_idx, const int thread_idx){
+
+    (*static_cast<const Func*>(func))(task_idx, thread_idx);
+}
+
+inline void ThreadPool::run(const int num_tasks,
+                            void (*invoke)(const void*, int, int),
+                            const void* func){
+
+    if(num_tasks <= 0){
+        return;
+    }
+
+    std::lock_guard<std::mutex> call_lock(call_mutex);
+
+    if(workers.empty() || num_tasks == 1){
+        for(int i = 0; i < num_tasks; i++){
+            invoke(func, i, 0);
+        }
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        job = invoke;
+        job_func = func;
+        this->num_tasks = num_tasks;
+        next_task = 0;
+        busy_workers = static_cast<int>(workers.size());
+        generation++;
+    }
+    start_condition.notify_all();
+
+    runTasks(0);
+
+    std::unique_lock<std::mutex> lock(mutex);
+    done_condition.wait(lock, [this]{ return busy_workers == 0; });
+    job = nullptr;
+    job_func = nullptr;
+
+    if(task_exception){
+        std::exception_ptr e = task_exception;
+        task_exception = nullptr;
+        std::rethrow_exception(e);
+    }
+}
+
+inline void ThreadPool::startWorkers(const int num_threads){
+
+    int n = num_threads;
+    if(n <= 0){
+        n = std::max(1, static_cast<int>(std::thread::hardware_concurrency()));
+    }
+
+    quit = false;
+    for(int i = 1; i < n; i++){
+        workers.emplace_back(&ThreadPool::workerLoop, this, i, generation);
+    }
+}
+
+inline void ThreadPool::stopWorkers(){
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        quit = true;
+    }
+    start_condition.notify_all();
+
+    for(auto& worker : workers){
+        worker.join();
+    }
+    workers.clear();
+}
+
+inline void ThreadPool::workerLoop(const int thread_idx,
+                                   unsigned long seen_generation){
+
+    while(true){
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            start_condition.wait(lock, [&]{
+                    return quit || generation != seen_generation;
+                });
+            if(quit){
+                return;
+            }
+            seen_generation = generation;
+        }
+
+        runTasks(thread_idx);
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            busy_workers--;
+        }
+        done_condition.notify_one();
+    }
+}
+
+inline void ThreadPool::runTasks(const int thread_idx){
+
+    while(true){
+        const int task_idx = next_task.fetch_add(1);
+        if(task_idx >= num_tasks){
+            return;
+        }
+        try{
+            job(job_func, task_idx, thread_idx);
+        }catch(...){
+            // skip the remaining tasks and rethrow in parallelFor()
+            next_task = num_tasks;
+            std::lock_guard<std::mutex> lock(mutex);
+            if(! task_exception){
+                task_exception = std::current_exception();
+            }
+        }
+    }
+}
+
+
 }
 
 
@@ -0,0 +1,155 @@
+#pragma once
+
+/*
+  Raw frame container, for recording the exact frames a camera gave and
+  replaying them without decoding.
+
+  Layout, little-endian:
+
+    [0, kRawFrameDataOffset)        RawFrameHeader, zero padded
+    [kRawFrameDataOffset, index)    num_frames frames, frame_stride bytes apart
+    [index, end)                    num_frames RawFrameIndexEntry
+
+  A frame is rows * cols * elemSize() bytes without row padding,
+  starting at a multiple of the page size, so that a replayed frame is
+  a cv::Mat header over the mapped pages. Every frame has the same
+  size and type.
+
+  The geometry of the header is written with the first frame, the
+  rest when the writer is closed. A file whose recording was cut short
+  has num_frames == 0 and no index; its whole frames are still read,
+  without timestamps.
+ */
+
+#include <opencv2/opencv.hpp>
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+
+struct RawFrameHeader{
+    char magic[8];              // kRawFrameMagic
+    uint32_t version;
+    uint32_t header_size;       // sizeof(RawFrameHeader)
+    int32_t rows;
+    int32_t cols;
+    int32_t type;               // OpenCV type, e.g. CV_8UC3
+    uint32_t reserved;
+    uint64_t frame_size;        // bytes of a frame
+    uint64_t frame_stride;      // bytes from one frame to the next
+    uint64_t num_frames;        // 0 until the writer is closed
+    uint64_t index_offset;      // 0 until the writer is closed
+};
+
+struct RawFrameIndexEntry{
+    uint64_t offset;            // of the frame, from the start of the file
+    int64_t timestamp_ns;       // capture time, from the first frame
+};
+
+const char kRawFrameMagic[8] = {'K', 'K', '4', 'R', 'A', 'W', 'F', '\0'};
+const uint32_t kRawFrameVersion = 1;
+
+// offset of the first frame, and alignment of all of them
+const uint64_t kRawFrameDataOffset = 4096;
+
+
+class RawFrameWriter{
+public:
+
+    RawFrameWriter();
+    ~RawFrameWriter();
+
+    RawFrameWriter(const RawFrameWriter&) = delete;
+    RawFrameWriter& operator=(const RawFrameWriter&) = delete;
+
+    // Creates or truncates file_name. Frame size and type are those of
+    // the first frame written.
+    void open(const std::string& file_name);
+
+    // Appends a frame, which must have the size and type of the first
+    // one. timestamp_ns is stored in the index as it is.
+    void write(const cv::Mat& frame, const int64_t timestamp_ns);
+
+    // Hands the frames written so far to the operating system, so that
+    // they survive a crash of the process.
+    void flush();
+
+    // Writes the index and completes the header. Called by the
+    // destructor if needed.
+    void close();
+
+    bool isOpen()const{
+        return file_ != nullptr;
+    }
+
+    int getNumFrames()const{
+        return static_cast<int>(index_.size());
+    }
+
+private:
+
+    void writeBytes(void const * data, const size_t size);
+
+    std::FILE* file_;
+    std::string file_name_;
+    RawFrameHeader header_;
+    std::vector<RawFrameIndexEntry> index_;
+    std::vector<uint8_t> padding_;
+};
+
+
+class RawFrameReader{
+public:
+
+    RawFrameReader();
+    ~RawFrameReader();
+
+    RawFrameReader(const RawFrameReader&) = delete;
+    RawFrameReader& operator=(const RawFrameReader&) = delete;
+
+    // Maps file_name read-only. Throws std::runtime_error if it is not
+    // a raw frame file.
+    void open(const std::string& file_name);
+    void close();
+
+    bool isOpen()const{
+        return data_ != nullptr;
+    }
+
+    int getNumFrames()const{
+        return num_frames_;
+    }
+
+    cv::Size getFrameSize()const{
+        return cv::Size(header_.cols, header_.rows);
+    }
+
+    int getType()const{
+        return header_.type;
+    }
+
+    // Frame frame_idx as a header over the mapped file, without a copy.
+    // The pages are read-only: writing to the data crashes, and the
+    // data is valid until close().
+    cv::Mat getFrame(const int frame_idx)const;
+
+    // -1 if the recording has no index
+    int64_t getTimestamp(const int frame_idx)const;
+
+    // getFrame() of the next frame; false after the last one
+    bool read(cv::Mat& frame);
+
+    // the next read() starts from frame_idx
+    void seek(const int frame_idx);
+
+private:
+
+    uint8_t const * data_;
+    size_t file_size_;
+    RawFrameHeader header_;
+    int num_frames_;
+    RawFrameIndexEntry const * index_;      // null without an index
+    int next_frame_idx_;
+};
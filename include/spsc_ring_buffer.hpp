@@ -0,0 +1,270 @@
+/*!
+  @file   spsc_ring_buffer.hpp
+
+  @brief  Fixed-capacity lock-free ring buffer between one producer
+  thread and one consumer thread.
+
+  Items are exchanged by swapping, not copying: push() hands the item
+  to the buffer and gets back the recycled item of a slot, pop() does
+  the reverse. With T holding preallocated cv::Mat's, the same image
+  buffers circulate between the threads and nothing is allocated in
+  the steady state.
+*/
+
+#pragma once
+
+#include <atomic>
+#include <vector>
+#include <thread>
+#include <chrono>
+#include <utility>
+#include <functional>
+#include <stdexcept>
+
+
+template<typename T>
+class SpscRingBuffer{
+public:
+
+    typedef enum{
+        BLOCK,                  // push() waits for a free slot
+        DROP_OLDEST             // push() discards the oldest item when full
+    }OverflowPolicy;
+
+    SpscRingBuffer(const size_t capacity,
+                   const OverflowPolicy policy = BLOCK,
+                   const std::function<void(T&)>& init_slot = nullptr);
+    ~SpscRingBuffer();
+
+    SpscRingBuffer(const SpscRingBuffer&) = delete;
+    SpscRingBuffer& operator=(const SpscRingBuffer&) = delete;
+
+    bool push(T& item);
+    bool tryPush(T& item);
+
+    bool pop(T& item);
+    bool tryPop(T& item);
+
+    void close();
+    bool isClosed()const{
+        return closed.load(std::memory_order_acquire);
+    }
+
+    size_t getCapacity()const{
+        return slots.size();
+    }
+    OverflowPolicy getPolicy()const{
+        return policy;
+    }
+    unsigned long getDroppedCount()const{
+        return dropped_count.load(std::memory_order_relaxed);
+    }
+
+private:
+
+    // Each slot carries a sequence number telling whose turn it is
+    // (D. Vyukov's bounded queue). The consumer side claims slots with
+    // a CAS, so that the producer can also pop the oldest item under
+    // DROP_OLDEST.
+    struct Slot{
+        std::atomic<size_t> sequence;
+        T item;
+    };
+
+    static void backoff(unsigned& spin_count);
+
+    std::vector<Slot> slots;
+    const OverflowPolicy policy;
+
+    size_t enqueue_pos;                 // touched by the producer only
+    std::atomic<size_t> dequeue_pos;
+    std::atomic<bool> closed;
+    std::atomic<unsigned long> dropped_count;
+
+    T dropped_item;                     // producer-side scratch
+};
+
+
+// sources
+
+
+//!
+/*!
+  Constructor.
+  @param capacity The number of slots.
+  @param policy What push() does when the buffer is full.
+  @param init_slot Called once for the item of every slot (and the
+  internal scratch item), e.g. to preallocate images.
+*/
+template<typename T>
+inline SpscRingBuffer<T>::SpscRingBuffer(const size_t capacity,
+                                         const OverflowPolicy policy,
+                                         const std::function<void(T&)>& init_slot)
+    : slots(capacity),
+      policy(policy),
+      enqueue_pos(0),
+      dequeue_pos(0),
+      closed(false),
+      dropped_count(0){
+
+    if(capacity == 0){
+        throw std::runtime_error("SpscRingBuffer: capacity must be positive");
+    }
+
+    for(size_t i = 0; i < capacity; i++){
+        slots[i].sequence.store(i, std::memory_order_relaxed);
+        if(init_slot){
+            init_slot(slots[i].item);
+        }
+    }
+    if(init_slot){
+        init_slot(dropped_item);
+    }
+}
+
+//!
+/*!
+  Destructor.
+*/
+template<typename T>
+inline SpscRingBuffer<T>::~SpscRingBuffer(){
+}
+
+//!
+/*!
+  Put an item without waiting. Producer only.
+  @param [in,out] item The item to put. Receives the recycled item of
+  the slot on success.
+
+  @return false if the buffer is full.
+*/
+template<typename T>
+inline bool SpscRingBuffer<T>::tryPush(T& item){
+
+    Slot& slot = slots[enqueue_pos % slots.size()];
+
+    if(slot.sequence.load(std::memory_order_acquire) != enqueue_pos){
+        return false;
+    }
+
+    std::swap(slot.item, item);
+    slot.sequence.store(enqueue_pos + 1, std::memory_order_release);
+    enqueue_pos++;
+
+    return true;
+}
+
+//!
+/*!
+  Put an item according to the overflow policy. Producer only.
+  @param [in,out] item The item to put. Receives a recycled item.
+
+  @return false if the buffer has been closed.
+*/
+template<typename T>
+inline bool SpscRingBuffer<T>::push(T& item){
+
+    unsigned spin_count = 0;
+
+    while(! isClosed()){
+
+        if(tryPush(item)){
+            return true;
+        }
+
+        if(policy == DROP_OLDEST && tryPop(dropped_item)){
+            dropped_count.fetch_add(1, std::memory_order_relaxed);
+            continue;
+        }
+
+        backoff(spin_count);
+    }
+
+    return false;
+}
+
+//!
+/*!
+  Take the oldest item without waiting.
+  @param [in,out] item Receives the item. Its previous content goes
+  back to the buffer for reuse.
+
+  @return false if the buffer is empty.
+*/
+template<typename T>
+inline bool SpscRingBuffer<T>::tryPop(T& item){
+
+    size_t pos = dequeue_pos.load(std::memory_order_relaxed);
+
+    while(true){
+
+        Slot& slot = slots[pos % slots.size()];
+        const size_t sequence = slot.sequence.load(std::memory_order_acquire);
+
+        if(sequence == pos + 1){
+            if(dequeue_pos.compare_exchange_weak(pos, pos + 1,
+                                                 std::memory_order_relaxed)){
+                std::swap(slot.item, item);
+                slot.sequence.store(pos + slots.size(), std::memory_order_release);
+                return true;
+            }
+            // pos was updated by the failed CAS
+        }else if(sequence < pos + 1){
+            return false;
+        }else{
+            pos = dequeue_pos.load(std::memory_order_relaxed);
+        }
+    }
+}
+
+//!
+/*!
+  Take the oldest item, waiting until one is available. Consumer only.
+  @param [in,out] item Receives the item. Its previous content goes
+  back to the buffer for reuse.
+
+  @return false if the buffer has been closed and is empty.
+*/
+template<typename T>
+inline bool SpscRingBuffer<T>::pop(T& item){
+
+    unsigned spin_count = 0;
+
+    while(true){
+
+        if(tryPop(item)){
+            return true;
+        }
+
+        if(isClosed()){
+            // an item may have been pushed just before close()
+            return tryPop(item);
+        }
+
+        backoff(spin_count);
+    }
+}
+
+//!
+/*!
+  Close the buffer. push() fails from now on, and pop() fails once the
+  remaining items are taken.
+*/
+template<typename T>
+inline void SpscRingBuffer<T>::close(){
+
+    closed.store(true, std::memory_order_release);
+}
+
+template<typename T>
+inline void SpscRingBuffer<T>::backoff(unsigned& spin_count){
+
+    if(spin_count < 64){
+        spin_count++;
+    }else if(spin_count < 128){
+        spin_count++;
+        std::this_thread::yield();
+    }else{
+        std::this_thread::sleep_for(std::chrono::microseconds(100));
+    }
+}
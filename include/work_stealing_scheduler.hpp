@@ -0,0 +1,140 @@
+#pragma once
+
+/*
+  Task scheduler shared by several streams of work, e.g. the frames of
+  several cameras, on one set of worker threads.
+
+  Every worker has a deque of its own. A task submitted from outside
+  goes to the deque of its stream's home worker, and a task submitted
+  from a running task goes to the front of the deque of the worker
+  running it, so that a frame's own subtasks run before the next frame.
+  Workers take from the front of their own deque, and an idle worker
+  steals from the front of the others' too. That is the newest
+  subtasks first, i.e. the rest of the frame being worked on rather
+  than a later frame, so a burst on one stream spreads over the
+  workers of the quiet ones without adding to the latency of its
+  current frame.
+
+  Per stream, the scheduler counts the tasks, the stolen ones, the time
+  they waited in a deque and the time they ran.
+ */
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+
+class WorkStealingScheduler{
+public:
+
+    // called with the index of the worker running it
+    typedef std::function<void(const int worker_idx)> Task;
+
+    // of one stream, since the last resetStats()
+    struct StreamStats{
+        long num_tasks;             // finished
+        long num_stolen;            // run by a worker other than the one queued on
+        double queue_seconds;       // total from submit() to the start
+        double max_queue_seconds;
+        double run_seconds;         // total
+
+        StreamStats()
+            : num_tasks(0),
+              num_stolen(0),
+              queue_seconds(0.0),
+              max_queue_seconds(0.0),
+              run_seconds(0.0){
+        }
+    };
+
+    // 0 workers means std::thread::hardware_concurrency()
+    explicit WorkStealingScheduler(const int num_workers = 0);
+
+    // finishes the queued tasks
+    ~WorkStealingScheduler();
+
+    WorkStealingScheduler(const WorkStealingScheduler&) = delete;
+    WorkStealingScheduler& operator=(const WorkStealingScheduler&) = delete;
+
+    // Queues task of stream stream_idx (>= 0). Safe from any thread,
+    // including from a task.
+    void submit(const int stream_idx, Task task);
+
+    // Blocks until no task is queued or running, then rethrows the
+    // first exception a task threw since the last call, if any. Not
+    // from a task.
+    void waitIdle();
+
+    int getNumWorkers()const{
+        return static_cast<int>(workers_.size());
+    }
+
+    int getHomeWorker(const int stream_idx)const{
+        return stream_idx % getNumWorkers();
+    }
+
+    // highest stream index submitted to so far, plus 1
+    int getNumStreams()const;
+
+    StreamStats getStreamStats(const int stream_idx)const;
+
+    /*
+      Jain's fairness index of the mean queue time of the streams that
+      ran tasks, (sum x)^2 / (n sum x^2): 1 when every stream waits as
+      long as the others, down to 1 / n when a single stream does all
+      the waiting.
+     */
+    double getFairnessIndex()const;
+
+    void resetStats();
+
+private:
+
+    typedef std::chrono::steady_clock Clock;
+
+    struct QueuedTask{
+        Task task;
+        int stream_idx;
+        int worker_idx;             // whose deque it was queued on
+        Clock::time_point submit_time;
+    };
+
+    struct Worker{
+        std::mutex mutex;
+        std::deque<QueuedTask> tasks;
+        std::thread thread;
+    };
+
+    void run(const int worker_idx);
+
+    // front of the own deque, then of the others' from the next worker on
+    bool take(const int worker_idx, QueuedTask& task);
+
+    void finish(const QueuedTask& task,
+                const int worker_idx,
+                const Clock::time_point start_time,
+                const Clock::time_point end_time);
+
+    std::vector<std::unique_ptr<Worker> > workers_;
+
+    // tasks in deques (changed with a deque mutex held), and tasks in
+    // deques or running; read under mutex_ to sleep on
+    std::atomic<long> num_queued_;
+    std::atomic<long> num_pending_;
+
+    std::mutex mutex_;
+    std::condition_variable work_condition_;
+    std::condition_variable idle_condition_;
+    bool quit_;
+    std::exception_ptr exception_;
+
+    mutable std::mutex stats_mutex_;
+    std::vector<StreamStats> stream_stats_;
+};
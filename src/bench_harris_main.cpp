@@ -0,0 +1,2714 @@
+/*
+  Headless benchmark of HarrisCorner.
+
+  Runs HarrisCorner::calcResponse() of each response function and of
+  all of them at once, HarrisCorner::nonMaximumSuppression(),
+  HarrisCorner::detectCorners() and cv::cornerHarris() on deterministic
+  synthetic images for a sweep of image sizes, window sizes and
+  thresholds, BRIEF descriptors and their matching with those of a
+  moved frame, and adaptive NMS with and without its grid index for a
+  sweep of candidate counts, and writes the timings as CSV and/or JSON.
+
+  --verify cross-checks the ISAs, thread counts, pipeline modes and NMS
+  methods against the scalar single-threaded reference instead, the
+  8-bit input path against the float one on a few synthetic images, the
+  incremental mode against full recomputes of a changing scene, the
+  batch API and the multi-stream scheduler against frame-by-frame
+  detection, corner tracking against the known motion of a panning
+  scene, raw frame files against the frames written to them, adaptive
+  NMS with a grid index against the naive one, descriptor matching
+  against plain loops and a moved frame, the kept intermediate planes
+  against direct computations and their debug images against their
+  refresh schedule, and the latency governor against made-up frame
+  times.
+ */
+
+#include <opencv2/opencv.hpp>
+
+#include <harris_corner.hpp>
+#include <harris_batch_detector.hpp>
+#include <brief_extractor.hpp>
+#include <debug_visualizer.hpp>
+#include <hamming_matcher.hpp>
+#include <harris_tracker.hpp>
+#include <latency_governor.hpp>
+#include <multi_stream_detector.hpp>
+#include <raw_frame_file.hpp>
+
+#include "my_utils_kk4.hpp"
+
+#include <stdexcept>
+#include <exception>
+#include <string>
+#include <sstream>
+#include <fstream>
+#include <iterator>
+#include <iostream>
+#include <vector>
+#include <algorithm>
+#include <thread>
+#include <cmath>
+#include <cstring>
+#include <cstdlib>
+#include <cstdio>
+#include <new>
+#include <atomic>
+#include <mutex>
+#include <utility>
+
+
+// Every heap allocation of the process is counted, so that --verify can
+// check that the detector does not allocate once warmed up.
+static std::atomic<unsigned long> num_heap_allocations(0);
+
+void* operator new(std::size_t size){
+
+    num_heap_allocations.fetch_add(1, std::memory_order_relaxed);
+    if(void* p = std::malloc(size ? size : 1)){
+        return p;
+    }
+    throw std::bad_alloc();
+}
+
+// not inlined, or GCC sees free() of what std::allocator got from
+// operator new and warns about a mismatch that is none
+__attribute__((noinline)) void operator delete(void* p)noexcept{
+
+    std::free(p);
+}
+
+__attribute__((noinline)) void operator delete(void* p, std::size_t)noexcept{
+
+    std::free(p);
+}
+
+
+struct BenchConfig{
+    std::vector<cv::Size> sizes;
+    std::vector<int> window_sizes;
+    std::vector<double> threshs;
+    int nms_window_size;
+    int num_levels;                 // of detectKeypointsMultiScale()
+    std::vector<int> anms_candidates;
+    int iterations;
+    int warmup_iterations;
+    int num_threads;
+    harris_kernels::Isa isa;
+    HarrisCorner::PipelineMode pipeline_mode;
+    std::string csv_path;           // "-" is stdout
+    std::string json_path;
+    bool verify;
+};
+
+struct BenchResult{
+    std::string method;
+    cv::Size size;
+    int window_size;
+    double thresh;                  // NaN if the method has no threshold
+    double ns_per_pixel;            // of the mean
+    double p50_ms;
+    double p99_ms;
+    double max_ms;
+    int corners;                    // -1 if the method does not detect corners
+};
+
+
+// Deterministic 8-bit test image: random rectangles, circles and lines
+// on a gradient, plus noise. cv::RNG gives the same sequence
+// everywhere, and each seed a different image.
+static cv::Mat makeSyntheticImage(const cv::Size& size,
+                                  const uint64_t seed = 0x6a09e667){
+
+    cv::RNG rng(seed);
+
+    cv::Mat image(size, CV_8UC1);
+    for(int i_r = 0; i_r < size.height; i_r++){
+        uint8_t* row = image.ptr<uint8_t>(i_r);
+        for(int i_c = 0; i_c < size.width; i_c++){
+            row[i_c] = static_cast<uint8_t>(64 + 64 * i_c / size.width + 32 * i_r / size.height);
+        }
+    }
+
+    const int num_shapes = size.area() / 4000;
+    const int max_extent = std::max(8, std::min(size.width, size.height) / 12);
+
+    for(int i = 0; i < num_shapes; i++){
+
+        const int x = rng.uniform(0, size.width);
+        const int y = rng.uniform(0, size.height);
+        const int w = rng.uniform(4, max_extent);
+        const int h = rng.uniform(4, max_extent);
+        const cv::Scalar color(rng.uniform(0, 256));
+
+        switch(rng.uniform(0, 3)){
+        case 0:
+            cv::rectangle(image, cv::Rect(x - w / 2, y - h / 2, w, h), color, -1);
+            break;
+        case 1:
+            cv::circle(image, cv::Point(x, y), w / 2, color, -1);
+            break;
+        default:
+            cv::line(image, cv::Point(x, y), cv::Point(x + w, y - h), color, rng.uniform(1, 4));
+            break;
+        }
+    }
+
+    for(int i_r = 0; i_r < size.height; i_r++){
+        uint8_t* row = image.ptr<uint8_t>(i_r);
+        for(int i_c = 0; i_c < size.width; i_c++){
+            const int noise = rng.uniform(0, 8);
+            row[i_c] = static_cast<uint8_t>(std::min(row[i_c] + noise, 255));
+        }
+    }
+
+    return image;
+}
+
+// the float input of an 8-bit image, as the camera app converts it
+static cv::Mat toFloat(const cv::Mat& image){
+
+    cv::Mat image_float;
+    image.convertTo(image_float, CV_32F, 1.0 / 255.0);
+    return image_float;
+}
+
+// image with a small square at a place that moves with frame_idx: a
+// mostly static scene for the incremental mode
+static cv::Mat makeMovingPatchFrame(const cv::Mat& image, const int frame_idx){
+
+    const int patch_size = 16;
+    const int x = frame_idx * 97 % std::max(1, image.cols - patch_size);
+    const int y = frame_idx * 61 % std::max(1, image.rows - patch_size);
+
+    cv::Mat frame = image.clone();
+    cv::rectangle(frame, cv::Rect(x, y, patch_size, patch_size), cv::Scalar(255), -1);
+    return frame;
+}
+
+// image moved by (dx, dy), with the uncovered border replicated: a
+// panning camera for the tracker
+static cv::Mat makeShiftedFrame(const cv::Mat& image, const int dx, const int dy){
+
+    cv::Mat frame(image.size(), image.type());
+    for(int i_r = 0; i_r < image.rows; i_r++){
+        uint8_t const * const src_row =
+            image.ptr<uint8_t>(std::min(std::max(i_r - dy, 0), image.rows - 1));
+        uint8_t* const row = frame.ptr<uint8_t>(i_r);
+        for(int i_c = 0; i_c < image.cols; i_c++){
+            row[i_c] = src_row[std::min(std::max(i_c - dx, 0), image.cols - 1)];
+        }
+    }
+    return frame;
+}
+
+// num candidate keypoints in an image of the given size, half of them
+// clumped in a few blobs as on textured areas, at whole pixels and
+// with scores from a few hundred levels so that ties occur
+static std::vector<HarrisCorner::Keypoint> makeCandidates(const int num, const cv::Size& size,
+                                                          const uint64_t seed = 1){
+
+    cv::RNG rng(seed);
+    std::vector<HarrisCorner::Keypoint> candidates(num);
+
+    const int num_blobs = 8;
+    cv::Point2f blob_centers[num_blobs];
+    for(cv::Point2f& center : blob_centers){
+        center = cv::Point2f(rng.uniform(0.0f, static_cast<float>(size.width)),
+                             rng.uniform(0.0f, static_cast<float>(size.height)));
+    }
+    const float blob_radius = 0.05f * std::min(size.width, size.height);
+
+    for(HarrisCorner::Keypoint& candidate : candidates){
+        float x = rng.uniform(0.0f, static_cast<float>(size.width));
+        float y = rng.uniform(0.0f, static_cast<float>(size.height));
+        if(rng.uniform(0, 2) == 0){
+            const cv::Point2f& center = blob_centers[rng.uniform(0, num_blobs)];
+            x = center.x + rng.uniform(-blob_radius, blob_radius);
+            y = center.y + rng.uniform(-blob_radius, blob_radius);
+        }
+        candidate.x = std::floor(std::min(std::max(x, 0.0f), size.width - 1.0f));
+        candidate.y = std::floor(std::min(std::max(y, 0.0f), size.height - 1.0f));
+        candidate.score = rng.uniform(1, 500) * 1e-4f;
+        candidate.scale = 1.0f;
+    }
+
+    return candidates;
+}
+
+// Runs func warmup + iterations times and fills the latency fields of
+// result from the timed iterations.
+template<typename Func>
+static void measure(const BenchConfig& config, Func func, BenchResult& result){
+
+    my_utils_kk4::StopWatch stop_watch;
+    std::vector<double> latencies;
+    latencies.reserve(config.iterations);
+
+    for(int i = 0; i < config.warmup_iterations + config.iterations; i++){
+
+        stop_watch.reset();
+        stop_watch.start();
+        func();
+        const double latency = stop_watch.stop();
+
+        if(i >= config.warmup_iterations){
+            latencies.push_back(latency);
+        }
+    }
+
+    double sum = 0.0;
+    for(const double latency : latencies){
+        sum += latency;
+    }
+    std::sort(latencies.begin(), latencies.end());
+
+    // nearest-rank percentile
+    auto percentile = [&](const double p){
+        const size_t rank = static_cast<size_t>(std::ceil(p / 100.0 * latencies.size()));
+        return latencies[std::max<size_t>(rank, 1) - 1];
+    };
+
+    result.ns_per_pixel = sum / latencies.size() * 1e9 / result.size.area();
+    result.p50_ms = percentile(50) * 1e3;
+    result.p99_ms = percentile(99) * 1e3;
+    result.max_ms = latencies.back() * 1e3;
+}
+
+static std::vector<BenchResult> runBenchmark(const BenchConfig& config){
+
+    std::vector<BenchResult> results;
+
+    HarrisCorner harris_corner(0.04, 3, config.num_threads);
+    harris_corner.setIsa(config.isa);
+    harris_corner.setPipelineMode(config.pipeline_mode);
+
+    cv::Mat image_float;
+    cv::Mat response;
+    std::vector<cv::Mat> responses;
+    cv::Mat response_opencv;
+    cv::Mat mask;
+    std::vector<HarrisCorner::Keypoint> keypoints;
+    HarrisCorner::NmsContext nms_context;
+
+    BriefExtractor extractor;
+    extractor.setIsa(config.isa);
+    HammingMatcher matcher;
+    matcher.setIsa(config.isa);
+    std::vector<HammingMatcher::Match> matches;
+
+    for(const cv::Size& size : config.sizes){
+
+        const cv::Mat image_u8 = makeSyntheticImage(size);
+        const cv::Mat image = toFloat(image_u8);
+
+        // the smoothed frame shared by detection and descriptors, and
+        // that of the frame moved by a few pixels to match it with
+        cv::Mat smoothed;
+        cv::Mat smoothed_shifted;
+        extractor.smooth(image_u8, smoothed);
+        extractor.smooth(makeShiftedFrame(image_u8, 5, 3), smoothed_shifted);
+
+        for(const int window_size : config.window_sizes){
+
+            std::cerr << "[ INFO] " << size.width << "x" << size.height
+                      << ", window " << window_size << std::endl;
+
+            harris_corner.setWindowSize(window_size);
+
+            BenchResult result;
+            result.size = size;
+            result.window_size = window_size;
+            result.thresh = NAN;
+            result.corners = -1;
+
+            result.method = "calcResponse";
+            measure(config, [&](){
+                    harris_corner.calcResponse(image, response);
+                }, result);
+            results.push_back(result);
+
+            // what the other responses add to the shared gradient and
+            // window sum work, alone and all at once
+            for(int r = 1; r < harris_kernels::kNumResponses; r++){
+                const harris_kernels::Response response_type =
+                    static_cast<harris_kernels::Response>(r);
+                harris_corner.setResponseType(response_type);
+                result.method = std::string("calcResponse(")
+                    + harris_kernels::responseName(response_type) + ")";
+                measure(config, [&](){
+                        harris_corner.calcResponse(image, response);
+                    }, result);
+                results.push_back(result);
+            }
+            harris_corner.setResponseType(harris_kernels::RESPONSE_HARRIS);
+
+            result.method = "calcResponses(all)";
+            measure(config, [&](){
+                    harris_corner.calcResponses(image, harris_kernels::kNumResponseMasks - 1,
+                                                responses);
+                }, result);
+            results.push_back(result);
+
+            // what the 8-bit path saves on top of the float one
+            result.method = "convertTo";
+            measure(config, [&](){
+                    image_u8.convertTo(image_float, CV_32F, 1.0 / 255.0);
+                }, result);
+            results.push_back(result);
+
+            result.method = "calcResponse(u8)";
+            measure(config, [&](){
+                    harris_corner.calcResponse(image_u8, response);
+                }, result);
+            results.push_back(result);
+
+            result.method = "BriefExtractor::smooth(u8)";
+            measure(config, [&](){
+                    extractor.smooth(image_u8, smoothed);
+                }, result);
+            results.push_back(result);
+
+            result.method = "cv::cornerHarris";
+            measure(config, [&](){
+                    cv::cornerHarris(image, response_opencv, window_size, 3,
+                                     harris_corner.getK());
+                }, result);
+            results.push_back(result);
+
+            for(const double thresh : config.threshs){
+
+                result.thresh = thresh;
+
+                result.method = "nonMaximumSuppression";
+                measure(config, [&](){
+                        HarrisCorner::nonMaximumSuppression(
+                            response, mask, thresh, config.nms_window_size,
+                            HarrisCorner::NMS_SEPARABLE, &harris_corner.getThreadPool(),
+                            &nms_context);
+                    }, result);
+                result.corners = cv::countNonZero(mask);
+                results.push_back(result);
+
+                result.method = "detectCorners";
+                measure(config, [&](){
+                        harris_corner.detectCorners(image, mask, thresh,
+                                                    config.nms_window_size);
+                    }, result);
+                result.corners = cv::countNonZero(mask);
+                results.push_back(result);
+
+                result.method = "detectKeypoints";
+                measure(config, [&](){
+                        harris_corner.detectKeypoints(image, keypoints, thresh,
+                                                      config.nms_window_size);
+                    }, result);
+                result.corners = static_cast<int>(keypoints.size());
+                results.push_back(result);
+
+                result.method = "detectKeypoints(u8)";
+                measure(config, [&](){
+                        harris_corner.detectKeypoints(image_u8, keypoints, thresh,
+                                                      config.nms_window_size);
+                    }, result);
+                result.corners = static_cast<int>(keypoints.size());
+                results.push_back(result);
+
+                {
+                    std::vector<HarrisCorner::Keypoint> keypoints_shifted;
+                    cv::Mat descriptors;
+                    cv::Mat descriptors_shifted;
+                    harris_corner.detectKeypoints(smoothed, keypoints, thresh,
+                                                  config.nms_window_size);
+                    harris_corner.detectKeypoints(smoothed_shifted, keypoints_shifted, thresh,
+                                                  config.nms_window_size);
+                    extractor.compute(smoothed_shifted, keypoints_shifted, descriptors_shifted);
+
+                    result.method = "BriefExtractor::compute";
+                    measure(config, [&](){
+                            extractor.compute(smoothed, keypoints, descriptors);
+                        }, result);
+                    result.corners = static_cast<int>(keypoints.size());
+                    results.push_back(result);
+
+                    // corners = matches
+                    result.method = "HammingMatcher::match";
+                    measure(config, [&](){
+                            matcher.match(descriptors, descriptors_shifted, matches);
+                        }, result);
+                    result.corners = static_cast<int>(matches.size());
+                    results.push_back(result);
+                }
+
+                {
+                    // frames in flight, timed per batch and reported per frame
+                    HarrisBatchDetector batch_detector(0.04, window_size, config.num_threads);
+                    batch_detector.setIsa(config.isa);
+
+                    const int num_frames = HarrisBatchDetector::kFramesPerThread
+                        * batch_detector.getNumThreads();
+                    const std::vector<cv::Mat> frames(num_frames, image);
+                    std::vector<std::vector<HarrisCorner::Keypoint> > batch_keypoints;
+
+                    result.method = "detectKeypoints(batch, per frame)";
+                    measure(config, [&](){
+                            batch_detector.detectKeypoints(frames, batch_keypoints, thresh,
+                                                           config.nms_window_size);
+                        }, result);
+                    result.ns_per_pixel /= num_frames;
+                    result.p50_ms /= num_frames;
+                    result.p99_ms /= num_frames;
+                    result.max_ms /= num_frames;
+                    result.corners = static_cast<int>(batch_keypoints.front().size());
+                    results.push_back(result);
+
+                    std::cerr << "[ INFO] batch: " << num_frames << " frames, "
+                              << (batch_detector.getLastParallelism()
+                                  == HarrisBatchDetector::PARALLEL_TILES ? "tiles" : "frames")
+                              << " in parallel" << std::endl;
+                }
+
+                {
+                    // frames of four streams in flight on one scheduler,
+                    // timed per round and reported per frame
+                    const int num_streams = 4;
+                    MultiStreamDetector multi_detector(0.04, window_size, config.num_threads);
+                    multi_detector.setIsa(config.isa);
+
+                    const int num_frames = multi_detector.getMaxFramesInFlight() * num_streams;
+                    std::atomic<int> num_corners(0);
+                    const MultiStreamDetector::KeypointSink sink =
+                        [&](const int, const long, const cv::Mat&,
+                            const std::vector<HarrisCorner::Keypoint>& frame_keypoints){
+                        num_corners = static_cast<int>(frame_keypoints.size());
+                    };
+
+                    result.method = "detectKeypoints(multi-stream, per frame)";
+                    measure(config, [&](){
+                            for(int i = 0; i < num_frames; i++){
+                                multi_detector.submit(i % num_streams, image, thresh,
+                                                      config.nms_window_size, sink);
+                            }
+                            multi_detector.waitIdle();
+                        }, result);
+                    result.ns_per_pixel /= num_frames;
+                    result.p50_ms /= num_frames;
+                    result.p99_ms /= num_frames;
+                    result.max_ms /= num_frames;
+                    result.corners = num_corners;
+                    results.push_back(result);
+
+                    const WorkStealingScheduler& scheduler = multi_detector.getScheduler();
+                    long num_tasks = 0;
+                    long num_stolen = 0;
+                    for(int stream_idx = 0; stream_idx < num_streams; stream_idx++){
+                        num_tasks += scheduler.getStreamStats(stream_idx).num_tasks;
+                        num_stolen += scheduler.getStreamStats(stream_idx).num_stolen;
+                    }
+                    std::cerr << "[ INFO] multi-stream: " << num_streams << " streams, "
+                              << num_stolen << " of " << num_tasks << " tasks stolen, fairness "
+                              << scheduler.getFairnessIndex() << std::endl;
+                }
+
+                {
+                    // a panning scene, re-detected every 5 frames
+                    const int detection_interval = 5;
+                    const int num_frames = 2 * detection_interval;
+                    std::vector<cv::Mat> frames;
+                    for(int i = 0; i < num_frames; i++){
+                        frames.push_back(toFloat(makeShiftedFrame(image_u8, i, 0)));
+                    }
+
+                    HarrisTracker tracker(harris_corner);
+                    tracker.setDetectionInterval(detection_interval);
+                    std::vector<HarrisTracker::Track> tracks;
+
+                    int frame_idx = 0;
+                    result.method = "detectKeypoints(tracking)";
+                    measure(config, [&](){
+                            if(frame_idx == config.warmup_iterations){
+                                tracker.resetStats();
+                            }
+                            tracker.track(frames[frame_idx++ % num_frames], tracks, thresh,
+                                          config.nms_window_size);
+                        }, result);
+                    result.corners = static_cast<int>(tracks.size());
+                    results.push_back(result);
+
+                    const HarrisTracker::Stats& stats = tracker.getStats();
+                    const double detection_ms =
+                        stats.detection_seconds * 1e3 / std::max(1, stats.detection_frames);
+                    const double tracking_ms =
+                        stats.tracking_seconds * 1e3 / std::max(1, stats.tracking_frames);
+                    const double mean_ms = (stats.detection_seconds + stats.tracking_seconds) * 1e3
+                        / std::max(1, stats.detection_frames + stats.tracking_frames);
+                    std::cerr << "[ INFO] tracking: detection " << detection_ms << " ms, tracking "
+                              << tracking_ms << " ms, " << mean_ms << " ms per frame on average, "
+                              << detection_ms / mean_ms << "x less than detecting every frame"
+                              << std::endl;
+                }
+
+                {
+                    const int num_frames = 8;
+                    std::vector<cv::Mat> frames;
+                    for(int i = 0; i < num_frames; i++){
+                        frames.push_back(toFloat(makeMovingPatchFrame(image_u8, i)));
+                    }
+
+                    int frame_idx = 0;
+                    double dirty_tile_fraction = 0.0;
+                    harris_corner.setIncremental(true);
+                    result.method = "detectKeypoints(incremental)";
+                    measure(config, [&](){
+                            harris_corner.detectKeypoints(frames[frame_idx++ % num_frames],
+                                                          keypoints, thresh,
+                                                          config.nms_window_size);
+                            dirty_tile_fraction += harris_corner.getDirtyTileFraction();
+                        }, result);
+                    harris_corner.setIncremental(false);
+                    result.corners = static_cast<int>(keypoints.size());
+                    results.push_back(result);
+
+                    std::cerr << "[ INFO] incremental: " << dirty_tile_fraction / frame_idx
+                              << " of the tiles recomputed per frame" << std::endl;
+                }
+
+                harris_corner.setSubpixelRefinement(true);
+                result.method = "detectKeypoints+subpixel";
+                measure(config, [&](){
+                        harris_corner.detectKeypoints(image, keypoints, thresh,
+                                                      config.nms_window_size);
+                    }, result);
+                harris_corner.setSubpixelRefinement(false);
+                result.corners = static_cast<int>(keypoints.size());
+                results.push_back(result);
+
+                result.method = "detectKeypointsMultiScale";
+                measure(config, [&](){
+                        harris_corner.detectKeypointsMultiScale(image, keypoints, thresh,
+                                                                config.nms_window_size,
+                                                                config.num_levels);
+                    }, result);
+                result.corners = static_cast<int>(keypoints.size());
+                results.push_back(result);
+            }
+        }
+    }
+
+    // adaptive NMS of candidates in the largest image, both methods;
+    // the naive one takes seconds for large counts, so it is timed once
+    const int anms_max_corners = 500;
+    for(const int num_candidates : config.anms_candidates){
+
+        const cv::Size size = config.sizes.back();
+        const std::vector<HarrisCorner::Keypoint> candidates = makeCandidates(num_candidates, size);
+
+        std::cerr << "[ INFO] adaptive NMS, " << num_candidates << " candidates" << std::endl;
+
+        BenchResult result;
+        result.size = size;
+        result.window_size = harris_corner.getWindowSize();
+        result.thresh = NAN;
+
+        double mean_ms[2] = {0.0, 0.0};
+        const HarrisCorner::AnmsMethod methods[] = {HarrisCorner::ANMS_GRID, HarrisCorner::ANMS_NAIVE};
+        for(const HarrisCorner::AnmsMethod method : methods){
+
+            BenchConfig anms_config = config;
+            if(method == HarrisCorner::ANMS_NAIVE && num_candidates > 10000){
+                anms_config.iterations = 1;
+                anms_config.warmup_iterations = 0;
+            }
+
+            result.method = std::string("adaptiveNonMaximalSuppression(")
+                + (method == HarrisCorner::ANMS_GRID ? "grid" : "naive")
+                + ":" + std::to_string(num_candidates) + ")";
+            measure(anms_config, [&](){
+                    keypoints = candidates;
+                    harris_corner.adaptiveNonMaximalSuppression(keypoints, anms_max_corners,
+                                                                HarrisCorner::kAnmsRobustness,
+                                                                method);
+                }, result);
+            result.corners = static_cast<int>(keypoints.size());
+            results.push_back(result);
+
+            mean_ms[method] = result.ns_per_pixel * size.area() * 1e-6;
+        }
+
+        std::cerr << "[ INFO] adaptive NMS: grid " << mean_ms[HarrisCorner::ANMS_GRID]
+                  << " ms, naive " << mean_ms[HarrisCorner::ANMS_NAIVE] << " ms, "
+                  << mean_ms[HarrisCorner::ANMS_NAIVE] / mean_ms[HarrisCorner::ANMS_GRID]
+                  << "x faster" << std::endl;
+    }
+
+    {
+        // a frame's worth of descriptors against the previous frame's:
+        // the train descriptors again, with a few bits flipped, in
+        // another order
+        const int num_descriptors = 2000;
+        cv::RNG rng(3);
+        cv::Mat train(num_descriptors, HammingMatcher::kDescriptorBytes, CV_8UC1);
+        cv::Mat query(num_descriptors, HammingMatcher::kDescriptorBytes, CV_8UC1);
+        for(int i_r = 0; i_r < num_descriptors; i_r++){
+            for(int i_c = 0; i_c < HammingMatcher::kDescriptorBytes; i_c++){
+                train.ptr<uint8_t>(i_r)[i_c] = static_cast<uint8_t>(rng.uniform(0, 256));
+            }
+        }
+        for(int i_r = 0; i_r < num_descriptors; i_r++){
+            uint8_t const * const src = train.ptr<uint8_t>(i_r * 7919 % num_descriptors);
+            for(int i_c = 0; i_c < HammingMatcher::kDescriptorBytes; i_c++){
+                query.ptr<uint8_t>(i_r)[i_c] = src[i_c]
+                    ^ static_cast<uint8_t>(rng.uniform(0, 8) == 0 ? 1 << rng.uniform(0, 8) : 0);
+            }
+        }
+
+        BenchResult result;
+        result.size = config.sizes.back();
+        result.window_size = harris_corner.getWindowSize();
+        result.thresh = NAN;
+        result.method = "HammingMatcher::match(" + std::to_string(num_descriptors) + "x"
+            + std::to_string(num_descriptors) + ")";
+        measure(config, [&](){
+                matcher.match(query, train, matches);
+            }, result);
+        result.corners = static_cast<int>(matches.size());
+        results.push_back(result);
+
+        // one such call per frame, against the 16.7 ms of a frame at 60 fps
+        const double frame_ms = 1e3 / 60;
+        std::cerr << "[ INFO] matching " << num_descriptors << "x" << num_descriptors
+                  << " descriptors: " << result.p50_ms << " ms, "
+                  << 1e3 / result.p50_ms << " calls per second, "
+                  << 100.0 * result.p50_ms / frame_ms << "% of a 60 fps frame" << std::endl;
+    }
+
+    return results;
+}
+
+static void writeCsv(std::ostream& os, const BenchConfig& config,
+                     const std::vector<BenchResult>& results){
+
+    os << "method,isa,threads,pipeline,width,height,window_size,nms_window_size,levels,"
+       << "thresh,ns_per_pixel,p50_ms,p99_ms,max_ms,corners" << std::endl;
+
+    for(const BenchResult& result : results){
+        os << result.method << ","
+           << harris_kernels::isaName(config.isa) << ","
+           << config.num_threads << ","
+           << (config.pipeline_mode == HarrisCorner::PIPELINE_PLANES ? "planes" : "streaming") << ","
+           << result.size.width << ","
+           << result.size.height << ","
+           << result.window_size << ","
+           << config.nms_window_size << ","
+           << config.num_levels << ",";
+        if(! std::isnan(result.thresh)){
+            os << result.thresh;
+        }
+        os << ","
+           << result.ns_per_pixel << ","
+           << result.p50_ms << ","
+           << result.p99_ms << ","
+           << result.max_ms << ",";
+        if(result.corners >= 0){
+            os << result.corners;
+        }
+        os << std::endl;
+    }
+}
+
+static void writeJson(std::ostream& os, const BenchConfig& config,
+                      const std::vector<BenchResult>& results){
+
+    os << "{" << std::endl
+       << "  \"isa\": \"" << harris_kernels::isaName(config.isa) << "\"," << std::endl
+       << "  \"threads\": " << config.num_threads << "," << std::endl
+       << "  \"pipeline\": \""
+       << (config.pipeline_mode == HarrisCorner::PIPELINE_PLANES ? "planes" : "streaming")
+       << "\"," << std::endl
+       << "  \"nms_window_size\": " << config.nms_window_size << "," << std::endl
+       << "  \"levels\": " << config.num_levels << "," << std::endl
+       << "  \"iterations\": " << config.iterations << "," << std::endl
+       << "  \"results\": [" << std::endl;
+
+    for(size_t i = 0; i < results.size(); i++){
+
+        const BenchResult& result = results[i];
+
+        os << "    {\"method\": \"" << result.method << "\""
+           << ", \"width\": " << result.size.width
+           << ", \"height\": " << result.size.height
+           << ", \"window_size\": " << result.window_size
+           << ", \"thresh\": ";
+        if(std::isnan(result.thresh)){
+            os << "null";
+        }else{
+            os << result.thresh;
+        }
+        os << ", \"ns_per_pixel\": " << result.ns_per_pixel
+           << ", \"p50_ms\": " << result.p50_ms
+           << ", \"p99_ms\": " << result.p99_ms
+           << ", \"max_ms\": " << result.max_ms
+           << ", \"corners\": ";
+        if(result.corners >= 0){
+            os << result.corners;
+        }else{
+            os << "null";
+        }
+        os << "}" << (i + 1 < results.size() ? "," : "") << std::endl;
+    }
+
+    os << "  ]" << std::endl
+       << "}" << std::endl;
+}
+
+
+// verification
+
+static bool verifyEqual(const std::string& name, const cv::Mat& a, const cv::Mat& b){
+
+    if(a.size() != b.size()){
+        std::cout << "[FAIL ] " << name << ": sizes differ" << std::endl;
+        return false;
+    }
+    // a bytewise comparison would pass e.g. CV_32SC1 against CV_32FC1
+    if(a.type() != b.type()){
+        std::cout << "[FAIL ] " << name << ": types differ" << std::endl;
+        return false;
+    }
+
+    int mismatches = 0;
+    const size_t row_bytes = a.cols * a.elemSize();
+    for(int i_r = 0; i_r < a.rows; i_r++){
+        uint8_t const * a_row = a.ptr<uint8_t>(i_r);
+        uint8_t const * b_row = b.ptr<uint8_t>(i_r);
+        if(std::memcmp(a_row, b_row, row_bytes) == 0){
+            continue;
+        }
+        for(size_t i = 0; i < row_bytes; i += a.elemSize()){
+            mismatches += std::memcmp(a_row + i, b_row + i, a.elemSize()) != 0;
+        }
+    }
+
+    std::cout << (mismatches == 0 ? "[  OK ] " : "[FAIL ] ") << name;
+    if(mismatches != 0){
+        std::cout << ": " << mismatches << " pixel(s) differ";
+    }
+    std::cout << std::endl;
+
+    return mismatches == 0;
+}
+
+// keypoints as a N x 4 float matrix, for verifyEqual()
+static cv::Mat toMat(const std::vector<HarrisCorner::Keypoint>& keypoints){
+
+    cv::Mat mat(static_cast<int>(keypoints.size()), 4, CV_32FC1);
+    for(int i = 0; i < mat.rows; i++){
+        float* row = mat.ptr<float>(i);
+        row[0] = keypoints[i].x;
+        row[1] = keypoints[i].y;
+        row[2] = keypoints[i].score;
+        row[3] = keypoints[i].scale;
+    }
+    return mat;
+}
+
+// SIMD running sums are not bit-exact, so responses are compared
+// relative to the largest magnitude of the reference.
+static bool verifyClose(const std::string& name, const cv::Mat& a, const cv::Mat& reference,
+                        const double tolerance){
+
+    double min_val = 0.0;
+    double max_val = 0.0;
+    cv::minMaxLoc(reference, &min_val, &max_val);
+    const double max_abs = std::max(std::abs(min_val), std::abs(max_val));
+
+    cv::Mat diff;
+    cv::absdiff(a, reference, diff);
+    double max_diff = 0.0;
+    cv::minMaxLoc(diff, nullptr, &max_diff);
+
+    const double error = max_diff / std::max(max_abs, 1e-30);
+
+    std::cout << (error <= tolerance ? "[  OK ] " : "[FAIL ] ") << name
+              << ": relative error " << error << std::endl;
+
+    return error <= tolerance;
+}
+
+// Corner masks that may differ where responses tie or touch the
+// threshold within float round-off. A corner found by only one of them
+// is a tie if the reference response there is within tolerance of the
+// largest response of the image from the threshold or from another
+// response of its NMS window; any other difference fails.
+static bool verifyAgreement(const std::string& name, const cv::Mat& a, const cv::Mat& reference,
+                            const cv::Mat& reference_response, const double thresh,
+                            const int nms_window_size, const double tolerance){
+
+    double max_response = 0.0;
+    cv::minMaxLoc(reference_response, nullptr, &max_response);
+    const double max_difference = tolerance * std::abs(max_response);
+    const int half_w = nms_window_size / 2;
+
+    int num_corners = 0;
+    int num_ties = 0;
+    int num_differing = 0;
+    for(int i_r = 0; i_r < a.rows; i_r++){
+        uint8_t const * a_row = a.ptr<uint8_t>(i_r);
+        uint8_t const * reference_row = reference.ptr<uint8_t>(i_r);
+        for(int i_c = 0; i_c < a.cols; i_c++){
+
+            num_corners += a_row[i_c] || reference_row[i_c];
+
+            if((a_row[i_c] != 0) == (reference_row[i_c] != 0)){
+                continue;
+            }
+
+            const float response = reference_response.ptr<float>(i_r)[i_c];
+            bool tie = std::abs(response - thresh) <= max_difference;
+
+            for(int j_r = std::max(0, i_r - half_w);
+                j_r <= std::min(a.rows - 1, i_r + half_w) && ! tie; j_r++){
+                for(int j_c = std::max(0, i_c - half_w);
+                    j_c <= std::min(a.cols - 1, i_c + half_w); j_c++){
+                    if((j_r != i_r || j_c != i_c)
+                       && std::abs(reference_response.ptr<float>(j_r)[j_c] - response)
+                       <= max_difference){
+                        tie = true;
+                    }
+                }
+            }
+
+            num_ties += tie;
+            num_differing += ! tie;
+        }
+    }
+
+    std::cout << (num_differing == 0 ? "[  OK ] " : "[FAIL ] ") << name
+              << ": " << num_differing << " of " << num_corners << " corner(s) differ, "
+              << num_ties << " more at ties" << std::endl;
+
+    return num_differing == 0;
+}
+
+// Runs func a few times to warm up, then checks that further calls
+// neither heap-allocate nor grow the workspaces of harris_corner, a
+// HarrisCorner or a HarrisCorner::NmsContext.
+template<typename Owner, typename Func>
+static bool verifyNoAllocation(const std::string& name, const Owner& harris_corner,
+                               Func func){
+
+    for(int i = 0; i < 3; i++){
+        func();
+    }
+
+    const unsigned long workspace_allocations = harris_corner.getWorkspaceAllocationCount();
+    const unsigned long heap_allocations = num_heap_allocations.load();
+
+    for(int i = 0; i < 5; i++){
+        func();
+    }
+
+    const unsigned long new_workspace_allocations =
+        harris_corner.getWorkspaceAllocationCount() - workspace_allocations;
+    const unsigned long new_heap_allocations = num_heap_allocations.load() - heap_allocations;
+    const bool ok = new_workspace_allocations == 0 && new_heap_allocations == 0;
+
+    std::cout << (ok ? "[  OK ] " : "[FAIL ] ") << name << ": "
+              << new_heap_allocations << " heap allocation(s), "
+              << new_workspace_allocations << " workspace allocation(s) after warm-up"
+              << std::endl;
+
+    return ok;
+}
+
+// Writes a few BGR frames to a raw frame file and checks that the
+// reader maps them back unchanged, also from a recording cut short.
+static bool verifyRawFrameFile(const cv::Mat& image_u8){
+
+    bool ok = true;
+
+    std::ostringstream tag;
+    tag << image_u8.cols << "x" << image_u8.rows << " raw frame file";
+
+    const std::string file_name = std::string(P_tmpdir) + "/bench_harris_verify.raw";
+    const std::string cut_file_name = file_name + ".cut";
+    const int num_frames = 4;
+
+    std::vector<cv::Mat> frames;
+    for(int i = 0; i < num_frames; i++){
+        cv::Mat frame;
+        cv::cvtColor(makeMovingPatchFrame(image_u8, i), frame, cv::COLOR_GRAY2BGR);
+        frames.push_back(frame);
+    }
+
+    {
+        RawFrameWriter writer;
+        writer.open(file_name);
+        for(int i = 0; i < num_frames; i++){
+            writer.write(frames[i], 1000 * i);
+        }
+        writer.close();
+    }
+
+    RawFrameReader reader;
+    reader.open(file_name);
+
+    if(reader.getNumFrames() != num_frames){
+        std::cout << "[FAIL ] " << tag.str() << ": " << reader.getNumFrames()
+                  << " frame(s) instead of " << num_frames << std::endl;
+        return false;
+    }
+
+    cv::Mat frame;
+    for(int i = 0; reader.read(frame); i++){
+        ok &= verifyEqual(tag.str() + " frame " + std::to_string(i), frame, frames[i]);
+
+        // a view of the mapped pages, not a copy
+        if(frame.data != reader.getFrame(i).data
+           || reinterpret_cast<uintptr_t>(frame.data) % kRawFrameDataOffset != 0
+           || reader.getTimestamp(i) != 1000 * i){
+            std::cout << "[FAIL ] " << tag.str() << " frame " << i
+                      << ": not mapped in place or wrong timestamp" << std::endl;
+            ok = false;
+        }
+    }
+
+    // the first 2.5 frames of a recording that is still open, as a
+    // crash would leave them
+    {
+        const std::string open_file_name = file_name + ".open";
+
+        RawFrameWriter writer;
+        writer.open(open_file_name);
+        for(int i = 0; i < 3; i++){
+            writer.write(frames[i], 1000 * i);
+        }
+        writer.flush();
+
+        std::ifstream ifs(open_file_name, std::ios::binary);
+        const std::vector<char> bytes((std::istreambuf_iterator<char>(ifs)),
+                                      std::istreambuf_iterator<char>());
+        RawFrameHeader header;
+        std::memcpy(&header, bytes.data(), sizeof(header));
+        const size_t cut_size = kRawFrameDataOffset + header.frame_stride * 2
+            + header.frame_size / 2;
+
+        std::ofstream ofs(cut_file_name, std::ios::binary);
+        ofs.write(bytes.data(), std::min(cut_size, bytes.size()));
+
+        writer.close();
+        std::remove(open_file_name.c_str());
+    }
+
+    reader.open(cut_file_name);
+    if(reader.getNumFrames() != 2 || reader.getTimestamp(1) != -1){
+        std::cout << "[FAIL ] " << tag.str() << " cut short: " << reader.getNumFrames()
+                  << " frame(s) instead of 2" << std::endl;
+        ok = false;
+    }else{
+        ok &= verifyEqual(tag.str() + " cut short frame 1", reader.getFrame(1), frames[1]);
+    }
+    reader.close();
+
+    std::remove(file_name.c_str());
+    std::remove(cut_file_name.c_str());
+
+    return ok;
+}
+
+// Adaptive NMS with the grid index against the naive one on clumped
+// candidates, degenerate layouts and detected corners, and that the
+// kept keypoints are ordered so that a prefix is a smaller selection.
+static bool verifyAdaptiveNms(const cv::Mat& image, const BenchConfig& config){
+
+    bool ok = true;
+    HarrisCorner harris_corner;
+    std::vector<HarrisCorner::Keypoint> grid;
+    std::vector<HarrisCorner::Keypoint> naive;
+
+    auto same = [](const std::vector<HarrisCorner::Keypoint>& a,
+                   const std::vector<HarrisCorner::Keypoint>& b){
+        if(a.size() != b.size()){
+            return false;
+        }
+        for(size_t i = 0; i < a.size(); i++){
+            if(a[i].x != b[i].x || a[i].y != b[i].y || a[i].score != b[i].score){
+                return false;
+            }
+        }
+        return true;
+    };
+
+    auto check = [&](const std::string& name,
+                     const std::vector<HarrisCorner::Keypoint>& candidates,
+                     const int max_corners, const double robustness){
+        grid = candidates;
+        naive = candidates;
+        harris_corner.adaptiveNonMaximalSuppression(grid, max_corners, robustness,
+                                                    HarrisCorner::ANMS_GRID);
+        harris_corner.adaptiveNonMaximalSuppression(naive, max_corners, robustness,
+                                                    HarrisCorner::ANMS_NAIVE);
+        const bool passed = same(grid, naive)
+            && grid.size() == std::min(candidates.size(), static_cast<size_t>(max_corners));
+        if(! passed){
+            std::cout << "[FAIL ] adaptive NMS " << name << ", " << candidates.size()
+                      << " candidates, max " << max_corners << ", robustness " << robustness
+                      << ": grid and naive differ" << std::endl;
+        }
+        return passed;
+    };
+
+    int num_cases = 0;
+    int num_failed = 0;
+    const cv::Size size(640, 480);
+    const int counts[] = {1, 2, 37, 500, 5000};
+    const double robustnesses[] = {HarrisCorner::kAnmsRobustness, 1.0, 0.5};
+    for(const int count : counts){
+        for(const double robustness : robustnesses){
+            for(const int max_corners : {1, 20, 300}){
+                const std::vector<HarrisCorner::Keypoint> candidates =
+                    makeCandidates(count, size, count + 7);
+                num_failed += check("clumped", candidates, max_corners, robustness) ? 0 : 1;
+                num_cases++;
+            }
+        }
+    }
+
+    {
+        std::vector<HarrisCorner::Keypoint> row = makeCandidates(2000, size, 3);
+        std::vector<HarrisCorner::Keypoint> point = row;
+        for(HarrisCorner::Keypoint& keypoint : row){
+            keypoint.y = 100.0f;
+        }
+        for(HarrisCorner::Keypoint& keypoint : point){
+            keypoint.x = 10.0f;
+            keypoint.y = 20.0f;
+        }
+        num_failed += check("on one row", row, 100, HarrisCorner::kAnmsRobustness) ? 0 : 1;
+        num_failed += check("at one point", point, 100, HarrisCorner::kAnmsRobustness) ? 0 : 1;
+        num_cases += 2;
+    }
+
+    std::cout << (num_failed == 0 ? "[  OK ] " : "[FAIL ] ") << "adaptive NMS grid vs naive: "
+              << num_failed << " of " << num_cases << " case(s) differ" << std::endl;
+    ok &= num_failed == 0;
+
+    {
+        const std::vector<HarrisCorner::Keypoint> candidates = makeCandidates(3000, size, 5);
+        std::vector<HarrisCorner::Keypoint> fewer = candidates;
+        grid = candidates;
+        harris_corner.adaptiveNonMaximalSuppression(grid, 200);
+        harris_corner.adaptiveNonMaximalSuppression(fewer, 50);
+        grid.resize(50);
+        const bool passed = same(grid, fewer);
+        std::cout << (passed ? "[  OK ] " : "[FAIL ] ")
+                  << "adaptive NMS prefix: first 50 of 200 kept are the 50 kept" << std::endl;
+        ok &= passed;
+    }
+
+    {
+        // through a selection, on detected corners
+        const double thresh = config.threshs.front();
+        harris_corner.detectKeypoints(image, naive, thresh, config.nms_window_size);
+        const size_t num_detected = naive.size();
+        HarrisCorner::KeypointSelection selection;
+        selection.max_corners = std::max(1, static_cast<int>(num_detected) / 3);
+        selection.adaptive_nms = true;
+        harris_corner.detectKeypoints(image, grid, thresh, config.nms_window_size, selection);
+        harris_corner.adaptiveNonMaximalSuppression(naive, selection.max_corners,
+                                                    HarrisCorner::kAnmsRobustness,
+                                                    HarrisCorner::ANMS_NAIVE);
+        const bool passed = same(grid, naive);
+        std::cout << (passed ? "[  OK ] " : "[FAIL ] ") << "adaptive NMS selection: "
+                  << grid.size() << " of " << num_detected << " detected corners kept, "
+                  << (passed ? "as" : "not as") << " the naive method keeps" << std::endl;
+        ok &= passed;
+    }
+
+    return ok;
+}
+
+// What HammingMatcher::match() should give, from plain loops over all
+// pairs.
+static std::vector<HammingMatcher::Match> matchReference(const cv::Mat& query,
+                                                         const cv::Mat& train,
+                                                         const HammingMatcher& matcher){
+
+    auto distance = [&](const int i_q, const int i_t){
+        int bits = 0;
+        for(int i = 0; i < HammingMatcher::kDescriptorBytes; i++){
+            unsigned x = query.ptr<uint8_t>(i_q)[i] ^ train.ptr<uint8_t>(i_t)[i];
+            for(; x; x &= x - 1){
+                bits++;
+            }
+        }
+        return bits;
+    };
+
+    std::vector<HammingMatcher::Match> matches;
+
+    for(int i_q = 0; i_q < query.rows; i_q++){
+
+        int best_train = -1;
+        int best = HammingMatcher::kDescriptorBits + 1;
+        int second = HammingMatcher::kDescriptorBits + 1;
+        for(int i_t = 0; i_t < train.rows; i_t++){
+            const int d = distance(i_q, i_t);
+            if(d < best){
+                second = best;
+                best = d;
+                best_train = i_t;
+            }else if(d < second){
+                second = d;
+            }
+        }
+        if(best_train < 0 || best > matcher.getMaxDistance()){
+            continue;
+        }
+        if(matcher.getRatio() < 1.0 && second <= HammingMatcher::kDescriptorBits
+           && best >= matcher.getRatio() * second){
+            continue;
+        }
+        if(matcher.getCrossCheck()){
+            int best_query = -1;
+            int best_query_distance = HammingMatcher::kDescriptorBits + 1;
+            for(int j_q = 0; j_q < query.rows; j_q++){
+                const int d = distance(j_q, best_train);
+                if(d < best_query_distance){
+                    best_query_distance = d;
+                    best_query = j_q;
+                }
+            }
+            if(best_query != i_q){
+                continue;
+            }
+        }
+
+        HammingMatcher::Match match;
+        match.query_idx = i_q;
+        match.train_idx = best_train;
+        match.distance = best;
+        matches.push_back(match);
+    }
+
+    return matches;
+}
+
+/*
+  The planes HarrisCorner keeps against direct computations of the
+  gradients and window sums and against calcResponse(), for both input
+  types and pipeline modes, which planes are kept when, and the
+  DebugVisualizer refreshes against their schedule.
+ */
+static bool verifyKeptPlanes(const cv::Mat& image_u8, const BenchConfig& config){
+
+    bool ok = true;
+
+    const cv::Mat image = toFloat(image_u8);
+    const int window_size = config.window_sizes.front();
+    const int half_w_size = (window_size - 1) / 2;
+    const double thresh = config.threshs.empty() ? 1e-3 : config.threshs.front();
+    const int rows = image.rows;
+    const int cols = image.cols;
+    const unsigned all_planes = (1u << HarrisCorner::kNumPlanes) - 1;
+
+    std::ostringstream size_tag;
+    size_tag << cols << "x" << rows << " w" << window_size << " kept planes";
+
+    for(const bool integer : {false, true}){
+
+        const cv::Mat& input = integer ? image_u8 : image;
+        const int grad_type = integer ? CV_16SC1 : CV_32FC1;
+        const int sum_type = integer ? CV_32SC1 : CV_32FC1;
+
+        // central differences, reflected at the border, and window sums
+        // of their products with zeros outside, in double
+        auto pixel = [&](const int i_r, const int i_c){
+            return integer ? static_cast<double>(image_u8.at<uint8_t>(i_r, i_c))
+                : static_cast<double>(image.at<float>(i_r, i_c));
+        };
+        cv::Mat grad_x(rows, cols, CV_64FC1);
+        cv::Mat grad_y(rows, cols, CV_64FC1);
+        for(int i_r = 0; i_r < rows; i_r++){
+            const int prev_row = i_r == 0 ? std::min(1, rows - 1) : i_r - 1;
+            const int next_row = i_r == rows - 1 ? std::max(rows - 2, 0) : i_r + 1;
+            for(int i_c = 0; i_c < cols; i_c++){
+                grad_x.at<double>(i_r, i_c) = i_c == 0 || i_c == cols - 1 ? 0.0
+                    : pixel(i_r, i_c + 1) - pixel(i_r, i_c - 1);
+                grad_y.at<double>(i_r, i_c) = pixel(next_row, i_c) - pixel(prev_row, i_c);
+            }
+        }
+        cv::Mat sums[3];
+        for(cv::Mat& sum : sums){
+            sum.create(rows, cols, CV_64FC1);
+        }
+        for(int i_r = 0; i_r < rows; i_r++){
+            for(int i_c = 0; i_c < cols; i_c++){
+                double xx = 0.0, yy = 0.0, xy = 0.0;
+                for(int j_r = std::max(0, i_r - half_w_size);
+                    j_r <= std::min(rows - 1, i_r + half_w_size); j_r++){
+                    for(int j_c = std::max(0, i_c - half_w_size);
+                        j_c <= std::min(cols - 1, i_c + half_w_size); j_c++){
+                        const double gx = grad_x.at<double>(j_r, j_c);
+                        const double gy = grad_y.at<double>(j_r, j_c);
+                        xx += gx * gx;
+                        yy += gy * gy;
+                        xy += gx * gy;
+                    }
+                }
+                sums[0].at<double>(i_r, i_c) = xx;
+                sums[1].at<double>(i_r, i_c) = yy;
+                sums[2].at<double>(i_r, i_c) = xy;
+            }
+        }
+
+        cv::Mat expected[HarrisCorner::kNumPlanes];
+        grad_x.convertTo(expected[HarrisCorner::PLANE_GRAD_X], grad_type);
+        grad_y.convertTo(expected[HarrisCorner::PLANE_GRAD_Y], grad_type);
+        for(int i = 0; i < 3; i++){
+            sums[i].convertTo(expected[HarrisCorner::PLANE_SUM_XX + i], sum_type);
+        }
+
+        HarrisCorner reference(0.04, window_size, 1);
+        reference.calcResponse(input, expected[HarrisCorner::PLANE_RESPONSE]);
+
+        // float products and running sums are rounded, integer ones exact
+        auto check_planes = [&](const std::string& tag, const HarrisCorner& harris_corner){
+            for(int p = 0; p < HarrisCorner::kNumPlanes; p++){
+                const HarrisCorner::Plane plane = static_cast<HarrisCorner::Plane>(p);
+                const cv::Mat& kept = harris_corner.getPlane(plane);
+                const std::string name = tag + " " + HarrisCorner::planeName(plane);
+                if(kept.type() != expected[p].type()){
+                    std::cout << "[FAIL ] " << name << ": wrong type" << std::endl;
+                    ok = false;
+                }else if(integer || plane <= HarrisCorner::PLANE_GRAD_Y
+                         || plane == HarrisCorner::PLANE_RESPONSE){
+                    ok &= verifyEqual(name, kept, expected[p]);
+                }else{
+                    ok &= verifyClose(name, kept, expected[p], 1e-5);
+                }
+            }
+        };
+
+        const std::string input_tag = size_tag.str() + (integer ? " 8-bit" : " float");
+
+        HarrisCorner harris_corner(0.04, window_size, 3);
+        std::vector<HarrisCorner::Keypoint> keypoints;
+        cv::Mat response;
+
+        harris_corner.setKeptPlanes(all_planes);
+        harris_corner.calcResponse(input, response);
+        check_planes(input_tag + " calcResponse", harris_corner);
+
+        const HarrisCorner::PipelineMode modes[] = {
+            HarrisCorner::PIPELINE_PLANES, HarrisCorner::PIPELINE_STREAMING
+        };
+        for(const HarrisCorner::PipelineMode mode : modes){
+            harris_corner.setPipelineMode(mode);
+            harris_corner.detectKeypoints(input, keypoints, thresh, config.nms_window_size);
+            check_planes(input_tag + (mode == HarrisCorner::PIPELINE_PLANES ? " planes"
+                                      : " streaming") + " detectKeypoints", harris_corner);
+        }
+
+        // a response of the caller is shared, never filled later on
+        const cv::Mat response_copy = response.clone();
+        harris_corner.calcResponse(input, response);
+        harris_corner.detectKeypoints(toFloat(makeSyntheticImage(input.size(), 2)), keypoints,
+                                      thresh, config.nms_window_size);
+        ok &= verifyEqual(input_tag + " response of the caller left as it is",
+                          response, response_copy);
+
+        // only what is asked for, and the response of the incremental
+        // mode's cache
+        auto kept_mask = [&](){
+            unsigned mask = 0;
+            for(int p = 0; p < HarrisCorner::kNumPlanes; p++){
+                if(! harris_corner.getPlane(static_cast<HarrisCorner::Plane>(p)).empty()){
+                    mask |= 1u << p;
+                }
+            }
+            return mask;
+        };
+        auto check_mask = [&](const std::string& name, const unsigned expected_mask){
+            const unsigned mask = kept_mask();
+            const bool passed = mask == expected_mask;
+            std::cout << (passed ? "[  OK ] " : "[FAIL ] ") << input_tag << " " << name
+                      << ": planes " << mask << ", expected " << expected_mask << std::endl;
+            ok &= passed;
+        };
+
+        harris_corner.setKeptPlanes(HarrisCorner::planeBit(HarrisCorner::PLANE_SUM_XY));
+        harris_corner.detectKeypoints(input, keypoints, thresh, config.nms_window_size);
+        check_mask("sum_xy only", HarrisCorner::planeBit(HarrisCorner::PLANE_SUM_XY));
+
+        harris_corner.setKeptPlanes(0);
+        harris_corner.detectKeypoints(input, keypoints, thresh, config.nms_window_size);
+        check_mask("none kept", 0);
+
+        harris_corner.setKeptPlanes(all_planes);
+        harris_corner.setIncremental(true);
+        harris_corner.detectKeypoints(input, keypoints, thresh, config.nms_window_size);
+        check_mask("incremental", HarrisCorner::planeBit(HarrisCorner::PLANE_RESPONSE));
+        ok &= verifyEqual(input_tag + " incremental response",
+                          harris_corner.getPlane(HarrisCorner::PLANE_RESPONSE),
+                          expected[HarrisCorner::PLANE_RESPONSE]);
+        harris_corner.setIncremental(false);
+    }
+
+    // debug images: every third frame, at once for a newly opened
+    // window, never with every window closed
+    {
+        HarrisCorner harris_corner(0.04, window_size, 1);
+        DebugVisualizer visualizer(3);
+        cv::Mat views[HarrisCorner::kNumPlanes];
+        std::vector<HarrisCorner::Keypoint> keypoints;
+
+        const unsigned grad_x = HarrisCorner::planeBit(HarrisCorner::PLANE_GRAD_X);
+        const unsigned response = HarrisCorner::planeBit(HarrisCorner::PLANE_RESPONSE);
+        const unsigned grad_y = HarrisCorner::planeBit(HarrisCorner::PLANE_GRAD_Y);
+
+        // open planes and expected refreshes per frame
+        const unsigned open[] = {
+            grad_x | response, grad_x | response, grad_x | response, grad_x | response,
+            grad_x | response | grad_y, grad_x | response | grad_y, grad_x | response | grad_y,
+            grad_x | response | grad_y, 0, 0, 0, 0
+        };
+        const unsigned refreshed[] = {
+            grad_x | response, 0, 0, grad_x | response,
+            grad_x | response | grad_y, 0, 0, grad_x | response | grad_y, 0, 0, 0, 0
+        };
+
+        int mismatches = 0;
+        for(size_t frame_idx = 0; frame_idx < sizeof(open) / sizeof(open[0]); frame_idx++){
+            visualizer.beginFrame(harris_corner, open[frame_idx]);
+            mismatches += harris_corner.getKeptPlanes() != refreshed[frame_idx];
+            harris_corner.detectKeypoints(image_u8, keypoints, thresh, config.nms_window_size);
+            mismatches += visualizer.render(harris_corner, views) != refreshed[frame_idx];
+        }
+
+        // one per refreshed plane
+        const bool passed = mismatches == 0 && visualizer.getNumRenders() == 10;
+        std::cout << (passed ? "[  OK ] " : "[FAIL ] ") << size_tag.str()
+                  << " debug images refreshed on schedule, " << visualizer.getNumRenders()
+                  << " made" << std::endl;
+        ok &= passed;
+
+        // the last refresh, frame 7, was of the image
+        cv::Mat normalized;
+        harris_corner.setKeptPlanes(grad_x);
+        harris_corner.detectKeypoints(image_u8, keypoints, thresh, config.nms_window_size);
+        cv::normalize(harris_corner.getPlane(HarrisCorner::PLANE_GRAD_X), normalized,
+                      0.0, 255.0, cv::NORM_MINMAX, CV_8U);
+        ok &= verifyEqual(size_tag.str() + " debug image of grad_x",
+                          views[HarrisCorner::PLANE_GRAD_X], normalized);
+    }
+
+    // with a tracker that detects every fourth frame, a refresh that
+    // falls due on a tracked frame waits for the next detection, and
+    // its image is of that detection
+    {
+        HarrisCorner harris_corner(0.04, window_size, 1);
+        HarrisTracker tracker(harris_corner);
+        tracker.setDetectionInterval(4);
+        DebugVisualizer visualizer(3);
+        cv::Mat views[HarrisCorner::kNumPlanes];
+        std::vector<HarrisTracker::Track> tracks;
+        cv::Mat normalized;
+
+        const unsigned grad_x = HarrisCorner::planeBit(HarrisCorner::PLANE_GRAD_X);
+
+        int mismatches = 0;
+        int num_refreshes = 0;
+        int refresh_frame_idx = -1;
+        for(int frame_idx = 0; frame_idx < 12; frame_idx++){
+            visualizer.beginFrame(harris_corner, grad_x);
+            tracker.track(makeMovingPatchFrame(image_u8, frame_idx), tracks,
+                          thresh, config.nms_window_size);
+            const bool detected = tracker.getLastFrameDetected();
+            const bool due = detected
+                && (refresh_frame_idx < 0 || frame_idx - refresh_frame_idx >= 3);
+            mismatches += visualizer.render(harris_corner, views, detected)
+                != (due ? grad_x : 0u);
+
+            if(due){
+                refresh_frame_idx = frame_idx;
+                num_refreshes++;
+                cv::normalize(harris_corner.getPlane(HarrisCorner::PLANE_GRAD_X), normalized,
+                              0.0, 255.0, cv::NORM_MINMAX, CV_8U);
+                mismatches += ! verifyEqual(size_tag.str() + " tracked debug image of frame "
+                                            + std::to_string(frame_idx),
+                                            views[HarrisCorner::PLANE_GRAD_X], normalized);
+            }
+        }
+
+        // detections on frames 0, 4 and 8 at least
+        const bool passed = mismatches == 0 && num_refreshes >= 3;
+        std::cout << (passed ? "[  OK ] " : "[FAIL ] ") << size_tag.str()
+                  << " debug images refreshed on detection frames of a tracker, "
+                  << num_refreshes << " refresh(es), " << mismatches << " mismatch(es)"
+                  << std::endl;
+        ok &= passed;
+    }
+
+    return ok;
+}
+
+/*
+  The descriptor kernels of every ISA against the scalar ones,
+  BriefExtractor::smooth() against a direct convolution, and matching
+  of the corners of a frame against those of the same frame moved by a
+  few pixels: HammingMatcher against plain loops for each ISA and
+  setting, and most matches where the motion puts them.
+ */
+static bool verifyDescriptors(const cv::Mat& image_u8, const BenchConfig& config){
+
+    bool ok = true;
+    const std::string tag = std::to_string(image_u8.cols) + "x" + std::to_string(image_u8.rows)
+        + " descriptors";
+
+    const harris_kernels::Isa isas[] = {
+        harris_kernels::ISA_SCALAR, harris_kernels::ISA_SSE41, harris_kernels::ISA_AVX2,
+        harris_kernels::ISA_AVX512
+    };
+    const harris_kernels::KernelTable& scalar_kernels = harris_kernels::getKernels(
+        harris_kernels::ISA_SCALAR);
+
+    // kernels, on lengths that leave every tail
+    cv::RNG rng(11);
+    const int max_n = 1000;
+    cv::Mat train(max_n, HammingMatcher::kDescriptorBytes, CV_8UC1);
+    for(int i_r = 0; i_r < train.rows; i_r++){
+        for(int i_c = 0; i_c < train.cols; i_c++){
+            train.ptr<uint8_t>(i_r)[i_c] = static_cast<uint8_t>(rng.uniform(0, 256));
+        }
+    }
+    for(const harris_kernels::Isa isa : isas){
+        if(isa == harris_kernels::ISA_SCALAR || ! harris_kernels::isSupported(isa)){
+            continue;
+        }
+        const harris_kernels::KernelTable& kernels = harris_kernels::getKernels(isa);
+        int num_differing = 0;
+        for(const int n : {1, 3, 4, 17, 31, 100, max_n}){
+            std::vector<uint16_t> distances(n);
+            std::vector<uint16_t> expected(n);
+            uint8_t const * const query = train.ptr<uint8_t>(n / 2);
+            kernels.hammingDistances(query, train.ptr<uint8_t>(0), n, distances.data());
+            scalar_kernels.hammingDistances(query, train.ptr<uint8_t>(0), n, expected.data());
+            num_differing += distances != expected;
+            num_differing += kernels.argminU16(distances.data(), n)
+                != scalar_kernels.argminU16(distances.data(), n);
+
+            std::vector<uint16_t> min(n);
+            std::vector<int32_t> min_idx(n, -1);
+            for(int i = 0; i < n; i++){
+                min[i] = static_cast<uint16_t>(rng.uniform(100, 140));
+            }
+            std::vector<uint16_t> expected_min = min;
+            std::vector<int32_t> expected_min_idx = min_idx;
+            kernels.updateMinU16(distances.data(), 7, min.data(), min_idx.data(), n);
+            scalar_kernels.updateMinU16(distances.data(), 7, expected_min.data(),
+                                        expected_min_idx.data(), n);
+            num_differing += min != expected_min || min_idx != expected_min_idx;
+        }
+        std::cout << (num_differing == 0 ? "[  OK ] " : "[FAIL ] ") << tag << " "
+                  << harris_kernels::isaName(isa) << " kernels: " << num_differing
+                  << " of 21 result(s) differ from scalar" << std::endl;
+        ok &= num_differing == 0;
+    }
+
+    // smoothing, against [1 4 6 4 1] / 16 in both directions, rounded
+    BriefExtractor extractor;
+    cv::Mat smoothed;
+    {
+        extractor.setIsa(harris_kernels::ISA_SCALAR);
+        extractor.smooth(image_u8, smoothed);
+
+        const int weights[5] = {1, 4, 6, 4, 1};
+        int num_differing = 0;
+        for(int i_r = 0; i_r < image_u8.rows; i_r++){
+            for(int i_c = 0; i_c < image_u8.cols; i_c++){
+                int sum = 0;
+                for(int j = 0; j < 5; j++){
+                    const int y = cv::borderInterpolate(i_r + j - 2, image_u8.rows,
+                                                        cv::BORDER_REFLECT_101);
+                    for(int i = 0; i < 5; i++){
+                        const int x = cv::borderInterpolate(i_c + i - 2, image_u8.cols,
+                                                            cv::BORDER_REFLECT_101);
+                        sum += weights[j] * weights[i] * image_u8.ptr<uint8_t>(y)[x];
+                    }
+                }
+                num_differing += smoothed.ptr<uint8_t>(i_r)[i_c] != (sum + 128) >> 8;
+            }
+        }
+
+        std::cout << (num_differing == 0 ? "[  OK ] " : "[FAIL ] ") << tag << " smooth: "
+                  << num_differing << " pixel(s) differ from the direct filter" << std::endl;
+        ok &= num_differing == 0;
+
+        cv::Mat other;
+        cv::Mat smoothed_float;
+        cv::Mat other_float;
+        extractor.smooth(toFloat(image_u8), smoothed_float);
+        for(const harris_kernels::Isa isa : isas){
+            if(isa != harris_kernels::ISA_SCALAR && harris_kernels::isSupported(isa)){
+                const std::string isa_tag = tag + " " + harris_kernels::isaName(isa);
+                extractor.setIsa(isa);
+                extractor.smooth(image_u8, other);
+                extractor.smooth(toFloat(image_u8), other_float);
+                ok &= verifyEqual(isa_tag + " smooth (8-bit)", other, smoothed);
+                ok &= verifyEqual(isa_tag + " smooth (float)", other_float, smoothed_float);
+            }
+        }
+    }
+
+    // the frame moved by (dx, dy)
+    const int dx = 5;
+    const int dy = 3;
+    cv::Mat smoothed_shifted;
+    extractor.smooth(makeShiftedFrame(image_u8, dx, dy), smoothed_shifted);
+
+    HarrisCorner harris_corner;
+    std::vector<HarrisCorner::Keypoint> keypoints;
+    std::vector<HarrisCorner::Keypoint> keypoints_shifted;
+    const double thresh = config.threshs.front();
+    harris_corner.detectKeypoints(smoothed, keypoints, thresh, config.nms_window_size);
+    harris_corner.detectKeypoints(smoothed_shifted, keypoints_shifted, thresh,
+                                  config.nms_window_size);
+
+    cv::Mat descriptors;
+    cv::Mat descriptors_shifted;
+    extractor.compute(smoothed, keypoints, descriptors);
+    extractor.compute(smoothed_shifted, keypoints_shifted, descriptors_shifted);
+
+    {
+        HammingMatcher matcher;
+        std::vector<HammingMatcher::Match> matches;
+        int num_cases = 0;
+        int num_failed = 0;
+        for(const bool cross_check : {true, false}){
+            for(const double ratio : {HammingMatcher::kDefaultRatio, 1.0}){
+                for(const int max_distance : {HammingMatcher::kDescriptorBits, 40}){
+                    matcher.setCrossCheck(cross_check);
+                    matcher.setRatio(ratio);
+                    matcher.setMaxDistance(max_distance);
+                    const std::vector<HammingMatcher::Match> expected =
+                        matchReference(descriptors, descriptors_shifted, matcher);
+                    for(const harris_kernels::Isa isa : isas){
+                        if(! harris_kernels::isSupported(isa)){
+                            continue;
+                        }
+                        matcher.setIsa(isa);
+                        matcher.match(descriptors, descriptors_shifted, matches);
+                        bool same = matches.size() == expected.size();
+                        for(size_t i = 0; same && i < matches.size(); i++){
+                            same = matches[i].query_idx == expected[i].query_idx
+                                && matches[i].train_idx == expected[i].train_idx
+                                && matches[i].distance == expected[i].distance;
+                        }
+                        num_failed += same ? 0 : 1;
+                        num_cases++;
+                    }
+                }
+            }
+        }
+        std::cout << (num_failed == 0 ? "[  OK ] " : "[FAIL ] ") << tag
+                  << " HammingMatcher vs plain loops: " << num_failed << " of " << num_cases
+                  << " case(s) differ" << std::endl;
+        ok &= num_failed == 0;
+    }
+
+    {
+        // pairs of corners whose descriptors the moved pixels all stay
+        // in the image of: the same pixels, so the same descriptors
+        HammingMatcher matcher;
+        std::vector<HammingMatcher::Match> matches;
+        matcher.match(descriptors, descriptors_shifted, matches);
+
+        const int margin = BriefExtractor::kPatchSize / 2 + std::max(dx, dy) + 1;
+        int num_inside = 0;
+        for(const HarrisCorner::Keypoint& keypoint : keypoints){
+            num_inside += keypoint.x >= margin && keypoint.x < image_u8.cols - margin
+                && keypoint.y >= margin && keypoint.y < image_u8.rows - margin;
+        }
+        int num_correct = 0;
+        for(const HammingMatcher::Match& match : matches){
+            const HarrisCorner::Keypoint& a = keypoints[match.query_idx];
+            const HarrisCorner::Keypoint& b = keypoints_shifted[match.train_idx];
+            num_correct += b.x - a.x == dx && b.y - a.y == dy;
+        }
+        const bool passed = num_correct >= 0.95 * matches.size() && num_correct >= 0.8 * num_inside;
+        std::cout << (passed ? "[  OK ] " : "[FAIL ] ") << tag << " matching a moved frame: "
+                  << num_correct << " of " << matches.size() << " match(es) correct, of "
+                  << num_inside << " corner(s) away from the border" << std::endl;
+        ok &= passed;
+    }
+
+    return ok;
+}
+
+/*
+  Drives a LatencyGovernor with frame times of a made-up cost per level
+  and checks that it walks down under overload and back up once the
+  load is gone, that noise within its hysteresis band moves nothing,
+  and that a budget between two levels costs few decisions instead of
+  a flip every few frames.
+ */
+static bool verifyLatencyGovernor(){
+
+    bool ok = true;
+    const std::string tag = "latency governor";
+
+    LatencyGovernor governor(10.0);
+    const int num_levels = static_cast<int>(governor.getLevels().size());
+
+    auto report = [&](const std::string& name, const bool passed, const std::string& detail){
+        std::cout << (passed ? "[  OK ] " : "[FAIL ] ") << tag << " " << name << ": "
+                  << detail << std::endl;
+        ok &= passed;
+    };
+
+    // overloaded at every level: one level per step down and settle
+    int frames = 0;
+    while(governor.getLevel() < num_levels - 1 && frames < 1000){
+        governor.update(20e-3);
+        frames++;
+    }
+    const int max_frames_down = (num_levels - 1)
+        * (LatencyGovernor::kFramesToStepDown + LatencyGovernor::kSettleFrames);
+    report("overload", governor.getLevel() == num_levels - 1 && frames <= max_frames_down,
+           "level " + std::to_string(governor.getLevel()) + " after " + std::to_string(frames)
+           + " frames");
+
+    // idle: back up, no faster than a hold per level
+    frames = 0;
+    while(governor.getLevel() > 0 && frames < 10000){
+        governor.update(3e-3);
+        frames++;
+    }
+    report("idle", governor.getLevel() == 0
+           && frames >= (num_levels - 1) * LatencyGovernor::kFramesToStepUp,
+           "level 0 after " + std::to_string(frames) + " frames");
+
+    // noise between the step-up fraction and the budget
+    governor.reset();
+    uint32_t state = 12345;
+    for(int i = 0; i < 2000; i++){
+        state = state * 1664525u + 1013904223u;
+        governor.update((7.5 + 2.0 * (state >> 8) / 16777216.0) * 1e-3);
+    }
+    report("noise", governor.getNumDecisions() == 0,
+           std::to_string(governor.getNumDecisions()) + " decision(s) in 2000 frames");
+
+    // level 0 over the budget and level 1 well under it
+    governor.reset();
+    for(int i = 0; i < 2000; i++){
+        governor.update(governor.getLevel() == 0 ? 12e-3 : 6e-3);
+    }
+    report("budget between levels", governor.getNumDecisions() <= 20
+           && governor.getFramesAtLevel(0) <= 100,
+           std::to_string(governor.getNumDecisions()) + " decision(s), "
+           + std::to_string(governor.getFramesAtLevel(0)) + " of 2000 frames over budget");
+
+    return ok;
+}
+
+static bool runVerification(const BenchConfig& config){
+
+    bool ok = true;
+
+    const int max_threads = std::max(2u, std::thread::hardware_concurrency());
+    const int thread_counts[] = {2, 3, max_threads};
+    const harris_kernels::Isa isas[] = {
+        harris_kernels::ISA_SCALAR, harris_kernels::ISA_SSE41, harris_kernels::ISA_AVX2,
+        harris_kernels::ISA_AVX512
+    };
+
+    ok &= verifyLatencyGovernor();
+
+    for(const cv::Size& size : config.sizes){
+
+        const cv::Mat image_u8 = makeSyntheticImage(size);
+        const cv::Mat image = toFloat(image_u8);
+
+        ok &= verifyRawFrameFile(image_u8);
+        ok &= verifyAdaptiveNms(image, config);
+        ok &= verifyDescriptors(image_u8, config);
+        ok &= verifyKeptPlanes(image_u8, config);
+
+        for(const int window_size : config.window_sizes){
+
+            std::ostringstream tag;
+            tag << size.width << "x" << size.height << " w" << window_size;
+
+            HarrisCorner reference(0.04, window_size, 1);
+            reference.setIsa(harris_kernels::ISA_SCALAR);
+
+            cv::Mat reference_response;
+            reference.calcResponse(image, reference_response);
+
+            cv::Mat reference_response_u8;
+            reference.calcResponse(image_u8, reference_response_u8);
+
+            // the 8-bit path against the float one on a few images
+            for(uint64_t seed = 1; seed <= 4; seed++){
+
+                const std::string seed_tag = tag.str() + " image " + std::to_string(seed);
+                const cv::Mat corpus_image_u8 = makeSyntheticImage(size, seed);
+                const cv::Mat corpus_image = toFloat(corpus_image_u8);
+
+                cv::Mat response;
+                cv::Mat response_u8;
+                reference.calcResponse(corpus_image, response);
+                reference.calcResponse(corpus_image_u8, response_u8);
+                ok &= verifyClose(seed_tag + " 8-bit response vs float", response_u8, response,
+                                  1e-5);
+
+                // thresholds relative to the strongest corner, so that
+                // every image has corners to compare
+                double max_response = 0.0;
+                cv::minMaxLoc(response, nullptr, &max_response);
+
+                for(const double relative_thresh : {0.01, 0.1, 0.5}){
+                    const double thresh = relative_thresh * max_response;
+                    cv::Mat mask;
+                    cv::Mat mask_u8;
+                    reference.detectCorners(corpus_image, mask, thresh, config.nms_window_size);
+                    reference.detectCorners(corpus_image_u8, mask_u8, thresh,
+                                            config.nms_window_size);
+                    ok &= verifyAgreement(seed_tag + " thresh " + std::to_string(relative_thresh)
+                                          + " of max, 8-bit corners vs float",
+                                          mask_u8, mask, response, thresh,
+                                          config.nms_window_size, 1e-5);
+                }
+            }
+
+            // The other responses against det and trace recovered from
+            // Harris responses with k = 0 and k = 1, which are det and
+            // det - trace^2
+            {
+                HarrisCorner harris(0.0, window_size, 1);
+                harris.setIsa(harris_kernels::ISA_SCALAR);
+
+                cv::Mat det;
+                cv::Mat det_minus_trace2;
+                harris.calcResponse(image, det);
+                harris.setK(1.0);
+                harris.calcResponse(image, det_minus_trace2);
+
+                cv::Mat expected[harris_kernels::kNumResponses];
+                expected[harris_kernels::RESPONSE_SHI_TOMASI].create(image.size(), CV_32FC1);
+                expected[harris_kernels::RESPONSE_NOBLE].create(image.size(), CV_32FC1);
+                for(int i_r = 0; i_r < image.rows; i_r++){
+                    for(int i_c = 0; i_c < image.cols; i_c++){
+                        const double d = det.at<float>(i_r, i_c);
+                        const double t = std::sqrt(std::max(
+                            0.0, d - det_minus_trace2.at<float>(i_r, i_c)));
+                        expected[harris_kernels::RESPONSE_SHI_TOMASI].at<float>(i_r, i_c) =
+                            static_cast<float>(0.5 * t - std::sqrt(std::max(0.0, 0.25 * t * t - d)));
+                        expected[harris_kernels::RESPONSE_NOBLE].at<float>(i_r, i_c) =
+                            static_cast<float>(d / (t + harris_kernels::kNobleEpsilon));
+                    }
+                }
+
+                for(int r = 1; r < harris_kernels::kNumResponses; r++){
+                    const harris_kernels::Response response_type =
+                        static_cast<harris_kernels::Response>(r);
+                    reference.setResponseType(response_type);
+                    cv::Mat response;
+                    cv::Mat response_u8;
+                    reference.calcResponse(image, response);
+                    reference.calcResponse(image_u8, response_u8);
+                    reference.setResponseType(harris_kernels::RESPONSE_HARRIS);
+
+                    const std::string response_tag = tag.str() + " "
+                        + harris_kernels::responseName(response_type);
+                    // the recovered trace loses digits to the subtraction
+                    ok &= verifyClose(response_tag + " response vs det and trace",
+                                      response, expected[r], 1e-4);
+                    ok &= verifyClose(response_tag + " 8-bit response vs float",
+                                      response_u8, response, 1e-5);
+                }
+            }
+
+            // every specialized NMS window size, and the first generic one
+            if(! config.threshs.empty()){
+
+                const double thresh = config.threshs.front();
+
+                for(int h = 0; h <= harris_kernels::kNumWindowMaxKernels; h++){
+
+                    const std::string nms_tag = tag.str() + " nms window " + std::to_string(2 * h + 1);
+
+                    cv::Mat naive_mask;
+                    HarrisCorner::nonMaximumSuppression(reference_response, naive_mask, thresh,
+                                                        2 * h + 1, HarrisCorner::NMS_NAIVE);
+                    cv::Mat mask;
+                    HarrisCorner::nonMaximumSuppression(reference_response, mask, thresh,
+                                                        2 * h + 1, HarrisCorner::NMS_SEPARABLE);
+                    ok &= verifyEqual(nms_tag + " separable vs naive NMS", mask, naive_mask);
+
+                    if(h == harris_kernels::kNumWindowMaxKernels){
+                        continue;
+                    }
+
+                    cv::Mat scalar_row_max(reference_response.size(), CV_32FC1);
+                    for(int i_r = 0; i_r < reference_response.rows; i_r++){
+                        harris_kernels::getScalarKernels()->windowMaxRow[h](
+                            reference_response.ptr<float>(i_r), scalar_row_max.ptr<float>(i_r),
+                            reference_response.cols);
+                    }
+
+                    for(const harris_kernels::Isa isa : isas){
+                        if(isa == harris_kernels::ISA_SCALAR || ! harris_kernels::isSupported(isa)){
+                            continue;
+                        }
+                        cv::Mat row_max(reference_response.size(), CV_32FC1);
+                        for(int i_r = 0; i_r < reference_response.rows; i_r++){
+                            harris_kernels::getKernels(isa).windowMaxRow[h](
+                                reference_response.ptr<float>(i_r), row_max.ptr<float>(i_r),
+                                reference_response.cols);
+                        }
+                        ok &= verifyEqual(nms_tag + " " + harris_kernels::isaName(isa)
+                                          + " row max vs scalar", row_max, scalar_row_max);
+                    }
+                }
+            }
+
+            // incremental detection over frames with a moving patch,
+            // against a full recompute of each
+            if(! config.threshs.empty()){
+
+                const double thresh = config.threshs.front();
+
+                HarrisCorner full(0.04, window_size, 1);
+                HarrisCorner incremental(0.04, window_size, max_threads);
+                HarrisCorner incremental_u8(0.04, window_size, max_threads);
+                incremental.setIncremental(true);
+                incremental_u8.setIncremental(true);
+
+                for(int frame_idx = 0; frame_idx < 6; frame_idx++){
+
+                    // frame 3 repeats frame 2
+                    const cv::Mat frame_u8 = makeMovingPatchFrame(image_u8, std::min(frame_idx, 2)
+                                                                  + std::max(0, frame_idx - 3));
+                    const cv::Mat frame = toFloat(frame_u8);
+                    const std::string frame_tag = tag.str() + " incremental frame "
+                        + std::to_string(frame_idx);
+
+                    cv::Mat full_mask;
+                    cv::Mat mask;
+                    full.detectCorners(frame, full_mask, thresh, config.nms_window_size);
+                    incremental.detectCorners(frame, mask, thresh, config.nms_window_size);
+                    ok &= verifyEqual(frame_tag + " corners vs full", mask, full_mask);
+
+                    if(frame_idx == 3 && incremental.getDirtyTileFraction() != 0.0){
+                        std::cout << "[FAIL ] " << frame_tag << ": unchanged frame recomputed "
+                                  << incremental.getDirtyTileFraction() << " of the tiles"
+                                  << std::endl;
+                        ok = false;
+                    }
+
+                    std::vector<HarrisCorner::Keypoint> full_keypoints;
+                    std::vector<HarrisCorner::Keypoint> keypoints;
+                    full.setSubpixelRefinement(true);
+                    incremental.setSubpixelRefinement(true);
+                    full.detectKeypoints(frame, full_keypoints, thresh, config.nms_window_size);
+                    incremental.detectKeypoints(frame, keypoints, thresh, config.nms_window_size);
+                    ok &= verifyEqual(frame_tag + " sub-pixel keypoints vs full",
+                                      toMat(keypoints), toMat(full_keypoints));
+                    full.setSubpixelRefinement(false);
+                    incremental.setSubpixelRefinement(false);
+
+                    full.detectCorners(frame_u8, full_mask, thresh, config.nms_window_size);
+                    incremental_u8.detectCorners(frame_u8, mask, thresh, config.nms_window_size);
+                    ok &= verifyEqual(frame_tag + " 8-bit corners vs full", mask, full_mask);
+                }
+            }
+
+            // tracking of corners that stand out of the noise, in a scene
+            // panning by a pixel per frame
+            {
+                double max_response = 0.0;
+                cv::minMaxLoc(reference_response, nullptr, &max_response);
+
+                const double thresh = 0.01 * max_response;
+                const int num_frames = 6;
+                const std::string track_tag = tag.str() + " tracking";
+
+                std::vector<cv::Mat> frames;
+                for(int frame_idx = 0; frame_idx < num_frames; frame_idx++){
+                    frames.push_back(toFloat(makeShiftedFrame(image_u8, frame_idx, 0)));
+                }
+
+                HarrisCorner detector(0.04, window_size, 1);
+                HarrisCorner detector_threads(0.04, window_size, max_threads);
+                HarrisTracker tracker(detector);
+                HarrisTracker tracker_threads(detector_threads);
+
+                std::vector<HarrisTracker::Track> tracks;
+                std::vector<HarrisTracker::Track> tracks_threads;
+                std::vector<HarrisTracker::Track> first_tracks;
+                std::vector<HarrisCorner::Keypoint> keypoints;
+                std::vector<HarrisCorner::Keypoint> keypoints_threads;
+
+                for(int frame_idx = 0; frame_idx < num_frames; frame_idx++){
+
+                    const std::string frame_tag = track_tag + " frame " + std::to_string(frame_idx);
+
+                    tracker.track(frames[frame_idx], tracks, thresh, config.nms_window_size);
+                    tracker_threads.track(frames[frame_idx], tracks_threads, thresh,
+                                          config.nms_window_size);
+
+                    keypoints.clear();
+                    keypoints_threads.clear();
+                    for(size_t i = 0; i < tracks.size(); i++){
+                        keypoints.push_back(tracks[i].keypoint);
+                    }
+                    for(size_t i = 0; i < tracks_threads.size(); i++){
+                        keypoints_threads.push_back(tracks_threads[i].keypoint);
+                    }
+                    ok &= verifyEqual(frame_tag + " " + std::to_string(max_threads)
+                                      + " threads vs 1", toMat(keypoints_threads), toMat(keypoints));
+
+                    // detection on the first and the sixth frame only
+                    if(tracker.getLastFrameDetected() != (frame_idx % 5 == 0)){
+                        std::cout << "[FAIL ] " << frame_tag << ": detected "
+                                  << tracker.getLastFrameDetected() << std::endl;
+                        ok = false;
+                    }
+
+                    if(frame_idx == 0){
+                        first_tracks = tracks;
+                        continue;
+                    }
+                    if(frame_idx == 5){
+                        continue;
+                    }
+
+                    // corners away from the replicated border move with the scene
+                    int num_expected = 0;
+                    int num_tracked = 0;
+                    int num_wrong = 0;
+                    size_t i = 0;
+                    for(const HarrisTracker::Track& first : first_tracks){
+                        const float margin = 16.0f;
+                        const bool expected = first.keypoint.x >= margin && first.keypoint.y >= margin
+                            && first.keypoint.x + frame_idx < image.cols - margin
+                            && first.keypoint.y < image.rows - margin;
+                        while(i < tracks.size() && tracks[i].id < first.id){
+                            i++;
+                        }
+                        const bool tracked = i < tracks.size() && tracks[i].id == first.id;
+                        num_expected += expected;
+                        num_tracked += expected && tracked;
+                        if(expected && tracked
+                           && (std::abs(tracks[i].keypoint.x - (first.keypoint.x + frame_idx)) > 0.05f
+                               || std::abs(tracks[i].keypoint.y - first.keypoint.y) > 0.05f)){
+                            num_wrong++;
+                        }
+                    }
+
+                    // a few may settle on a neighbouring structure of the
+                    // cluttered synthetic scene and still match their patch
+                    const bool frame_ok = num_wrong <= 0.01 * num_tracked
+                        && num_tracked >= 0.9 * num_expected;
+                    std::cout << (frame_ok ? "[  OK ] " : "[FAIL ] ") << frame_tag << ": "
+                              << num_tracked << " of " << num_expected << " corners tracked, "
+                              << num_wrong << " off the scene motion" << std::endl;
+                    ok &= frame_ok;
+                }
+            }
+
+            // the batch API in both kinds of parallelism against one
+            // frame at a time, over the same frames as above
+            if(! config.threshs.empty()){
+
+                const double thresh = config.threshs.front();
+
+                HarrisCorner single(0.04, window_size, 1);
+                single.setSubpixelRefinement(true);
+
+                std::vector<cv::Mat> frames;
+                std::vector<std::vector<HarrisCorner::Keypoint> > expected(7);
+                for(int frame_idx = 0; frame_idx < 7; frame_idx++){
+                    frames.push_back(toFloat(makeMovingPatchFrame(image_u8, frame_idx)));
+                    single.detectKeypoints(frames.back(), expected[frame_idx], thresh,
+                                           config.nms_window_size);
+                }
+
+                const HarrisBatchDetector::Parallelism parallelisms[] = {
+                    HarrisBatchDetector::PARALLEL_FRAMES, HarrisBatchDetector::PARALLEL_TILES
+                };
+
+                for(const HarrisBatchDetector::Parallelism parallelism : parallelisms){
+
+                    const std::string batch_tag = tag.str() + " batch "
+                        + (parallelism == HarrisBatchDetector::PARALLEL_TILES ? "tiles" : "frames");
+
+                    HarrisBatchDetector batch_detector(0.04, window_size, 3);
+                    batch_detector.setSubpixelRefinement(true);
+                    batch_detector.setParallelism(parallelism);
+
+                    std::vector<std::vector<HarrisCorner::Keypoint> > keypoints;
+                    batch_detector.detectKeypoints(frames, keypoints, thresh,
+                                                   config.nms_window_size);
+
+                    for(int frame_idx = 0; frame_idx < 7; frame_idx++){
+                        ok &= verifyEqual(batch_tag + " frame " + std::to_string(frame_idx)
+                                          + " keypoints vs single", toMat(keypoints[frame_idx]),
+                                          toMat(expected[frame_idx]));
+                    }
+
+                    // 7 frames do not fill a whole number of batches
+                    int next_frame = 0;
+                    int next_result = 0;
+                    batch_detector.detectKeypoints(
+                        [&](cv::Mat& frame){
+                            if(next_frame == 7){
+                                return false;
+                            }
+                            frames[next_frame++].copyTo(frame);
+                            return true;
+                        },
+                        [&](const int frame_idx, const cv::Mat&,
+                            const std::vector<HarrisCorner::Keypoint>& frame_keypoints){
+                            if(frame_idx != next_result){
+                                std::cout << "[FAIL ] " << batch_tag << ": frame " << frame_idx
+                                          << " delivered in place of " << next_result << std::endl;
+                                ok = false;
+                            }
+                            ok &= verifyEqual(batch_tag + " source frame " + std::to_string(frame_idx)
+                                              + " keypoints vs single", toMat(frame_keypoints),
+                                              toMat(expected[std::min(frame_idx, 6)]));
+                            next_result++;
+                        },
+                        thresh, config.nms_window_size);
+
+                    if(next_result != 7){
+                        std::cout << "[FAIL ] " << batch_tag << ": " << next_result
+                                  << " of 7 frames delivered" << std::endl;
+                        ok = false;
+                    }
+                }
+
+                {
+                    // three streams of the same frames on one scheduler,
+                    // split into tiles that start anywhere, the last with
+                    // a selection
+                    const std::string multi_tag = tag.str() + " multi-stream";
+                    const int num_streams = 3;
+                    const int tile_rows = 29;
+
+                    HarrisCorner::KeypointSelection selection;
+                    selection.max_corners = 50;
+                    selection.grid_cols = 4;
+                    selection.grid_rows = 3;
+                    selection.max_corners_per_cell = 8;
+
+                    std::vector<std::vector<HarrisCorner::Keypoint> > expected_selected(7);
+                    for(int frame_idx = 0; frame_idx < 7; frame_idx++){
+                        single.detectKeypoints(frames[frame_idx], expected_selected[frame_idx],
+                                               thresh, config.nms_window_size, selection);
+                    }
+
+                    MultiStreamDetector multi_detector(0.04, window_size, 3);
+                    multi_detector.setSubpixelRefinement(true);
+                    multi_detector.setTileRows(tile_rows);
+
+                    std::mutex mutex;
+                    std::vector<std::vector<std::vector<HarrisCorner::Keypoint> > >
+                        keypoints(num_streams, std::vector<std::vector<HarrisCorner::Keypoint> >(7));
+                    std::vector<int> num_delivered(num_streams, 0);
+
+                    const MultiStreamDetector::KeypointSink sink =
+                        [&](const int stream_idx, const long frame_idx, const cv::Mat&,
+                            const std::vector<HarrisCorner::Keypoint>& frame_keypoints){
+                        std::lock_guard<std::mutex> lock(mutex);
+                        keypoints[stream_idx][frame_idx] = frame_keypoints;
+                        num_delivered[stream_idx]++;
+                    };
+
+                    for(int frame_idx = 0; frame_idx < 7; frame_idx++){
+                        for(int stream_idx = 0; stream_idx < num_streams; stream_idx++){
+                            multi_detector.submit(stream_idx, frames[frame_idx], thresh,
+                                                  config.nms_window_size, sink,
+                                                  stream_idx == num_streams - 1
+                                                  ? selection : HarrisCorner::KeypointSelection());
+                        }
+                    }
+                    multi_detector.waitIdle();
+
+                    const int rows = frames[0].rows;
+                    const int num_tiles = rows >= 2 * tile_rows
+                        ? (rows + tile_rows - 1) / tile_rows : 1;
+
+                    for(int stream_idx = 0; stream_idx < num_streams; stream_idx++){
+
+                        const std::string stream_tag = multi_tag + " stream "
+                            + std::to_string(stream_idx);
+                        const bool selected = stream_idx == num_streams - 1;
+
+                        for(int frame_idx = 0; frame_idx < 7; frame_idx++){
+                            ok &= verifyEqual(stream_tag + " frame " + std::to_string(frame_idx)
+                                              + " keypoints vs single",
+                                              toMat(keypoints[stream_idx][frame_idx]),
+                                              toMat(selected ? expected_selected[frame_idx]
+                                                    : expected[frame_idx]));
+                        }
+
+                        const MultiStreamDetector::StreamStats stats =
+                            multi_detector.getStreamStats(stream_idx);
+                        const WorkStealingScheduler::StreamStats task_stats =
+                            multi_detector.getScheduler().getStreamStats(stream_idx);
+                        if(num_delivered[stream_idx] != 7 || stats.num_frames != 7
+                           || stats.num_dropped != 0 || task_stats.num_tasks != 7 * num_tiles){
+                            std::cout << "[FAIL ] " << stream_tag << ": " << num_delivered[stream_idx]
+                                      << " of 7 frames delivered, " << stats.num_frames
+                                      << " counted, " << stats.num_dropped << " dropped, "
+                                      << task_stats.num_tasks << " of " << 7 * num_tiles
+                                      << " tasks run" << std::endl;
+                            ok = false;
+                        }
+                    }
+
+                    // a burst on a stream that takes one frame at a time
+                    // drops what does not fit, and delivers the rest right
+                    multi_detector.setMaxFramesInFlight(1);
+                    multi_detector.resetStats();
+
+                    std::vector<std::pair<long, std::vector<HarrisCorner::Keypoint> > > burst;
+                    const MultiStreamDetector::KeypointSink burst_sink =
+                        [&](const int, const long frame_idx, const cv::Mat&,
+                            const std::vector<HarrisCorner::Keypoint>& frame_keypoints){
+                        std::lock_guard<std::mutex> lock(mutex);
+                        burst.push_back(std::make_pair(frame_idx, frame_keypoints));
+                    };
+
+                    int num_accepted = 0;
+                    for(int frame_idx = 0; frame_idx < 7; frame_idx++){
+                        num_accepted += multi_detector.trySubmit(0, frames[frame_idx], thresh,
+                                                                 config.nms_window_size,
+                                                                 burst_sink);
+                    }
+                    multi_detector.waitIdle();
+
+                    const MultiStreamDetector::StreamStats stats = multi_detector.getStreamStats(0);
+                    if(num_accepted < 1 || static_cast<int>(burst.size()) != num_accepted
+                       || stats.num_frames != num_accepted
+                       || stats.num_dropped != 7 - num_accepted){
+                        std::cout << "[FAIL ] " << multi_tag << " burst: " << num_accepted
+                                  << " of 7 frames accepted, " << burst.size() << " delivered, "
+                                  << stats.num_dropped << " dropped" << std::endl;
+                        ok = false;
+                    }
+
+                    // frame indices count on from the first round
+                    for(const auto& frame_result : burst){
+                        const long frame_idx = frame_result.first - 7;
+                        if(frame_idx < 0 || frame_idx >= 7){
+                            std::cout << "[FAIL ] " << multi_tag << " burst: frame index "
+                                      << frame_result.first << std::endl;
+                            ok = false;
+                            continue;
+                        }
+                        ok &= verifyEqual(multi_tag + " burst frame " + std::to_string(frame_idx)
+                                          + " keypoints vs single", toMat(frame_result.second),
+                                          toMat(expected[frame_idx]));
+                    }
+                }
+            }
+
+            for(const harris_kernels::Isa isa : isas){
+
+                if(! harris_kernels::isSupported(isa)){
+                    std::cout << "[ SKIP] " << harris_kernels::isaName(isa)
+                              << " not supported" << std::endl;
+                    continue;
+                }
+
+                const std::string isa_tag = tag.str() + " " + harris_kernels::isaName(isa);
+
+                HarrisCorner single(0.04, window_size, 1);
+                single.setIsa(isa);
+
+                cv::Mat single_response;
+                single.calcResponse(image, single_response);
+                if(isa != harris_kernels::ISA_SCALAR){
+                    ok &= verifyClose(isa_tag + " response vs scalar",
+                                      single_response, reference_response, 1e-4);
+                }
+
+                // integer sums are exact, so the 8-bit path matches bit for bit
+                cv::Mat single_response_u8;
+                single.calcResponse(image_u8, single_response_u8);
+                if(isa != harris_kernels::ISA_SCALAR){
+                    ok &= verifyEqual(isa_tag + " 8-bit response vs scalar",
+                                      single_response_u8, reference_response_u8);
+                }
+
+                // every response from one pass is the one of its own pass,
+                // for every combination, and the same on every ISA
+                for(unsigned mask = 1; mask < harris_kernels::kNumResponseMasks; mask++){
+
+                    std::vector<cv::Mat> responses;
+                    std::vector<cv::Mat> responses_u8;
+                    single.calcResponses(image, mask, responses);
+                    single.calcResponses(image_u8, mask, responses_u8);
+
+                    for(int r = 0; r < harris_kernels::kNumResponses; r++){
+
+                        const harris_kernels::Response response_type =
+                            static_cast<harris_kernels::Response>(r);
+                        if(! (mask & harris_kernels::responseBit(response_type))){
+                            continue;
+                        }
+
+                        const std::string response_tag = isa_tag + " responses "
+                            + std::to_string(mask) + " " + harris_kernels::responseName(response_type);
+
+                        cv::Mat response;
+                        cv::Mat response_u8;
+                        single.setResponseType(response_type);
+                        single.calcResponse(image, response);
+                        single.calcResponse(image_u8, response_u8);
+                        single.setResponseType(harris_kernels::RESPONSE_HARRIS);
+
+                        ok &= verifyEqual(response_tag + " vs calcResponse",
+                                          responses[r], response);
+                        ok &= verifyEqual(response_tag + " 8-bit vs calcResponse",
+                                          responses_u8[r], response_u8);
+
+                        if(isa != harris_kernels::ISA_SCALAR
+                           && mask == harris_kernels::responseBit(response_type)){
+                            cv::Mat scalar_response;
+                            cv::Mat scalar_response_u8;
+                            reference.setResponseType(response_type);
+                            reference.calcResponse(image, scalar_response);
+                            reference.calcResponse(image_u8, scalar_response_u8);
+                            reference.setResponseType(harris_kernels::RESPONSE_HARRIS);
+                            ok &= verifyClose(response_tag + " vs scalar", response,
+                                              scalar_response, 1e-4);
+                            ok &= verifyEqual(response_tag + " 8-bit vs scalar", response_u8,
+                                              scalar_response_u8);
+                        }
+                    }
+                }
+
+                for(const int num_threads : thread_counts){
+
+                    HarrisCorner multi(0.04, window_size, num_threads);
+                    multi.setIsa(isa);
+
+                    cv::Mat response;
+                    multi.calcResponse(image, response);
+                    ok &= verifyEqual(isa_tag + " response " + std::to_string(num_threads)
+                                      + " threads vs 1", response, single_response);
+
+                    multi.calcResponse(image_u8, response);
+                    ok &= verifyEqual(isa_tag + " 8-bit response " + std::to_string(num_threads)
+                                      + " threads vs 1", response, single_response_u8);
+                }
+
+                for(const double thresh : config.threshs){
+
+                    const std::string thresh_tag = isa_tag + " thresh "
+                        + std::to_string(thresh);
+
+                    cv::Mat naive_mask;
+                    HarrisCorner::nonMaximumSuppression(single_response, naive_mask, thresh,
+                                                        config.nms_window_size,
+                                                        HarrisCorner::NMS_NAIVE);
+
+                    cv::Mat mask;
+                    HarrisCorner::nonMaximumSuppression(single_response, mask, thresh,
+                                                        config.nms_window_size,
+                                                        HarrisCorner::NMS_SEPARABLE);
+                    ok &= verifyEqual(thresh_tag + " separable vs naive NMS", mask, naive_mask);
+
+                    HarrisCorner detector(0.04, window_size, max_threads);
+                    detector.setIsa(isa);
+
+                    detector.setPipelineMode(HarrisCorner::PIPELINE_PLANES);
+                    detector.detectCorners(image, mask, thresh, config.nms_window_size);
+                    ok &= verifyEqual(thresh_tag + " planes pipeline vs naive NMS",
+                                      mask, naive_mask);
+
+                    detector.setPipelineMode(HarrisCorner::PIPELINE_STREAMING);
+                    detector.detectCorners(image, mask, thresh, config.nms_window_size);
+                    ok &= verifyEqual(thresh_tag + " streaming pipeline vs naive NMS",
+                                      mask, naive_mask);
+
+                    HarrisCorner::nonMaximumSuppression(single_response_u8, naive_mask, thresh,
+                                                        config.nms_window_size,
+                                                        HarrisCorner::NMS_NAIVE);
+
+                    detector.setPipelineMode(HarrisCorner::PIPELINE_PLANES);
+                    detector.detectCorners(image_u8, mask, thresh, config.nms_window_size);
+                    ok &= verifyEqual(thresh_tag + " 8-bit planes pipeline vs naive NMS",
+                                      mask, naive_mask);
+
+                    detector.setPipelineMode(HarrisCorner::PIPELINE_STREAMING);
+                    detector.detectCorners(image_u8, mask, thresh, config.nms_window_size);
+                    ok &= verifyEqual(thresh_tag + " 8-bit streaming pipeline vs naive NMS",
+                                      mask, naive_mask);
+
+                    std::vector<HarrisCorner::Keypoint> single_keypoints;
+                    std::vector<HarrisCorner::Keypoint> multi_keypoints;
+                    single.detectKeypointsMultiScale(image, single_keypoints, thresh,
+                                                     config.nms_window_size, config.num_levels);
+                    detector.detectKeypointsMultiScale(image, multi_keypoints, thresh,
+                                                       config.nms_window_size, config.num_levels);
+                    ok &= verifyEqual(thresh_tag + " multi-scale " + std::to_string(max_threads)
+                                      + " threads vs 1",
+                                      toMat(multi_keypoints), toMat(single_keypoints));
+
+                    single.setSubpixelRefinement(true);
+                    detector.setSubpixelRefinement(true);
+                    single.detectKeypoints(image, single_keypoints, thresh,
+                                           config.nms_window_size);
+
+                    detector.setPipelineMode(HarrisCorner::PIPELINE_PLANES);
+                    detector.detectKeypoints(image, multi_keypoints, thresh,
+                                             config.nms_window_size);
+                    ok &= verifyEqual(thresh_tag + " planes sub-pixel keypoints "
+                                      + std::to_string(max_threads) + " threads vs 1",
+                                      toMat(multi_keypoints), toMat(single_keypoints));
+
+                    detector.setPipelineMode(HarrisCorner::PIPELINE_STREAMING);
+                    detector.detectKeypoints(image, multi_keypoints, thresh,
+                                             config.nms_window_size);
+                    ok &= verifyEqual(thresh_tag + " streaming sub-pixel keypoints "
+                                      + std::to_string(max_threads) + " threads vs 1",
+                                      toMat(multi_keypoints), toMat(single_keypoints));
+
+                    single.setSubpixelRefinement(false);
+                }
+
+                {  // steady state must not allocate
+                    HarrisCorner detector(0.04, window_size, max_threads);
+                    detector.setIsa(isa);
+
+                    const double thresh = config.threshs.front();
+                    cv::Mat response;
+                    cv::Mat mask;
+                    std::vector<HarrisCorner::Keypoint> keypoints;
+                    HarrisCorner::KeypointSelection selection;
+                    selection.grid_cols = 4;
+                    selection.grid_rows = 3;
+                    selection.max_corners_per_cell = 50;
+                    selection.max_corners = 300;
+
+                    ok &= verifyNoAllocation(isa_tag + " calcResponse", detector, [&](){
+                            detector.calcResponse(image, response);
+                        });
+                    HarrisCorner::NmsContext nms_context;
+                    ok &= verifyNoAllocation(isa_tag + " nonMaximumSuppression", nms_context, [&](){
+                            HarrisCorner::nonMaximumSuppression(
+                                response, mask, thresh, config.nms_window_size,
+                                HarrisCorner::NMS_SEPARABLE, &detector.getThreadPool(),
+                                &nms_context);
+                        });
+
+                    const HarrisCorner::PipelineMode modes[] = {
+                        HarrisCorner::PIPELINE_PLANES, HarrisCorner::PIPELINE_STREAMING
+                    };
+                    for(const HarrisCorner::PipelineMode mode : modes){
+
+                        const std::string mode_tag = isa_tag
+                            + (mode == HarrisCorner::PIPELINE_PLANES ? " planes" : " streaming");
+
+                        detector.setPipelineMode(mode);
+
+                        ok &= verifyNoAllocation(mode_tag + " detectCorners", detector, [&](){
+                                detector.detectCorners(image, mask, thresh,
+                                                       config.nms_window_size);
+                            });
+                        ok &= verifyNoAllocation(mode_tag + " detectKeypoints", detector, [&](){
+                                detector.detectKeypoints(image, keypoints, thresh,
+                                                         config.nms_window_size, selection);
+                            });
+
+                        ok &= verifyNoAllocation(mode_tag + " detectKeypoints adaptive NMS",
+                                                 detector, [&](){
+                                HarrisCorner::KeypointSelection adaptive_selection = selection;
+                                adaptive_selection.adaptive_nms = true;
+                                detector.detectKeypoints(image, keypoints, thresh,
+                                                         config.nms_window_size,
+                                                         adaptive_selection);
+                            });
+
+                        ok &= verifyNoAllocation(mode_tag + " 8-bit detectKeypoints", detector, [&](){
+                                detector.detectKeypoints(image_u8, keypoints, thresh,
+                                                         config.nms_window_size, selection);
+                            });
+
+                        detector.setSubpixelRefinement(true);
+                        ok &= verifyNoAllocation(mode_tag + " detectKeypoints sub-pixel",
+                                                 detector, [&](){
+                                detector.detectKeypoints(image, keypoints, thresh,
+                                                         config.nms_window_size, selection);
+                            });
+                        detector.setSubpixelRefinement(false);
+
+                        detector.setKeptPlanes((1u << HarrisCorner::kNumPlanes) - 1);
+                        ok &= verifyNoAllocation(mode_tag + " detectKeypoints kept planes",
+                                                 detector, [&](){
+                                detector.detectKeypoints(image, keypoints, thresh,
+                                                         config.nms_window_size, selection);
+                            });
+                        detector.setKeptPlanes(0);
+                    }
+
+                    {
+                        const cv::Mat frames[] = {
+                            toFloat(makeMovingPatchFrame(image_u8, 1)),
+                            toFloat(makeMovingPatchFrame(image_u8, 2))
+                        };
+                        int frame_idx = 0;
+
+                        detector.setIncremental(true);
+                        detector.setSubpixelRefinement(true);
+                        ok &= verifyNoAllocation(isa_tag + " incremental detectKeypoints",
+                                                 detector, [&](){
+                                detector.detectKeypoints(frames[frame_idx++ % 2], keypoints,
+                                                         thresh, config.nms_window_size,
+                                                         selection);
+                            });
+                        detector.setSubpixelRefinement(false);
+                        detector.setIncremental(false);
+                    }
+
+                    {
+                        const cv::Mat frames[] = {
+                            toFloat(makeShiftedFrame(image_u8, 0, 0)),
+                            toFloat(makeShiftedFrame(image_u8, 1, 1))
+                        };
+                        int frame_idx = 0;
+
+                        // detections always on the first frame
+                        HarrisTracker tracker(detector);
+                        tracker.setDetectionInterval(4);
+                        std::vector<HarrisTracker::Track> tracks;
+                        ok &= verifyNoAllocation(isa_tag + " HarrisTracker::track", detector, [&](){
+                                tracker.track(frames[frame_idx++ % 2], tracks, thresh,
+                                              config.nms_window_size, selection);
+                            });
+                    }
+
+                    ok &= verifyNoAllocation(isa_tag + " detectKeypointsMultiScale", detector, [&](){
+                            detector.detectKeypointsMultiScale(image, keypoints, thresh,
+                                                               config.nms_window_size,
+                                                               config.num_levels, selection);
+                        });
+
+                    detector.setSubpixelRefinement(true);
+                    ok &= verifyNoAllocation(isa_tag + " detectKeypointsMultiScale sub-pixel",
+                                             detector, [&](){
+                            detector.detectKeypointsMultiScale(image, keypoints, thresh,
+                                                               config.nms_window_size,
+                                                               config.num_levels, selection);
+                        });
+                }
+            }
+        }
+    }
+
+    std::cout << (ok ? "[ INFO] All checks passed" : "[ERROR] Some checks failed")
+              << std::endl;
+
+    return ok;
+}
+
+
+// command line
+
+static cv::Size parseSize(const std::string& name){
+
+    if(name == "vga"){
+        return cv::Size(640, 480);
+    }else if(name == "hd"){
+        return cv::Size(1280, 720);
+    }else if(name == "fullhd"){
+        return cv::Size(1920, 1080);
+    }else if(name == "4k"){
+        return cv::Size(3840, 2160);
+    }
+
+    const size_t x = name.find('x');
+    if(x == std::string::npos){
+        throw std::runtime_error("Invalid image size: " + name);
+    }
+    return cv::Size(std::stoi(name.substr(0, x)), std::stoi(name.substr(x + 1)));
+}
+
+static std::vector<std::string> splitList(const std::string& list){
+
+    std::vector<std::string> items;
+    std::istringstream iss(list);
+    std::string item;
+    while(std::getline(iss, item, ',')){
+        if(! item.empty()){
+            items.push_back(item);
+        }
+    }
+    return items;
+}
+
+static harris_kernels::Isa parseIsa(const std::string& name){
+
+    if(name == "best"){
+        return harris_kernels::getBestIsa();
+    }
+    const harris_kernels::Isa isas[] = {
+        harris_kernels::ISA_SCALAR, harris_kernels::ISA_SSE41, harris_kernels::ISA_AVX2,
+        harris_kernels::ISA_AVX512
+    };
+    for(const harris_kernels::Isa isa : isas){
+        if(name == harris_kernels::isaName(isa)){
+            return isa;
+        }
+    }
+    throw std::runtime_error("Invalid ISA: " + name);
+}
+
+static void printUsage(const char* program_name){
+
+    std::cout << "Usage: " << program_name << " [options]" << std::endl
+              << "  --sizes=LIST         vga,hd,fullhd,4k or WxH (default vga,hd,fullhd,4k)" << std::endl
+              << "  --windows=LIST       window sizes (default 3,5,7)" << std::endl
+              << "  --threshs=LIST       NMS thresholds (default 1e-4,1e-3,1e-2)" << std::endl
+              << "  --nms-window=N       NMS window size (default 3)" << std::endl
+              << "  --levels=N           pyramid levels of the multi-scale detector (default 4)" << std::endl
+              << "  --anms=LIST          candidate counts of the adaptive NMS, in the largest" << std::endl
+              << "                       size (default 1000,10000,100000; empty: none)" << std::endl
+              << "  --iterations=N       timed iterations (default 20)" << std::endl
+              << "  --warmup=N           untimed iterations (default 3)" << std::endl
+              << "  --threads=N          0: all cores (default 1)" << std::endl
+              << "  --isa=NAME           scalar, sse4.1, avx2, avx512 or best (default best)" << std::endl
+              << "  --pipeline=NAME      planes or streaming (default planes)" << std::endl
+              << "  --csv=PATH           CSV output, - for stdout (default -)" << std::endl
+              << "  --json=PATH          JSON output" << std::endl
+              << "  --verify             cross-check ISAs, threads and pipelines" << std::endl;
+}
+
+static bool parseArgs(int argc, char** argv, BenchConfig& config){
+
+    config.sizes = {cv::Size(640, 480), cv::Size(1280, 720),
+                    cv::Size(1920, 1080), cv::Size(3840, 2160)};
+    config.window_sizes = {3, 5, 7};
+    config.threshs = {1e-4, 1e-3, 1e-2};
+    config.nms_window_size = 3;
+    config.num_levels = 4;
+    config.anms_candidates = {1000, 10000, 100000};
+    config.iterations = 20;
+    config.warmup_iterations = 3;
+    config.num_threads = 1;
+    config.isa = harris_kernels::getBestIsa();
+    config.pipeline_mode = HarrisCorner::PIPELINE_PLANES;
+    config.csv_path = "-";
+    config.verify = false;
+
+    for(int i = 1; i < argc; i++){
+
+        const std::string arg = argv[i];
+        const size_t eq = arg.find('=');
+        const std::string key = arg.substr(0, eq);
+        const std::string value = eq == std::string::npos ? "" : arg.substr(eq + 1);
+
+        if(key == "--sizes"){
+            config.sizes.clear();
+            for(const std::string& item : splitList(value)){
+                config.sizes.push_back(parseSize(item));
+            }
+        }else if(key == "--windows"){
+            config.window_sizes.clear();
+            for(const std::string& item : splitList(value)){
+                config.window_sizes.push_back(std::stoi(item));
+            }
+        }else if(key == "--threshs"){
+            config.threshs.clear();
+            for(const std::string& item : splitList(value)){
+                config.threshs.push_back(std::stod(item));
+            }
+        }else if(key == "--nms-window"){
+            config.nms_window_size = std::stoi(value);
+        }else if(key == "--levels"){
+            config.num_levels = std::stoi(value);
+        }else if(key == "--anms"){
+            config.anms_candidates.clear();
+            for(const std::string& item : splitList(value)){
+                config.anms_candidates.push_back(std::stoi(item));
+            }
+        }else if(key == "--iterations"){
+            config.iterations = std::stoi(value);
+        }else if(key == "--warmup"){
+            config.warmup_iterations = std::stoi(value);
+        }else if(key == "--threads"){
+            config.num_threads = std::stoi(value);
+        }else if(key == "--isa"){
+            config.isa = parseIsa(value);
+        }else if(key == "--pipeline" && (value == "planes" || value == "streaming")){
+            config.pipeline_mode = value == "planes" ?
+                HarrisCorner::PIPELINE_PLANES : HarrisCorner::PIPELINE_STREAMING;
+        }else if(key == "--csv"){
+            config.csv_path = value;
+        }else if(key == "--json"){
+            config.json_path = value;
+        }else if(key == "--verify"){
+            config.verify = true;
+        }else{
+            return false;
+        }
+    }
+
+    if(config.sizes.empty() || config.window_sizes.empty() || config.threshs.empty()
+       || config.num_levels <= 0 || config.iterations <= 0 || config.warmup_iterations < 0){
+        return false;
+    }
+    if(config.num_threads == 0){
+        config.num_threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+
+    return true;
+}
+
+
+int main(int argc, char** argv){
+
+    BenchConfig config;
+
+    try{
+        if(! parseArgs(argc, argv, config)){
+            printUsage(argv[0]);
+            return 1;
+        }
+
+        if(config.verify){
+            return runVerification(config) ? 0 : 1;
+        }
+
+        const std::vector<BenchResult> results = runBenchmark(config);
+
+        if(config.csv_path == "-"){
+            writeCsv(std::cout, config, results);
+        }else if(! config.csv_path.empty()){
+            std::ofstream ofs(config.csv_path);
+            if(! ofs){
+                throw std::runtime_error("Could not open " + config.csv_path);
+            }
+            writeCsv(ofs, config, results);
+        }
+
+        if(! config.json_path.empty()){
+            std::ofstream ofs(config.json_path);
+            if(! ofs){
+                throw std::runtime_error("Could not open " + config.json_path);
+            }
+            writeJson(ofs, config, results);
+        }
+    }catch(const std::exception& e){
+        std::cout << "[ERROR] " << e.what() << std::endl;
+        return 1;
+    }
+
+    return 0;
+}
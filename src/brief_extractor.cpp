@@ -0,0 +1,255 @@
+#include <brief_extractor.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <stdexcept>
+
+
+namespace{
+
+/*
+  Pixel pairs drawn from an isotropic Gaussian around the keypoint with
+  a standard deviation of a fifth of the patch, clamped to the patch,
+  which is BRIEF's best sampling strategy (G II). The Gaussian is a sum
+  of uniforms from a fixed LCG rather than <random>, whose
+  distributions differ between standard libraries, so that descriptors
+  are the same on every platform.
+ */
+template<typename Pair>
+std::vector<Pair> makePattern(const int num_pairs, const int patch_size){
+
+    uint32_t state = 0x2545f491u;
+    auto uniform = [&](){
+        state = state * 1664525u + 1013904223u;
+        return (state >> 8) / 16777216.0;
+    };
+
+    // mean 0, variance 1
+    auto gaussian = [&](){
+        double sum = 0.0;
+        for(int i = 0; i < 4; i++){
+            sum += uniform();
+        }
+        return (sum - 2.0) * std::sqrt(3.0);
+    };
+
+    const int radius = patch_size / 2;
+    const double sigma = patch_size / 5.0;
+
+    auto coordinate = [&](){
+        const int c = static_cast<int>(std::lround(sigma * gaussian()));
+        return std::min(std::max(c, -radius), radius);
+    };
+
+    std::vector<Pair> pattern;
+    while(static_cast<int>(pattern.size()) < num_pairs){
+        Pair pair;
+        pair.x1 = coordinate();
+        pair.y1 = coordinate();
+        pair.x2 = coordinate();
+        pair.y2 = coordinate();
+        // a pixel compared with itself would be a constant bit
+        if(pair.x1 != pair.x2 || pair.y1 != pair.y2){
+            pattern.push_back(pair);
+        }
+    }
+
+    return pattern;
+}
+
+/*
+  Bits of the descriptor of the pixel at center, whose pairs are
+  offsets1[i] and offsets2[i] elements away from it when the whole
+  pattern lies in the image. Otherwise pixel(dx, dy) clamps.
+ */
+template<typename T, typename Pair>
+void describe(const cv::Mat& image,
+              const HarrisCorner::Keypoint& keypoint,
+              const std::vector<Pair>& pattern,
+              const std::vector<int>& offsets1,
+              const std::vector<int>& offsets2,
+              const int reach,
+              uint8_t * const descriptor){
+
+    const int x = static_cast<int>(std::lround(keypoint.x));
+    const int y = static_cast<int>(std::lround(keypoint.y));
+
+    if(x - reach >= 0 && x + reach < image.cols && y - reach >= 0 && y + reach < image.rows){
+
+        T const * const center = image.ptr<T>(y) + x;
+        for(int i_byte = 0; i_byte < BriefExtractor::kDescriptorBytes; i_byte++){
+            uint8_t byte = 0;
+            for(int i_bit = 0; i_bit < 8; i_bit++){
+                const int i = 8 * i_byte + i_bit;
+                byte |= static_cast<uint8_t>((center[offsets1[i]] < center[offsets2[i]]) << i_bit);
+            }
+            descriptor[i_byte] = byte;
+        }
+
+    }else{
+
+        auto pixel = [&](const int dx, const int dy){
+            return image.ptr<T>(std::min(std::max(y + dy, 0), image.rows - 1))
+                [std::min(std::max(x + dx, 0), image.cols - 1)];
+        };
+        for(int i_byte = 0; i_byte < BriefExtractor::kDescriptorBytes; i_byte++){
+            uint8_t byte = 0;
+            for(int i_bit = 0; i_bit < 8; i_bit++){
+                const Pair& pair = pattern[8 * i_byte + i_bit];
+                byte |= static_cast<uint8_t>((pixel(pair.x1, pair.y1) < pixel(pair.x2, pair.y2))
+                                             << i_bit);
+            }
+            descriptor[i_byte] = byte;
+        }
+    }
+}
+
+}
+
+
+BriefExtractor::BriefExtractor()
+    : kernels_(&harris_kernels::getBestKernels()),
+      pattern_(makePattern<SamplePair>(kDescriptorBits, kPatchSize)){
+
+}
+
+void BriefExtractor::setIsa(const harris_kernels::Isa isa){
+
+    kernels_ = &harris_kernels::getKernels(isa);
+}
+
+/*
+  A horizontal pass into a ring of five rows, then a vertical one from
+  the ring into smoothed. Both are binomialRows() kernels, the
+  horizontal one on a padded row with shifted pointers. A row of the
+  input is read before any row of smoothed at or below it is written,
+  so smoothed may be input_image. Sums of 8-bit pixels are exact
+  integers in float, so the 8-bit result is exactly rounded.
+ */
+void BriefExtractor::smooth(const cv::Mat& input_image, cv::Mat& smoothed){
+
+    MY_UTILS_KK4_TRACE_SPAN("BriefExtractor::smooth");
+
+    const int type = input_image.type();
+    if(type != CV_32FC1 && type != CV_8UC1){
+        throw std::runtime_error("input_image must be CV_32FC1 or CV_8UC1");
+    }
+
+    const int rows = input_image.rows;
+    const int cols = input_image.cols;
+
+    horizontal_.resize(5 * static_cast<size_t>(cols));
+    row_buffer_.resize(cols + 4);
+    float * const v = row_buffer_.data() + 2;
+
+    // horizontal pass of input row i_r, into slot i_r % 5
+    auto filter_row = [&](const int i_r){
+        if(type == CV_32FC1){
+            std::copy(input_image.ptr<float>(i_r), input_image.ptr<float>(i_r) + cols, v);
+        }else{
+            std::copy(input_image.ptr<uint8_t>(i_r), input_image.ptr<uint8_t>(i_r) + cols, v);
+        }
+        for(int k = 1; k <= 2; k++){
+            v[-k] = v[cv::borderInterpolate(-k, cols, cv::BORDER_REFLECT_101)];
+            v[cols - 1 + k] = v[cv::borderInterpolate(cols - 1 + k, cols, cv::BORDER_REFLECT_101)];
+        }
+        kernels_->binomialRows(v - 2, v - 1, v, v + 1, v + 2,
+                               &horizontal_[(i_r % 5) * static_cast<size_t>(cols)], cols);
+    };
+
+    smoothed.create(input_image.size(), type);
+
+    int num_filtered = 0;
+
+    for(int i_r = 0; i_r < rows; i_r++){
+
+        // rows i_r - 2 to i_r + 2, reflected ones included
+        for(; num_filtered < std::min(i_r + 3, rows); num_filtered++){
+            filter_row(num_filtered);
+        }
+
+        float const * r[5];
+        for(int k = 0; k < 5; k++){
+            const int src_row = cv::borderInterpolate(i_r + k - 2, rows, cv::BORDER_REFLECT_101);
+            r[k] = &horizontal_[(src_row % 5) * static_cast<size_t>(cols)];
+        }
+
+        if(type == CV_32FC1){
+            float * const dst = smoothed.ptr<float>(i_r);
+            kernels_->binomialRows(r[0], r[1], r[2], r[3], r[4], dst, cols);
+            for(int i_c = 0; i_c < cols; i_c++){
+                dst[i_c] *= 1.0f / 256.0f;
+            }
+        }else{
+            kernels_->binomialRows(r[0], r[1], r[2], r[3], r[4], v, cols);
+            uint8_t * const dst = smoothed.ptr<uint8_t>(i_r);
+            for(int i_c = 0; i_c < cols; i_c++){
+                dst[i_c] = static_cast<uint8_t>((static_cast<int>(v[i_c]) + 128) >> 8);
+            }
+        }
+    }
+}
+
+void BriefExtractor::compute(const cv::Mat& smoothed_image,
+                             const std::vector<Keypoint>& keypoints,
+                             cv::Mat& descriptors){
+
+    MY_UTILS_KK4_TRACE_SPAN("BriefExtractor::compute");
+
+    const int type = smoothed_image.type();
+    if(type != CV_32FC1 && type != CV_8UC1){
+        throw std::runtime_error("smoothed_image must be CV_32FC1 or CV_8UC1");
+    }
+
+    const int num_keypoints = static_cast<int>(keypoints.size());
+    descriptors.create(num_keypoints, kDescriptorBytes, CV_8UC1);
+
+    // the pattern at a scale, and its offsets in elements of the image
+    const int step = static_cast<int>(smoothed_image.step / smoothed_image.elemSize());
+    float pattern_scale = -1.0f;
+    const std::vector<SamplePair>* pattern = &pattern_;
+    int reach = 0;
+
+    auto set_scale = [&](const float scale){
+        if(scale > 1.0f){
+            scaled_pattern_.resize(pattern_.size());
+            for(size_t j = 0; j < pattern_.size(); j++){
+                const SamplePair& pair = pattern_[j];
+                scaled_pattern_[j].x1 = static_cast<int>(std::lround(pair.x1 * scale));
+                scaled_pattern_[j].y1 = static_cast<int>(std::lround(pair.y1 * scale));
+                scaled_pattern_[j].x2 = static_cast<int>(std::lround(pair.x2 * scale));
+                scaled_pattern_[j].y2 = static_cast<int>(std::lround(pair.y2 * scale));
+            }
+            pattern = &scaled_pattern_;
+        }else{
+            pattern = &pattern_;
+        }
+        reach = static_cast<int>(std::lround(kPatchSize / 2 * std::max(scale, 1.0f)));
+
+        offsets1_.resize(pattern->size());
+        offsets2_.resize(pattern->size());
+        for(size_t j = 0; j < pattern->size(); j++){
+            offsets1_[j] = (*pattern)[j].y1 * step + (*pattern)[j].x1;
+            offsets2_[j] = (*pattern)[j].y2 * step + (*pattern)[j].x2;
+        }
+        pattern_scale = scale;
+    };
+
+    for(int i = 0; i < num_keypoints; i++){
+
+        const Keypoint& keypoint = keypoints[i];
+        const float scale = std::max(keypoint.scale, 1.0f);
+        if(scale != pattern_scale){
+            set_scale(scale);
+        }
+
+        if(type == CV_32FC1){
+            describe<float>(smoothed_image, keypoint, *pattern, offsets1_, offsets2_, reach,
+                            descriptors.ptr<uint8_t>(i));
+        }else{
+            describe<uint8_t>(smoothed_image, keypoint, *pattern, offsets1_, offsets2_, reach,
+                              descriptors.ptr<uint8_t>(i));
+        }
+    }
+}
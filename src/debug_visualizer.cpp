@@ -0,0 +1,82 @@
+#include <debug_visualizer.hpp>
+
+#include <stdexcept>
+
+
+DebugVisualizer::DebugVisualizer(const int refresh_interval)
+    : display_(DISPLAY_NORMALIZED),
+      frame_idx_(0),
+      refresh_frame_idx_(-1),
+      shown_planes_(0),
+      pending_planes_(0),
+      num_renders_(0){
+
+    setRefreshInterval(refresh_interval);
+}
+
+void DebugVisualizer::setRefreshInterval(const int refresh_interval){
+
+    if(refresh_interval <= 0){
+        throw std::runtime_error("refresh_interval must be positive");
+    }
+
+    refresh_interval_ = refresh_interval;
+}
+
+void DebugVisualizer::beginFrame(HarrisCorner& harris_corner, const unsigned open_planes){
+
+    const bool due = refresh_frame_idx_ < 0
+        || frame_idx_ - refresh_frame_idx_ >= refresh_interval_
+        || (open_planes & ~shown_planes_) != 0;
+
+    pending_planes_ = open_planes != 0 && due ? open_planes : 0;
+
+    if(open_planes == 0){
+        shown_planes_ = 0;
+    }
+
+    harris_corner.setKeptPlanes(pending_planes_);
+    frame_idx_++;
+}
+
+unsigned DebugVisualizer::render(const HarrisCorner& harris_corner, cv::Mat* views,
+                                  const bool detected){
+
+    MY_UTILS_KK4_TRACE_SPAN("DebugVisualizer::render");
+
+    // the planes are those of an earlier frame; still due next frame
+    if(! detected || ! pending_planes_){
+        pending_planes_ = 0;
+        return 0;
+    }
+
+    refresh_frame_idx_ = frame_idx_ - 1;
+    shown_planes_ = pending_planes_;
+
+    unsigned rendered = 0;
+
+    for(int p = 0; p < HarrisCorner::kNumPlanes; p++){
+
+        const HarrisCorner::Plane plane = static_cast<HarrisCorner::Plane>(p);
+        const cv::Mat& source = harris_corner.getPlane(plane);
+
+        // empty if the detection did not make it
+        if(! (pending_planes_ & HarrisCorner::planeBit(plane)) || source.empty()){
+            continue;
+        }
+
+        if(display_ == DISPLAY_COLOR_MAP){
+            cv::normalize(source, normalized_, 0.0, 255.0, cv::NORM_MINMAX, CV_8U);
+            cv::applyColorMap(normalized_, views[p], cv::COLORMAP_JET);
+        }else{
+            cv::normalize(source, views[p], 0.0, 255.0, cv::NORM_MINMAX, CV_8U);
+        }
+
+        rendered |= HarrisCorner::planeBit(plane);
+        num_renders_++;
+    }
+
+    pending_planes_ = 0;
+
+    return rendered;
+}
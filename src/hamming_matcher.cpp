@@ -0,0 +1,131 @@
+#include <hamming_matcher.hpp>
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+
+constexpr double HammingMatcher::kDefaultRatio;
+
+
+HammingMatcher::HammingMatcher()
+    : kernels_(&harris_kernels::getBestKernels()),
+      cross_check_(true),
+      ratio_(kDefaultRatio),
+      max_distance_(kDescriptorBits){
+
+}
+
+void HammingMatcher::setCrossCheck(const bool cross_check){
+
+    cross_check_ = cross_check;
+}
+
+void HammingMatcher::setRatio(const double ratio){
+
+    if(! (ratio > 0.0 && ratio <= 1.0)){
+        throw std::runtime_error("ratio must be in (0, 1]");
+    }
+
+    ratio_ = ratio;
+}
+
+void HammingMatcher::setMaxDistance(const int max_distance){
+
+    if(max_distance < 0){
+        throw std::runtime_error("max_distance must not be negative");
+    }
+
+    max_distance_ = max_distance;
+}
+
+void HammingMatcher::setIsa(const harris_kernels::Isa isa){
+
+    kernels_ = &harris_kernels::getKernels(isa);
+}
+
+void HammingMatcher::match(const cv::Mat& query_descriptors,
+                           const cv::Mat& train_descriptors,
+                           std::vector<Match>& matches){
+
+    MY_UTILS_KK4_TRACE_SPAN("HammingMatcher::match");
+
+    for(const cv::Mat* descriptors : {&query_descriptors, &train_descriptors}){
+        if(! descriptors->empty()
+           && (descriptors->type() != CV_8UC1 || descriptors->cols != kDescriptorBytes)){
+            throw std::runtime_error("Descriptors must be CV_8UC1 rows of "
+                                     + std::to_string(kDescriptorBytes) + " bytes");
+        }
+    }
+
+    matches.clear();
+
+    const int num_queries = query_descriptors.empty() ? 0 : query_descriptors.rows;
+    const int num_trains = train_descriptors.empty() ? 0 : train_descriptors.rows;
+    if(num_queries == 0 || num_trains == 0){
+        return;
+    }
+
+    uint8_t const * train = train_descriptors.ptr<uint8_t>(0);
+    if(! train_descriptors.isContinuous()){
+        train_scratch_.resize(static_cast<size_t>(num_trains) * kDescriptorBytes);
+        for(int i = 0; i < num_trains; i++){
+            std::memcpy(&train_scratch_[static_cast<size_t>(i) * kDescriptorBytes],
+                        train_descriptors.ptr<uint8_t>(i), kDescriptorBytes);
+        }
+        train = train_scratch_.data();
+    }
+
+    // farther than any pair
+    const uint16_t kNone = kDescriptorBits + 1;
+
+    distances_.resize(num_trains);
+    best_train_.resize(num_queries);
+    best_distance_.resize(num_queries);
+    second_distance_.resize(num_queries);
+    best_query_.assign(num_trains, -1);
+    best_query_distance_.assign(num_trains, kNone);
+
+    for(int i_q = 0; i_q < num_queries; i_q++){
+
+        kernels_->hammingDistances(query_descriptors.ptr<uint8_t>(i_q), train, num_trains,
+                                   distances_.data());
+
+        if(cross_check_){
+            kernels_->updateMinU16(distances_.data(), i_q, best_query_distance_.data(),
+                                   best_query_.data(), num_trains);
+        }
+
+        // the second nearest is the nearest once the nearest is gone
+        const int best_train = kernels_->argminU16(distances_.data(), num_trains);
+        const uint16_t best = distances_[best_train];
+        uint16_t second = kNone;
+        if(num_trains > 1){
+            distances_[best_train] = kNone;
+            second = distances_[kernels_->argminU16(distances_.data(), num_trains)];
+        }
+
+        best_train_[i_q] = best_train;
+        best_distance_[i_q] = best;
+        second_distance_[i_q] = second;
+    }
+
+    for(int i_q = 0; i_q < num_queries; i_q++){
+
+        const int i_t = best_train_[i_q];
+        const int distance = best_distance_[i_q];
+
+        if(distance > max_distance_
+           || (cross_check_ && best_query_[i_t] != i_q)
+           || (ratio_ < 1.0 && second_distance_[i_q] != kNone
+               && distance >= ratio_ * second_distance_[i_q])){
+            continue;
+        }
+
+        Match match;
+        match.query_idx = i_q;
+        match.train_idx = i_t;
+        match.distance = distance;
+        matches.push_back(match);
+    }
+}
@@ -0,0 +1,167 @@
+#include <harris_batch_detector.hpp>
+
+#include <algorithm>
+
+
+HarrisBatchDetector::HarrisBatchDetector(const double k, const int window_size,
+                                         const int num_threads)
+    : thread_pool_(num_threads),
+      tile_detector_(k, window_size, 1),
+      parallelism_(PARALLEL_AUTO),
+      last_parallelism_(PARALLEL_FRAMES){
+
+    frame_detectors_.resize(thread_pool_.getNumThreads());
+
+    for(std::unique_ptr<HarrisCorner>& detector : frame_detectors_){
+        // each frame fits one thread's caches best when streamed
+        detector.reset(new HarrisCorner(k, window_size, 1));
+        detector->setPipelineMode(HarrisCorner::PIPELINE_STREAMING);
+    }
+}
+
+HarrisBatchDetector::~HarrisBatchDetector(){
+
+}
+
+void HarrisBatchDetector::setIsa(const harris_kernels::Isa isa){
+
+    for(std::unique_ptr<HarrisCorner>& detector : frame_detectors_){
+        detector->setIsa(isa);
+    }
+    tile_detector_.setIsa(isa);
+}
+
+void HarrisBatchDetector::setSubpixelRefinement(const bool subpixel_refinement){
+
+    for(std::unique_ptr<HarrisCorner>& detector : frame_detectors_){
+        detector->setSubpixelRefinement(subpixel_refinement);
+    }
+    tile_detector_.setSubpixelRefinement(subpixel_refinement);
+}
+
+HarrisBatchDetector::Parallelism
+HarrisBatchDetector::chooseParallelism(const cv::Size& frame_size, const int num_frames)const{
+
+    if(parallelism_ != PARALLEL_AUTO){
+        return parallelism_;
+    }
+
+    const int num_threads = thread_pool_.getNumThreads();
+
+    // bands of HarrisCorner start at multiples of this many rows
+    const int max_bands = frame_size.height / HarrisCorner::kRunningSumRestartInterval;
+
+    if(num_threads == 1 || max_bands < num_threads){
+        return PARALLEL_FRAMES;
+    }
+
+    if(num_frames < num_threads){
+        return PARALLEL_TILES;
+    }
+
+    const long pixels_in_flight = static_cast<long>(frame_size.area()) * num_threads;
+
+    if(pixels_in_flight > kMaxPixelsInFlight && max_bands >= 2 * num_threads){
+        return PARALLEL_TILES;
+    }
+
+    return PARALLEL_FRAMES;
+}
+
+void HarrisBatchDetector::detectKeypoints(const std::vector<cv::Mat>& frames,
+                                          std::vector<std::vector<Keypoint> >& keypoints,
+                                          const double thresh,
+                                          const int nms_window_size,
+                                          const KeypointSelection& selection){
+
+    MY_UTILS_KK4_TRACE_SPAN("HarrisBatchDetector::detectKeypoints");
+
+    const int num_frames = static_cast<int>(frames.size());
+
+    keypoints.resize(num_frames);
+
+    if(num_frames == 0){
+        return;
+    }
+
+    detectBatch(frames.data(), keypoints.data(), num_frames,
+                chooseParallelism(frames[0].size(), num_frames),
+                thresh, nms_window_size, selection);
+}
+
+void HarrisBatchDetector::detectKeypoints(const FrameSource& source,
+                                          const KeypointSink& sink,
+                                          const double thresh,
+                                          const int nms_window_size,
+                                          const KeypointSelection& selection){
+
+    MY_UTILS_KK4_TRACE_SPAN("HarrisBatchDetector::detectKeypoints(source)");
+
+    const int max_batch_frames = kFramesPerThread * thread_pool_.getNumThreads();
+
+    frame_buffers_.resize(max_batch_frames);
+    keypoint_buffers_.resize(max_batch_frames);
+
+    int frame_idx = 0;
+
+    while(source(frame_buffers_[0])){
+
+        // the source is taken to be long, so that only the frame size
+        // matters; PARALLEL_TILES then needs no read-ahead
+        const Parallelism parallelism =
+            chooseParallelism(frame_buffers_[0].size(), max_batch_frames);
+        const int batch_capacity = parallelism == PARALLEL_TILES ? 1 : max_batch_frames;
+
+        int num_frames = 1;
+        while(num_frames < batch_capacity && source(frame_buffers_[num_frames])){
+            num_frames++;
+        }
+
+        detectBatch(frame_buffers_.data(), keypoint_buffers_.data(), num_frames,
+                    parallelism, thresh, nms_window_size, selection);
+
+        for(int i = 0; i < num_frames; i++){
+            sink(frame_idx + i, frame_buffers_[i], keypoint_buffers_[i]);
+        }
+        frame_idx += num_frames;
+
+        if(num_frames < batch_capacity){
+            break;
+        }
+    }
+}
+
+void HarrisBatchDetector::detectBatch(cv::Mat const * const frames,
+                                      std::vector<Keypoint>* keypoints,
+                                      const int num_frames,
+                                      const Parallelism parallelism,
+                                      const double thresh,
+                                      const int nms_window_size,
+                                      const KeypointSelection& selection){
+
+    last_parallelism_ = parallelism;
+
+    if(parallelism == PARALLEL_TILES){
+
+        // the threads of tile_detector_ are only started once needed
+        if(tile_detector_.getNumThreads() != thread_pool_.getNumThreads()){
+            tile_detector_.setNumThreads(thread_pool_.getNumThreads());
+        }
+
+        for(int i = 0; i < num_frames; i++){
+            tile_detector_.detectKeypoints(frames[i], keypoints[i],
+                                           thresh, nms_window_size, selection);
+        }
+        return;
+    }
+
+    // parallelFor() hands out frames dynamically, so that a slow frame
+    // does not hold up a thread's share; each lands in its own slot
+    thread_pool_.parallelFor(num_frames, [&](const int frame_idx, const int thread_idx){
+
+            MY_UTILS_KK4_TRACE_SPAN("detectFrame");
+
+            frame_detectors_[thread_idx]->detectKeypoints(frames[frame_idx], keypoints[frame_idx],
+                                                          thresh, nms_window_size, selection);
+        });
+}
@@ -1,53 +1,1559 @@
 #include <harris_corner.hpp>
 
+#include <algorithm>
+#include <cstring>
+#include <limits>
+#include <numeric>
+#include <stdexcept>
+#include <vector>
 
-HarrisCorner::HarrisCorner(){
 
+namespace{
+
+// std::vector::resize() that counts reallocations
+template<typename T>
+void resizeCounted(std::vector<T>& v, const size_t n, unsigned long& num_allocations){
+
+    if(n > v.capacity()){
+        num_allocations++;
+    }
+    v.resize(n);
+}
+
+// std::vector::assign() that counts reallocations
+template<typename T>
+void assignCounted(std::vector<T>& v, const size_t n, const T& value,
+                   unsigned long& num_allocations){
+
+    if(n > v.capacity()){
+        num_allocations++;
+    }
+    v.assign(n, value);
+}
+
+// cv::Mat::create() that counts reallocations
+void createCounted(cv::Mat& mat, const cv::Size& size, const int type,
+                   unsigned long& num_allocations){
+
+    if(mat.size() != size || mat.type() != type){
+        num_allocations++;
+    }
+    mat.create(size, type);
+}
+
+// dst = tiles within radius tiles of a tile set in src (Chebyshev distance)
+void dilateTiles(const std::vector<uint8_t>& src,
+                 std::vector<uint8_t>& dst,
+                 const int tiles_x,
+                 const int tiles_y,
+                 const int radius){
+
+    for(int tile_row = 0; tile_row < tiles_y; tile_row++){
+        for(int tile_col = 0; tile_col < tiles_x; tile_col++){
+
+            uint8_t dirty = 0;
+
+            for(int j = std::max(0, tile_row - radius);
+                j <= std::min(tiles_y - 1, tile_row + radius) && ! dirty;
+                j++){
+                for(int i = std::max(0, tile_col - radius);
+                    i <= std::min(tiles_x - 1, tile_col + radius);
+                    i++){
+                    dirty |= src[j * tiles_x + i];
+                }
+            }
+
+            dst[tile_row * tiles_x + tile_col] = dirty;
+        }
+    }
+}
+
+// higher scores first, ties broken by position so that the order is
+// deterministic
+bool higherFirst(const HarrisCorner::Keypoint& a, const HarrisCorner::Keypoint& b){
+
+    if(a.score != b.score){
+        return a.score > b.score;
+    }
+    if(a.y != b.y){
+        return a.y < b.y;
+    }
+    return a.x < b.x;
+}
+
+float squaredDistance(const float ax, const float ay, const float bx, const float by){
+
+    const float dx = ax - bx;
+    const float dy = ay - by;
+    return dx * dx + dy * dy;
+}
+
+}
+
+
+constexpr double HarrisCorner::kAnmsRobustness;
+
+
+HarrisCorner::HarrisCorner(const double k, const int window_size,
+                           const int num_threads)
+    : k_(k),
+      response_type_(harris_kernels::RESPONSE_HARRIS),
+      window_size_(window_size),
+      kernels_(&harris_kernels::getBestKernels()),
+      pipeline_mode_(PIPELINE_PLANES),
+      subpixel_refinement_(false),
+      incremental_(false),
+      thread_pool_(num_threads),
+      kept_planes_(0),
+      response_plane_shared_(false),
+      num_allocations_(0){
+
+    if(window_size_ <= 0 || window_size_ % 2 == 0){
+        throw std::runtime_error("window_size must be a positive odd number");
+    }
+}
+
+HarrisCorner::~HarrisCorner(){
+
+}
+
+void HarrisCorner::setK(const double k){
+
+    k_ = k;
+}
+
+void HarrisCorner::setResponseType(const harris_kernels::Response response_type){
+
+    if(response_type < 0 || response_type >= harris_kernels::kNumResponses){
+        throw std::runtime_error("Invalid response type");
+    }
+
+    response_type_ = response_type;
+}
+
+void HarrisCorner::setWindowSize(const int window_size){
+
+    if(window_size <= 0 || window_size % 2 == 0){
+        throw std::runtime_error("window_size must be a positive odd number");
+    }
+
+    window_size_ = window_size;
+}
+
+void HarrisCorner::setIsa(const harris_kernels::Isa isa){
+
+    kernels_ = &harris_kernels::getKernels(isa);
+}
+
+void HarrisCorner::setNumThreads(const int num_threads){
+
+    thread_pool_.setNumThreads(num_threads);
+}
+
+void HarrisCorner::setPipelineMode(const PipelineMode pipeline_mode){
+
+    pipeline_mode_ = pipeline_mode;
+}
+
+void HarrisCorner::setSubpixelRefinement(const bool subpixel_refinement){
+
+    subpixel_refinement_ = subpixel_refinement;
+}
+
+void HarrisCorner::setIncremental(const bool incremental){
+
+    incremental_ = incremental;
+    incremental_state_.valid = false;
+}
+
+void HarrisCorner::setKeptPlanes(const unsigned plane_mask){
+
+    if(plane_mask >= 1u << kNumPlanes){
+        throw std::runtime_error("Invalid plane mask");
+    }
+
+    kept_planes_ = plane_mask;
+}
+
+const char* HarrisCorner::planeName(const Plane plane){
+
+    switch(plane){
+    case PLANE_GRAD_X:
+        return "grad_x";
+    case PLANE_GRAD_Y:
+        return "grad_y";
+    case PLANE_SUM_XX:
+        return "sum_xx";
+    case PLANE_SUM_YY:
+        return "sum_yy";
+    case PLANE_SUM_XY:
+        return "sum_xy";
+    case PLANE_RESPONSE:
+        return "response";
+    }
+    return "unknown";
+}
+
+unsigned long HarrisCorner::getWorkspaceAllocationCount()const{
+
+    unsigned long count = num_allocations_;
+    for(const BandWorkspace& workspace : band_workspaces_){
+        count += workspace.num_allocations + workspace.nms.num_allocations;
+    }
+    return count;
+}
+
+unsigned long HarrisCorner::NmsContext::getWorkspaceAllocationCount()const{
+
+    unsigned long count = num_allocations_;
+    for(const NmsWorkspace& workspace : workspaces_){
+        count += workspace.num_allocations;
+    }
+    return count;
+}
+
+/*
+  Make sure there is a workspace for every thread, sized for rows of
+  cols pixels and, if nms_window_size is positive, for NMS over
+  nms_rows rows. Any thread may get any band, so sizing them all here
+  for the largest band, rather than in the bands, keeps buffers from
+  growing after the first call. The list never shrinks, so that the
+  buffers of idle workspaces are kept.
+ */
+void HarrisCorner::prepareBandWorkspaces(const int cols,
+                                         const int depth,
+                                         const int nms_window_size,
+                                         const int nms_rows){
+
+    const size_t num_threads = thread_pool_.getNumThreads();
+
+    if(band_workspaces_.size() < num_threads){
+        resizeCounted(band_workspaces_, num_threads, num_allocations_);
+    }
+
+    for(BandWorkspace& workspace : band_workspaces_){
+        prepareTensorWorkspace(workspace, cols, depth);
+        if(nms_window_size > 0){
+            prepareNmsWorkspace(workspace.nms, cols, nms_window_size, nms_rows);
+        }
+        std::fill(workspace.kept_planes, workspace.kept_planes + kNumPlanes, nullptr);
+    }
+}
+
+/*
+  Point the workspaces at the planes of plane_mask for the bands to
+  fill, after prepareBandWorkspaces(), and release the others. A
+  non-null response is the response plane of the detection, which is
+  then shared instead of filled.
+ */
+void HarrisCorner::prepareKeptPlanes(const cv::Mat& input_image,
+                                     const unsigned plane_mask,
+                                     const cv::Mat* response){
+
+    const bool integer = input_image.depth() == CV_8U;
+
+    for(int p = 0; p < kNumPlanes; p++){
+
+        const Plane plane = static_cast<Plane>(p);
+        cv::Mat* filled = nullptr;
+
+        if(! (plane_mask & planeBit(plane))){
+            planes_[p].release();
+        }else if(plane == PLANE_RESPONSE && response){
+            planes_[p] = *response;
+        }else{
+            // never fill a plane of someone else
+            if(plane == PLANE_RESPONSE && response_plane_shared_){
+                planes_[p].release();
+            }
+            const int type = plane == PLANE_RESPONSE ? CV_32FC1
+                : plane <= PLANE_GRAD_Y ? (integer ? CV_16SC1 : CV_32FC1)
+                : (integer ? CV_32SC1 : CV_32FC1);
+            createCounted(planes_[p], input_image.size(), type, num_allocations_);
+            filled = &planes_[p];
+        }
+
+        for(BandWorkspace& workspace : band_workspaces_){
+            workspace.kept_planes[p] = filled;
+        }
+    }
+
+    response_plane_shared_ = (plane_mask & planeBit(PLANE_RESPONSE)) && response;
+}
+
+// row i_r of a kept plane, if kept and in the rows of the band; bands
+// also compute rows of their neighbours, which those write
+template<typename T>
+void HarrisCorner::keepPlaneRow(BandWorkspace& workspace,
+                                const Plane plane,
+                                const int i_r,
+                                T const * const src){
+
+    cv::Mat * const dst = workspace.kept_planes[plane];
+
+    if(dst && i_r >= workspace.kept_row_begin && i_r < workspace.kept_row_end){
+        std::copy(src, src + dst->cols, dst->ptr<T>(i_r));
+    }
+}
+
+void HarrisCorner::calcResponse(const cv::Mat& input_image,
+                                cv::Mat& harris_response){
+
+    MY_UTILS_KK4_TRACE_SPAN("HarrisCorner::calcResponse");
+
+    cv::Mat* responses[harris_kernels::kNumResponses] = {};
+    responses[response_type_] = &harris_response;
+
+    calcResponses(input_image, harris_kernels::responseBit(response_type_), responses);
+}
+
+void HarrisCorner::calcResponses(const cv::Mat& input_image,
+                                 const unsigned response_mask,
+                                 std::vector<cv::Mat>& responses){
+
+    MY_UTILS_KK4_TRACE_SPAN("HarrisCorner::calcResponses");
+
+    if(response_mask >= static_cast<unsigned>(harris_kernels::kNumResponseMasks)){
+        throw std::runtime_error("Invalid response mask");
+    }
+
+    if(responses.size() < static_cast<size_t>(harris_kernels::kNumResponses)){
+        responses.resize(harris_kernels::kNumResponses);
+    }
+
+    cv::Mat* planes[harris_kernels::kNumResponses] = {};
+    for(int r = 0; r < harris_kernels::kNumResponses; r++){
+        if(response_mask & harris_kernels::responseBit(static_cast<harris_kernels::Response>(r))){
+            planes[r] = &responses[r];
+        }
+    }
+
+    calcResponses(input_image, response_mask, planes);
+}
+
+void HarrisCorner::calcResponses(const cv::Mat& input_image,
+                                 const unsigned response_mask,
+                                 cv::Mat * const * responses){
+
+    checkInputType(input_image);
+
+    for(int r = 0; r < harris_kernels::kNumResponses; r++){
+        if(responses[r]){
+            responses[r]->create(input_image.size(), CV_32FC1);
+        }
+    }
+
+    const int rows = input_image.rows;
+    const int band_rows = calcBandRows(rows, window_size_);
+    const int num_bands = (rows + band_rows - 1) / band_rows;
+
+    prepareBandWorkspaces(input_image.cols, input_image.depth(), 0, 0);
+
+    // the response plane is one of the outputs, if at all
+    const cv::Mat* response = responses[response_type_];
+    prepareKeptPlanes(input_image,
+                      response ? kept_planes_ : kept_planes_ & ~planeBit(PLANE_RESPONSE),
+                      response);
+
+    thread_pool_.parallelFor(num_bands, [&](const int band_idx, const int thread_idx){
+
+            const int row_begin = band_idx * band_rows;
+            const int row_end = std::min(row_begin + band_rows, rows);
+
+            MY_UTILS_KK4_TRACE_SPAN("calcResponseBand");
+
+            calcResponsesBand(input_image, response_mask, responses, row_begin, row_end,
+                              band_workspaces_[thread_idx]);
+        });
+}
+
+void HarrisCorner::detectCorners(const cv::Mat& input_image,
+                                 cv::Mat& img_binary_result,
+                                 const double thresh,
+                                 const int nms_window_size){
+
+    MY_UTILS_KK4_TRACE_SPAN("HarrisCorner::detectCorners");
+
+    detect(input_image, &img_binary_result, nullptr, thresh, nms_window_size);
+}
+
+void HarrisCorner::detectKeypoints(const cv::Mat& input_image,
+                                   std::vector<Keypoint>& keypoints,
+                                   const double thresh,
+                                   const int nms_window_size,
+                                   const KeypointSelection& selection){
+
+    MY_UTILS_KK4_TRACE_SPAN("HarrisCorner::detectKeypoints");
+
+    detect(input_image, nullptr, &keypoints, thresh, nms_window_size);
+
+    selectKeypoints(keypoints, input_image.size(), selection);
+}
+
+void HarrisCorner::detectKeypointsRows(const cv::Mat& input_image,
+                                       std::vector<Keypoint>& keypoints,
+                                       const double thresh,
+                                       const int nms_window_size,
+                                       const int row_begin,
+                                       const int row_end){
+
+    MY_UTILS_KK4_TRACE_SPAN("HarrisCorner::detectKeypointsRows");
+
+    checkInputType(input_image);
+
+    if(nms_window_size <= 0 || nms_window_size % 2 == 0){
+        throw std::runtime_error("window_size must be an odd number");
+    }
+
+    if(row_begin < 0 || row_end > input_image.rows || row_begin > row_end){
+        throw std::runtime_error("Invalid row range");
+    }
+
+    // the streaming band gives the same corners as every mode
+    prepareBandWorkspaces(input_image.cols, input_image.depth(), nms_window_size,
+                          2 * nms_window_size);
+    prepareBandKeypoints(1);
+
+    NeighborhoodBatch* const neighborhoods =
+        subpixel_refinement_ ? &band_neighborhoods_[0] : nullptr;
+
+    keypoints.clear();
+    if(neighborhoods){
+        neighborhoods->clear();
+    }
+
+    detectCornersBand(input_image, nullptr, &keypoints, neighborhoods,
+                      toFloatThreshold(thresh), nms_window_size,
+                      row_begin, row_end, band_workspaces_[0]);
+
+    if(neighborhoods){
+        refineKeypoints(keypoints, *neighborhoods);
+    }
 }
 
-HarrisCorner::~HarrisCorner(){
+void HarrisCorner::detectKeypointsMultiScale(const cv::Mat& input_image,
+                                             std::vector<Keypoint>& keypoints,
+                                             const double thresh,
+                                             const int nms_window_size,
+                                             const int num_levels,
+                                             const KeypointSelection& selection){
+
+    MY_UTILS_KK4_TRACE_SPAN("HarrisCorner::detectKeypointsMultiScale");
+
+    if(input_image.type() != CV_32FC1){
+        throw std::runtime_error("Invalid matrix type");
+    }
+
+    if(nms_window_size <= 0 || nms_window_size % 2 == 0){
+        throw std::runtime_error("window_size must be an odd number");
+    }
+
+    if(num_levels <= 0){
+        throw std::runtime_error("num_levels must be positive");
+    }
+
+    // every workspace is sized for the full-size level, the largest
+    {
+        const int max_band_rows = std::min(input_image.rows,
+                                           calcBandRows(input_image.rows,
+                                                        window_size_ + nms_window_size));
+        prepareBandWorkspaces(input_image.cols, CV_32F, nms_window_size,
+                              max_band_rows + nms_window_size - 1);
+
+        for(BandWorkspace& workspace : band_workspaces_){
+            resizeCounted(workspace.pyramid_row, input_image.cols + 6,
+                          workspace.num_allocations);
+        }
+    }
+
+    const int levels = buildPyramid(input_image, num_levels, nms_window_size);
+    const float thresh_f = toFloatThreshold(thresh);
+    const int half_nms_w_size = (nms_window_size - 1) / 2;
+
+    // The bands of all levels go to the pool as one job, so the small
+    // levels run alongside the large ones. The pool cannot be entered
+    // from a task, so every band runs on a single thread.
+    const size_t task_capacity = pyramid_tasks_.capacity();
+    pyramid_tasks_.clear();
+    for(int level = 0; level < levels; level++){
+        const int rows = pyramid_responses_[level].rows;
+        const int band_rows = calcBandRows(rows, window_size_ + nms_window_size);
+        for(int row_begin = 0; row_begin < rows; row_begin += band_rows){
+            const PyramidTask task = {level, row_begin, std::min(row_begin + band_rows, rows)};
+            pyramid_tasks_.push_back(task);
+        }
+    }
+    if(pyramid_tasks_.capacity() != task_capacity){
+        num_allocations_++;
+    }
+
+    const int num_tasks = static_cast<int>(pyramid_tasks_.size());
+
+    thread_pool_.parallelFor(num_tasks, [&](const int task_idx, const int thread_idx){
+
+            const PyramidTask& task = pyramid_tasks_[task_idx];
+            const cv::Mat& image = task.level == 0 ? input_image : pyramid_images_[task.level];
+
+            MY_UTILS_KK4_TRACE_SPAN("calcResponseBand");
+
+            calcResponseBand(image, pyramid_responses_[task.level],
+                             task.row_begin, task.row_end, band_workspaces_[thread_idx]);
+        });
+
+    // NMS within each level needs the whole level, and the scale check
+    // needs the adjacent levels, so it starts once all responses exist
+    prepareBandKeypoints(num_tasks);
+
+    thread_pool_.parallelFor(num_tasks, [&](const int task_idx, const int thread_idx){
+
+            const PyramidTask& task = pyramid_tasks_[task_idx];
+            std::vector<Keypoint>& band_keypoints = band_keypoints_[task_idx];
+            BandWorkspace& workspace = band_workspaces_[thread_idx];
+            NeighborhoodBatch* const neighborhoods =
+                subpixel_refinement_ ? &band_neighborhoods_[task_idx] : nullptr;
+
+            MY_UTILS_KK4_TRACE_SPAN("nonMaximumSuppressionBand");
+
+            band_keypoints.clear();
+            if(neighborhoods){
+                neighborhoods->clear();
+            }
+
+            nonMaximumSuppressionSeparableBand(
+                pyramid_responses_[task.level], nullptr, &band_keypoints, neighborhoods,
+                thresh_f, nms_window_size, task.row_begin, task.row_end, workspace.nms,
+                *kernels_);
+
+            // drop the keypoints that are not maxima across scales, with
+            // their neighbourhoods
+            size_t num_kept = 0;
+            for(size_t i = 0; i < band_keypoints.size(); i++){
+                if(isScaleMaximum(band_keypoints[i], task.level, levels, half_nms_w_size)){
+                    if(neighborhoods){
+                        neighborhoods->move(i, num_kept);
+                    }
+                    band_keypoints[num_kept++] = band_keypoints[i];
+                }
+            }
+            band_keypoints.resize(num_kept);
+
+            if(neighborhoods){
+                neighborhoods->resize(num_kept);
+                refineKeypoints(band_keypoints, *neighborhoods);
+            }
+
+            // map to input image pixels
+            const float scale = static_cast<float>(1 << task.level);
+            for(Keypoint& kp : band_keypoints){
+                kp.x *= scale;
+                kp.y *= scale;
+                kp.scale = scale;
+            }
+        });
+
+    keypoints.clear();
+    for(int task_idx = 0; task_idx < num_tasks; task_idx++){
+        keypoints.insert(keypoints.end(),
+                         band_keypoints_[task_idx].begin(),
+                         band_keypoints_[task_idx].end());
+    }
+
+    selectKeypoints(keypoints, input_image.size(), selection);
+}
+
+/*
+  Keep at most selection.max_corners_per_cell keypoints in each cell of
+  a selection.grid_cols x selection.grid_rows grid, and then at most
+  selection.max_corners keypoints in total, preferring higher scores,
+  or with selection.adaptive_nms the largest suppression radii of
+  adaptiveNonMaximalSuppression(). Uses std::nth_element, so the cost
+  is linear in the number of keypoints, and the kept keypoints are not
+  sorted. Ties are broken by position so that the result is
+  deterministic.
+ */
+void HarrisCorner::selectKeypoints(std::vector<Keypoint>& keypoints,
+                                   const cv::Size& image_size,
+                                   const KeypointSelection& selection){
+
+    MY_UTILS_KK4_TRACE_SPAN("HarrisCorner::selectKeypoints");
+
+    const int grid_cols = std::max(1, selection.grid_cols);
+    const int grid_rows = std::max(1, selection.grid_rows);
+    const int num_cells = grid_cols * grid_rows;
+
+    if(selection.max_corners_per_cell > 0){
+
+        // bucket the keypoints by cell (counting sort, stable)
+        std::vector<int>& cell_begin = cell_begin_scratch_;
+        std::vector<Keypoint>& scratch = keypoint_scratch_;
+
+        assignCounted(cell_begin, num_cells + 1, 0, num_allocations_);
+
+        auto cell_of = [&](const Keypoint& kp){
+            const int c = std::min(grid_cols - 1,
+                                   static_cast<int>(kp.x) * grid_cols / image_size.width);
+            const int r = std::min(grid_rows - 1,
+                                   static_cast<int>(kp.y) * grid_rows / image_size.height);
+            return r * grid_cols + c;
+        };
+
+        for(const Keypoint& kp : keypoints){
+            cell_begin[cell_of(kp) + 1]++;
+        }
+        for(int i = 0; i < num_cells; i++){
+            cell_begin[i + 1] += cell_begin[i];
+        }
+
+        scratch.resize(keypoints.size());
+        {
+            std::vector<int>& cell_fill = cell_fill_scratch_;
+            resizeCounted(cell_fill, num_cells, num_allocations_);
+            std::copy(cell_begin.begin(), cell_begin.end() - 1, cell_fill.begin());
+            for(const Keypoint& kp : keypoints){
+                scratch[cell_fill[cell_of(kp)]++] = kp;
+            }
+        }
+
+        keypoints.clear();
+
+        for(int i = 0; i < num_cells; i++){
+
+            auto first = scratch.begin() + cell_begin[i];
+            auto last = scratch.begin() + cell_begin[i + 1];
+
+            if(last - first > selection.max_corners_per_cell){
+                auto nth = first + selection.max_corners_per_cell;
+                std::nth_element(first, nth, last, higherFirst);
+                last = nth;
+            }
+
+            keypoints.insert(keypoints.end(), first, last);
+        }
+    }
+
+    if(selection.adaptive_nms){
+        adaptiveNonMaximalSuppression(keypoints, selection.max_corners);
+
+    }else if(selection.max_corners > 0 &&
+             static_cast<int>(keypoints.size()) > selection.max_corners){
+
+        auto nth = keypoints.begin() + selection.max_corners;
+        std::nth_element(keypoints.begin(), nth, keypoints.end(), higherFirst);
+        keypoints.resize(selection.max_corners);
+    }
+}
+
+/*
+  Both methods take the radius of a keypoint as the minimum over the
+  same stronger keypoints with the same float arithmetic, so they agree
+  exactly.
+
+  ANMS_GRID visits the keypoints in score order. The keypoints that
+  suppress one are then a prefix of that order, the ranks below a limit
+  that only grows, so a grid of all of them whose cells list their
+  keypoints in rank order indexes the stronger ones: a cell is read up
+  to the limit. The nearest is searched ring by ring of cells around
+  the keypoint's cell, until the next ring cannot hold anything nearer.
+  With about kAnmsKeypointsPerCell keypoints per cell, the k-th
+  keypoint reads about n / k cells before it meets one of its k
+  stronger ones, so all of them read about n log n cells.
+ */
+void HarrisCorner::adaptiveNonMaximalSuppression(std::vector<Keypoint>& keypoints,
+                                                 const int max_corners,
+                                                 const double robustness,
+                                                 const AnmsMethod method){
+
+    MY_UTILS_KK4_TRACE_SPAN("HarrisCorner::adaptiveNonMaximalSuppression");
+
+    if(! (robustness > 0.0 && robustness <= 1.0)){
+        throw std::runtime_error("robustness must be in (0, 1]");
+    }
+
+    const int n = static_cast<int>(keypoints.size());
+    if(max_corners <= 0 || n <= max_corners){
+        return;
+    }
+
+    std::sort(keypoints.begin(), keypoints.end(), higherFirst);
+
+    // whether stronger suppresses keypoint
+    const float c_robust = static_cast<float>(robustness);
+    auto suppresses = [c_robust](const Keypoint& stronger, const Keypoint& keypoint){
+        return keypoint.score < c_robust * stronger.score;
+    };
+
+    std::vector<float>& radius2 = anms_radius_scratch_;
+    resizeCounted(radius2, n, num_allocations_);
+
+    if(method == ANMS_NAIVE){
+
+        for(int i = 0; i < n; i++){
+            const Keypoint& keypoint = keypoints[i];
+            float best = std::numeric_limits<float>::infinity();
+            for(int j = 0; j < n; j++){
+                if(j != i && suppresses(keypoints[j], keypoint)){
+                    best = std::min(best, squaredDistance(keypoint.x, keypoint.y,
+                                                          keypoints[j].x, keypoints[j].y));
+                }
+            }
+            radius2[i] = best;
+        }
+
+    }else{
+
+        float min_x = keypoints[0].x;
+        float max_x = keypoints[0].x;
+        float min_y = keypoints[0].y;
+        float max_y = keypoints[0].y;
+        for(const Keypoint& keypoint : keypoints){
+            min_x = std::min(min_x, keypoint.x);
+            max_x = std::max(max_x, keypoint.x);
+            min_y = std::min(min_y, keypoint.y);
+            max_y = std::max(max_y, keypoint.y);
+        }
+
+        // a pixel more each way, so that a line of keypoints still has an area
+        const double width = static_cast<double>(max_x) - min_x;
+        const double height = static_cast<double>(max_y) - min_y;
+        const double cell_size =
+            std::sqrt((width + 1.0) * (height + 1.0) * kAnmsKeypointsPerCell / n);
+        const int cols = static_cast<int>(width / cell_size) + 1;
+        const int rows = static_cast<int>(height / cell_size) + 1;
+
+        auto col_of = [&](const float x){
+            return std::min(cols - 1, static_cast<int>((x - static_cast<double>(min_x)) / cell_size));
+        };
+        auto row_of = [&](const float y){
+            return std::min(rows - 1, static_cast<int>((y - static_cast<double>(min_y)) / cell_size));
+        };
+
+        // bucket the keypoints by cell in rank order (counting sort, stable)
+        std::vector<int>& cell_begin = cell_begin_scratch_;
+        std::vector<AnmsPoint>& points = anms_points_scratch_;
+
+        assignCounted(cell_begin, static_cast<size_t>(cols) * rows + 1, 0, num_allocations_);
+        for(const Keypoint& keypoint : keypoints){
+            cell_begin[row_of(keypoint.y) * cols + col_of(keypoint.x) + 1]++;
+        }
+        for(int i = 0; i < cols * rows; i++){
+            cell_begin[i + 1] += cell_begin[i];
+        }
+
+        resizeCounted(points, n, num_allocations_);
+        {
+            std::vector<int>& cell_fill = cell_fill_scratch_;
+            resizeCounted(cell_fill, cols * rows, num_allocations_);
+            std::copy(cell_begin.begin(), cell_begin.end() - 1, cell_fill.begin());
+            for(int i = 0; i < n; i++){
+                const Keypoint& keypoint = keypoints[i];
+                AnmsPoint& point = points[cell_fill[row_of(keypoint.y) * cols + col_of(keypoint.x)]++];
+                point.x = keypoint.x;
+                point.y = keypoint.y;
+                point.rank = i;
+            }
+        }
+
+        int limit = 0;      // keypoints [0, limit) suppress keypoints[i]
+
+        for(int i = 0; i < n; i++){
+
+            const Keypoint& keypoint = keypoints[i];
+            while(limit < n && suppresses(keypoints[limit], keypoint)){
+                limit++;
+            }
+
+            float best = std::numeric_limits<float>::infinity();
+
+            auto search_cell = [&](const int cell){
+                for(int p = cell_begin[cell]; p < cell_begin[cell + 1] && points[p].rank < limit; p++){
+                    if(points[p].rank != i){
+                        best = std::min(best, squaredDistance(keypoint.x, keypoint.y,
+                                                              points[p].x, points[p].y));
+                    }
+                }
+            };
+
+            const int col = col_of(keypoint.x);
+            const int row = row_of(keypoint.y);
+            const int max_ring = limit == 0 ? -1
+                : std::max(std::max(col, cols - 1 - col), std::max(row, rows - 1 - row));
+
+            for(int ring = 0; ring <= max_ring; ring++){
+
+                for(int j = std::max(0, row - ring); j <= std::min(rows - 1, row + ring); j++){
+                    if(j == row - ring || j == row + ring){
+                        for(int k = std::max(0, col - ring); k <= std::min(cols - 1, col + ring); k++){
+                            search_cell(j * cols + k);
+                        }
+                    }else{
+                        if(col - ring >= 0){
+                            search_cell(j * cols + col - ring);
+                        }
+                        if(col + ring < cols){
+                            search_cell(j * cols + col + ring);
+                        }
+                    }
+                }
+
+                // the next ring is more than ring cells away, less a
+                // margin for round-off
+                const double reach = ring * cell_size * (1.0 - 1e-3);
+                if(best <= reach * reach){
+                    break;
+                }
+            }
+
+            radius2[i] = best;
+        }
+    }
+
+    // largest radii first, ties in score order
+    std::vector<int>& order = anms_order_scratch_;
+    resizeCounted(order, n, num_allocations_);
+    std::iota(order.begin(), order.end(), 0);
+
+    auto wider_first = [&](const int a, const int b){
+        if(radius2[a] != radius2[b]){
+            return radius2[a] > radius2[b];
+        }
+        return a < b;
+    };
+    std::nth_element(order.begin(), order.begin() + max_corners, order.end(), wider_first);
+    std::sort(order.begin(), order.begin() + max_corners, wider_first);
+
+    std::vector<Keypoint>& scratch = keypoint_scratch_;
+    scratch.resize(max_corners);
+    for(int i = 0; i < max_corners; i++){
+        scratch[i] = keypoints[order[i]];
+    }
+    keypoints.assign(scratch.begin(), scratch.end());
+}
+
+/*
+  Common part of detectCorners() and detectKeypoints(). Either output
+  may be null. Keypoints are listed in raster order.
+ */
+void HarrisCorner::detect(const cv::Mat& input_image,
+                          cv::Mat* img_binary_result,
+                          std::vector<Keypoint>* keypoints,
+                          const double thresh,
+                          const int nms_window_size){
+
+    checkInputType(input_image);
+
+    if(nms_window_size <= 0 || nms_window_size % 2 == 0){
+        throw std::runtime_error("window_size must be an odd number");
+    }
+
+    if(img_binary_result){
+        img_binary_result->create(input_image.size(), CV_8UC1);
+    }
+
+    const float thresh_f = toFloatThreshold(thresh);
+    const int rows = input_image.rows;
+    const int cols = input_image.cols;
+
+    if(incremental_){
+        detectIncremental(input_image, img_binary_result, keypoints, thresh_f, nms_window_size);
+        prepareKeptPlanes(input_image, kept_planes_ & planeBit(PLANE_RESPONSE),
+                          &incremental_state_.response);
+        return;
+    }
+
+    int band_rows, num_bands;
+
+    if(pipeline_mode_ == PIPELINE_PLANES){
+
+        createCounted(response_, input_image.size(), CV_32FC1, num_allocations_);
+        calcResponse(input_image, response_);
+
+        band_rows = calcBandRows(rows, nms_window_size);
+        num_bands = (rows + band_rows - 1) / band_rows;
+        prepareBandWorkspaces(cols, input_image.depth(), nms_window_size,
+                              std::min(rows, band_rows) + nms_window_size - 1);
+        prepareBandKeypoints(num_bands);
+
+        thread_pool_.parallelFor(num_bands, [&](const int band_idx, const int thread_idx){
+
+                const int row_begin = band_idx * band_rows;
+                const int row_end = std::min(row_begin + band_rows, rows);
+
+                MY_UTILS_KK4_TRACE_SPAN("nonMaximumSuppressionBand");
+
+                BandWorkspace& workspace = band_workspaces_[thread_idx];
+                NeighborhoodBatch* const neighborhoods =
+                    keypoints && subpixel_refinement_ ? &band_neighborhoods_[band_idx] : nullptr;
+
+                band_keypoints_[band_idx].clear();
+                if(neighborhoods){
+                    neighborhoods->clear();
+                }
+
+                nonMaximumSuppressionSeparableBand(
+                    response_, img_binary_result,
+                    keypoints ? &band_keypoints_[band_idx] : nullptr, neighborhoods,
+                    thresh_f, nms_window_size, row_begin, row_end, workspace.nms,
+                    *kernels_);
+
+                if(neighborhoods){
+                    refineKeypoints(band_keypoints_[band_idx], *neighborhoods);
+                }
+            });
+
+    }else{
+
+        band_rows = calcBandRows(rows, window_size_ + nms_window_size);
+        num_bands = (rows + band_rows - 1) / band_rows;
+        prepareBandWorkspaces(cols, input_image.depth(), nms_window_size,
+                              2 * nms_window_size);
+        prepareKeptPlanes(input_image, kept_planes_, nullptr);
+        prepareBandKeypoints(num_bands);
+
+        thread_pool_.parallelFor(num_bands, [&](const int band_idx, const int thread_idx){
+
+                const int row_begin = band_idx * band_rows;
+                const int row_end = std::min(row_begin + band_rows, rows);
+
+                MY_UTILS_KK4_TRACE_SPAN("detectCornersBand");
+
+                BandWorkspace& workspace = band_workspaces_[thread_idx];
+                NeighborhoodBatch* const neighborhoods =
+                    keypoints && subpixel_refinement_ ? &band_neighborhoods_[band_idx] : nullptr;
+
+                band_keypoints_[band_idx].clear();
+                if(neighborhoods){
+                    neighborhoods->clear();
+                }
+
+                detectCornersBand(input_image, img_binary_result,
+                                  keypoints ? &band_keypoints_[band_idx] : nullptr,
+                                  neighborhoods, thresh_f, nms_window_size,
+                                  row_begin, row_end, workspace);
+
+                if(neighborhoods){
+                    refineKeypoints(band_keypoints_[band_idx], *neighborhoods);
+                }
+            });
+    }
+
+    if(keypoints){
+        keypoints->clear();
+        for(int band_idx = 0; band_idx < num_bands; band_idx++){
+            keypoints->insert(keypoints->end(),
+                              band_keypoints_[band_idx].begin(),
+                              band_keypoints_[band_idx].end());
+        }
+    }
+}
+
+/*
+  detect() in incremental mode. Tiles are aligned with the running sum
+  restarts. The response of a tile depends on the input within
+  (window_size_ - 1) / 2 + 1 pixels of it, up to its restart rows and
+  columns, and its corners on the response within
+  (nms_window_size - 1) / 2 pixels, so a changed input tile makes its
+  neighbours dirty in turn. Dirty tiles are recomputed run by run on
+  views of the images that start at restart multiples and include those
+  halos, which gives exactly the values of a full recompute.
+ */
+void HarrisCorner::detectIncremental(const cv::Mat& input_image,
+                                     cv::Mat* img_binary_result,
+                                     std::vector<Keypoint>* keypoints,
+                                     const float thresh,
+                                     const int nms_window_size){
+
+    MY_UTILS_KK4_TRACE_SPAN("HarrisCorner::detectIncremental");
+
+    IncrementalState& state = incremental_state_;
+
+    const int tile_size = kIncrementalTileSize;
+    const int tiles_x = (input_image.cols + tile_size - 1) / tile_size;
+    const int tiles_y = (input_image.rows + tile_size - 1) / tile_size;
+    const int num_tiles = tiles_x * tiles_y;
+
+    const bool reuse = state.valid
+        && state.input.size() == input_image.size()
+        && state.input.type() == input_image.type()
+        && state.k == k_
+        && state.response_type == response_type_
+        && state.window_size == window_size_
+        && state.kernels == kernels_
+        && state.thresh == thresh
+        && state.nms_window_size == nms_window_size;
+
+    createCounted(state.input, input_image.size(), input_image.type(), num_allocations_);
+    createCounted(state.response, input_image.size(), CV_32FC1, num_allocations_);
+    resizeCounted(state.tile_keypoints, num_tiles, num_allocations_);
+    resizeCounted(state.input_dirty, num_tiles, num_allocations_);
+    resizeCounted(state.response_dirty, num_tiles, num_allocations_);
+    resizeCounted(state.nms_dirty, num_tiles, num_allocations_);
+
+    // room for every tile, so that the lists never grow
+    resizeCounted(state.runs, num_tiles, num_allocations_);
+    resizeCounted(state.nms_tiles, num_tiles, num_allocations_);
+
+    const int half_w_size = (window_size_ - 1) / 2;
+    const int half_nms_w_size = (nms_window_size - 1) / 2;
+
+    // views of a run are at most this high (see calcResponseTiles())
+    const int max_view_rows = tile_size + kRunningSumRestartInterval + 2 * (half_w_size + 1);
+
+    prepareBandWorkspaces(input_image.cols, input_image.depth(), nms_window_size,
+                          tile_size + 2 * half_nms_w_size);
+    for(BandWorkspace& workspace : band_workspaces_){
+        workspace.response.create(max_view_rows, input_image.cols, workspace.num_allocations);
+    }
+
+    state.valid = false;
+
+    if(reuse){
+        thread_pool_.parallelFor(tiles_y, [&](const int tile_row, const int){
+                findChangedTiles(input_image, tile_row);
+            });
+    }else{
+        input_image.copyTo(state.input);
+        std::fill(state.input_dirty.begin(), state.input_dirty.end(), 1);
+    }
+
+    dilateTiles(state.input_dirty, state.response_dirty, tiles_x, tiles_y,
+                (half_w_size + 1 + tile_size - 1) / tile_size);
+    dilateTiles(state.response_dirty, state.nms_dirty, tiles_x, tiles_y,
+                (half_nms_w_size + tile_size - 1) / tile_size);
+
+    state.dirty_tile_fraction =
+        static_cast<double>(std::count(state.response_dirty.begin(),
+                                       state.response_dirty.end(), 1)) / num_tiles;
+
+    collectTileRuns(state.response_dirty, tiles_x, tiles_y, state.runs);
+    thread_pool_.parallelFor(static_cast<int>(state.runs.size()),
+                             [&](const int run_idx, const int thread_idx){
+            MY_UTILS_KK4_TRACE_SPAN("calcResponseTiles");
+            calcResponseTiles(input_image, state.runs[run_idx], band_workspaces_[thread_idx]);
+        });
+
+    // one tile at a time, so that each writes its keypoints in place
+    state.nms_tiles.clear();
+    for(int tile_idx = 0; tile_idx < num_tiles; tile_idx++){
+        if(state.nms_dirty[tile_idx]){
+            state.nms_tiles.push_back(tile_idx);
+        }
+    }
+    thread_pool_.parallelFor(static_cast<int>(state.nms_tiles.size()),
+                             [&](const int i, const int thread_idx){
+            MY_UTILS_KK4_TRACE_SPAN("nonMaximumSuppressionTile");
+            nonMaximumSuppressionTile(state.nms_tiles[i], thresh, nms_window_size,
+                                      band_workspaces_[thread_idx]);
+        });
+
+    state.valid = true;
+    state.k = k_;
+    state.response_type = response_type_;
+    state.window_size = window_size_;
+    state.kernels = kernels_;
+    state.thresh = thresh;
+    state.nms_window_size = nms_window_size;
+
+    emitTileKeypoints(img_binary_result, keypoints);
+}
+
+/*
+  Mark the tiles of a tile row that differ from the previous frame as
+  input_dirty, and update the previous frame with them. Tiles are
+  compared exactly, so that any change is seen.
+ */
+void HarrisCorner::findChangedTiles(const cv::Mat& input_image,
+                                    const int tile_row){
+
+    IncrementalState& state = incremental_state_;
+
+    const int tile_size = kIncrementalTileSize;
+    const int tiles_x = (input_image.cols + tile_size - 1) / tile_size;
+    const int row_begin = tile_row * tile_size;
+    const int row_end = std::min(row_begin + tile_size, input_image.rows);
+    const size_t elem_size = input_image.elemSize();
+
+    for(int tile_col = 0; tile_col < tiles_x; tile_col++){
+
+        const int col_begin = tile_col * tile_size;
+        const size_t bytes = (std::min(col_begin + tile_size, input_image.cols) - col_begin)
+            * elem_size;
+
+        bool changed = false;
+
+        for(int i_r = row_begin; i_r < row_end; i_r++){
+
+            uint8_t const * const src = input_image.ptr<uint8_t>(i_r) + col_begin * elem_size;
+            uint8_t * const prev = state.input.ptr<uint8_t>(i_r) + col_begin * elem_size;
+
+            if(changed || std::memcmp(src, prev, bytes) != 0){
+                std::memcpy(prev, src, bytes);
+                changed = true;
+            }
+        }
+
+        state.input_dirty[tile_row * tiles_x + tile_col] = changed;
+    }
+}
+
+/*
+  Response of a run of tiles, into state.response. The view of the
+  input extends (window_size_ - 1) / 2 + 1 pixels past the tiles, for
+  the window and the central differences, and starts at a restart
+  multiple at or before that so that the running sums restart where
+  they do over the whole image. Pixels of the view outside the tiles
+  see the view border instead of the image and are thrown away.
+ */
+void HarrisCorner::calcResponseTiles(const cv::Mat& input_image,
+                                     const TileRun& run,
+                                     BandWorkspace& workspace){
+
+    const int tile_size = kIncrementalTileSize;
+    const int margin = (window_size_ - 1) / 2 + 1;
+
+    const int col_begin = run.tile_begin * tile_size;
+    const int col_end = std::min(run.tile_end * tile_size, input_image.cols);
+    const int row_begin = run.tile_row * tile_size;
+    const int row_end = std::min(row_begin + tile_size, input_image.rows);
+
+    const int view_col_begin = std::max(0, col_begin - margin)
+        / kRunningSumRestartInterval * kRunningSumRestartInterval;
+    const int view_row_begin = std::max(0, row_begin - margin)
+        / kRunningSumRestartInterval * kRunningSumRestartInterval;
+    const int view_col_end = std::min(input_image.cols, col_end + margin);
+    const int view_row_end = std::min(input_image.rows, row_end + margin);
+
+    const cv::Mat view = input_image(cv::Range(view_row_begin, view_row_end),
+                                     cv::Range(view_col_begin, view_col_end));
+
+    workspace.response.create(view.rows, view.cols, workspace.num_allocations);
+    calcResponseBand(view, workspace.response.buffer,
+                     row_begin - view_row_begin, row_end - view_row_begin, workspace);
+
+    for(int i_r = row_begin; i_r < row_end; i_r++){
+        float const * const src = workspace.response.row(i_r - view_row_begin)
+            + (col_begin - view_col_begin);
+        std::copy(src, src + (col_end - col_begin),
+                  incremental_state_.response.ptr<float>(i_r) + col_begin);
+    }
+}
+
+/*
+  Corners of a tile, into its state.tile_keypoints, by the separable NMS
+  on a view of the response that extends (nms_window_size - 1) / 2
+  pixels past the tile. Corners of the view outside the tile see the
+  view border instead of the image and are thrown away.
+ */
+void HarrisCorner::nonMaximumSuppressionTile(const int tile_idx,
+                                             const float thresh,
+                                             const int nms_window_size,
+                                             BandWorkspace& workspace){
+
+    IncrementalState& state = incremental_state_;
+
+    const int tile_size = kIncrementalTileSize;
+    const int rows = state.response.rows;
+    const int cols = state.response.cols;
+    const int tiles_x = (cols + tile_size - 1) / tile_size;
+    const int margin = (nms_window_size - 1) / 2;
+
+    const int col_begin = tile_idx % tiles_x * tile_size;
+    const int col_end = std::min(col_begin + tile_size, cols);
+    const int row_begin = tile_idx / tiles_x * tile_size;
+    const int row_end = std::min(row_begin + tile_size, rows);
+
+    const int view_col_begin = std::max(0, col_begin - margin);
+    const int view_row_begin = std::max(0, row_begin - margin);
+
+    const cv::Mat view = state.response(
+        cv::Range(view_row_begin, std::min(rows, row_end + margin)),
+        cv::Range(view_col_begin, std::min(cols, col_end + margin)));
+
+    std::vector<Keypoint>& keypoints = state.tile_keypoints[tile_idx];
+    keypoints.clear();
+
+    nonMaximumSuppressionSeparableBand(view, nullptr, &keypoints, nullptr,
+                                       thresh, nms_window_size,
+                                       row_begin - view_row_begin, row_end - view_row_begin,
+                                       workspace.nms, *kernels_);
+
+    auto last = std::remove_if(keypoints.begin(), keypoints.end(), [&](const Keypoint& kp){
+            const int i_c = static_cast<int>(kp.x) + view_col_begin;
+            return i_c < col_begin || i_c >= col_end;
+        });
+    keypoints.erase(last, keypoints.end());
+
+    for(Keypoint& kp : keypoints){
+        kp.x += view_col_begin;
+        kp.y += view_row_begin;
+    }
+}
+
+/*
+  Merge the keypoints of the tiles into raster order, draw them into
+  img_binary_result and refine them, either output may be null.
+ */
+void HarrisCorner::emitTileKeypoints(cv::Mat* img_binary_result,
+                                     std::vector<Keypoint>* keypoints){
+
+    IncrementalState& state = incremental_state_;
+
+    const int tile_size = kIncrementalTileSize;
+    const int rows = state.response.rows;
+    const int cols = state.response.cols;
+    const int tiles_x = (cols + tile_size - 1) / tile_size;
+    const int tiles_y = (rows + tile_size - 1) / tile_size;
+
+    if(img_binary_result){
+        img_binary_result->setTo(cv::Scalar(0));
+    }
+    if(keypoints){
+        keypoints->clear();
+    }
+
+    for(int tile_row = 0; tile_row < tiles_y; tile_row++){
+
+        std::vector<Keypoint> const * const tile_keypoints =
+            &state.tile_keypoints[tile_row * tiles_x];
+        assignCounted(state.cursors, tiles_x, size_t(0), num_allocations_);
+
+        const int row_end = std::min((tile_row + 1) * tile_size, rows);
+
+        for(int i_r = tile_row * tile_size; i_r < row_end; i_r++){
+            for(int tile_col = 0; tile_col < tiles_x; tile_col++){
+
+                size_t& cursor = state.cursors[tile_col];
+
+                for(; cursor < tile_keypoints[tile_col].size()
+                        && static_cast<int>(tile_keypoints[tile_col][cursor].y) == i_r;
+                    cursor++){
+
+                    const Keypoint& kp = tile_keypoints[tile_col][cursor];
+                    if(img_binary_result){
+                        img_binary_result->at<uint8_t>(i_r, static_cast<int>(kp.x)) = 255;
+                    }
+                    if(keypoints){
+                        keypoints->push_back(kp);
+                    }
+                }
+            }
+        }
+    }
+
+    if(keypoints && subpixel_refinement_){
+
+        prepareBandKeypoints(1);
+        NeighborhoodBatch& neighborhoods = band_neighborhoods_[0];
+        neighborhoods.clear();
+
+        // one row at a time, mirrored at the border as in
+        // nonMaximumSuppressionBlock()
+        auto first = keypoints->cbegin();
+        while(first != keypoints->cend()){
+
+            const int i_r = static_cast<int>(first->y);
+            auto last = first;
+            while(last != keypoints->cend() && static_cast<int>(last->y) == i_r){
+                ++last;
+            }
+
+            const int above = i_r > 0 ? i_r - 1 : std::min(1, rows - 1);
+            const int below = i_r < rows - 1 ? i_r + 1 : std::max(0, rows - 2);
+            collectNeighborhoods(state.response.ptr<float>(above),
+                                 state.response.ptr<float>(i_r),
+                                 state.response.ptr<float>(below), cols,
+                                 first, last, neighborhoods);
+            first = last;
+        }
+
+        refineKeypoints(*keypoints, neighborhoods);
+    }
+}
+
+// runs of adjacent dirty tiles, row by row
+void HarrisCorner::collectTileRuns(const std::vector<uint8_t>& dirty,
+                                   const int tiles_x,
+                                   const int tiles_y,
+                                   std::vector<TileRun>& runs){
+
+    runs.clear();
+
+    for(int tile_row = 0; tile_row < tiles_y; tile_row++){
+
+        uint8_t const * const row = &dirty[tile_row * tiles_x];
+
+        for(int tile_col = 0; tile_col < tiles_x; tile_col++){
+
+            if(! row[tile_col]){
+                continue;
+            }
+
+            TileRun run;
+            run.tile_row = tile_row;
+            run.tile_begin = tile_col;
+            while(tile_col < tiles_x && row[tile_col]){
+                tile_col++;
+            }
+            run.tile_end = tile_col;
+            runs.push_back(run);
+        }
+    }
+}
+
+/*
+  Level l of the pyramid is input_image downsampled by 2^l (level 0 is
+  input_image itself and is not copied). Levels are only added while
+  both sides stay at least twice the larger window. Allocates only when
+  the input size or the number of levels grows. Returns the number of
+  levels built.
+ */
+int HarrisCorner::buildPyramid(const cv::Mat& input_image,
+                               const int num_levels,
+                               const int nms_window_size){
+
+    MY_UTILS_KK4_TRACE_SPAN("HarrisCorner::buildPyramid");
+
+    const int min_size = 2 * std::max(window_size_, nms_window_size);
+
+    if(pyramid_responses_.size() < static_cast<size_t>(num_levels)){
+        resizeCounted(pyramid_images_, num_levels, num_allocations_);
+        resizeCounted(pyramid_responses_, num_levels, num_allocations_);
+    }
+
+    cv::Size size = input_image.size();
+    createCounted(pyramid_responses_[0], size, CV_32FC1, num_allocations_);
+
+    int levels = 1;
+
+    for(; levels < num_levels; levels++){
+
+        const cv::Size next_size((size.width + 1) / 2, (size.height + 1) / 2);
+        if(std::min(next_size.width, next_size.height) < min_size){
+            break;
+        }
+
+        const cv::Mat& src = levels == 1 ? input_image : pyramid_images_[levels - 1];
+        cv::Mat& dst = pyramid_images_[levels];
+
+        createCounted(dst, next_size, CV_32FC1, num_allocations_);
+        createCounted(pyramid_responses_[levels], next_size, CV_32FC1, num_allocations_);
+
+        const int band_rows = std::max(1, (next_size.height + 2 * getNumThreads() - 1)
+                                       / (2 * getNumThreads()));
+        const int num_bands = (next_size.height + band_rows - 1) / band_rows;
+
+        thread_pool_.parallelFor(num_bands, [&](const int band_idx, const int thread_idx){
+
+                BandWorkspace& workspace = band_workspaces_[thread_idx];
+                resizeCounted(workspace.pyramid_row, size.width + 6, workspace.num_allocations);
+
+                downsampleRows(src, dst, band_idx * band_rows,
+                               std::min((band_idx + 1) * band_rows, next_size.height),
+                               workspace.pyramid_row.data());
+            });
+
+        size = next_size;
+    }
 
+    return levels;
 }
 
-void HarrisCorner::calcResponse(const cv::Mat& input_image,
-                                cv::Mat& harris_response){
+/*
+  Rows [row_begin, row_end) of dst = src blurred with the binomial
+  kernel [1 4 6 4 1] / 16 in both directions and sampled at even
+  pixels, the same as cv::pyrDown() with the default (reflect 101)
+  border. row_buffer must hold src.cols + 6 floats.
+ */
+void HarrisCorner::downsampleRows(const cv::Mat& src,
+                                  cv::Mat& dst,
+                                  const int row_begin,
+                                  const int row_end,
+                                  float * const row_buffer)const{
+
+    const int cols = src.cols;
+    float * const v = row_buffer + 2;
 
-    assert(input_image.type() == CV_32FC1);
+    for(int i_r = row_begin; i_r < row_end; i_r++){
 
-    cv::Mat result = cv::Mat::zeros(input_image.size(), CV_32FC1);
+        float const * r[5];
+        for(int k = 0; k < 5; k++){
+            r[k] = src.ptr<float>(cv::borderInterpolate(2 * i_r + k - 2, src.rows,
+                                                        cv::BORDER_REFLECT_101));
+        }
+
+        // vertical pass, padded by reflection for the horizontal one
+        kernels_->binomialRows(r[0], r[1], r[2], r[3], r[4], v, cols);
+        for(int k = 1; k <= 2; k++){
+            v[-k] = v[cv::borderInterpolate(-k, cols, cv::BORDER_REFLECT_101)];
+            v[cols - 1 + k] = v[cv::borderInterpolate(cols - 1 + k, cols, cv::BORDER_REFLECT_101)];
+        }
+        v[cols + 2] = 0.0f;     // read but not used by SIMD kernels
 
-    cv::Mat M = cv::Mat::zeros(cv::Size(2, 2), CV_32FC1);
+        kernels_->binomialDecimate(v, dst.ptr<float>(i_r), dst.cols);
+    }
+}
 
-    cv::Mat grad_x, grad_y;
+/*
+  Scale-space part of detectKeypointsMultiScale(): true if no response
+  of the adjacent levels around the keypoint (given in pixels of its
+  level) is larger. The NMS window is mapped to each adjacent level,
+  i.e. doubled on the finer level and halved on the coarser one, and
+  covers at least one pixel around the keypoint.
+ */
+bool HarrisCorner::isScaleMaximum(const Keypoint& keypoint,
+                                  const int level,
+                                  const int num_levels,
+                                  const int half_nms_w_size)const{
 
-    cv::Sobel(input_image, grad_x, CV_32F, 1, 0, 1);
-    cv::Sobel(input_image, grad_y, CV_32F, 0, 1, 1);
+    const int x = static_cast<int>(keypoint.x);
+    const int y = static_cast<int>(keypoint.y);
+    const float val = keypoint.score;
 
-    for(size_t row_idx = 0; row_idx < input_image.rows; row_idx++){
+    // inclusive bounds, clipped to the level
+    auto has_larger = [val](const cv::Mat& response,
+                            int x_begin, int x_end, int y_begin, int y_end){
+        x_begin = std::max(x_begin, 0);
+        y_begin = std::max(y_begin, 0);
+        x_end = std::min(x_end, response.cols - 1);
+        y_end = std::min(y_end, response.rows - 1);
+        for(int i_r = y_begin; i_r <= y_end; i_r++){
+            float const * const row = response.ptr<float>(i_r);
+            for(int i_c = x_begin; i_c <= x_end; i_c++){
+                if(row[i_c] > val){
+                    return true;
+                }
+            }
+        }
+        return false;
+    };
 
-        for(size_t col_idx = 0; col_idx < input_image.cols; col_idx++){
+    if(level > 0){
+        const int h = std::max(1, 2 * half_nms_w_size);
+        if(has_larger(pyramid_responses_[level - 1],
+                      2 * x - h, 2 * x + h, 2 * y - h, 2 * y + h)){
+            return false;
+        }
+    }
 
-            calcM(grad_x, grad_y, M, row_idx, col_idx);
+    if(level + 1 < num_levels){
+        const int h = std::max(1, half_nms_w_size / 2);
+        if(has_larger(pyramid_responses_[level + 1],
+                      (x >> 1) - h, ((x + 1) >> 1) + h, (y >> 1) - h, ((y + 1) >> 1) + h)){
+            return false;
         }
     }
 
-    
+    return true;
+}
+
+// grow-only, like prepareBandWorkspaces()
+void HarrisCorner::prepareBandKeypoints(const int num_bands){
+
+    if(band_keypoints_.size() < static_cast<size_t>(num_bands)){
+        resizeCounted(band_keypoints_, num_bands, num_allocations_);
+    }
+    if(band_neighborhoods_.size() < static_cast<size_t>(num_bands)){
+        resizeCounted(band_neighborhoods_, num_bands, num_allocations_);
+    }
+}
+
+/*
+  Move every keypoint by the sub-pixel offset of the quadratic fitted
+  to its neighbourhood. neighborhoods holds one neighbourhood per
+  keypoint, in the same order.
+ */
+void HarrisCorner::refineKeypoints(std::vector<Keypoint>& keypoints,
+                                   NeighborhoodBatch& neighborhoods)const{
+
+    assert(neighborhoods.size() == keypoints.size());
+
+    MY_UTILS_KK4_TRACE_SPAN("refineKeypoints");
+
+    const int n = static_cast<int>(keypoints.size());
+
+    neighborhoods.offset_x.resize(n);
+    neighborhoods.offset_y.resize(n);
+
+    float const * samples[9];
+    for(int k = 0; k < 9; k++){
+        samples[k] = neighborhoods.samples[k].data();
+    }
+
+    kernels_->subpixelOffsets(samples, neighborhoods.offset_x.data(),
+                              neighborhoods.offset_y.data(), n);
+
+    for(int m = 0; m < n; m++){
+        keypoints[m].x += neighborhoods.offset_x[m];
+        keypoints[m].y += neighborhoods.offset_y[m];
+    }
+}
+
+/*
+  Rows per band for splitting an image of the given height among the
+  threads. Bands start at multiples of kRunningSumRestartInterval so
+  that every band restarts its running sums exactly where a single band
+  would, which keeps the result independent of the thread count. Two
+  bands per thread give some load balancing; since each band also
+  recomputes a halo, bands are not made smaller than halo rows.
+ */
+int HarrisCorner::calcBandRows(const int rows, const int halo)const{
+
+    const int num_threads = thread_pool_.getNumThreads();
+    const int num_blocks = (rows + kRunningSumRestartInterval - 1) / kRunningSumRestartInterval;
+    const int target_bands = num_threads == 1 ? 1 : 2 * num_threads;
+    const int blocks_per_band = std::max((num_blocks + target_bands - 1) / target_bands,
+                                         (halo + kRunningSumRestartInterval - 1)
+                                         / kRunningSumRestartInterval);
+
+    return std::max(1, blocks_per_band) * kRunningSumRestartInterval;
 }
 
 void HarrisCorner::nonMaximumSuppression(const cv::Mat& img_response,
                                          cv::Mat& img_binary_result,
                                          const double thresh,
-                                         const int window_size){
+                                         const int window_size,
+                                         const NmsMethod method,
+                                         my_utils_kk4::ThreadPool* thread_pool,
+                                         NmsContext* context){
+
+    MY_UTILS_KK4_TRACE_SPAN("HarrisCorner::nonMaximumSuppression");
 
     if(img_response.type() != CV_32FC1){
         throw std::runtime_error("Invalid matrix type");
     }
 
-    if(window_size % 2 == 0){
+    if(window_size <= 0 || window_size % 2 == 0){
         throw std::runtime_error("window_size must be an odd number");
     }
 
-    img_binary_result = cv::Mat::zeros(img_response.size(), CV_8UC1);
+    switch(method){
+    case NMS_NAIVE:
+        nonMaximumSuppressionNaive(img_response, img_binary_result,
+                                   thresh, window_size);
+        break;
+    case NMS_SEPARABLE:
+        if(context){
+            nonMaximumSuppressionSeparable(img_response, img_binary_result,
+                                           thresh, window_size, thread_pool,
+                                           harris_kernels::getBestKernels(), *context);
+        }else{
+            NmsContext local_context;
+            nonMaximumSuppressionSeparable(img_response, img_binary_result,
+                                           thresh, window_size, thread_pool,
+                                           harris_kernels::getBestKernels(), local_context);
+        }
+        break;
+    default:
+        throw std::runtime_error("Invalid NMS method");
+    }
+}
+
+void HarrisCorner::nonMaximumSuppressionNaive(const cv::Mat& img_response,
+                                              cv::Mat& img_binary_result,
+                                              const double thresh,
+                                              const int window_size){
+
+    img_binary_result.create(img_response.size(), CV_8UC1);
+    img_binary_result.setTo(cv::Scalar(0));
 
     const int window_min = - (window_size - 1) / 2;
     const int window_max = -window_min;
@@ -82,6 +1588,10 @@ void HarrisCorner::nonMaximumSuppression(const cv::Mat& img_response,
                     continue;
                 }
 
+                if(i_r + j_r < 0 || i_r + j_r >= img_response.rows){
+                    continue;
+                }
+
                 if(nonMaximumSuppressionCheckRow(
                        val, img_response.ptr<float>(i_r + j_r),
                        i_c, window_min, window_max, img_response.cols)){
@@ -102,37 +1612,766 @@ void HarrisCorner::nonMaximumSuppression(const cv::Mat& img_response,
     return;
 }
 
+/*
+  Same result as nonMaximumSuppressionNaive(): a pixel is kept when it
+  is not below thresh and no pixel in its window (clipped to the image)
+  is larger, i.e. when it equals the window maximum, so plateaus are
+  kept as a whole. The window maximum is computed separably, first
+  along each row and then along each column, with slidingWindowMax().
+ */
+void HarrisCorner::nonMaximumSuppressionSeparable(const cv::Mat& img_response,
+                                                  cv::Mat& img_binary_result,
+                                                  const double thresh,
+                                                  const int window_size,
+                                                  my_utils_kk4::ThreadPool* thread_pool,
+                                                  const harris_kernels::KernelTable& kernels,
+                                                  NmsContext& context){
+
+    const int rows = img_response.rows;
+    const float thresh_f = toFloatThreshold(thresh);
+
+    img_binary_result.create(img_response.size(), CV_8UC1);
+
+    // The max is exact, so bands can be split anywhere. Each band
+    // redoes the row pass for (window_size - 1) / 2 rows of halo on
+    // both sides.
+    const int num_threads = thread_pool ? thread_pool->getNumThreads() : 1;
+    const int target_bands = num_threads == 1 ? 1 : 2 * num_threads;
+    const int band_rows = std::max((rows + target_bands - 1) / target_bands,
+                                   window_size);
+    const int num_bands = (rows + band_rows - 1) / band_rows;
+
+    // Any thread may get any band, so every workspace is sized here for
+    // the largest band, as in prepareBandWorkspaces().
+    if(context.workspaces_.size() < static_cast<size_t>(num_threads)){
+        resizeCounted(context.workspaces_, num_threads, context.num_allocations_);
+    }
+    for(int thread_idx = 0; thread_idx < num_threads; thread_idx++){
+        prepareNmsWorkspace(context.workspaces_[thread_idx], img_response.cols, window_size,
+                            std::min(rows, band_rows + window_size - 1));
+    }
+
+    auto run_band = [&](const int band_idx, const int thread_idx){
+
+        const int row_begin = band_idx * band_rows;
+        const int row_end = std::min(row_begin + band_rows, rows);
+
+        MY_UTILS_KK4_TRACE_SPAN("nonMaximumSuppressionBand");
+
+        nonMaximumSuppressionSeparableBand(img_response, &img_binary_result, nullptr, nullptr,
+                                           thresh_f, window_size, row_begin, row_end,
+                                           context.workspaces_[thread_idx], kernels);
+    };
+
+    if(thread_pool){
+        thread_pool->parallelFor(num_bands, run_band);
+    }else{
+        for(int band_idx = 0; band_idx < num_bands; band_idx++){
+            run_band(band_idx, 0);
+        }
+    }
+}
+
+void HarrisCorner::nonMaximumSuppressionSeparableBand(const cv::Mat& img_response,
+                                                      cv::Mat* img_binary_result,
+                                                      std::vector<Keypoint>* keypoints,
+                                                      NeighborhoodBatch* neighborhoods,
+                                                      const float thresh,
+                                                      const int window_size,
+                                                      const int row_begin,
+                                                      const int row_end,
+                                                      NmsWorkspace& workspace,
+                                                      const harris_kernels::KernelTable& kernels){
+
+    const int rows = img_response.rows;
+    const int cols = img_response.cols;
+    const int half_w_size = (window_size - 1) / 2;
+    const int halo_begin = std::max(0, row_begin - half_w_size);
+    const int halo_end = std::min(rows, row_end + half_w_size);
+
+    // the whole plane, as a ring with as many rows as the image
+    RowRing response;
+    response.buffer = img_response;
+
+    prepareNmsWorkspace(workspace, cols, window_size, halo_end - halo_begin);
+
+    for(int i_r = halo_begin; i_r < halo_end; i_r++){
+        calcRowMax(response.row(i_r), workspace.row_max.row(i_r),
+                   cols, window_size, workspace, kernels);
+    }
+
+    for(int block_begin = 0; block_begin < row_end - row_begin; block_begin += window_size){
+        nonMaximumSuppressionBlock(response, rows, row_begin, row_end, block_begin,
+                                   thresh, window_size, workspace, kernels,
+                                   img_binary_result, keypoints, neighborhoods);
+    }
+}
+
+void HarrisCorner::prepareNmsWorkspace(NmsWorkspace& workspace,
+                                       const int cols,
+                                       const int window_size,
+                                       const int row_max_capacity){
+
+    const int w = window_size;
+    const float neg_inf = -std::numeric_limits<float>::infinity();
+
+    unsigned long& num_allocations = workspace.num_allocations;
+
+    assignCounted(workspace.padded_row, ((cols + w - 1) / w + 1) * w, neg_inf, num_allocations);
+    resizeCounted(workspace.suffix_max, w, num_allocations);
+    assignCounted(workspace.neg_inf_row, cols, neg_inf, num_allocations);
+    workspace.suffix_rows.create(w, cols, num_allocations);
+    resizeCounted(workspace.prefix_row, cols, num_allocations);
+    resizeCounted(workspace.window_max_row, cols, num_allocations);
+    resizeCounted(workspace.mask_row, cols, num_allocations);
+    workspace.row_max.create(row_max_capacity, cols, num_allocations);
+}
+
+/*
+  Row pass of the separable NMS for one row. Window sizes the kernels
+  are specialized for go to them; larger ones take the generic
+  slidingWindowMax() on a padded copy of the row.
+ */
+void HarrisCorner::calcRowMax(float const * const response_row,
+                              float * const row_max_row,
+                              const int cols,
+                              const int window_size,
+                              NmsWorkspace& workspace,
+                              const harris_kernels::KernelTable& kernels){
+
+    const int half_w_size = (window_size - 1) / 2;
+
+    if(half_w_size < harris_kernels::kNumWindowMaxKernels){
+        kernels.windowMaxRow[half_w_size](response_row, row_max_row, cols);
+        return;
+    }
+
+    std::copy(response_row, response_row + cols,
+              workspace.padded_row.begin() + half_w_size);
+
+    slidingWindowMax(workspace.padded_row.data(), row_max_row,
+                     cols, window_size, workspace.suffix_max.data());
+}
+
+/*
+  Column pass of the separable NMS: slidingWindowMax() applied to whole
+  rows at once, for the output rows
+  [row_begin + block_begin, row_begin + block_begin + window_size)
+  clipped to row_end. The row maxima of image rows
+  [row_begin + block_begin - half_w_size,
+   min(row_begin + block_begin + window_size - 1, row_end - 1) + half_w_size]
+  must be in workspace.row_max, and the responses of the output rows in
+  response. The result goes to img_binary_result and/or keypoints,
+  either of which may be null.
+
+  Padded row p corresponds to image row row_begin - half_w_size + p;
+  the window of output row row_begin + q spans padded rows [q, q + w).
+ */
+void HarrisCorner::nonMaximumSuppressionBlock(const RowRing& response,
+                                              const int rows,
+                                              const int row_begin,
+                                              const int row_end,
+                                              const int block_begin,
+                                              const float thresh,
+                                              const int window_size,
+                                              NmsWorkspace& workspace,
+                                              const harris_kernels::KernelTable& kernels,
+                                              cv::Mat* img_binary_result,
+                                              std::vector<Keypoint>* keypoints,
+                                              NeighborhoodBatch* neighborhoods){
+
+    const int cols = static_cast<int>(workspace.prefix_row.size());
+    const int w = window_size;
+    const int half_w_size = (w - 1) / 2;
+    const float neg_inf = -std::numeric_limits<float>::infinity();
+
+    auto padded_row_ptr = [&](const int p) -> float const *{
+        const int i_r = row_begin - half_w_size + p;
+        if(i_r < 0 || i_r >= rows){
+            return workspace.neg_inf_row.data();
+        }
+        return workspace.row_max.row(i_r);
+    };
+
+    cv::Mat& suffix_rows = workspace.suffix_rows.buffer;
+    float * const prefix_row = workspace.prefix_row.data();
+    float * const window_max_row = workspace.window_max_row.data();
+
+    {
+        float const * const src = padded_row_ptr(block_begin + w - 1);
+        std::copy(src, src + cols, suffix_rows.ptr<float>(w - 1));
+    }
+    for(int j = w - 2; j >= 0; j--){
+        kernels.maxRow(padded_row_ptr(block_begin + j),
+                       suffix_rows.ptr<float>(j + 1),
+                       suffix_rows.ptr<float>(j), cols);
+    }
+
+    std::fill(prefix_row, prefix_row + cols, neg_inf);
+
+    for(int j = 0; j < w && row_begin + block_begin + j < row_end; j++){
+
+        const int i_r = row_begin + block_begin + j;
+
+        if(j > 0){
+            kernels.maxRow(prefix_row, padded_row_ptr(block_begin + w + j - 1),
+                           prefix_row, cols);
+        }
+
+        kernels.maxRow(suffix_rows.ptr<float>(j), prefix_row, window_max_row, cols);
+
+        uint8_t * const mask = img_binary_result ?
+            img_binary_result->ptr<uint8_t>(i_r) : workspace.mask_row.data();
+
+        kernels.nmsCompare(response.row(i_r), window_max_row, thresh, mask, cols);
+
+        if(keypoints){
+            const size_t first = keypoints->size();
+            collectKeypoints(mask, response.row(i_r), i_r, cols, *keypoints);
+
+            if(neighborhoods && keypoints->size() > first){
+                // mirrored at the image border, which gives no offset
+                // across it
+                const int above = i_r > 0 ? i_r - 1 : std::min(1, rows - 1);
+                const int below = i_r < rows - 1 ? i_r + 1 : std::max(0, rows - 2);
+                collectNeighborhoods(response.row(above), response.row(i_r),
+                                     response.row(below), cols,
+                                     keypoints->begin() + first, keypoints->end(),
+                                     *neighborhoods);
+            }
+        }
+    }
+}
+
+// append the pixels set in a mask row to keypoints
+void HarrisCorner::collectKeypoints(uint8_t const * const mask_row,
+                                    float const * const response_row,
+                                    const int i_r,
+                                    const int cols,
+                                    std::vector<Keypoint>& keypoints){
+
+    int i_c = 0;
+
+    while(i_c < cols){
+
+        // skip empty runs 8 pixels at a time
+        if(i_c + 8 <= cols){
+            uint64_t chunk;
+            std::memcpy(&chunk, mask_row + i_c, sizeof(chunk));
+            if(chunk == 0){
+                i_c += 8;
+                continue;
+            }
+        }
+
+        if(mask_row[i_c]){
+            Keypoint kp;
+            kp.x = static_cast<float>(i_c);
+            kp.y = static_cast<float>(i_r);
+            kp.score = response_row[i_c];
+            kp.scale = 1.0f;
+            keypoints.push_back(kp);
+        }
+        i_c++;
+    }
+}
+
+// append the 3x3 neighbourhoods of the keypoints [first, last) of one row
+void HarrisCorner::collectNeighborhoods(float const * const above_row,
+                                        float const * const response_row,
+                                        float const * const below_row,
+                                        const int cols,
+                                        std::vector<Keypoint>::const_iterator first,
+                                        std::vector<Keypoint>::const_iterator last,
+                                        NeighborhoodBatch& neighborhoods){
+
+    float const * const rows[3] = {above_row, response_row, below_row};
+
+    for(; first != last; ++first){
+
+        const int i_c = static_cast<int>(first->x);
+        const int left = i_c > 0 ? i_c - 1 : std::min(1, cols - 1);
+        const int right = i_c < cols - 1 ? i_c + 1 : std::max(0, cols - 2);
+
+        for(int j = 0; j < 3; j++){
+            neighborhoods.samples[3 * j].push_back(rows[j][left]);
+            neighborhoods.samples[3 * j + 1].push_back(rows[j][i_c]);
+            neighborhoods.samples[3 * j + 2].push_back(rows[j][right]);
+        }
+    }
+}
+
+// smallest float not below thresh, so that comparing floats with it is
+// the same as comparing with the double thresh
+float HarrisCorner::toFloatThreshold(const double thresh){
+
+    float thresh_f = static_cast<float>(thresh);
+    if(static_cast<double>(thresh_f) < thresh){
+        thresh_f = std::nextafter(thresh_f, std::numeric_limits<float>::infinity());
+    }
+    return thresh_f;
+}
+
+/*
+  van Herk/Gil-Werman sliding window maximum.
+  dst[i] = max(src[i], ..., src[i + window_size - 1]) for i in [0, length).
+  src must be readable up to index
+  ((length + window_size - 1) / window_size + 1) * window_size - 1 (pad
+  with -inf). suffix_max is a scratch buffer of window_size elements.
+ */
+void HarrisCorner::slidingWindowMax(float const * const src,
+                                    float * const dst,
+                                    const int length,
+                                    const int window_size,
+                                    float * const suffix_max){
+
+    const int w = window_size;
+
+    for(int block_begin = 0; block_begin < length; block_begin += w){
+
+        float const * const block = src + block_begin;
+
+        suffix_max[w - 1] = block[w - 1];
+        for(int j = w - 2; j >= 0; j--){
+            suffix_max[j] = std::max(block[j], suffix_max[j + 1]);
+        }
+
+        float prefix_max = -std::numeric_limits<float>::infinity();
+
+        for(int j = 0; j < w && block_begin + j < length; j++){
+
+            if(j > 0){
+                prefix_max = std::max(prefix_max, block[w + j - 1]);
+            }
+
+            dst[block_begin + j] = std::max(suffix_max[j], prefix_max);
+        }
+    }
+}
+
+
+/*
+  Compute the response of image rows [row_begin, row_end), which must
+  start at a multiple of kRunningSumRestartInterval. Gradients and
+  tensor products are produced one row at a time into a ring of
+  window_size_ + 1 rows, just ahead of the response row that needs
+  them, so they never exist as full planes.
+ */
+void HarrisCorner::calcResponseBand(const cv::Mat& input_image,
+                                    cv::Mat& harris_response,
+                                    const int row_begin,
+                                    const int row_end,
+                                    BandWorkspace& workspace)const{
+
+    cv::Mat* responses[harris_kernels::kNumResponses] = {};
+    responses[response_type_] = &harris_response;
+
+    calcResponsesBand(input_image, harris_kernels::responseBit(response_type_), responses,
+                      row_begin, row_end, workspace);
+}
+
+// calcResponseBand() of the responses of response_mask, into the
+// planes of responses indexed by response
+void HarrisCorner::calcResponsesBand(const cv::Mat& input_image,
+                                     const unsigned response_mask,
+                                     cv::Mat * const * responses,
+                                     const int row_begin,
+                                     const int row_end,
+                                     BandWorkspace& workspace)const{
+
+    const int rows = input_image.rows;
+    const int half_w_size = (window_size_ - 1) / 2;
+
+    prepareTensorWorkspace(workspace, input_image.cols, input_image.depth());
+    workspace.kept_row_begin = row_begin;
+    workspace.kept_row_end = row_end;
+
+    int next_product_row = std::max(0, row_begin - half_w_size);
+
+    for(int i_r = row_begin; i_r < row_end; i_r++){
+
+        for(; next_product_row <= std::min(rows - 1, i_r + half_w_size); next_product_row++){
+            calcTensorProductRow(input_image, next_product_row, workspace);
+        }
+
+        float* response_rows[harris_kernels::kNumResponses] = {};
+        for(int r = 0; r < harris_kernels::kNumResponses; r++){
+            if(responses[r]){
+                response_rows[r] = responses[r]->ptr<float>(i_r);
+            }
+        }
+
+        calcResponsesRow(workspace, i_r, rows, input_image.depth(),
+                         response_mask, response_rows);
+    }
+}
 
-void HarrisCorner::calcM(const cv::Mat& grad_x,
-                         const cv::Mat& grad_y,
-                         cv::Mat& M,
-                         const size_t row_idx,
-                         const size_t col_idx){
+/*
+  Fused pipeline from the input image to the corner mask of image rows
+  [row_begin, row_end). Rows flow through rings sized by the windows:
+  tensor products (window_size_ + 1 rows), responses and their row
+  maxima (2 * nms_window_size rows each, and at least 3 responses for
+  the neighbourhoods of neighborhoods). A block of mask rows is emitted
+  as soon as the row maxima it depends on, and the responses one row
+  below it, are available. Responses are computed from the restart row
+  at or above the NMS halo so that they are bit-identical to
+  calcResponse().
+ */
+void HarrisCorner::detectCornersBand(const cv::Mat& input_image,
+                                     cv::Mat* img_binary_result,
+                                     std::vector<Keypoint>* keypoints,
+                                     NeighborhoodBatch* neighborhoods,
+                                     const float thresh,
+                                     const int nms_window_size,
+                                     const int row_begin,
+                                     const int row_end,
+                                     BandWorkspace& workspace)const{
 
-    // w_ represents window
-    
+    const int rows = input_image.rows;
+    const int cols = input_image.cols;
     const int half_w_size = (window_size_ - 1) / 2;
+    const int half_nms_w_size = (nms_window_size - 1) / 2;
+    // the NMS halo, and one row for the neighbourhoods
+    const int response_halo = std::max(half_nms_w_size, 1);
+
+    const int response_begin = std::max(0, row_begin - response_halo);
+    const int response_end = std::min(rows, row_end + response_halo);
+    const int first_response_row =
+        response_begin / kRunningSumRestartInterval * kRunningSumRestartInterval;
+
+    prepareTensorWorkspace(workspace, cols, input_image.depth());
+    workspace.response.create(std::max(2 * nms_window_size, 3), cols,
+                              workspace.num_allocations);
+    prepareNmsWorkspace(workspace.nms, cols, nms_window_size, 2 * nms_window_size);
+    workspace.kept_row_begin = row_begin;
+    workspace.kept_row_end = row_end;
+
+    int next_product_row = std::max(0, first_response_row - half_w_size);
+    int next_block = 0;
 
-    
-    for(int tmp_row_idx = static_cast<int>(row_idx) - half_w_size;
-        tmp_row_idx <= row_idx + half_w_size;
-        tmp_row_idx++){
+    for(int i_r = first_response_row; i_r < response_end; i_r++){
 
-        if(tmp_row_idx < 0 || tmp_row_idx >= grad_x.rows){
+        for(; next_product_row <= std::min(rows - 1, i_r + half_w_size); next_product_row++){
+            calcTensorProductRow(input_image, next_product_row, workspace);
+        }
+
+        calcResponseRow(workspace, i_r, rows, input_image.depth(),
+                        workspace.response.row(i_r));
+        keepPlaneRow(workspace, PLANE_RESPONSE, i_r, workspace.response.row(i_r));
+
+        if(i_r < response_begin){
             continue;
         }
 
-        for(int tmp_col_idx = static_cast<int>(col_idx) - half_w_size;
-            tmp_col_idx <= col_idx + half_w_size;
-            tmp_col_idx++){
+        calcRowMax(workspace.response.row(i_r), workspace.nms.row_max.row(i_r),
+                   cols, nms_window_size, workspace.nms, *kernels_);
 
-            if(tmp_col_idx < 0 || tmp_col_idx >= grad_x.cols){
-                continue;
+        while(next_block < row_end - row_begin){
+
+            const int last_output_row = std::min(row_begin + next_block + nms_window_size,
+                                                 row_end) - 1;
+            const int last_needed_row = std::min(rows - 1,
+                                                 last_output_row + response_halo);
+            if(i_r < last_needed_row){
+                break;
             }
 
-            
+            nonMaximumSuppressionBlock(workspace.response, rows, row_begin, row_end,
+                                       next_block, thresh, nms_window_size,
+                                       workspace.nms, *kernels_, img_binary_result, keypoints,
+                                       neighborhoods);
+
+            next_block += nms_window_size;
+        }
+    }
+}
+
+void HarrisCorner::prepareTensorWorkspace(BandWorkspace& workspace,
+                                          const int cols,
+                                          const int depth)const{
+
+    unsigned long& num_allocations = workspace.num_allocations;
+
+    if(depth == CV_8U){
+        resizeCounted(workspace.grad_x_row_s16, cols, num_allocations);
+        resizeCounted(workspace.grad_y_row_s16, cols, num_allocations);
+        prepareTensorSums(workspace.tensor_s32, cols, CV_32SC1, num_allocations);
+    }else{
+        resizeCounted(workspace.grad_x_row, cols, num_allocations);
+        resizeCounted(workspace.grad_y_row, cols, num_allocations);
+        prepareTensorSums(workspace.tensor, cols, CV_32FC1, num_allocations);
+    }
+}
+
+template<typename T>
+void HarrisCorner::prepareTensorSums(TensorWorkspace<T>& tensor,
+                                     const int cols,
+                                     const int type,
+                                     unsigned long& num_allocations)const{
+
+    const int half_w_size = (window_size_ - 1) / 2;
+
+    tensor.grad_xx.create(window_size_ + 1, cols, num_allocations, type);
+    tensor.grad_yy.create(window_size_ + 1, cols, num_allocations, type);
+    tensor.grad_xy.create(window_size_ + 1, cols, num_allocations, type);
+
+    // vertical sums, padded with half_w_size + 1 zeros on both sides so
+    // that the horizontal pass needs no bounds checks
+    const size_t padded_cols = cols + 2 * half_w_size + 2;
+    assignCounted(tensor.col_sum_xx, padded_cols, T(0), num_allocations);
+    assignCounted(tensor.col_sum_yy, padded_cols, T(0), num_allocations);
+    assignCounted(tensor.col_sum_xy, padded_cols, T(0), num_allocations);
+
+    resizeCounted(tensor.sum_xx, cols, num_allocations);
+    resizeCounted(tensor.sum_yy, cols, num_allocations);
+    resizeCounted(tensor.sum_xy, cols, num_allocations);
+}
+
+/*
+  Gradients of image row i_r by central differences, equivalent to
+  cv::Sobel(input_image, grad, CV_32F, dx, dy, 1) with the default
+  (reflect 101) border, so both gradients are zero on the image border
+  in their own direction. Their products go to the tensor product
+  rings.
+ */
+void HarrisCorner::calcTensorProductRow(const cv::Mat& input_image,
+                                        const int i_r,
+                                        BandWorkspace& workspace)const{
+
+    if(input_image.depth() == CV_8U){
+        calcTensorProductRowU8(input_image, i_r, workspace);
+        return;
+    }
+
+    const int rows = input_image.rows;
+    const int cols = input_image.cols;
+
+    float const * const src = input_image.ptr<float>(i_r);
+    float * const gx = workspace.grad_x_row.data();
+    float * const gy = workspace.grad_y_row.data();
+
+    gx[0] = 0.0f;
+    gx[cols - 1] = 0.0f;
+    if(cols > 2){
+        kernels_->subtract(src + 2, src, gx + 1, cols - 2);
+    }
+
+    const int prev_row = i_r == 0 ? std::min(1, rows - 1) : i_r - 1;
+    const int next_row = i_r == rows - 1 ? std::max(rows - 2, 0) : i_r + 1;
+
+    kernels_->subtract(input_image.ptr<float>(next_row),
+                       input_image.ptr<float>(prev_row), gy, cols);
+
+    keepPlaneRow(workspace, PLANE_GRAD_X, i_r, gx);
+    keepPlaneRow(workspace, PLANE_GRAD_Y, i_r, gy);
+
+    kernels_->tensorProducts(gx, gy,
+                             workspace.tensor.grad_xx.row(i_r),
+                             workspace.tensor.grad_yy.row(i_r),
+                             workspace.tensor.grad_xy.row(i_r), cols);
+}
+
+// calcTensorProductRow() of 8-bit input, in integers
+void HarrisCorner::calcTensorProductRowU8(const cv::Mat& input_image,
+                                          const int i_r,
+                                          BandWorkspace& workspace)const{
+
+    const int rows = input_image.rows;
+    const int cols = input_image.cols;
+
+    uint8_t const * const src = input_image.ptr<uint8_t>(i_r);
+    int16_t * const gx = workspace.grad_x_row_s16.data();
+    int16_t * const gy = workspace.grad_y_row_s16.data();
+
+    gx[0] = 0;
+    gx[cols - 1] = 0;
+    if(cols > 2){
+        kernels_->subtractU8(src + 2, src, gx + 1, cols - 2);
+    }
+
+    const int prev_row = i_r == 0 ? std::min(1, rows - 1) : i_r - 1;
+    const int next_row = i_r == rows - 1 ? std::max(rows - 2, 0) : i_r + 1;
+
+    kernels_->subtractU8(input_image.ptr<uint8_t>(next_row),
+                         input_image.ptr<uint8_t>(prev_row), gy, cols);
+
+    keepPlaneRow(workspace, PLANE_GRAD_X, i_r, gx);
+    keepPlaneRow(workspace, PLANE_GRAD_Y, i_r, gy);
+
+    TensorWorkspace<int32_t>& tensor = workspace.tensor_s32;
+    kernels_->tensorProductsS16(gx, gy,
+                                tensor.grad_xx.rowAs<int32_t>(i_r),
+                                tensor.grad_yy.rowAs<int32_t>(i_r),
+                                tensor.grad_xy.rowAs<int32_t>(i_r), cols);
+}
+
+/*
+  Compute the response of row i_r. Rows must be computed in order
+  starting at a multiple of kRunningSumRestartInterval, and the tensor
+  products of rows up to i_r + (window_size_ - 1) / 2 must be in the
+  rings. depth is that of the input image.
+
+  The sums of 8-bit input are exact integers, so their response is the
+  one of the float input value / 255 up to float round-off.
+ */
+void HarrisCorner::calcResponseRow(BandWorkspace& workspace,
+                                   const int i_r,
+                                   const int rows,
+                                   const int depth,
+                                   float * const response)const{
+
+    float* responses[harris_kernels::kNumResponses] = {};
+    responses[response_type_] = response;
+
+    calcResponsesRow(workspace, i_r, rows, depth,
+                     harris_kernels::responseBit(response_type_), responses);
+}
+
+// calcResponseRow() of the responses of response_mask, into the rows
+// of responses indexed by response. The window sums are computed once.
+void HarrisCorner::calcResponsesRow(BandWorkspace& workspace,
+                                    const int i_r,
+                                    const int rows,
+                                    const int depth,
+                                    const unsigned response_mask,
+                                    float * const * responses)const{
+
+    const float k = static_cast<float>(k_);
+
+    if(depth == CV_8U){
+        TensorWorkspace<int32_t>& tensor = workspace.tensor_s32;
+        calcWindowSums(tensor, i_r, rows);
+        keepPlaneRow(workspace, PLANE_SUM_XX, i_r, tensor.sum_xx.data());
+        keepPlaneRow(workspace, PLANE_SUM_YY, i_r, tensor.sum_yy.data());
+        keepPlaneRow(workspace, PLANE_SUM_XY, i_r, tensor.sum_xy.data());
+        kernels_->responsesS32[response_mask](tensor.sum_xx.data(), tensor.sum_yy.data(),
+                                              tensor.sum_xy.data(), k,
+                                              1.0f / (255.0f * 255.0f), responses,
+                                              static_cast<int>(tensor.sum_xx.size()));
+    }else{
+        TensorWorkspace<float>& tensor = workspace.tensor;
+        calcWindowSums(tensor, i_r, rows);
+        keepPlaneRow(workspace, PLANE_SUM_XX, i_r, tensor.sum_xx.data());
+        keepPlaneRow(workspace, PLANE_SUM_YY, i_r, tensor.sum_yy.data());
+        keepPlaneRow(workspace, PLANE_SUM_XY, i_r, tensor.sum_xy.data());
+        kernels_->responses[response_mask](tensor.sum_xx.data(), tensor.sum_yy.data(),
+                                           tensor.sum_xy.data(), k, responses,
+                                           static_cast<int>(tensor.sum_xx.size()));
+    }
+}
+
+namespace{
+
+// kernels of calcWindowSums() by element type
+
+void addRow(const harris_kernels::KernelTable& kernels,
+            float * acc, float const * src, int n){
+    kernels.addRow(acc, src, n);
+}
+void addRow(const harris_kernels::KernelTable& kernels,
+            int32_t * acc, int32_t const * src, int n){
+    kernels.addRowS32(acc, src, n);
+}
+void subtractRow(const harris_kernels::KernelTable& kernels,
+                 float * acc, float const * src, int n){
+    kernels.subtractRow(acc, src, n);
+}
+void subtractRow(const harris_kernels::KernelTable& kernels,
+                 int32_t * acc, int32_t const * src, int n){
+    kernels.subtractRowS32(acc, src, n);
+}
+void runningSum(const harris_kernels::KernelTable& kernels,
+                float const * v, float * dst, int begin, int end, int half_w_size){
+    kernels.runningSum(v, dst, begin, end, half_w_size);
+}
+void runningSum(const harris_kernels::KernelTable& kernels,
+                int32_t const * v, int32_t * dst, int begin, int end, int half_w_size){
+    kernels.runningSumS32(v, dst, begin, end, half_w_size);
+}
+
+}
+
+/*
+  Window sums of the tensor products around row i_r, into tensor.sum_*.
+
+  They are obtained with running sums: a vertical one per column,
+  updated by adding the row entering the window and subtracting the
+  row leaving it, and then a horizontal one over those column sums.
+  Pixels outside the image count as zero. Both are restarted from a
+  direct sum at multiples of kRunningSumRestartInterval, so the cost
+  per pixel does not depend on window_size_.
+ */
+template<typename T>
+void HarrisCorner::calcWindowSums(TensorWorkspace<T>& tensor,
+                                  const int i_r,
+                                  const int rows)const{
+
+    const int cols = static_cast<int>(tensor.sum_xx.size());
+    const int half_w_size = (window_size_ - 1) / 2;
+    const harris_kernels::KernelTable& kernels = *kernels_;
+
+    T * const v_xx = tensor.col_sum_xx.data() + half_w_size + 1;
+    T * const v_yy = tensor.col_sum_yy.data() + half_w_size + 1;
+    T * const v_xy = tensor.col_sum_xy.data() + half_w_size + 1;
+
+    if(i_r % kRunningSumRestartInterval == 0){
+
+        // direct sum over the window
+        std::fill(v_xx, v_xx + cols, T(0));
+        std::fill(v_yy, v_yy + cols, T(0));
+        std::fill(v_xy, v_xy + cols, T(0));
+
+        for(int j_r = std::max(0, i_r - half_w_size);
+            j_r <= std::min(rows - 1, i_r + half_w_size);
+            j_r++){
+
+            addRow(kernels, v_xx, tensor.grad_xx.template rowAs<T>(j_r), cols);
+            addRow(kernels, v_yy, tensor.grad_yy.template rowAs<T>(j_r), cols);
+            addRow(kernels, v_xy, tensor.grad_xy.template rowAs<T>(j_r), cols);
+        }
+
+    }else{
+
+        const int row_in = i_r + half_w_size;
+        const int row_out = i_r - half_w_size - 1;
+
+        if(row_in < rows){
+            addRow(kernels, v_xx, tensor.grad_xx.template rowAs<T>(row_in), cols);
+            addRow(kernels, v_yy, tensor.grad_yy.template rowAs<T>(row_in), cols);
+            addRow(kernels, v_xy, tensor.grad_xy.template rowAs<T>(row_in), cols);
+        }
+
+        if(row_out >= 0){
+            subtractRow(kernels, v_xx, tensor.grad_xx.template rowAs<T>(row_out), cols);
+            subtractRow(kernels, v_yy, tensor.grad_yy.template rowAs<T>(row_out), cols);
+            subtractRow(kernels, v_xy, tensor.grad_xy.template rowAs<T>(row_out), cols);
         }
     }
+
+    T * const s_xx = tensor.sum_xx.data();
+    T * const s_yy = tensor.sum_yy.data();
+    T * const s_xy = tensor.sum_xy.data();
+
+    for(int col_begin = 0; col_begin < cols; col_begin += kRunningSumRestartInterval){
+
+        const int col_end = std::min(col_begin + kRunningSumRestartInterval, cols);
+
+        runningSum(kernels, v_xx, s_xx, col_begin, col_end, half_w_size);
+        runningSum(kernels, v_yy, s_yy, col_begin, col_end, half_w_size);
+        runningSum(kernels, v_xy, s_xy, col_begin, col_end, half_w_size);
+    }
+}
+
+// CV_32FC1 or CV_8UC1
+void HarrisCorner::checkInputType(const cv::Mat& input_image)const{
+
+    if(input_image.type() != CV_32FC1 && input_image.type() != CV_8UC1){
+        throw std::runtime_error("Invalid matrix type");
+    }
+
+    if(input_image.type() == CV_8UC1 && window_size_ > kMaxWindowSizeU8){
+        throw std::runtime_error("window_size too large for 8-bit input");
+    }
 }
 
 bool HarrisCorner::nonMaximumSuppressionCheckRow(const float val,
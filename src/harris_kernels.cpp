@@ -0,0 +1,400 @@
+#include <harris_kernels.hpp>
+#include <harris_kernels_response.hpp>
+#include <harris_kernels_window.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+
+
+namespace harris_kernels{
+
+namespace{
+
+void subtractScalar(float const * a, float const * b, float * dst, int n){
+
+    for(int i = 0; i < n; i++){
+        dst[i] = a[i] - b[i];
+    }
+}
+
+void tensorProductsScalar(float const * gx, float const * gy,
+                          float * gxx, float * gyy, float * gxy, int n){
+
+    for(int i = 0; i < n; i++){
+        gxx[i] = gx[i] * gx[i];
+        gyy[i] = gy[i] * gy[i];
+        gxy[i] = gx[i] * gy[i];
+    }
+}
+
+void addRowScalar(float * acc, float const * src, int n){
+
+    for(int i = 0; i < n; i++){
+        acc[i] += src[i];
+    }
+}
+
+void subtractRowScalar(float * acc, float const * src, int n){
+
+    for(int i = 0; i < n; i++){
+        acc[i] -= src[i];
+    }
+}
+
+void runningSumScalar(float const * v, float * dst,
+                      int begin, int end, int half_w_size){
+
+    if(begin >= end){
+        return;
+    }
+
+    float s = 0.0f;
+    for(int j = begin - half_w_size; j <= begin + half_w_size; j++){
+        s += v[j];
+    }
+    dst[begin] = s;
+
+    for(int i = begin + 1; i < end; i++){
+        s += v[i + half_w_size] - v[i - half_w_size - 1];
+        dst[i] = s;
+    }
+}
+
+void maxRowScalar(float const * a, float const * b, float * dst, int n){
+
+    for(int i = 0; i < n; i++){
+        dst[i] = a[i] < b[i] ? b[i] : a[i];
+    }
+}
+
+void nmsCompareScalar(float const * val, float const * window_max,
+                      float thresh, uint8_t * dst, int n){
+
+    for(int i = 0; i < n; i++){
+        dst[i] = (val[i] >= thresh && val[i] >= window_max[i]) ? 255 : 0;
+    }
+}
+
+void binomialRowsScalar(float const * r0, float const * r1, float const * r2,
+                        float const * r3, float const * r4, float * dst, int n){
+
+    for(int i = 0; i < n; i++){
+        dst[i] = r0[i] + r4[i] + 4.0f * (r1[i] + r3[i]) + 6.0f * r2[i];
+    }
+}
+
+void binomialDecimateScalar(float const * v, float * dst, int n){
+
+    for(int i = 0; i < n; i++){
+        float const * const p = v + 2 * i;
+        dst[i] = (p[-2] + p[2] + 4.0f * (p[-1] + p[1]) + 6.0f * p[0]) * (1.0f / 256.0f);
+    }
+}
+
+// set bits of x, by summing them in ever wider fields
+inline int popcount64(uint64_t x){
+
+    x = x - ((x >> 1) & 0x5555555555555555ull);
+    x = (x & 0x3333333333333333ull) + ((x >> 2) & 0x3333333333333333ull);
+    x = (x + (x >> 4)) & 0x0f0f0f0f0f0f0f0full;
+    return static_cast<int>((x * 0x0101010101010101ull) >> 56);
+}
+
+void hammingDistancesScalar(uint8_t const * query, uint8_t const * train,
+                            int n, uint16_t * dst){
+
+    uint64_t q[kDescriptorBytes / 8];
+    std::memcpy(q, query, kDescriptorBytes);
+
+    for(int i = 0; i < n; i++){
+        uint64_t t[kDescriptorBytes / 8];
+        std::memcpy(t, train + kDescriptorBytes * i, kDescriptorBytes);
+        int distance = 0;
+        for(int j = 0; j < kDescriptorBytes / 8; j++){
+            distance += popcount64(q[j] ^ t[j]);
+        }
+        dst[i] = static_cast<uint16_t>(distance);
+    }
+}
+
+int argminU16Scalar(uint16_t const * v, int n){
+
+    int min_idx = 0;
+    for(int i = 1; i < n; i++){
+        if(v[i] < v[min_idx]){
+            min_idx = i;
+        }
+    }
+    return min_idx;
+}
+
+void updateMinU16Scalar(uint16_t const * v, int32_t idx,
+                        uint16_t * min, int32_t * min_idx, int n){
+
+    for(int i = 0; i < n; i++){
+        if(v[i] < min[i]){
+            min[i] = v[i];
+            min_idx[i] = idx;
+        }
+    }
+}
+
+void subpixelOffsetsScalar(float const * const * samples,
+                           float * offset_x, float * offset_y, int n){
+
+    for(int m = 0; m < n; m++){
+        float s[9];
+        for(int k = 0; k < 9; k++){
+            s[k] = samples[k][m];
+        }
+
+        // column (left, center, right) and row (top, middle, bottom) sums
+        const float l = s[0] + s[3] + s[6];
+        const float c = s[1] + s[4] + s[7];
+        const float r = s[2] + s[5] + s[8];
+        const float t = s[0] + s[1] + s[2];
+        const float mid = s[3] + s[4] + s[5];
+        const float b = s[6] + s[7] + s[8];
+
+        const float dx = (r - l) * (1.0f / 6.0f);
+        const float dy = (b - t) * (1.0f / 6.0f);
+        const float dxx = (l + r - 2.0f * c) * (1.0f / 3.0f);
+        const float dyy = (t + b - 2.0f * mid) * (1.0f / 3.0f);
+        const float dxy = ((s[8] - s[6]) - (s[2] - s[0])) * 0.25f;
+        const float det = dxx * dyy - dxy * dxy;
+
+        if(det > 0.0f && dxx < 0.0f){
+            const float ox = (dxy * dy - dyy * dx) / det;
+            const float oy = (dxy * dx - dxx * dy) / det;
+            offset_x[m] = std::min(0.5f, std::max(-0.5f, ox));
+            offset_y[m] = std::min(0.5f, std::max(-0.5f, oy));
+        }else{
+            offset_x[m] = 0.0f;
+            offset_y[m] = 0.0f;
+        }
+    }
+}
+
+void subtractU8Scalar(uint8_t const * a, uint8_t const * b, int16_t * dst, int n){
+
+    for(int i = 0; i < n; i++){
+        dst[i] = static_cast<int16_t>(a[i] - b[i]);
+    }
+}
+
+void tensorProductsS16Scalar(int16_t const * gx, int16_t const * gy,
+                             int32_t * gxx, int32_t * gyy, int32_t * gxy, int n){
+
+    for(int i = 0; i < n; i++){
+        gxx[i] = gx[i] * gx[i];
+        gyy[i] = gy[i] * gy[i];
+        gxy[i] = gx[i] * gy[i];
+    }
+}
+
+void addRowS32Scalar(int32_t * acc, int32_t const * src, int n){
+
+    for(int i = 0; i < n; i++){
+        acc[i] += src[i];
+    }
+}
+
+void subtractRowS32Scalar(int32_t * acc, int32_t const * src, int n){
+
+    for(int i = 0; i < n; i++){
+        acc[i] -= src[i];
+    }
+}
+
+void runningSumS32Scalar(int32_t const * v, int32_t * dst,
+                         int begin, int end, int half_w_size){
+
+    if(begin >= end){
+        return;
+    }
+
+    int32_t s = 0;
+    for(int j = begin - half_w_size; j <= begin + half_w_size; j++){
+        s += v[j];
+    }
+    dst[begin] = s;
+
+    for(int i = begin + 1; i < end; i++){
+        s += v[i + half_w_size] - v[i - half_w_size - 1];
+        dst[i] = s;
+    }
+}
+
+// one float, for the window_max and response templates
+struct ScalarVector{
+    typedef float Type;
+    static const int kWidth = 1;
+    static Type load(float const * p){ return *p; }
+    static Type loadS32(int32_t const * p){ return static_cast<float>(*p); }
+    static void store(float * p, const Type v){ *p = v; }
+    static Type set1(const float v){ return v; }
+    static Type max(const Type a, const Type b){ return a < b ? b : a; }
+    static Type add(const Type a, const Type b){ return a + b; }
+    static Type sub(const Type a, const Type b){ return a - b; }
+    static Type mul(const Type a, const Type b){ return a * b; }
+    static Type div(const Type a, const Type b){ return a / b; }
+    static Type sqrt(const Type a){ return std::sqrt(a); }
+};
+
+const KernelTable scalar_kernels = {
+    ISA_SCALAR,
+    subtractScalar,
+    tensorProductsScalar,
+    addRowScalar,
+    subtractRowScalar,
+    runningSumScalar,
+    HARRIS_KERNELS_RESPONSE_TABLE(ScalarVector),
+    maxRowScalar,
+    nmsCompareScalar,
+    binomialRowsScalar,
+    binomialDecimateScalar,
+    subpixelOffsetsScalar,
+    subtractU8Scalar,
+    tensorProductsS16Scalar,
+    addRowS32Scalar,
+    subtractRowS32Scalar,
+    runningSumS32Scalar,
+    HARRIS_KERNELS_RESPONSE_S32_TABLE(ScalarVector),
+    HARRIS_KERNELS_WINDOW_MAX_TABLE(ScalarVector),
+    hammingDistancesScalar,
+    argminU16Scalar,
+    updateMinU16Scalar
+};
+
+// the AVX2 table, with the kernels that AVX-512 speeds up replaced.
+// Built here rather than in the AVX-512 translation unit, where even
+// copying the table may compile to zmm moves.
+const KernelTable* makeAvx512Kernels(){
+
+    const KernelTable* const avx2_kernels = getAvx2Kernels();
+    const HammingDistancesKernel hamming_distances = getAvx512HammingDistances();
+    if(! avx2_kernels || ! hamming_distances){
+        return nullptr;
+    }
+
+    static KernelTable avx512_kernels = *avx2_kernels;
+    avx512_kernels.isa = ISA_AVX512;
+    avx512_kernels.hammingDistances = hamming_distances;
+    return &avx512_kernels;
+}
+
+bool cpuSupports(const Isa isa){
+
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+    switch(isa){
+    case ISA_SCALAR:
+        return true;
+    case ISA_SSE41:
+        return __builtin_cpu_supports("sse4.1");
+    case ISA_AVX2:
+        return __builtin_cpu_supports("avx2");
+    case ISA_AVX512:
+        return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("avx512vl")
+            && __builtin_cpu_supports("avx512vpopcntdq");
+    }
+    return false;
+#else
+    return isa == ISA_SCALAR;
+#endif
+}
+
+}
+
+
+const KernelTable* getScalarKernels(){
+
+    return &scalar_kernels;
+}
+
+const KernelTable* getAvx512Kernels(){
+
+    static const KernelTable* const avx512_kernels = makeAvx512Kernels();
+    return avx512_kernels;
+}
+
+const char* isaName(const Isa isa){
+
+    switch(isa){
+    case ISA_SCALAR:
+        return "scalar";
+    case ISA_SSE41:
+        return "sse4.1";
+    case ISA_AVX2:
+        return "avx2";
+    case ISA_AVX512:
+        return "avx512";
+    }
+    return "unknown";
+}
+
+const char* responseName(const Response response){
+
+    switch(response){
+    case RESPONSE_HARRIS:
+        return "harris";
+    case RESPONSE_SHI_TOMASI:
+        return "shi-tomasi";
+    case RESPONSE_NOBLE:
+        return "noble";
+    }
+    return "unknown";
+}
+
+bool isSupported(const Isa isa){
+
+    switch(isa){
+    case ISA_SCALAR:
+        return true;
+    case ISA_SSE41:
+        return cpuSupports(isa) && getSse41Kernels() != nullptr;
+    case ISA_AVX2:
+        return cpuSupports(isa) && getAvx2Kernels() != nullptr;
+    case ISA_AVX512:
+        return cpuSupports(isa) && getAvx512Kernels() != nullptr;
+    }
+    return false;
+}
+
+Isa getBestIsa(){
+
+    static const Isa best_isa =
+        isSupported(ISA_AVX512) ? ISA_AVX512 :
+        isSupported(ISA_AVX2) ? ISA_AVX2 :
+        isSupported(ISA_SSE41) ? ISA_SSE41 :
+        ISA_SCALAR;
+
+    return best_isa;
+}
+
+const KernelTable& getKernels(const Isa isa){
+
+    if(! isSupported(isa)){
+        throw std::runtime_error(std::string("ISA not supported: ") + isaName(isa));
+    }
+
+    switch(isa){
+    case ISA_SSE41:
+        return *getSse41Kernels();
+    case ISA_AVX2:
+        return *getAvx2Kernels();
+    case ISA_AVX512:
+        return *getAvx512Kernels();
+    default:
+        return *getScalarKernels();
+    }
+}
+
+const KernelTable& getBestKernels(){
+
+    return getKernels(getBestIsa());
+}
+
+}
@@ -0,0 +1,509 @@
+#include <harris_kernels.hpp>
+#include <harris_kernels_response.hpp>
+#include <harris_kernels_window.hpp>
+
+#if defined(__AVX2__)
+
+#include <harris_kernels_hamming.hpp>
+
+#include <immintrin.h>
+
+
+namespace harris_kernels{
+
+namespace{
+
+void subtractAvx2(float const * a, float const * b, float * dst, int n){
+
+    int i = 0;
+    for(; i + 8 <= n; i += 8){
+        _mm256_storeu_ps(dst + i, _mm256_sub_ps(_mm256_loadu_ps(a + i),
+                                                _mm256_loadu_ps(b + i)));
+    }
+    for(; i < n; i++){
+        dst[i] = a[i] - b[i];
+    }
+}
+
+void tensorProductsAvx2(float const * gx, float const * gy,
+                        float * gxx, float * gyy, float * gxy, int n){
+
+    int i = 0;
+    for(; i + 8 <= n; i += 8){
+        const __m256 x = _mm256_loadu_ps(gx + i);
+        const __m256 y = _mm256_loadu_ps(gy + i);
+        _mm256_storeu_ps(gxx + i, _mm256_mul_ps(x, x));
+        _mm256_storeu_ps(gyy + i, _mm256_mul_ps(y, y));
+        _mm256_storeu_ps(gxy + i, _mm256_mul_ps(x, y));
+    }
+    for(; i < n; i++){
+        gxx[i] = gx[i] * gx[i];
+        gyy[i] = gy[i] * gy[i];
+        gxy[i] = gx[i] * gy[i];
+    }
+}
+
+void addRowAvx2(float * acc, float const * src, int n){
+
+    int i = 0;
+    for(; i + 8 <= n; i += 8){
+        _mm256_storeu_ps(acc + i, _mm256_add_ps(_mm256_loadu_ps(acc + i),
+                                                _mm256_loadu_ps(src + i)));
+    }
+    for(; i < n; i++){
+        acc[i] += src[i];
+    }
+}
+
+void subtractRowAvx2(float * acc, float const * src, int n){
+
+    int i = 0;
+    for(; i + 8 <= n; i += 8){
+        _mm256_storeu_ps(acc + i, _mm256_sub_ps(_mm256_loadu_ps(acc + i),
+                                                _mm256_loadu_ps(src + i)));
+    }
+    for(; i < n; i++){
+        acc[i] -= src[i];
+    }
+}
+
+// inclusive prefix sum of the 8 lanes
+inline __m256 prefixSum(__m256 x){
+
+    x = _mm256_add_ps(x, _mm256_castsi256_ps(
+                          _mm256_slli_si256(_mm256_castps_si256(x), 4)));
+    x = _mm256_add_ps(x, _mm256_castsi256_ps(
+                          _mm256_slli_si256(_mm256_castps_si256(x), 8)));
+
+    // carry the total of the low 128-bit lane into the high one
+    __m256 low_total = _mm256_permute2f128_ps(x, x, 0x08);
+    low_total = _mm256_shuffle_ps(low_total, low_total, _MM_SHUFFLE(3, 3, 3, 3));
+
+    return _mm256_add_ps(x, low_total);
+}
+
+void runningSumAvx2(float const * v, float * dst,
+                    int begin, int end, int half_w_size){
+
+    if(begin >= end){
+        return;
+    }
+
+    float s = 0.0f;
+    for(int j = begin - half_w_size; j <= begin + half_w_size; j++){
+        s += v[j];
+    }
+    dst[begin] = s;
+
+    int i = begin + 1;
+
+    if(i + 8 <= end){
+
+        __m256 carry = _mm256_set1_ps(s);
+
+        for(; i + 8 <= end; i += 8){
+
+            const __m256 diff =
+                _mm256_sub_ps(_mm256_loadu_ps(v + i + half_w_size),
+                              _mm256_loadu_ps(v + i - half_w_size - 1));
+
+            const __m256 sum = _mm256_add_ps(carry, prefixSum(diff));
+            _mm256_storeu_ps(dst + i, sum);
+
+            carry = _mm256_permute2f128_ps(sum, sum, 0x11);
+            carry = _mm256_shuffle_ps(carry, carry, _MM_SHUFFLE(3, 3, 3, 3));
+        }
+
+        s = dst[i - 1];
+    }
+
+    for(; i < end; i++){
+        s += v[i + half_w_size] - v[i - half_w_size - 1];
+        dst[i] = s;
+    }
+}
+
+void maxRowAvx2(float const * a, float const * b, float * dst, int n){
+
+    int i = 0;
+    for(; i + 8 <= n; i += 8){
+        _mm256_storeu_ps(dst + i, _mm256_max_ps(_mm256_loadu_ps(a + i),
+                                                _mm256_loadu_ps(b + i)));
+    }
+    for(; i < n; i++){
+        dst[i] = a[i] < b[i] ? b[i] : a[i];
+    }
+}
+
+void nmsCompareAvx2(float const * val, float const * window_max,
+                    float thresh, uint8_t * dst, int n){
+
+    const __m256 thresh_v = _mm256_set1_ps(thresh);
+
+    int i = 0;
+    for(; i + 8 <= n; i += 8){
+        const __m256 x = _mm256_loadu_ps(val + i);
+        const __m256 keep = _mm256_and_ps(
+            _mm256_cmp_ps(x, thresh_v, _CMP_GE_OQ),
+            _mm256_cmp_ps(x, _mm256_loadu_ps(window_max + i), _CMP_GE_OQ));
+
+        // 8 x int32 masks (0 or -1) -> 8 x uint8 (0 or 255)
+        const __m128i lo = _mm256_castsi256_si128(_mm256_castps_si256(keep));
+        const __m128i hi = _mm256_extractf128_si256(_mm256_castps_si256(keep), 1);
+        const __m128i packed16 = _mm_packs_epi32(lo, hi);
+        const __m128i packed8 = _mm_packs_epi16(packed16, packed16);
+        _mm_storel_epi64(reinterpret_cast<__m128i*>(dst + i), packed8);
+    }
+    for(; i < n; i++){
+        dst[i] = (val[i] >= thresh && val[i] >= window_max[i]) ? 255 : 0;
+    }
+}
+
+void binomialRowsAvx2(float const * r0, float const * r1, float const * r2,
+                      float const * r3, float const * r4, float * dst, int n){
+
+    const __m256 four = _mm256_set1_ps(4.0f);
+    const __m256 six = _mm256_set1_ps(6.0f);
+
+    int i = 0;
+    for(; i + 8 <= n; i += 8){
+        const __m256 outer = _mm256_add_ps(_mm256_loadu_ps(r0 + i), _mm256_loadu_ps(r4 + i));
+        const __m256 inner = _mm256_add_ps(_mm256_loadu_ps(r1 + i), _mm256_loadu_ps(r3 + i));
+        _mm256_storeu_ps(dst + i,
+                         _mm256_add_ps(_mm256_add_ps(outer, _mm256_mul_ps(four, inner)),
+                                       _mm256_mul_ps(six, _mm256_loadu_ps(r2 + i))));
+    }
+    for(; i < n; i++){
+        dst[i] = r0[i] + r4[i] + 4.0f * (r1[i] + r3[i]) + 6.0f * r2[i];
+    }
+}
+
+// p[0], p[2], ..., p[14]
+inline __m256 loadEven(float const * p){
+
+    const __m256 x = _mm256_shuffle_ps(_mm256_loadu_ps(p), _mm256_loadu_ps(p + 8),
+                                       _MM_SHUFFLE(2, 0, 2, 0));
+    return _mm256_castpd_ps(_mm256_permute4x64_pd(_mm256_castps_pd(x),
+                                                  _MM_SHUFFLE(3, 1, 2, 0)));
+}
+
+void binomialDecimateAvx2(float const * v, float * dst, int n){
+
+    const __m256 four = _mm256_set1_ps(4.0f);
+    const __m256 six = _mm256_set1_ps(6.0f);
+    const __m256 scale = _mm256_set1_ps(1.0f / 256.0f);
+
+    int i = 0;
+    for(; i + 8 <= n; i += 8){
+        float const * const p = v + 2 * i;
+        const __m256 outer = _mm256_add_ps(loadEven(p - 2), loadEven(p + 2));
+        const __m256 inner = _mm256_add_ps(loadEven(p - 1), loadEven(p + 1));
+        const __m256 sum = _mm256_add_ps(_mm256_add_ps(outer, _mm256_mul_ps(four, inner)),
+                                         _mm256_mul_ps(six, loadEven(p)));
+        _mm256_storeu_ps(dst + i, _mm256_mul_ps(sum, scale));
+    }
+    for(; i < n; i++){
+        float const * const p = v + 2 * i;
+        dst[i] = (p[-2] + p[2] + 4.0f * (p[-1] + p[1]) + 6.0f * p[0]) * (1.0f / 256.0f);
+    }
+}
+
+void subpixelOffsetsAvx2(float const * const * samples,
+                          float * offset_x, float * offset_y, int n){
+
+    const __m256 zero = _mm256_setzero_ps();
+    const __m256 two = _mm256_set1_ps(2.0f);
+    const __m256 quarter = _mm256_set1_ps(0.25f);
+    const __m256 third = _mm256_set1_ps(1.0f / 3.0f);
+    const __m256 sixth = _mm256_set1_ps(1.0f / 6.0f);
+    const __m256 lo = _mm256_set1_ps(-0.5f);
+    const __m256 hi = _mm256_set1_ps(0.5f);
+
+    int m = 0;
+    for(; m + 8 <= n; m += 8){
+        __m256 s[9];
+        for(int k = 0; k < 9; k++){
+            s[k] = _mm256_loadu_ps(samples[k] + m);
+        }
+
+        const __m256 l = _mm256_add_ps(_mm256_add_ps(s[0], s[3]), s[6]);
+        const __m256 c = _mm256_add_ps(_mm256_add_ps(s[1], s[4]), s[7]);
+        const __m256 r = _mm256_add_ps(_mm256_add_ps(s[2], s[5]), s[8]);
+        const __m256 t = _mm256_add_ps(_mm256_add_ps(s[0], s[1]), s[2]);
+        const __m256 mid = _mm256_add_ps(_mm256_add_ps(s[3], s[4]), s[5]);
+        const __m256 b = _mm256_add_ps(_mm256_add_ps(s[6], s[7]), s[8]);
+
+        const __m256 dx = _mm256_mul_ps(_mm256_sub_ps(r, l), sixth);
+        const __m256 dy = _mm256_mul_ps(_mm256_sub_ps(b, t), sixth);
+        const __m256 dxx = _mm256_mul_ps(_mm256_sub_ps(_mm256_add_ps(l, r), _mm256_mul_ps(two, c)), third);
+        const __m256 dyy = _mm256_mul_ps(_mm256_sub_ps(_mm256_add_ps(t, b), _mm256_mul_ps(two, mid)), third);
+        const __m256 dxy = _mm256_mul_ps(_mm256_sub_ps(_mm256_sub_ps(s[8], s[6]),
+                                              _mm256_sub_ps(s[2], s[0])), quarter);
+        const __m256 det = _mm256_sub_ps(_mm256_mul_ps(dxx, dyy), _mm256_mul_ps(dxy, dxy));
+
+        // lanes without a maximum divide by a non-positive det; their
+        // result is masked out below
+        const __m256 valid = _mm256_and_ps(_mm256_cmp_ps(det, zero, _CMP_GT_OQ), _mm256_cmp_ps(dxx, zero, _CMP_LT_OQ));
+        const __m256 ox = _mm256_div_ps(_mm256_sub_ps(_mm256_mul_ps(dxy, dy), _mm256_mul_ps(dyy, dx)), det);
+        const __m256 oy = _mm256_div_ps(_mm256_sub_ps(_mm256_mul_ps(dxy, dx), _mm256_mul_ps(dxx, dy)), det);
+
+        _mm256_storeu_ps(offset_x + m, _mm256_and_ps(valid, _mm256_min_ps(hi, _mm256_max_ps(lo, ox))));
+        _mm256_storeu_ps(offset_y + m, _mm256_and_ps(valid, _mm256_min_ps(hi, _mm256_max_ps(lo, oy))));
+    }
+    if(m < n){
+        float const * tail_samples[9];
+        for(int k = 0; k < 9; k++){
+            tail_samples[k] = samples[k] + m;
+        }
+        getScalarKernels()->subpixelOffsets(tail_samples, offset_x + m, offset_y + m, n - m);
+    }
+}
+
+void subtractU8Avx2(uint8_t const * a, uint8_t const * b, int16_t * dst, int n){
+
+    int i = 0;
+    for(; i + 16 <= n; i += 16){
+        const __m256i a_v = _mm256_cvtepu8_epi16(_mm_loadu_si128(reinterpret_cast<__m128i const *>(a + i)));
+        const __m256i b_v = _mm256_cvtepu8_epi16(_mm_loadu_si128(reinterpret_cast<__m128i const *>(b + i)));
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(dst + i), _mm256_sub_epi16(a_v, b_v));
+    }
+    for(; i < n; i++){
+        dst[i] = static_cast<int16_t>(a[i] - b[i]);
+    }
+}
+
+void tensorProductsS16Avx2(int16_t const * gx, int16_t const * gy,
+                           int32_t * gxx, int32_t * gyy, int32_t * gxy, int n){
+
+    int i = 0;
+    for(; i + 8 <= n; i += 8){
+        const __m256i x = _mm256_cvtepi16_epi32(_mm_loadu_si128(reinterpret_cast<__m128i const *>(gx + i)));
+        const __m256i y = _mm256_cvtepi16_epi32(_mm_loadu_si128(reinterpret_cast<__m128i const *>(gy + i)));
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(gxx + i), _mm256_mullo_epi32(x, x));
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(gyy + i), _mm256_mullo_epi32(y, y));
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(gxy + i), _mm256_mullo_epi32(x, y));
+    }
+    for(; i < n; i++){
+        gxx[i] = gx[i] * gx[i];
+        gyy[i] = gy[i] * gy[i];
+        gxy[i] = gx[i] * gy[i];
+    }
+}
+
+void addRowS32Avx2(int32_t * acc, int32_t const * src, int n){
+
+    int i = 0;
+    for(; i + 8 <= n; i += 8){
+        __m256i * const p = reinterpret_cast<__m256i *>(acc + i);
+        _mm256_storeu_si256(p, _mm256_add_epi32(
+                                _mm256_loadu_si256(p),
+                                _mm256_loadu_si256(reinterpret_cast<__m256i const *>(src + i))));
+    }
+    for(; i < n; i++){
+        acc[i] += src[i];
+    }
+}
+
+void subtractRowS32Avx2(int32_t * acc, int32_t const * src, int n){
+
+    int i = 0;
+    for(; i + 8 <= n; i += 8){
+        __m256i * const p = reinterpret_cast<__m256i *>(acc + i);
+        _mm256_storeu_si256(p, _mm256_sub_epi32(
+                                _mm256_loadu_si256(p),
+                                _mm256_loadu_si256(reinterpret_cast<__m256i const *>(src + i))));
+    }
+    for(; i < n; i++){
+        acc[i] -= src[i];
+    }
+}
+
+// inclusive prefix sum of the 8 lanes
+inline __m256i prefixSum(__m256i x){
+
+    x = _mm256_add_epi32(x, _mm256_slli_si256(x, 4));
+    x = _mm256_add_epi32(x, _mm256_slli_si256(x, 8));
+
+    // carry the total of the low 128-bit lane into the high one
+    __m256i low_total = _mm256_permute2x128_si256(x, x, 0x08);
+    low_total = _mm256_shuffle_epi32(low_total, _MM_SHUFFLE(3, 3, 3, 3));
+
+    return _mm256_add_epi32(x, low_total);
+}
+
+void runningSumS32Avx2(int32_t const * v, int32_t * dst,
+                       int begin, int end, int half_w_size){
+
+    if(begin >= end){
+        return;
+    }
+
+    int32_t s = 0;
+    for(int j = begin - half_w_size; j <= begin + half_w_size; j++){
+        s += v[j];
+    }
+    dst[begin] = s;
+
+    int i = begin + 1;
+
+    if(i + 8 <= end){
+
+        __m256i carry = _mm256_set1_epi32(s);
+
+        for(; i + 8 <= end; i += 8){
+
+            const __m256i diff = _mm256_sub_epi32(
+                _mm256_loadu_si256(reinterpret_cast<__m256i const *>(v + i + half_w_size)),
+                _mm256_loadu_si256(reinterpret_cast<__m256i const *>(v + i - half_w_size - 1)));
+
+            const __m256i sum = _mm256_add_epi32(carry, prefixSum(diff));
+            _mm256_storeu_si256(reinterpret_cast<__m256i *>(dst + i), sum);
+
+            carry = _mm256_permute2x128_si256(sum, sum, 0x11);
+            carry = _mm256_shuffle_epi32(carry, _MM_SHUFFLE(3, 3, 3, 3));
+        }
+
+        s = dst[i - 1];
+    }
+
+    for(; i < end; i++){
+        s += v[i + half_w_size] - v[i - half_w_size - 1];
+        dst[i] = s;
+    }
+}
+
+// set bits of each 64-bit lane, from a 16-entry table of nibbles
+struct Avx2Popcount{
+    static __m256i popcount(const __m256i v){
+        const __m256i lookup = _mm256_setr_epi8(0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4,
+                                                0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4);
+        const __m256i low_nibbles = _mm256_set1_epi8(0x0f);
+        const __m256i bytes = _mm256_add_epi8(
+            _mm256_shuffle_epi8(lookup, _mm256_and_si256(v, low_nibbles)),
+            _mm256_shuffle_epi8(lookup, _mm256_and_si256(_mm256_srli_epi16(v, 4), low_nibbles)));
+        return _mm256_sad_epu8(bytes, _mm256_setzero_si256());
+    }
+};
+
+int argminU16Avx2(uint16_t const * v, int n){
+
+    // the smallest value, then where it first is
+    __m256i min16 = _mm256_set1_epi16(-1);
+    int i = 0;
+    for(; i + 16 <= n; i += 16){
+        min16 = _mm256_min_epu16(min16, _mm256_loadu_si256(reinterpret_cast<__m256i const *>(v + i)));
+    }
+    uint16_t min_value = static_cast<uint16_t>(_mm_cvtsi128_si32(_mm_minpos_epu16(
+                                                   _mm_min_epu16(_mm256_castsi256_si128(min16),
+                                                                 _mm256_extracti128_si256(min16, 1)))));
+    for(; i < n; i++){
+        min_value = std::min(min_value, v[i]);
+    }
+
+    const __m256i target = _mm256_set1_epi16(static_cast<int16_t>(min_value));
+    for(i = 0; i + 16 <= n; i += 16){
+        const unsigned mask = static_cast<unsigned>(_mm256_movemask_epi8(_mm256_cmpeq_epi16(
+                                                        target, _mm256_loadu_si256(reinterpret_cast<__m256i const *>(v + i)))));
+        if(mask){
+            return i + __builtin_ctz(mask) / 2;
+        }
+    }
+    for(; v[i] != min_value; i++){
+    }
+    return i;
+}
+
+void updateMinU16Avx2(uint16_t const * v, int32_t idx,
+                      uint16_t * min, int32_t * min_idx, int n){
+
+    const __m256i idx8 = _mm256_set1_epi32(idx);
+
+    int i = 0;
+    for(; i + 16 <= n; i += 16){
+        const __m256i old_min = _mm256_loadu_si256(reinterpret_cast<__m256i const *>(min + i));
+        const __m256i new_min = _mm256_min_epu16(old_min,
+                                                 _mm256_loadu_si256(reinterpret_cast<__m256i const *>(v + i)));
+        const __m256i lower = _mm256_xor_si256(_mm256_cmpeq_epi16(new_min, old_min),
+                                               _mm256_set1_epi16(-1));
+        if(_mm256_testz_si256(lower, lower)){
+            continue;
+        }
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(min + i), new_min);
+        __m256i* const p = reinterpret_cast<__m256i*>(min_idx + i);
+        _mm256_storeu_si256(p, _mm256_blendv_epi8(_mm256_loadu_si256(p), idx8,
+                                                  _mm256_cvtepi16_epi32(_mm256_castsi256_si128(lower))));
+        _mm256_storeu_si256(p + 1, _mm256_blendv_epi8(_mm256_loadu_si256(p + 1), idx8,
+                                                      _mm256_cvtepi16_epi32(_mm256_extracti128_si256(lower, 1))));
+    }
+    for(; i < n; i++){
+        if(v[i] < min[i]){
+            min[i] = v[i];
+            min_idx[i] = idx;
+        }
+    }
+}
+
+// 8 floats, for the window_max and response templates
+struct Avx2Vector{
+    typedef __m256 Type;
+    static const int kWidth = 8;
+    static Type load(float const * p){ return _mm256_loadu_ps(p); }
+    static Type loadS32(int32_t const * p){
+        return _mm256_cvtepi32_ps(_mm256_loadu_si256(reinterpret_cast<__m256i const *>(p)));
+    }
+    static void store(float * p, const Type v){ _mm256_storeu_ps(p, v); }
+    static Type set1(const float v){ return _mm256_set1_ps(v); }
+    static Type max(const Type a, const Type b){ return _mm256_max_ps(a, b); }
+    static Type add(const Type a, const Type b){ return _mm256_add_ps(a, b); }
+    static Type sub(const Type a, const Type b){ return _mm256_sub_ps(a, b); }
+    static Type mul(const Type a, const Type b){ return _mm256_mul_ps(a, b); }
+    static Type div(const Type a, const Type b){ return _mm256_div_ps(a, b); }
+    static Type sqrt(const Type a){ return _mm256_sqrt_ps(a); }
+};
+
+const KernelTable avx2_kernels = {
+    ISA_AVX2,
+    subtractAvx2,
+    tensorProductsAvx2,
+    addRowAvx2,
+    subtractRowAvx2,
+    runningSumAvx2,
+    HARRIS_KERNELS_RESPONSE_TABLE(Avx2Vector),
+    maxRowAvx2,
+    nmsCompareAvx2,
+    binomialRowsAvx2,
+    binomialDecimateAvx2,
+    subpixelOffsetsAvx2,
+    subtractU8Avx2,
+    tensorProductsS16Avx2,
+    addRowS32Avx2,
+    subtractRowS32Avx2,
+    runningSumS32Avx2,
+    HARRIS_KERNELS_RESPONSE_S32_TABLE(Avx2Vector),
+    HARRIS_KERNELS_WINDOW_MAX_TABLE(Avx2Vector),
+    hammingDistances256<Avx2Popcount>,
+    argminU16Avx2,
+    updateMinU16Avx2
+};
+
+}
+
+const KernelTable* getAvx2Kernels(){
+
+    return &avx2_kernels;
+}
+
+}
+
+#else
+
+namespace harris_kernels{
+
+const KernelTable* getAvx2Kernels(){
+
+    return nullptr;
+}
+
+}
+
+#endif
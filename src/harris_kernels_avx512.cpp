@@ -0,0 +1,40 @@
+#include <harris_kernels.hpp>
+
+#if defined(__AVX2__) && defined(__AVX512VL__) && defined(__AVX512VPOPCNTDQ__)
+
+#include <harris_kernels_hamming.hpp>
+
+#include <immintrin.h>
+
+
+namespace harris_kernels{
+
+namespace{
+
+struct Avx512Popcount{
+    static __m256i popcount(const __m256i v){
+        return _mm256_popcnt_epi64(v);
+    }
+};
+
+}
+
+HammingDistancesKernel getAvx512HammingDistances(){
+
+    return hammingDistances256<Avx512Popcount>;
+}
+
+}
+
+#else
+
+namespace harris_kernels{
+
+HammingDistancesKernel getAvx512HammingDistances(){
+
+    return nullptr;
+}
+
+}
+
+#endif
@@ -0,0 +1,496 @@
+#include <harris_kernels.hpp>
+#include <harris_kernels_response.hpp>
+#include <harris_kernels_window.hpp>
+
+#if defined(__SSE4_1__)
+
+#include <smmintrin.h>
+
+
+namespace harris_kernels{
+
+namespace{
+
+void subtractSse41(float const * a, float const * b, float * dst, int n){
+
+    int i = 0;
+    for(; i + 4 <= n; i += 4){
+        _mm_storeu_ps(dst + i, _mm_sub_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i)));
+    }
+    for(; i < n; i++){
+        dst[i] = a[i] - b[i];
+    }
+}
+
+void tensorProductsSse41(float const * gx, float const * gy,
+                         float * gxx, float * gyy, float * gxy, int n){
+
+    int i = 0;
+    for(; i + 4 <= n; i += 4){
+        const __m128 x = _mm_loadu_ps(gx + i);
+        const __m128 y = _mm_loadu_ps(gy + i);
+        _mm_storeu_ps(gxx + i, _mm_mul_ps(x, x));
+        _mm_storeu_ps(gyy + i, _mm_mul_ps(y, y));
+        _mm_storeu_ps(gxy + i, _mm_mul_ps(x, y));
+    }
+    for(; i < n; i++){
+        gxx[i] = gx[i] * gx[i];
+        gyy[i] = gy[i] * gy[i];
+        gxy[i] = gx[i] * gy[i];
+    }
+}
+
+void addRowSse41(float * acc, float const * src, int n){
+
+    int i = 0;
+    for(; i + 4 <= n; i += 4){
+        _mm_storeu_ps(acc + i, _mm_add_ps(_mm_loadu_ps(acc + i), _mm_loadu_ps(src + i)));
+    }
+    for(; i < n; i++){
+        acc[i] += src[i];
+    }
+}
+
+void subtractRowSse41(float * acc, float const * src, int n){
+
+    int i = 0;
+    for(; i + 4 <= n; i += 4){
+        _mm_storeu_ps(acc + i, _mm_sub_ps(_mm_loadu_ps(acc + i), _mm_loadu_ps(src + i)));
+    }
+    for(; i < n; i++){
+        acc[i] -= src[i];
+    }
+}
+
+// inclusive prefix sum of the 4 lanes
+inline __m128 prefixSum(__m128 x){
+
+    x = _mm_add_ps(x, _mm_castsi128_ps(_mm_slli_si128(_mm_castps_si128(x), 4)));
+    x = _mm_add_ps(x, _mm_castsi128_ps(_mm_slli_si128(_mm_castps_si128(x), 8)));
+
+    return x;
+}
+
+void runningSumSse41(float const * v, float * dst,
+                     int begin, int end, int half_w_size){
+
+    if(begin >= end){
+        return;
+    }
+
+    float s = 0.0f;
+    for(int j = begin - half_w_size; j <= begin + half_w_size; j++){
+        s += v[j];
+    }
+    dst[begin] = s;
+
+    int i = begin + 1;
+
+    if(i + 4 <= end){
+
+        __m128 carry = _mm_set1_ps(s);
+
+        for(; i + 4 <= end; i += 4){
+
+            const __m128 diff = _mm_sub_ps(_mm_loadu_ps(v + i + half_w_size),
+                                           _mm_loadu_ps(v + i - half_w_size - 1));
+
+            const __m128 sum = _mm_add_ps(carry, prefixSum(diff));
+            _mm_storeu_ps(dst + i, sum);
+
+            carry = _mm_shuffle_ps(sum, sum, _MM_SHUFFLE(3, 3, 3, 3));
+        }
+
+        s = dst[i - 1];
+    }
+
+    for(; i < end; i++){
+        s += v[i + half_w_size] - v[i - half_w_size - 1];
+        dst[i] = s;
+    }
+}
+
+void maxRowSse41(float const * a, float const * b, float * dst, int n){
+
+    int i = 0;
+    for(; i + 4 <= n; i += 4){
+        _mm_storeu_ps(dst + i, _mm_max_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i)));
+    }
+    for(; i < n; i++){
+        dst[i] = a[i] < b[i] ? b[i] : a[i];
+    }
+}
+
+void nmsCompareSse41(float const * val, float const * window_max,
+                     float thresh, uint8_t * dst, int n){
+
+    const __m128 thresh_v = _mm_set1_ps(thresh);
+
+    int i = 0;
+    for(; i + 8 <= n; i += 8){
+
+        const __m128 x0 = _mm_loadu_ps(val + i);
+        const __m128 x1 = _mm_loadu_ps(val + i + 4);
+        const __m128 keep0 = _mm_and_ps(_mm_cmpge_ps(x0, thresh_v),
+                                        _mm_cmpge_ps(x0, _mm_loadu_ps(window_max + i)));
+        const __m128 keep1 = _mm_and_ps(_mm_cmpge_ps(x1, thresh_v),
+                                        _mm_cmpge_ps(x1, _mm_loadu_ps(window_max + i + 4)));
+
+        // 8 x int32 masks (0 or -1) -> 8 x uint8 (0 or 255)
+        const __m128i packed16 = _mm_packs_epi32(_mm_castps_si128(keep0),
+                                                 _mm_castps_si128(keep1));
+        const __m128i packed8 = _mm_packs_epi16(packed16, packed16);
+        _mm_storel_epi64(reinterpret_cast<__m128i*>(dst + i), packed8);
+    }
+    for(; i < n; i++){
+        dst[i] = (val[i] >= thresh && val[i] >= window_max[i]) ? 255 : 0;
+    }
+}
+
+void binomialRowsSse41(float const * r0, float const * r1, float const * r2,
+                       float const * r3, float const * r4, float * dst, int n){
+
+    const __m128 four = _mm_set1_ps(4.0f);
+    const __m128 six = _mm_set1_ps(6.0f);
+
+    int i = 0;
+    for(; i + 4 <= n; i += 4){
+        const __m128 outer = _mm_add_ps(_mm_loadu_ps(r0 + i), _mm_loadu_ps(r4 + i));
+        const __m128 inner = _mm_add_ps(_mm_loadu_ps(r1 + i), _mm_loadu_ps(r3 + i));
+        _mm_storeu_ps(dst + i, _mm_add_ps(_mm_add_ps(outer, _mm_mul_ps(four, inner)),
+                                          _mm_mul_ps(six, _mm_loadu_ps(r2 + i))));
+    }
+    for(; i < n; i++){
+        dst[i] = r0[i] + r4[i] + 4.0f * (r1[i] + r3[i]) + 6.0f * r2[i];
+    }
+}
+
+// p[0], p[2], p[4], p[6]
+inline __m128 loadEven(float const * p){
+
+    return _mm_shuffle_ps(_mm_loadu_ps(p), _mm_loadu_ps(p + 4), _MM_SHUFFLE(2, 0, 2, 0));
+}
+
+void binomialDecimateSse41(float const * v, float * dst, int n){
+
+    const __m128 four = _mm_set1_ps(4.0f);
+    const __m128 six = _mm_set1_ps(6.0f);
+    const __m128 scale = _mm_set1_ps(1.0f / 256.0f);
+
+    int i = 0;
+    for(; i + 4 <= n; i += 4){
+        float const * const p = v + 2 * i;
+        const __m128 outer = _mm_add_ps(loadEven(p - 2), loadEven(p + 2));
+        const __m128 inner = _mm_add_ps(loadEven(p - 1), loadEven(p + 1));
+        const __m128 sum = _mm_add_ps(_mm_add_ps(outer, _mm_mul_ps(four, inner)),
+                                      _mm_mul_ps(six, loadEven(p)));
+        _mm_storeu_ps(dst + i, _mm_mul_ps(sum, scale));
+    }
+    for(; i < n; i++){
+        float const * const p = v + 2 * i;
+        dst[i] = (p[-2] + p[2] + 4.0f * (p[-1] + p[1]) + 6.0f * p[0]) * (1.0f / 256.0f);
+    }
+}
+
+void subpixelOffsetsSse41(float const * const * samples,
+                          float * offset_x, float * offset_y, int n){
+
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 two = _mm_set1_ps(2.0f);
+    const __m128 quarter = _mm_set1_ps(0.25f);
+    const __m128 third = _mm_set1_ps(1.0f / 3.0f);
+    const __m128 sixth = _mm_set1_ps(1.0f / 6.0f);
+    const __m128 lo = _mm_set1_ps(-0.5f);
+    const __m128 hi = _mm_set1_ps(0.5f);
+
+    int m = 0;
+    for(; m + 4 <= n; m += 4){
+        __m128 s[9];
+        for(int k = 0; k < 9; k++){
+            s[k] = _mm_loadu_ps(samples[k] + m);
+        }
+
+        const __m128 l = _mm_add_ps(_mm_add_ps(s[0], s[3]), s[6]);
+        const __m128 c = _mm_add_ps(_mm_add_ps(s[1], s[4]), s[7]);
+        const __m128 r = _mm_add_ps(_mm_add_ps(s[2], s[5]), s[8]);
+        const __m128 t = _mm_add_ps(_mm_add_ps(s[0], s[1]), s[2]);
+        const __m128 mid = _mm_add_ps(_mm_add_ps(s[3], s[4]), s[5]);
+        const __m128 b = _mm_add_ps(_mm_add_ps(s[6], s[7]), s[8]);
+
+        const __m128 dx = _mm_mul_ps(_mm_sub_ps(r, l), sixth);
+        const __m128 dy = _mm_mul_ps(_mm_sub_ps(b, t), sixth);
+        const __m128 dxx = _mm_mul_ps(_mm_sub_ps(_mm_add_ps(l, r), _mm_mul_ps(two, c)), third);
+        const __m128 dyy = _mm_mul_ps(_mm_sub_ps(_mm_add_ps(t, b), _mm_mul_ps(two, mid)), third);
+        const __m128 dxy = _mm_mul_ps(_mm_sub_ps(_mm_sub_ps(s[8], s[6]),
+                                              _mm_sub_ps(s[2], s[0])), quarter);
+        const __m128 det = _mm_sub_ps(_mm_mul_ps(dxx, dyy), _mm_mul_ps(dxy, dxy));
+
+        // lanes without a maximum divide by a non-positive det; their
+        // result is masked out below
+        const __m128 valid = _mm_and_ps(_mm_cmpgt_ps(det, zero), _mm_cmplt_ps(dxx, zero));
+        const __m128 ox = _mm_div_ps(_mm_sub_ps(_mm_mul_ps(dxy, dy), _mm_mul_ps(dyy, dx)), det);
+        const __m128 oy = _mm_div_ps(_mm_sub_ps(_mm_mul_ps(dxy, dx), _mm_mul_ps(dxx, dy)), det);
+
+        _mm_storeu_ps(offset_x + m, _mm_and_ps(valid, _mm_min_ps(hi, _mm_max_ps(lo, ox))));
+        _mm_storeu_ps(offset_y + m, _mm_and_ps(valid, _mm_min_ps(hi, _mm_max_ps(lo, oy))));
+    }
+    if(m < n){
+        float const * tail_samples[9];
+        for(int k = 0; k < 9; k++){
+            tail_samples[k] = samples[k] + m;
+        }
+        getScalarKernels()->subpixelOffsets(tail_samples, offset_x + m, offset_y + m, n - m);
+    }
+}
+
+void subtractU8Sse41(uint8_t const * a, uint8_t const * b, int16_t * dst, int n){
+
+    int i = 0;
+    for(; i + 8 <= n; i += 8){
+        const __m128i a_v = _mm_cvtepu8_epi16(_mm_loadl_epi64(reinterpret_cast<__m128i const *>(a + i)));
+        const __m128i b_v = _mm_cvtepu8_epi16(_mm_loadl_epi64(reinterpret_cast<__m128i const *>(b + i)));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + i), _mm_sub_epi16(a_v, b_v));
+    }
+    for(; i < n; i++){
+        dst[i] = static_cast<int16_t>(a[i] - b[i]);
+    }
+}
+
+void tensorProductsS16Sse41(int16_t const * gx, int16_t const * gy,
+                            int32_t * gxx, int32_t * gyy, int32_t * gxy, int n){
+
+    int i = 0;
+    for(; i + 4 <= n; i += 4){
+        const __m128i x = _mm_cvtepi16_epi32(_mm_loadl_epi64(reinterpret_cast<__m128i const *>(gx + i)));
+        const __m128i y = _mm_cvtepi16_epi32(_mm_loadl_epi64(reinterpret_cast<__m128i const *>(gy + i)));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(gxx + i), _mm_mullo_epi32(x, x));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(gyy + i), _mm_mullo_epi32(y, y));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(gxy + i), _mm_mullo_epi32(x, y));
+    }
+    for(; i < n; i++){
+        gxx[i] = gx[i] * gx[i];
+        gyy[i] = gy[i] * gy[i];
+        gxy[i] = gx[i] * gy[i];
+    }
+}
+
+void addRowS32Sse41(int32_t * acc, int32_t const * src, int n){
+
+    int i = 0;
+    for(; i + 4 <= n; i += 4){
+        __m128i * const p = reinterpret_cast<__m128i *>(acc + i);
+        _mm_storeu_si128(p, _mm_add_epi32(_mm_loadu_si128(p),
+                                          _mm_loadu_si128(reinterpret_cast<__m128i const *>(src + i))));
+    }
+    for(; i < n; i++){
+        acc[i] += src[i];
+    }
+}
+
+void subtractRowS32Sse41(int32_t * acc, int32_t const * src, int n){
+
+    int i = 0;
+    for(; i + 4 <= n; i += 4){
+        __m128i * const p = reinterpret_cast<__m128i *>(acc + i);
+        _mm_storeu_si128(p, _mm_sub_epi32(_mm_loadu_si128(p),
+                                          _mm_loadu_si128(reinterpret_cast<__m128i const *>(src + i))));
+    }
+    for(; i < n; i++){
+        acc[i] -= src[i];
+    }
+}
+
+// inclusive prefix sum of the 4 lanes
+inline __m128i prefixSum(__m128i x){
+
+    x = _mm_add_epi32(x, _mm_slli_si128(x, 4));
+    x = _mm_add_epi32(x, _mm_slli_si128(x, 8));
+
+    return x;
+}
+
+void runningSumS32Sse41(int32_t const * v, int32_t * dst,
+                        int begin, int end, int half_w_size){
+
+    if(begin >= end){
+        return;
+    }
+
+    int32_t s = 0;
+    for(int j = begin - half_w_size; j <= begin + half_w_size; j++){
+        s += v[j];
+    }
+    dst[begin] = s;
+
+    int i = begin + 1;
+
+    if(i + 4 <= end){
+
+        __m128i carry = _mm_set1_epi32(s);
+
+        for(; i + 4 <= end; i += 4){
+
+            const __m128i diff =
+                _mm_sub_epi32(_mm_loadu_si128(reinterpret_cast<__m128i const *>(v + i + half_w_size)),
+                              _mm_loadu_si128(reinterpret_cast<__m128i const *>(v + i - half_w_size - 1)));
+
+            const __m128i sum = _mm_add_epi32(carry, prefixSum(diff));
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + i), sum);
+
+            carry = _mm_shuffle_epi32(sum, _MM_SHUFFLE(3, 3, 3, 3));
+        }
+
+        s = dst[i - 1];
+    }
+
+    for(; i < end; i++){
+        s += v[i + half_w_size] - v[i - half_w_size - 1];
+        dst[i] = s;
+    }
+}
+
+// set bits of each byte, from a 16-entry table of nibbles
+inline __m128i popcountBytes(const __m128i v){
+
+    const __m128i lookup = _mm_setr_epi8(0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4);
+    const __m128i low_nibbles = _mm_set1_epi8(0x0f);
+    return _mm_add_epi8(_mm_shuffle_epi8(lookup, _mm_and_si128(v, low_nibbles)),
+                        _mm_shuffle_epi8(lookup, _mm_and_si128(_mm_srli_epi16(v, 4),
+                                                               low_nibbles)));
+}
+
+void hammingDistancesSse41(uint8_t const * query, uint8_t const * train,
+                           int n, uint16_t * dst){
+
+    const __m128i q0 = _mm_loadu_si128(reinterpret_cast<__m128i const *>(query));
+    const __m128i q1 = _mm_loadu_si128(reinterpret_cast<__m128i const *>(query + 16));
+
+    for(int i = 0; i < n; i++){
+        uint8_t const * const t = train + kDescriptorBytes * i;
+        const __m128i x0 = _mm_xor_si128(q0, _mm_loadu_si128(reinterpret_cast<__m128i const *>(t)));
+        const __m128i x1 = _mm_xor_si128(q1, _mm_loadu_si128(reinterpret_cast<__m128i const *>(t + 16)));
+        const __m128i sums = _mm_sad_epu8(_mm_add_epi8(popcountBytes(x0), popcountBytes(x1)),
+                                          _mm_setzero_si128());
+        dst[i] = static_cast<uint16_t>(_mm_cvtsi128_si32(
+                                           _mm_add_epi64(sums, _mm_unpackhi_epi64(sums, sums))));
+    }
+}
+
+int argminU16Sse41(uint16_t const * v, int n){
+
+    // the smallest value, then where it first is
+    __m128i min8 = _mm_set1_epi16(-1);
+    int i = 0;
+    for(; i + 8 <= n; i += 8){
+        min8 = _mm_min_epu16(min8, _mm_loadu_si128(reinterpret_cast<__m128i const *>(v + i)));
+    }
+    uint16_t min_value = static_cast<uint16_t>(_mm_cvtsi128_si32(_mm_minpos_epu16(min8)));
+    for(; i < n; i++){
+        min_value = std::min(min_value, v[i]);
+    }
+
+    const __m128i target = _mm_set1_epi16(static_cast<int16_t>(min_value));
+    for(i = 0; i + 8 <= n; i += 8){
+        const int mask = _mm_movemask_epi8(_mm_cmpeq_epi16(
+                                               target, _mm_loadu_si128(reinterpret_cast<__m128i const *>(v + i))));
+        if(mask){
+            return i + __builtin_ctz(mask) / 2;
+        }
+    }
+    for(; v[i] != min_value; i++){
+    }
+    return i;
+}
+
+void updateMinU16Sse41(uint16_t const * v, int32_t idx,
+                       uint16_t * min, int32_t * min_idx, int n){
+
+    const __m128i idx4 = _mm_set1_epi32(idx);
+
+    int i = 0;
+    for(; i + 8 <= n; i += 8){
+        const __m128i old_min = _mm_loadu_si128(reinterpret_cast<__m128i const *>(min + i));
+        const __m128i new_min = _mm_min_epu16(old_min,
+                                              _mm_loadu_si128(reinterpret_cast<__m128i const *>(v + i)));
+        const __m128i lower = _mm_xor_si128(_mm_cmpeq_epi16(new_min, old_min), _mm_set1_epi16(-1));
+        if(_mm_testz_si128(lower, lower)){
+            continue;
+        }
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(min + i), new_min);
+        __m128i* const p = reinterpret_cast<__m128i*>(min_idx + i);
+        _mm_storeu_si128(p, _mm_blendv_epi8(_mm_loadu_si128(p), idx4, _mm_cvtepi16_epi32(lower)));
+        _mm_storeu_si128(p + 1, _mm_blendv_epi8(_mm_loadu_si128(p + 1), idx4,
+                                                _mm_cvtepi16_epi32(_mm_srli_si128(lower, 8))));
+    }
+    for(; i < n; i++){
+        if(v[i] < min[i]){
+            min[i] = v[i];
+            min_idx[i] = idx;
+        }
+    }
+}
+
+// 4 floats, for the window_max and response templates
+struct Sse41Vector{
+    typedef __m128 Type;
+    static const int kWidth = 4;
+    static Type load(float const * p){ return _mm_loadu_ps(p); }
+    static Type loadS32(int32_t const * p){
+        return _mm_cvtepi32_ps(_mm_loadu_si128(reinterpret_cast<__m128i const *>(p)));
+    }
+    static void store(float * p, const Type v){ _mm_storeu_ps(p, v); }
+    static Type set1(const float v){ return _mm_set1_ps(v); }
+    static Type max(const Type a, const Type b){ return _mm_max_ps(a, b); }
+    static Type add(const Type a, const Type b){ return _mm_add_ps(a, b); }
+    static Type sub(const Type a, const Type b){ return _mm_sub_ps(a, b); }
+    static Type mul(const Type a, const Type b){ return _mm_mul_ps(a, b); }
+    static Type div(const Type a, const Type b){ return _mm_div_ps(a, b); }
+    static Type sqrt(const Type a){ return _mm_sqrt_ps(a); }
+};
+
+const KernelTable sse41_kernels = {
+    ISA_SSE41,
+    subtractSse41,
+    tensorProductsSse41,
+    addRowSse41,
+    subtractRowSse41,
+    runningSumSse41,
+    HARRIS_KERNELS_RESPONSE_TABLE(Sse41Vector),
+    maxRowSse41,
+    nmsCompareSse41,
+    binomialRowsSse41,
+    binomialDecimateSse41,
+    subpixelOffsetsSse41,
+    subtractU8Sse41,
+    tensorProductsS16Sse41,
+    addRowS32Sse41,
+    subtractRowS32Sse41,
+    runningSumS32Sse41,
+    HARRIS_KERNELS_RESPONSE_S32_TABLE(Sse41Vector),
+    HARRIS_KERNELS_WINDOW_MAX_TABLE(Sse41Vector),
+    hammingDistancesSse41,
+    argminU16Sse41,
+    updateMinU16Sse41
+};
+
+}
+
+const KernelTable* getSse41Kernels(){
+
+    return &sse41_kernels;
+}
+
+}
+
+#else
+
+namespace harris_kernels{
+
+const KernelTable* getSse41Kernels(){
+
+    return nullptr;
+}
+
+}
+
+#endif
@@ -0,0 +1,398 @@
+#include <harris_tracker.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <stdexcept>
+
+
+namespace{
+
+// tracking of a corner stops once an update moves it less than this (pixels)
+const float kConvergenceEpsilon = 0.01f;
+
+// Below this smallest eigenvalue of the Hessian per template pixel, a
+// patch is too flat (or an edge) to be tracked.
+const float kMinEigenvalue = 1e-4f;
+
+// tracks per task of the thread pool
+const int kTracksPerTask = 64;
+
+/*
+  dst = the size x size patch of image whose top left pixel is at
+  (x, y), sampled bilinearly, in float intensities. All of it must be
+  within the image, one more pixel on the right and bottom included.
+  The fraction of the position is the same for every pixel, so the
+  weights are too.
+ */
+template<typename T>
+void samplePatch(const cv::Mat& image, const float x, const float y,
+                 const int size, const float scale, float* dst){
+
+    const int x0 = static_cast<int>(std::floor(x));
+    const int y0 = static_cast<int>(std::floor(y));
+    const float fx = x - x0;
+    const float fy = y - y0;
+    const float w00 = (1.0f - fx) * (1.0f - fy) * scale;
+    const float w01 = fx * (1.0f - fy) * scale;
+    const float w10 = (1.0f - fx) * fy * scale;
+    const float w11 = fx * fy * scale;
+
+    for(int i_r = 0; i_r < size; i_r++){
+
+        T const * const row0 = image.ptr<T>(y0 + i_r) + x0;
+        T const * const row1 = image.ptr<T>(y0 + i_r + 1) + x0;
+
+        for(int i_c = 0; i_c < size; i_c++){
+            dst[i_r * size + i_c] = w00 * row0[i_c] + w01 * row0[i_c + 1]
+                + w10 * row1[i_c] + w11 * row1[i_c + 1];
+        }
+    }
+}
+
+void samplePatch(const cv::Mat& image, const float x, const float y,
+                 const int size, float* dst){
+
+    if(image.depth() == CV_8U){
+        samplePatch<uint8_t>(image, x, y, size, 1.0f / 255.0f, dst);
+    }else{
+        samplePatch<float>(image, x, y, size, 1.0f, dst);
+    }
+}
+
+// whether a size x size patch centered at (x, y) can be sampled
+bool patchInside(const cv::Mat& image, const float x, const float y, const int size){
+
+    const float half = 0.5f * (size - 1);
+
+    return x - half >= 0.0f && y - half >= 0.0f
+        && x + half < image.cols - 1 && y + half < image.rows - 1;
+}
+
+}
+
+
+HarrisTracker::HarrisTracker(HarrisCorner& detector)
+    : detector_(detector),
+      detection_interval_(5),
+      min_tracks_(0),
+      track_window_size_(7),
+      max_iterations_(10),
+      max_residual_(0.05f),
+      frames_since_detection_(-1),
+      last_frame_detected_(false),
+      next_id_(0),
+      frame_type_(-1){
+
+}
+
+HarrisTracker::~HarrisTracker(){
+
+}
+
+void HarrisTracker::reset(){
+
+    frames_since_detection_ = -1;
+}
+
+void HarrisTracker::setDetectionInterval(const int detection_interval){
+
+    if(detection_interval <= 0){
+        throw std::runtime_error("detection_interval must be positive");
+    }
+
+    detection_interval_ = detection_interval;
+}
+
+void HarrisTracker::setMinTracks(const int min_tracks){
+
+    if(min_tracks < 0){
+        throw std::runtime_error("min_tracks must not be negative");
+    }
+
+    min_tracks_ = min_tracks;
+}
+
+void HarrisTracker::setTrackWindowSize(const int track_window_size){
+
+    if(track_window_size <= 1 || track_window_size % 2 == 0
+       || track_window_size > kMaxTrackWindowSize){
+        throw std::runtime_error("track_window_size must be an odd number in [3, "
+                                 + std::to_string(kMaxTrackWindowSize) + "]");
+    }
+
+    track_window_size_ = track_window_size;
+    reset();
+}
+
+void HarrisTracker::setMaxIterations(const int max_iterations){
+
+    if(max_iterations <= 0){
+        throw std::runtime_error("max_iterations must be positive");
+    }
+
+    max_iterations_ = max_iterations;
+}
+
+void HarrisTracker::setMaxResidual(const double max_residual){
+
+    max_residual_ = static_cast<float>(max_residual);
+}
+
+void HarrisTracker::track(const cv::Mat& input_image,
+                          std::vector<Track>& tracks,
+                          const double thresh,
+                          const int nms_window_size,
+                          const KeypointSelection& selection){
+
+    MY_UTILS_KK4_TRACE_SPAN("HarrisTracker::track");
+
+    if(input_image.type() != CV_32FC1 && input_image.type() != CV_8UC1){
+        throw std::runtime_error("Invalid matrix type");
+    }
+
+    const bool same_format = input_image.size() == frame_size_
+        && input_image.type() == frame_type_;
+    frame_size_ = input_image.size();
+    frame_type_ = input_image.type();
+
+    bool detect_frame = frames_since_detection_ < 0 || ! same_format
+        || frames_since_detection_ + 1 >= detection_interval_;
+
+    if(! detect_frame){
+
+        my_utils_kk4::StopWatch stop_watch;
+        stop_watch.start();
+
+        const int num_tracks = static_cast<int>(tracks_.size());
+        alive_.resize(num_tracks);
+
+        detector_.getThreadPool().parallelFor(
+            (num_tracks + kTracksPerTask - 1) / kTracksPerTask,
+            [&](const int task_idx, const int){
+                const int begin = task_idx * kTracksPerTask;
+                trackRange(input_image, begin, std::min(begin + kTracksPerTask, num_tracks));
+            });
+
+        compactTracks();
+
+        stats_.tracking_seconds += stop_watch.stop();
+
+        // too few left: detect on this frame after all
+        detect_frame = static_cast<int>(tracks_.size()) < min_tracks_;
+
+        if(! detect_frame){
+            stats_.tracking_frames++;
+            frames_since_detection_++;
+        }
+    }
+
+    if(detect_frame){
+
+        my_utils_kk4::StopWatch stop_watch;
+        stop_watch.start();
+
+        detect(input_image, thresh, nms_window_size, selection);
+
+        stats_.detection_seconds += stop_watch.stop();
+        stats_.detection_frames++;
+        frames_since_detection_ = 0;
+    }
+
+    last_frame_detected_ = detect_frame;
+    tracks.assign(tracks_.begin(), tracks_.end());
+}
+
+void HarrisTracker::detect(const cv::Mat& input_image,
+                           const double thresh,
+                           const int nms_window_size,
+                           const KeypointSelection& selection){
+
+    detector_.detectKeypoints(input_image, keypoints_, thresh, nms_window_size, selection);
+
+    const int num_tracks = static_cast<int>(keypoints_.size());
+
+    tracks_.resize(num_tracks);
+    velocities_.assign(num_tracks, cv::Point2f(0.0f, 0.0f));
+    alive_.resize(num_tracks);
+    templates_.resize(static_cast<size_t>(num_tracks) * templateStride());
+
+    for(int i = 0; i < num_tracks; i++){
+        tracks_[i].keypoint = keypoints_[i];
+        tracks_[i].age = 0;
+    }
+
+    detector_.getThreadPool().parallelFor(
+        (num_tracks + kTracksPerTask - 1) / kTracksPerTask,
+        [&](const int task_idx, const int){
+            const int begin = task_idx * kTracksPerTask;
+            const int end = std::min(begin + kTracksPerTask, num_tracks);
+            for(int i = begin; i < end; i++){
+                alive_[i] = takeTemplate(input_image, i);
+            }
+        });
+
+    compactTracks();
+
+    // ids in the order of the keypoints, whatever the threads did
+    for(Track& track : tracks_){
+        track.id = next_id_++;
+    }
+}
+
+bool HarrisTracker::takeTemplate(const cv::Mat& input_image, const int track_idx){
+
+    const int w = track_window_size_;
+    const int n = w * w;
+    const float x = tracks_[track_idx].keypoint.x;
+    const float y = tracks_[track_idx].keypoint.y;
+
+    // the template with a one pixel border for central differences
+    if(! patchInside(input_image, x, y, w + 2)){
+        return false;
+    }
+
+    float patch[(kMaxTrackWindowSize + 2) * (kMaxTrackWindowSize + 2)];
+    const float half = 0.5f * (w + 1);
+    samplePatch(input_image, x - half, y - half, w + 2, patch);
+
+    float* const templ = &templates_[static_cast<size_t>(track_idx) * templateStride()];
+    float* const grad_x = templ + n;
+    float* const grad_y = grad_x + n;
+    float* const hessian_inv = grad_y + n;
+
+    float hxx = 0.0f;
+    float hxy = 0.0f;
+    float hyy = 0.0f;
+
+    for(int i_r = 0; i_r < w; i_r++){
+        float const * const row = patch + (i_r + 1) * (w + 2) + 1;
+        for(int i_c = 0; i_c < w; i_c++){
+            const float gx = 0.5f * (row[i_c + 1] - row[i_c - 1]);
+            const float gy = 0.5f * (row[i_c + w + 2] - row[i_c - (w + 2)]);
+            templ[i_r * w + i_c] = row[i_c];
+            grad_x[i_r * w + i_c] = gx;
+            grad_y[i_r * w + i_c] = gy;
+            hxx += gx * gx;
+            hxy += gx * gy;
+            hyy += gy * gy;
+        }
+    }
+
+    // smallest eigenvalue of [hxx hxy; hxy hyy]
+    const float min_eigenvalue = 0.5f * (hxx + hyy)
+        - std::sqrt(0.25f * (hxx - hyy) * (hxx - hyy) + hxy * hxy);
+
+    if(! (min_eigenvalue >= kMinEigenvalue * n)){
+        return false;
+    }
+
+    const float det = hxx * hyy - hxy * hxy;
+    hessian_inv[0] = hyy / det;
+    hessian_inv[1] = -hxy / det;
+    hessian_inv[2] = hxx / det;
+
+    return true;
+}
+
+void HarrisTracker::trackRange(const cv::Mat& input_image, const int begin, const int end){
+
+    const int w = track_window_size_;
+    const int n = w * w;
+
+    float patch[kMaxTrackWindowSize * kMaxTrackWindowSize];
+
+    for(int i = begin; i < end; i++){
+
+        Track& track = tracks_[i];
+        float const * const templ = &templates_[static_cast<size_t>(i) * templateStride()];
+        float const * const grad_x = templ + n;
+        float const * const grad_y = grad_x + n;
+        float const * const hessian_inv = grad_y + n;
+
+        // from where the motion of the last frame would take it
+        float x = track.keypoint.x + velocities_[i].x;
+        float y = track.keypoint.y + velocities_[i].y;
+        bool inside = true;
+        bool converged = false;
+
+        for(int iteration = 0; iteration < max_iterations_; iteration++){
+
+            if(! patchInside(input_image, x, y, w)){
+                inside = false;
+                break;
+            }
+
+            samplePatch(input_image, x - 0.5f * (w - 1), y - 0.5f * (w - 1), w, patch);
+
+            float bx = 0.0f;
+            float by = 0.0f;
+            for(int j = 0; j < n; j++){
+                const float error = patch[j] - templ[j];
+                bx += grad_x[j] * error;
+                by += grad_y[j] * error;
+            }
+
+            // inverse compositional: the warp moves by minus the update
+            const float dx = hessian_inv[0] * bx + hessian_inv[1] * by;
+            const float dy = hessian_inv[1] * bx + hessian_inv[2] * by;
+            x -= dx;
+            y -= dy;
+
+            if(dx * dx + dy * dy < kConvergenceEpsilon * kConvergenceEpsilon){
+                converged = true;
+                break;
+            }
+        }
+
+        // one still wandering after max_iterations_ is mostly caught
+        // between two structures, not on its corner
+        if(! inside || ! converged || ! patchInside(input_image, x, y, w)){
+            alive_[i] = false;
+            continue;
+        }
+
+        samplePatch(input_image, x - 0.5f * (w - 1), y - 0.5f * (w - 1), w, patch);
+
+        float residual = 0.0f;
+        for(int j = 0; j < n; j++){
+            residual += std::abs(patch[j] - templ[j]);
+        }
+
+        if(! (residual <= max_residual_ * n)){
+            alive_[i] = false;
+            continue;
+        }
+
+        velocities_[i] = cv::Point2f(x - track.keypoint.x, y - track.keypoint.y);
+        track.keypoint.x = x;
+        track.keypoint.y = y;
+        track.age++;
+        alive_[i] = true;
+    }
+}
+
+void HarrisTracker::compactTracks(){
+
+    const size_t stride = templateStride();
+    size_t num_alive = 0;
+
+    for(size_t i = 0; i < tracks_.size(); i++){
+
+        if(! alive_[i]){
+            continue;
+        }
+
+        if(num_alive != i){
+            tracks_[num_alive] = tracks_[i];
+            velocities_[num_alive] = velocities_[i];
+            std::memcpy(&templates_[num_alive * stride], &templates_[i * stride],
+                        stride * sizeof(float));
+        }
+        num_alive++;
+    }
+
+    tracks_.resize(num_alive);
+    velocities_.resize(num_alive);
+    templates_.resize(num_alive * stride);
+}
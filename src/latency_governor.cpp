@@ -0,0 +1,159 @@
+#include <latency_governor.hpp>
+
+#include <algorithm>
+#include <sstream>
+#include <stdexcept>
+
+
+constexpr double LatencyGovernor::kSmoothing;
+constexpr double LatencyGovernor::kStepUpFraction;
+const int LatencyGovernor::kFramesToStepUp;
+
+
+LatencyGovernor::LatencyGovernor(const double budget_ms)
+    : budget_ms_(budget_ms){
+
+    if(budget_ms <= 0.0){
+        throw std::runtime_error("budget_ms must be positive");
+    }
+
+    setLevels(getDefaultLevels());
+}
+
+void LatencyGovernor::setBudgetMs(const double budget_ms){
+
+    if(budget_ms <= 0.0){
+        throw std::runtime_error("budget_ms must be positive");
+    }
+
+    budget_ms_ = budget_ms;
+    restart();
+}
+
+void LatencyGovernor::setLevels(const std::vector<Settings>& levels){
+
+    if(levels.empty()){
+        throw std::runtime_error("A latency governor needs at least one level");
+    }
+
+    for(const Settings& settings : levels){
+        if(settings.scale <= 0.0 || settings.scale > 1.0
+           || settings.roi_fraction <= 0.0 || settings.roi_fraction > 1.0
+           || settings.min_nms_window_size <= 0 || settings.min_nms_window_size % 2 == 0
+           || settings.max_corners < 0){
+            throw std::runtime_error("Invalid latency governor level: " + describe(settings));
+        }
+    }
+
+    levels_ = levels;
+    reset();
+}
+
+/*
+  The cheap knobs first: capping the corners and widening the NMS
+  window cost little quality. Scale then cuts the work per frame by its
+  square, and the ROI last, since it loses whole parts of the view.
+ */
+std::vector<LatencyGovernor::Settings> LatencyGovernor::getDefaultLevels(){
+
+    std::vector<Settings> levels;
+    levels.push_back(Settings(1.0, 1, 0, 1.0));
+    levels.push_back(Settings(1.0, 5, 1000, 1.0));
+    levels.push_back(Settings(0.75, 5, 1000, 1.0));
+    levels.push_back(Settings(0.5, 5, 500, 1.0));
+    levels.push_back(Settings(0.5, 5, 500, 0.75));
+    levels.push_back(Settings(0.5, 7, 300, 0.5));
+    return levels;
+}
+
+bool LatencyGovernor::update(const double frame_seconds){
+
+    const double frame_ms = frame_seconds * 1e3;
+
+    frames_at_level_[level_]++;
+    frame_idx_++;
+
+    smoothed_ms_ = smoothed_ms_ < 0.0 ? frame_ms
+        : kSmoothing * frame_ms + (1.0 - kSmoothing) * smoothed_ms_;
+
+    if(frames_to_settle_ > 0){
+        frames_to_settle_--;
+        return false;
+    }
+
+    frames_over_ = smoothed_ms_ > budget_ms_ ? frames_over_ + 1 : 0;
+    frames_under_ = smoothed_ms_ < kStepUpFraction * budget_ms_ ? frames_under_ + 1 : 0;
+
+    const int num_levels = static_cast<int>(levels_.size());
+
+    if(frames_over_ >= kFramesToStepDown && level_ + 1 < num_levels){
+
+        // back to where a step up came from, too soon: stay longer next time
+        const int level = level_ + 1;
+        if(stepped_up_at_[level] >= 0
+           && frame_idx_ - stepped_up_at_[level] <= step_up_holds_[level]){
+            step_up_holds_[level] = std::min(2 * step_up_holds_[level],
+                                             kMaxStepUpHoldFactor * kFramesToStepUp);
+        }
+        changeLevel(level);
+        return true;
+    }
+
+    if(level_ > 0 && frames_under_ >= step_up_holds_[level_]){
+        stepped_up_at_[level_] = frame_idx_;
+        changeLevel(level_ - 1);
+        return true;
+    }
+
+    return false;
+}
+
+void LatencyGovernor::reset(){
+
+    const size_t num_levels = levels_.size();
+
+    level_ = 0;
+    frame_idx_ = 0;
+    step_up_holds_.assign(num_levels, kFramesToStepUp);
+    stepped_up_at_.assign(num_levels, -1);
+    last_decision_ = Decision();
+    num_decisions_ = 0;
+    frames_at_level_.assign(num_levels, 0);
+
+    restart();
+}
+
+std::string LatencyGovernor::describe(const Settings& settings){
+
+    std::ostringstream os;
+    os << "scale " << settings.scale << ", NMS >= " << settings.min_nms_window_size << ", ";
+    if(settings.max_corners > 0){
+        os << "max " << settings.max_corners << " corners";
+    }else{
+        os << "all corners";
+    }
+    os << ", ROI " << settings.roi_fraction * 100.0 << "%";
+    return os.str();
+}
+
+void LatencyGovernor::changeLevel(const int level){
+
+    last_decision_.frame_idx = frame_idx_;
+    last_decision_.from_level = level_;
+    last_decision_.to_level = level;
+    last_decision_.frame_ms = smoothed_ms_;
+    last_decision_.budget_ms = budget_ms_;
+    num_decisions_++;
+
+    level_ = level;
+    restart();
+    frames_to_settle_ = kSettleFrames;
+}
+
+void LatencyGovernor::restart(){
+
+    smoothed_ms_ = -1.0;
+    frames_over_ = 0;
+    frames_under_ = 0;
+    frames_to_settle_ = 0;
+}
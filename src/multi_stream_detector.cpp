@@ -0,0 +1,267 @@
+#include <multi_stream_detector.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <exception>
+#include <stdexcept>
+
+
+struct MultiStreamDetector::FrameJob{
+    int stream_idx;
+    long frame_idx;
+    cv::Mat frame;
+    double thresh;
+    int nms_window_size;
+    KeypointSink sink;
+    KeypointSelection selection;
+    std::chrono::steady_clock::time_point submit_time;
+
+    std::vector<std::vector<Keypoint> > tile_keypoints;
+    std::vector<Keypoint> keypoints;
+    int tile_rows;
+    std::atomic<int> num_tiles_left;
+
+    std::mutex mutex;               // guards exception
+    std::exception_ptr exception;
+};
+
+
+MultiStreamDetector::MultiStreamDetector(const double k, const int window_size,
+                                         const int num_threads)
+    : max_frames_in_flight_(kDefaultMaxFramesInFlight),
+      tile_rows_(kDefaultTileRows),
+      scheduler_(num_threads){
+
+    detectors_.resize(scheduler_.getNumWorkers());
+
+    for(std::unique_ptr<HarrisCorner>& detector : detectors_){
+        detector.reset(new HarrisCorner(k, window_size, 1));
+    }
+}
+
+MultiStreamDetector::~MultiStreamDetector(){
+
+}
+
+void MultiStreamDetector::setMaxFramesInFlight(const int max_frames_in_flight){
+
+    if(max_frames_in_flight <= 0){
+        throw std::runtime_error("max_frames_in_flight must be positive");
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    max_frames_in_flight_ = max_frames_in_flight;
+}
+
+void MultiStreamDetector::setTileRows(const int tile_rows){
+
+    if(tile_rows < 0){
+        throw std::runtime_error("tile_rows must not be negative");
+    }
+
+    tile_rows_ = tile_rows;
+}
+
+void MultiStreamDetector::setIsa(const harris_kernels::Isa isa){
+
+    for(std::unique_ptr<HarrisCorner>& detector : detectors_){
+        detector->setIsa(isa);
+    }
+}
+
+void MultiStreamDetector::setResponseType(const harris_kernels::Response response_type){
+
+    for(std::unique_ptr<HarrisCorner>& detector : detectors_){
+        detector->setResponseType(response_type);
+    }
+}
+
+void MultiStreamDetector::setSubpixelRefinement(const bool subpixel_refinement){
+
+    for(std::unique_ptr<HarrisCorner>& detector : detectors_){
+        detector->setSubpixelRefinement(subpixel_refinement);
+    }
+}
+
+void MultiStreamDetector::submit(const int stream_idx,
+                                 const cv::Mat& frame,
+                                 const double thresh,
+                                 const int nms_window_size,
+                                 const KeypointSink& sink,
+                                 const KeypointSelection& selection){
+
+    submitFrame(stream_idx, frame, thresh, nms_window_size, sink, selection, true);
+}
+
+bool MultiStreamDetector::trySubmit(const int stream_idx,
+                                    const cv::Mat& frame,
+                                    const double thresh,
+                                    const int nms_window_size,
+                                    const KeypointSink& sink,
+                                    const KeypointSelection& selection){
+
+    return submitFrame(stream_idx, frame, thresh, nms_window_size, sink, selection, false);
+}
+
+void MultiStreamDetector::waitIdle(){
+
+    scheduler_.waitIdle();
+}
+
+MultiStreamDetector::StreamStats
+MultiStreamDetector::getStreamStats(const int stream_idx)const{
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    if(stream_idx < 0 || static_cast<size_t>(stream_idx) >= streams_.size()){
+        return StreamStats();
+    }
+    return streams_[stream_idx].stats;
+}
+
+void MultiStreamDetector::resetStats(){
+
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        for(StreamState& stream : streams_){
+            stream.stats = StreamStats();
+        }
+    }
+    scheduler_.resetStats();
+}
+
+bool MultiStreamDetector::submitFrame(const int stream_idx,
+                                      const cv::Mat& frame,
+                                      const double thresh,
+                                      const int nms_window_size,
+                                      const KeypointSink& sink,
+                                      const KeypointSelection& selection,
+                                      const bool wait){
+
+    if(stream_idx < 0){
+        throw std::runtime_error("stream_idx must not be negative");
+    }
+
+    std::shared_ptr<FrameJob> job = std::make_shared<FrameJob>();
+
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+
+        if(streams_.size() <= static_cast<size_t>(stream_idx)){
+            streams_.resize(stream_idx + 1);
+        }
+
+        StreamState& stream = streams_[stream_idx];
+        job->frame_idx = stream.next_frame_idx++;
+
+        if(wait){
+            done_condition_.wait(lock, [&]{
+                    return streams_[stream_idx].frames_in_flight < max_frames_in_flight_;
+                });
+        }else if(stream.frames_in_flight >= max_frames_in_flight_){
+            stream.stats.num_dropped++;
+            return false;
+        }
+
+        streams_[stream_idx].frames_in_flight++;
+    }
+
+    job->stream_idx = stream_idx;
+    job->frame = frame;
+    job->thresh = thresh;
+    job->nms_window_size = nms_window_size;
+    job->sink = sink;
+    job->selection = selection;
+    job->submit_time = std::chrono::steady_clock::now();
+
+    scheduler_.submit(stream_idx, [this, job](const int worker_idx){
+            runFrame(job, worker_idx);
+        });
+
+    return true;
+}
+
+void MultiStreamDetector::runFrame(const std::shared_ptr<FrameJob>& job, const int worker_idx){
+
+    const int rows = job->frame.rows;
+    const int setting = tile_rows_.load();
+    const int tile_rows = setting > 0 && rows >= 2 * setting ? setting : std::max(rows, 1);
+    const int num_tiles = (rows + tile_rows - 1) / tile_rows;
+
+    job->tile_rows = tile_rows;
+    job->tile_keypoints.resize(std::max(num_tiles, 1));
+    job->num_tiles_left = std::max(num_tiles, 1);
+
+    // queued last to first, so that they come off the front in order
+    for(int tile_idx = num_tiles - 1; tile_idx > 0; tile_idx--){
+        scheduler_.submit(job->stream_idx, [this, job, tile_idx](const int tile_worker_idx){
+                runTile(*job, tile_idx, tile_worker_idx);
+            });
+    }
+
+    runTile(*job, 0, worker_idx);
+}
+
+void MultiStreamDetector::runTile(FrameJob& job, const int tile_idx, const int worker_idx){
+
+    MY_UTILS_KK4_TRACE_SPAN("MultiStreamDetector::runTile");
+
+    const int row_begin = std::min(tile_idx * job.tile_rows, job.frame.rows);
+    const int row_end = std::min(row_begin + job.tile_rows, job.frame.rows);
+
+    try{
+        detectors_[worker_idx]->detectKeypointsRows(job.frame, job.tile_keypoints[tile_idx],
+                                                    job.thresh, job.nms_window_size,
+                                                    row_begin, row_end);
+    }catch(...){
+        std::lock_guard<std::mutex> lock(job.mutex);
+        if(! job.exception){
+            job.exception = std::current_exception();
+        }
+    }
+
+    if(--job.num_tiles_left == 0){
+        finishFrame(job, worker_idx);
+    }
+}
+
+void MultiStreamDetector::finishFrame(FrameJob& job, const int worker_idx){
+
+    double latency_seconds = 0.0;
+
+    if(! job.exception){
+        try{
+            for(const std::vector<Keypoint>& tile_keypoints : job.tile_keypoints){
+                job.keypoints.insert(job.keypoints.end(),
+                                     tile_keypoints.begin(), tile_keypoints.end());
+            }
+            detectors_[worker_idx]->selectKeypoints(job.keypoints, job.frame.size(),
+                                                    job.selection);
+
+            latency_seconds = std::chrono::duration<double>(
+                std::chrono::steady_clock::now() - job.submit_time).count();
+
+            job.sink(job.stream_idx, job.frame_idx, job.frame, job.keypoints);
+        }catch(...){
+            job.exception = std::current_exception();
+        }
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        StreamState& stream = streams_[job.stream_idx];
+        stream.frames_in_flight--;
+        if(! job.exception){
+            stream.stats.num_frames++;
+            stream.stats.latency_seconds += latency_seconds;
+            stream.stats.max_latency_seconds =
+                std::max(stream.stats.max_latency_seconds, latency_seconds);
+        }
+    }
+    done_condition_.notify_all();
+
+    // to the scheduler, which hands it to waitIdle()
+    if(job.exception){
+        std::rethrow_exception(job.exception);
+    }
+}
@@ -0,0 +1,273 @@
+#include <raw_frame_file.hpp>
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+
+RawFrameWriter::RawFrameWriter()
+    : file_(nullptr){
+
+}
+
+RawFrameWriter::~RawFrameWriter(){
+
+    try{
+        close();
+    }catch(const std::exception&){
+        // nothing to report to from a destructor; close() explicitly to
+        // see write errors
+    }
+}
+
+void RawFrameWriter::open(const std::string& file_name){
+
+    close();
+
+    file_ = std::fopen(file_name.c_str(), "wb");
+    if(! file_){
+        throw std::runtime_error("Could not open " + file_name + " for writing");
+    }
+
+    file_name_ = file_name;
+    index_.clear();
+
+    std::memset(&header_, 0, sizeof(header_));
+    std::memcpy(header_.magic, kRawFrameMagic, sizeof(header_.magic));
+    header_.version = kRawFrameVersion;
+    header_.header_size = sizeof(RawFrameHeader);
+
+    // without geometry until the first frame, incomplete until close(),
+    // padded to the first frame
+    padding_.assign(kRawFrameDataOffset, 0);
+    std::memcpy(padding_.data(), &header_, sizeof(header_));
+    writeBytes(padding_.data(), padding_.size());
+}
+
+void RawFrameWriter::write(const cv::Mat& frame, const int64_t timestamp_ns){
+
+    if(! file_){
+        throw std::runtime_error("RawFrameWriter is not open");
+    }
+
+    if(index_.empty()){
+        const uint64_t page_size = kRawFrameDataOffset;
+        header_.rows = frame.rows;
+        header_.cols = frame.cols;
+        header_.type = frame.type();
+        header_.frame_size = static_cast<uint64_t>(frame.rows) * frame.cols * frame.elemSize();
+        header_.frame_stride = (header_.frame_size + page_size - 1) / page_size * page_size;
+        padding_.assign(header_.frame_stride - header_.frame_size, 0);
+
+        // the geometry on disk at once, for the reader of a recording
+        // that is never closed
+        if(std::fseek(file_, 0, SEEK_SET) != 0
+           || std::fwrite(&header_, sizeof(header_), 1, file_) != 1
+           || std::fseek(file_, 0, SEEK_END) != 0
+           || std::fflush(file_) != 0){
+            throw std::runtime_error("Could not write " + file_name_);
+        }
+    }else if(frame.rows != header_.rows || frame.cols != header_.cols
+             || frame.type() != header_.type){
+        throw std::runtime_error("Frames of a raw frame file must have the same size and type");
+    }
+
+    RawFrameIndexEntry entry;
+    entry.offset = kRawFrameDataOffset + index_.size() * header_.frame_stride;
+    entry.timestamp_ns = timestamp_ns;
+
+    const size_t row_size = frame.cols * frame.elemSize();
+    if(frame.isContinuous()){
+        writeBytes(frame.data, row_size * frame.rows);
+    }else{
+        for(int i_r = 0; i_r < frame.rows; i_r++){
+            writeBytes(frame.ptr(i_r), row_size);
+        }
+    }
+    writeBytes(padding_.data(), padding_.size());
+
+    index_.push_back(entry);
+}
+
+void RawFrameWriter::flush(){
+
+    if(file_ && std::fflush(file_) != 0){
+        throw std::runtime_error("Could not write " + file_name_);
+    }
+}
+
+void RawFrameWriter::close(){
+
+    if(! file_){
+        return;
+    }
+
+    header_.num_frames = index_.size();
+    header_.index_offset = kRawFrameDataOffset + index_.size() * header_.frame_stride;
+
+    bool ok = index_.empty()
+        || std::fwrite(index_.data(), sizeof(RawFrameIndexEntry), index_.size(), file_)
+        == index_.size();
+    ok &= std::fseek(file_, 0, SEEK_SET) == 0;
+    ok &= std::fwrite(&header_, sizeof(header_), 1, file_) == 1;
+    ok &= std::fclose(file_) == 0;
+    file_ = nullptr;
+
+    if(! ok){
+        throw std::runtime_error("Could not write " + file_name_);
+    }
+}
+
+void RawFrameWriter::writeBytes(void const * data, const size_t size){
+
+    if(size > 0 && std::fwrite(data, 1, size, file_) != size){
+        throw std::runtime_error("Could not write " + file_name_);
+    }
+}
+
+
+RawFrameReader::RawFrameReader()
+    : data_(nullptr),
+      file_size_(0),
+      num_frames_(0),
+      index_(nullptr),
+      next_frame_idx_(0){
+
+    std::memset(&header_, 0, sizeof(header_));
+}
+
+RawFrameReader::~RawFrameReader(){
+
+    close();
+}
+
+void RawFrameReader::open(const std::string& file_name){
+
+    close();
+
+    const int fd = ::open(file_name.c_str(), O_RDONLY);
+    if(fd < 0){
+        throw std::runtime_error("Could not open " + file_name);
+    }
+
+    struct stat file_stat;
+    if(fstat(fd, &file_stat) != 0 || file_stat.st_size < static_cast<off_t>(kRawFrameDataOffset)){
+        ::close(fd);
+        throw std::runtime_error(file_name + " is not a raw frame file");
+    }
+
+    file_size_ = static_cast<size_t>(file_stat.st_size);
+    void* const data = mmap(nullptr, file_size_, PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+
+    if(data == MAP_FAILED){
+        throw std::runtime_error("Could not map " + file_name);
+    }
+
+    data_ = static_cast<uint8_t const*>(data);
+
+    // replay reads front to back
+    madvise(data, file_size_, MADV_SEQUENTIAL);
+
+    std::memcpy(&header_, data_, sizeof(header_));
+
+    const uint64_t frame_size = static_cast<uint64_t>(std::max(0, header_.rows))
+        * std::max(0, header_.cols) * CV_ELEM_SIZE(header_.type);
+
+    if(std::memcmp(header_.magic, kRawFrameMagic, sizeof(header_.magic)) != 0
+       || header_.version != kRawFrameVersion
+       || header_.header_size != sizeof(RawFrameHeader)
+       || header_.frame_size != frame_size
+       || header_.frame_stride < header_.frame_size
+       || header_.frame_stride % kRawFrameDataOffset != 0){
+        close();
+        throw std::runtime_error(file_name + " is not a raw frame file");
+    }
+
+    const uint64_t frames_end = header_.index_offset;
+    const uint64_t index_end = header_.index_offset
+        + header_.num_frames * sizeof(RawFrameIndexEntry);
+
+    if(header_.num_frames > 0){
+
+        if(frames_end != kRawFrameDataOffset + header_.num_frames * header_.frame_stride
+           || index_end > file_size_){
+            close();
+            throw std::runtime_error(file_name + " is truncated");
+        }
+
+        index_ = reinterpret_cast<RawFrameIndexEntry const*>(data_ + header_.index_offset);
+
+        for(uint64_t i = 0; i < header_.num_frames; i++){
+            if(index_[i].offset < kRawFrameDataOffset
+               || index_[i].offset + header_.frame_size > frames_end){
+                close();
+                throw std::runtime_error(file_name + " has a broken index");
+            }
+        }
+
+        num_frames_ = static_cast<int>(header_.num_frames);
+
+    }else if(header_.frame_size > 0 && file_size_ >= kRawFrameDataOffset + header_.frame_size){
+
+        // cut short: the whole frames there are
+        num_frames_ = static_cast<int>((file_size_ - kRawFrameDataOffset - header_.frame_size)
+                                       / header_.frame_stride + 1);
+    }
+}
+
+void RawFrameReader::close(){
+
+    if(data_){
+        munmap(const_cast<uint8_t*>(data_), file_size_);
+    }
+
+    data_ = nullptr;
+    file_size_ = 0;
+    num_frames_ = 0;
+    index_ = nullptr;
+    next_frame_idx_ = 0;
+}
+
+cv::Mat RawFrameReader::getFrame(const int frame_idx)const{
+
+    if(frame_idx < 0 || frame_idx >= num_frames_){
+        throw std::runtime_error("Frame index out of range");
+    }
+
+    const uint64_t offset = index_ ? index_[frame_idx].offset
+        : kRawFrameDataOffset + frame_idx * header_.frame_stride;
+
+    return cv::Mat(header_.rows, header_.cols, header_.type,
+                   const_cast<uint8_t*>(data_ + offset));
+}
+
+int64_t RawFrameReader::getTimestamp(const int frame_idx)const{
+
+    if(frame_idx < 0 || frame_idx >= num_frames_){
+        throw std::runtime_error("Frame index out of range");
+    }
+
+    return index_ ? index_[frame_idx].timestamp_ns : -1;
+}
+
+bool RawFrameReader::read(cv::Mat& frame){
+
+    if(next_frame_idx_ >= num_frames_){
+        return false;
+    }
+
+    frame = getFrame(next_frame_idx_++);
+
+    return true;
+}
+
+void RawFrameReader::seek(const int frame_idx){
+
+    next_frame_idx_ = std::max(0, std::min(frame_idx, num_frames_));
+}
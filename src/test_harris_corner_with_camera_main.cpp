@@ -1,7 +1,13 @@
 #include <opencv2/opencv.hpp>
 #include <eigen3/Eigen/Core>
 
+#include <debug_visualizer.hpp>
 #include <harris_corner.hpp>
+#include <harris_tracker.hpp>
+#include <latency_governor.hpp>
+#include <multi_stream_detector.hpp>
+#include <raw_frame_file.hpp>
+#include <spsc_ring_buffer.hpp>
 
 #include "my_utils_kk4.hpp"
 
@@ -9,85 +15,956 @@
 #include <exception>
 #include <string>
 #include <iostream>
+#include <fstream>
+#include <sstream>
+#include <vector>
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <chrono>
+#include <memory>
+#include <mutex>
 
 static int nms_window_size_ = 1;
 
 
+// images of one frame, passed between the pipeline stages
+struct Frame{
+    cv::Mat image;
+    cv::Mat gray_image;
+    cv::Mat gray_image_float;
+    cv::Mat scaled_image;                           // governed only
+    cv::Mat harris_response_binary;
+    cv::Mat debug_views[HarrisCorner::kNumPlanes];  // by plane, of the open debug windows
+    unsigned debug_views_refreshed;                 // planes of the views made for this frame
+    std::vector<HarrisCorner::Keypoint> keypoints;  // headless, tracking or governed only
+
+    Frame()
+        : debug_views_refreshed(0){
+    }
+};
+
+// seconds spent in each stage, over all frames
+struct StageTimes{
+    double capture;
+    double record;
+    double cvt_color;
+    double convert_to;
+    double detection;
+    double debug_images;
+    double output;
+
+    StageTimes()
+        : capture(0.0), record(0.0), cvt_color(0.0), convert_to(0.0),
+          detection(0.0), debug_images(0.0), output(0.0){
+    }
+};
+
+// adds the time until the end of the scope to a StageTimes field
+class StageTimer{
+public:
+    StageTimer(double& seconds)
+        : seconds_(seconds){
+        stop_watch_.start();
+    }
+    ~StageTimer(){
+        seconds_ += stop_watch_.stop();
+    }
+private:
+    double& seconds_;
+    my_utils_kk4::StopWatch stop_watch_;
+};
+
+// trackbar values, copied by the GUI thread for the detection thread
+struct DetectorSettings{
+    std::atomic<int> harris_k;
+    std::atomic<int> response_type;     // harris_kernels::Response
+    std::atomic<int> harris_window_size;
+    std::atomic<int> binarization_thresh;
+    std::atomic<int> nms_window_size;
+    std::atomic<int> integer_input;     // 1: detect on the 8-bit image
+    std::atomic<int> incremental;       // 1: recompute changed tiles only
+    std::atomic<int> track_interval;    // N > 0: detect every N frames, track between
+    std::atomic<int> target_fps;        // N > 0: governed to process N frames per second
+    std::atomic<unsigned> debug_planes; // of the open debug windows, HarrisCorner::planeBit()s
+};
+
+// Headless, the corners are listed in frame.keypoints instead of drawn
+// into frame.harris_response_binary, and no debug images are made.
+// Otherwise visualizer makes those of the open debug windows, from the
+// planes of the detection, when they are due. tracker works on
+// harris_corner when tracking is on. With a target frame rate,
+// governor picks the settings of each frame from the time the previous
+// ones took, and logs its decisions.
+static void detect(HarrisCorner& harris_corner,
+                   HarrisTracker& tracker,
+                   std::vector<HarrisTracker::Track>& tracks,
+                   LatencyGovernor& governor,
+                   DebugVisualizer& visualizer,
+                   const DetectorSettings& settings,
+                   const bool headless,
+                   Frame& frame,
+                   StageTimes& stage_times){
+
+    const double busy_seconds = stage_times.cvt_color + stage_times.convert_to
+        + stage_times.detection + stage_times.debug_images;
+
+    const int target_fps = settings.target_fps;
+    const bool governed = target_fps > 0;
+    if(governed){
+        const double budget_ms = 1e3 / target_fps;
+        if(governor.getBudgetMs() != budget_ms){
+            governor.setBudgetMs(budget_ms);
+        }
+    }else if(governor.getLevel() != 0){
+        governor.reset();
+    }
+
+    {
+        MY_UTILS_KK4_TRACE_SPAN("cvtColor");
+        StageTimer timer(stage_times.cvt_color);
+        cv::cvtColor(frame.image, frame.gray_image, cv::COLOR_BGR2GRAY);
+    }
+
+    bool detected = true;     // false on the frames the tracker only tracks
+
+    {  // Harris corner detection
+        harris_corner.setK(settings.harris_k / 100.0);
+        harris_corner.setResponseType(
+            static_cast<harris_kernels::Response>(settings.response_type.load()));
+        harris_corner.setWindowSize(settings.harris_window_size * 2 + 1);
+
+        // switching drops the cache, so only on a change
+        const bool incremental = settings.incremental != 0;
+        if(harris_corner.getIncremental() != incremental){
+            harris_corner.setIncremental(incremental);
+        }
+
+        if(! headless){
+            visualizer.beginFrame(harris_corner, settings.debug_planes);
+        }
+
+        // the 8-bit path takes the gray image as it is, and gives the
+        // same corners as its float conversion
+        const bool integer_input = settings.integer_input != 0;
+        if(! integer_input){
+            MY_UTILS_KK4_TRACE_SPAN("convertTo");
+            StageTimer timer(stage_times.convert_to);
+            frame.gray_image.convertTo(frame.gray_image_float, CV_32F, 1.0 / 255.0);
+        }
+
+        StageTimer timer(stage_times.detection);
+        cv::Mat input_image = integer_input ? frame.gray_image : frame.gray_image_float;
+        const double thresh = static_cast<double>(settings.binarization_thresh) / 1e3;
+        int nms_window_size = settings.nms_window_size * 2 + 1;
+        HarrisCorner::KeypointSelection selection;
+
+        // the governed image is the ROI of the scaled one
+        double scale = 1.0;
+        cv::Point roi_offset(0, 0);
+        if(governed){
+            const LatencyGovernor::Settings& level = governor.getSettings();
+            if(level.scale < 1.0){
+                MY_UTILS_KK4_TRACE_SPAN("resize");
+                cv::resize(input_image, frame.scaled_image, cv::Size(),
+                           level.scale, level.scale, cv::INTER_AREA);
+                input_image = frame.scaled_image;
+                scale = level.scale;
+            }
+            if(level.roi_fraction < 1.0){
+                const int roi_width = std::max(1, cvRound(input_image.cols * level.roi_fraction));
+                const int roi_height = std::max(1, cvRound(input_image.rows * level.roi_fraction));
+                roi_offset = cv::Point((input_image.cols - roi_width) / 2,
+                                       (input_image.rows - roi_height) / 2);
+                input_image = input_image(cv::Rect(roi_offset.x, roi_offset.y,
+                                                   roi_width, roi_height));
+            }
+            nms_window_size = std::max(nms_window_size, level.min_nms_window_size);
+            selection.max_corners = level.max_corners;
+        }
+
+        const int track_interval = settings.track_interval;
+
+        if(track_interval > 0){
+            if(tracker.getDetectionInterval() != track_interval){
+                tracker.setDetectionInterval(track_interval);
+            }
+            tracker.track(input_image, tracks, thresh, nms_window_size, selection);
+            detected = tracker.getLastFrameDetected();
+
+            frame.keypoints.clear();
+            for(const HarrisTracker::Track& track : tracks){
+                frame.keypoints.push_back(track.keypoint);
+            }
+        }else if(headless || governed){
+            tracker.reset();
+            harris_corner.detectKeypoints(input_image, frame.keypoints,
+                                          thresh, nms_window_size, selection);
+        }else{
+            tracker.reset();
+            // cv::threshold(harris_response, harris_response_binary,
+            //               binarization_thresh / 10000.0, 255, cv::THRESH_BINARY);
+            harris_corner.detectCorners(input_image, frame.harris_response_binary,
+                                        thresh, nms_window_size);
+        }
+
+        if(track_interval > 0 || headless || governed){
+
+            // back to full frame pixels, whose centers the scaled
+            // pixels' centers are scale times as far from the origin
+            if(scale != 1.0 || roi_offset != cv::Point(0, 0)){
+                for(HarrisCorner::Keypoint& keypoint : frame.keypoints){
+                    keypoint.x = static_cast<float>((keypoint.x + roi_offset.x + 0.5) / scale - 0.5);
+                    keypoint.y = static_cast<float>((keypoint.y + roi_offset.y + 0.5) / scale - 0.5);
+                    keypoint.scale = static_cast<float>(keypoint.scale / scale);
+                }
+            }
+
+            if(! headless){
+                const cv::Size size = frame.gray_image.size();
+                frame.harris_response_binary.create(size, CV_8UC1);
+                frame.harris_response_binary.setTo(cv::Scalar(0));
+                for(const HarrisCorner::Keypoint& keypoint : frame.keypoints){
+                    const int x = std::min(std::max(cvRound(keypoint.x), 0), size.width - 1);
+                    const int y = std::min(std::max(cvRound(keypoint.y), 0), size.height - 1);
+                    frame.harris_response_binary.at<uint8_t>(y, x) = 255;
+                }
+            }
+        }
+    }
+
+    if(! headless){
+        // the planes of the detection, of the governed image if scaled
+        StageTimer timer(stage_times.debug_images);
+        frame.debug_views_refreshed = visualizer.render(harris_corner, frame.debug_views,
+                                                        detected);
+    }
+
+    if(governed){
+        const double frame_seconds = stage_times.cvt_color + stage_times.convert_to
+            + stage_times.detection + stage_times.debug_images - busy_seconds;
+        if(governor.update(frame_seconds)){
+            const LatencyGovernor::Decision& decision = governor.getLastDecision();
+            std::cout << "[ INFO] governor: frame " << decision.frame_idx << ", "
+                      << decision.frame_ms << " ms "
+                      << (decision.to_level > decision.from_level ? ">" : "<") << " "
+                      << decision.budget_ms << " ms budget, level " << decision.from_level
+                      << " -> " << decision.to_level << " ("
+                      << LatencyGovernor::describe(governor.getSettings()) << ")" << std::endl;
+        }
+    }
+}
+
+// Input frames of a camera, a video file, an image directory or a raw
+// frame file. The open functions report what they opened, or why not.
+class FrameSource{
+public:
+
+    FrameSource()
+        : is_camera_(false),
+          next_image_idx_(0){
+    }
+
+    bool openCamera(const int camera_id){
+        if(! video_.open(camera_id)){
+            std::cout << "[ERROR] Could not open video device "
+                      << camera_id << std::endl;
+            return false;
+        }
+        std::cout << "[ INFO] Successfully opened video device "
+                  << camera_id << std::endl;
+        is_camera_ = true;
+        return true;
+    }
+
+    bool openVideo(const std::string& file_name){
+        if(! video_.open(file_name)){
+            std::cout << "[ERROR] Could not open video file "
+                      << file_name << std::endl;
+            return false;
+        }
+        std::cout << "[ INFO] Successfully opened video file "
+                  << file_name << std::endl;
+        return true;
+    }
+
+    bool openImages(const std::string& dir_name){
+        cv::glob(dir_name, image_file_names_, false);
+        std::sort(image_file_names_.begin(), image_file_names_.end());
+        if(image_file_names_.empty()){
+            std::cout << "[ERROR] No files in " << dir_name << std::endl;
+            return false;
+        }
+        std::cout << "[ INFO] Found " << image_file_names_.size()
+                  << " file(s) in " << dir_name << std::endl;
+        return true;
+    }
+
+    bool openRaw(const std::string& file_name){
+        try{
+            raw_reader_.open(file_name);
+        }catch(const std::exception& e){
+            std::cout << "[ERROR] " << e.what() << std::endl;
+            return false;
+        }
+        std::cout << "[ INFO] Mapped " << raw_reader_.getNumFrames() << " frame(s) of "
+                  << raw_reader_.getFrameSize().width << "x" << raw_reader_.getFrameSize().height
+                  << " from " << file_name << std::endl;
+        return true;
+    }
+
+    // Opens "camera:ID", "video:FILE", "images:DIR" or "raw:FILE".
+    bool open(const std::string& spec){
+        const size_t colon = spec.find(':');
+        const std::string kind = spec.substr(0, colon);
+        const std::string name = colon == std::string::npos ? "" : spec.substr(colon + 1);
+        if(kind == "camera" && ! name.empty()
+           && name.find_first_not_of("0123456789") == std::string::npos){
+            return openCamera(std::stoi(name));
+        }else if(kind == "video" && ! name.empty()){
+            return openVideo(name);
+        }else if(kind == "images" && ! name.empty()){
+            return openImages(name);
+        }else if(kind == "raw" && ! name.empty()){
+            return openRaw(name);
+        }
+        std::cout << "[ERROR] Invalid stream " << spec << std::endl;
+        return false;
+    }
+
+    // a live source, which does not wait for the detection
+    bool isCamera()const{
+        return is_camera_;
+    }
+
+    // as reported by the camera or the video file, empty otherwise
+    cv::Size getFrameSize()const{
+        return cv::Size(static_cast<int>(video_.get(cv::CAP_PROP_FRAME_WIDTH)),
+                        static_cast<int>(video_.get(cv::CAP_PROP_FRAME_HEIGHT)));
+    }
+
+    // Next frame, as 8-bit BGR. Returns false at the end of the input.
+    // Files of the image directory that are no images are skipped.
+    // Raw frames are views of the mapped file, read-only.
+    bool read(cv::Mat& image){
+        if(raw_reader_.isOpen()){
+            return raw_reader_.read(image);
+        }
+        if(image_file_names_.empty()){
+            return video_.read(image) && ! image.empty();
+        }
+        while(next_image_idx_ < image_file_names_.size()){
+            const std::string& file_name = image_file_names_[next_image_idx_++];
+            image = cv::imread(file_name, cv::IMREAD_COLOR);
+            if(! image.empty()){
+                return true;
+            }
+            std::cout << "[ WARN] Skipped " << file_name << ", not an image" << std::endl;
+        }
+        return false;
+    }
+
+private:
+    bool is_camera_;
+    cv::VideoCapture video_;
+    std::vector<std::string> image_file_names_;
+    size_t next_image_idx_;
+    RawFrameReader raw_reader_;
+};
+
+static void printUsage(const char* program_name){
+
+    std::cout << "Usage: "
+              << program_name << " <(optional) camera ID integer>"
+              << " [--video <file> | --images <dir> | --raw <file>] [--corners <file>]"
+              << " [--record <file>]"
+              << " [--pipelined [--queue-size <N>] [--drop-oldest]] [--integer]"
+              << " [--incremental] [--response <N>] [--harris-k <N>] [--harris-window-size <N>]"
+              << " [--binarization-thresh <N>] [--nms-window-size <N>] [--track <N>]"
+              << " [--target-fps <N>] [--debug <planes>] [--debug-every <N>] [--debug-color]"
+              << " [--trace <file>]" << std::endl
+              << "       " << program_name << " --stream <source> [--stream <source> ...]"
+              << " [--max-frames <N>] [--corners <file>] [--integer] [--response <N>]"
+              << " [--harris-k <N>] [--harris-window-size <N>] [--binarization-thresh <N>]"
+              << " [--nms-window-size <N>] [--trace <file>]" << std::endl
+              << "  --video FILE    read a video file instead of a camera, headless"
+              << std::endl
+              << "  --images DIR    read the images of a directory in name order instead"
+              << " of a camera, headless" << std::endl
+              << "  --raw FILE      replay a raw frame file straight from its"
+              << " memory mapping, headless" << std::endl
+              << "  --corners FILE  headless: write the corners as CSV"
+              << " (frame, x, y, response; with --stream, stream first)" << std::endl
+              << "  --record FILE   write the input frames to a raw frame file"
+              << std::endl
+              << "  --pipelined     run capture, detection and display on separate threads"
+              << std::endl
+              << "  --queue-size N  frames buffered between two stages (default 2)"
+              << std::endl
+              << "  --drop-oldest   drop the oldest buffered frame instead of"
+              << " waiting when a stage falls behind" << std::endl
+              << "  --integer       start with detection on the 8-bit image instead"
+              << " of its float conversion" << std::endl
+              << "  --incremental   start with recomputing only the tiles that changed"
+              << " since the previous frame" << std::endl
+              << "  --trace FILE    write a Chrome trace (chrome://tracing) on exit"
+              << std::endl
+              << "  --stream SRC    one of several sources detected on shared worker threads,"
+              << " headless: camera:ID, video:FILE, images:DIR or raw:FILE" << std::endl
+              << "  --max-frames N  with --stream: stop each stream after N frames"
+              << " (default 0: at its end)" << std::endl
+              << "  --response N              0: Harris, 1: Shi-Tomasi, 2: Noble (default 0)"
+              << std::endl
+              << "  --harris-k N              k = N / 100 (default 4)" << std::endl
+              << "  --harris-window-size N    window size N * 2 + 1 (default 2)"
+              << std::endl
+              << "  --binarization-thresh N   threshold N / 1e3 (default 10); up to the"
+              << " cv::cornerHarris() version the scale was N / 1e6, and an old N is"
+              << " about N * W^4 / 1000 now, W the Harris window size" << std::endl
+              << "  --nms-window-size N       NMS window size N * 2 + 1 (default 1)"
+              << std::endl
+              << "  --track N                 detect every N frames and track the corners"
+              << " in between (default 0: detect on every frame)" << std::endl
+              << "  --target-fps N            lower the processing scale, raise the NMS"
+              << " window, cap the corners and shrink the ROI as needed to process N frames"
+              << " per second (default 0: off)" << std::endl
+              << "  --debug PLANES            comma-separated planes to show in debug windows:"
+              << " grad_x, grad_y, sum_xx, sum_yy, sum_xy, response (default grad_x;"
+              << " empty: none). A closed window is no longer made." << std::endl
+              << "  --debug-every N           refresh the debug windows every N frames"
+              << " (default " << DebugVisualizer::kDefaultRefreshInterval << ")" << std::endl
+              << "  --debug-color             show the debug planes through a color map"
+              << std::endl
+              << "The seven from --response set the start values of the trackbars."
+              << " Headless modes show no windows, run as fast as possible and print"
+              << " the throughput and per-stage timing at the end." << std::endl
+              << "With --stream, camera frames are dropped while their stream is busy,"
+              << " and the per-stream latency and fairness are printed at the end."
+              << std::endl;
+}
+
+/*
+  Headless detection of several sources at once. Each is read and
+  converted on a capture thread of its own, and all are detected on one
+  MultiStreamDetector, whose workers steal frames and tiles from each
+  other's streams. A stream stops at its end or after max_frames frames.
+ */
+static int runStreams(const std::vector<std::string>& stream_specs,
+                      const DetectorSettings& settings,
+                      const int max_frames,
+                      const std::string& corners_file_name){
+
+    const int num_streams = static_cast<int>(stream_specs.size());
+
+    std::vector<std::unique_ptr<FrameSource> > sources;
+    for(const std::string& spec : stream_specs){
+        sources.emplace_back(new FrameSource());
+        if(! sources.back()->open(spec)){
+            return 1;
+        }
+    }
+
+    std::ofstream corners_file;
+    if(! corners_file_name.empty()){
+        corners_file.open(corners_file_name);
+        if(! corners_file){
+            std::cout << "[ERROR] Could not open " << corners_file_name << std::endl;
+            return 1;
+        }
+        corners_file << "stream,frame,x,y,response" << std::endl;
+    }
+
+    MultiStreamDetector detector(settings.harris_k / 100.0, settings.harris_window_size * 2 + 1);
+    detector.setResponseType(static_cast<harris_kernels::Response>(settings.response_type.load()));
+
+    const bool integer_input = settings.integer_input != 0;
+    const double thresh = static_cast<double>(settings.binarization_thresh) / 1e3;
+    const int nms_window_size = settings.nms_window_size * 2 + 1;
+
+    std::mutex output_mutex;
+    std::vector<long> num_corners(num_streams, 0);
+
+    const MultiStreamDetector::KeypointSink sink =
+        [&](const int stream_idx, const long frame_idx, const cv::Mat&,
+            const std::vector<HarrisCorner::Keypoint>& keypoints){
+
+        MY_UTILS_KK4_TRACE_SPAN("output");
+        std::lock_guard<std::mutex> lock(output_mutex);
+
+        if(corners_file.is_open()){
+            for(const HarrisCorner::Keypoint& keypoint : keypoints){
+                corners_file << stream_idx << "," << frame_idx << "," << keypoint.x
+                             << "," << keypoint.y << "," << keypoint.score << "\n";
+            }
+        }
+        num_corners[stream_idx] += static_cast<long>(keypoints.size());
+    };
+
+    std::cout << "[ INFO] " << num_streams << " stream(s) on "
+              << detector.getNumThreads() << " worker thread(s)" << std::endl;
+
+    my_utils_kk4::StopWatch total_stop_watch;
+    total_stop_watch.start();
+
+    std::vector<std::thread> capture_threads;
+    for(int stream_idx = 0; stream_idx < num_streams; stream_idx++){
+        capture_threads.emplace_back([&, stream_idx](){
+                if(my_utils_kk4::Tracer::isEnabled()){
+                    my_utils_kk4::Tracer::getInstance().setThreadName(
+                        "capture " + std::to_string(stream_idx));
+                }
+                FrameSource& source = *sources[stream_idx];
+                for(int i = 0; max_frames == 0 || i < max_frames; i++){
+
+                    // new images for every frame, which the detector
+                    // holds on to until its sink is called
+                    cv::Mat image, gray_image, input_image;
+                    {
+                        MY_UTILS_KK4_TRACE_SPAN("capture");
+                        if(! source.read(image)){
+                            break;
+                        }
+                    }
+                    cv::cvtColor(image, gray_image, cv::COLOR_BGR2GRAY);
+                    if(integer_input){
+                        input_image = gray_image;
+                    }else{
+                        gray_image.convertTo(input_image, CV_32F, 1.0 / 255.0);
+                    }
+
+                    if(source.isCamera()){
+                        detector.trySubmit(stream_idx, input_image, thresh, nms_window_size, sink);
+                    }else{
+                        detector.submit(stream_idx, input_image, thresh, nms_window_size, sink);
+                    }
+                }
+            });
+    }
+
+    for(std::thread& capture_thread : capture_threads){
+        capture_thread.join();
+    }
+
+    try{
+        detector.waitIdle();
+    }catch(const std::exception& e){
+        std::cout << "[ERROR] " << e.what() << std::endl;
+        return 1;
+    }
+
+    const double total = total_stop_watch.stop();
+
+    long num_frames = 0;
+    long total_corners = 0;
+    for(int stream_idx = 0; stream_idx < num_streams; stream_idx++){
+        num_frames += detector.getStreamStats(stream_idx).num_frames;
+        total_corners += num_corners[stream_idx];
+    }
+
+    std::cout << "[ INFO] " << num_frames << " frame(s) in " << total << " s, "
+              << (total > 0.0 ? num_frames / total : 0.0) << " fps" << std::endl
+              << "[ INFO] " << total_corners << " corner(s)";
+    if(corners_file.is_open()){
+        std::cout << " written to " << corners_file_name;
+    }
+    std::cout << std::endl;
+
+    const WorkStealingScheduler& scheduler = detector.getScheduler();
+
+    for(int stream_idx = 0; stream_idx < num_streams; stream_idx++){
+        const MultiStreamDetector::StreamStats stats = detector.getStreamStats(stream_idx);
+        const WorkStealingScheduler::StreamStats task_stats = scheduler.getStreamStats(stream_idx);
+        std::cout << "[ INFO] stream " << stream_idx << " (" << stream_specs[stream_idx] << "): "
+                  << stats.num_frames << " frame(s), " << stats.num_dropped << " dropped, "
+                  << num_corners[stream_idx] << " corner(s), latency "
+                  << stats.latency_seconds * 1e3 / std::max(1L, stats.num_frames) << " ms mean "
+                  << stats.max_latency_seconds * 1e3 << " ms max, "
+                  << task_stats.num_tasks << " task(s) with "
+                  << task_stats.queue_seconds * 1e3 / std::max(1L, task_stats.num_tasks)
+                  << " ms mean queue time, " << task_stats.num_stolen << " stolen" << std::endl;
+    }
+
+    std::cout << "[ INFO] fairness index of the queue times: "
+              << scheduler.getFairnessIndex() << std::endl;
+
+    return 0;
+}
+
+
 int main(int argc, char** argv){
 
     int camera_id = 0;
+    bool camera_id_specified = false;
     int binarization_thresh = 10;
     int harris_k = 4;
-    
-    
-    switch(argc){
-        
-    case 1:
+    int response_type = harris_kernels::RESPONSE_HARRIS;
+    int harris_window_size = 2;
+    int integer_input = 0;
+    int incremental = 0;
+    int track_interval = 0;
+    int target_fps = 0;
+    std::string debug_plane_names = HarrisCorner::planeName(HarrisCorner::PLANE_GRAD_X);
+    int debug_refresh_interval = DebugVisualizer::kDefaultRefreshInterval;
+    bool debug_color_map = false;
+    bool pipelined = false;
+    int queue_size = 2;
+    SpscRingBuffer<Frame>::OverflowPolicy queue_policy = SpscRingBuffer<Frame>::BLOCK;
+    std::string trace_file_name;
+    std::string video_file_name;
+    std::string image_dir_name;
+    std::string raw_file_name;
+    std::string corners_file_name;
+    std::string record_file_name;
+    std::vector<std::string> stream_specs;
+    int max_frames = 0;
+
+    // non-negative trackbar value of an option
+    auto parse_value = [](const std::string& arg, const char* value){
+        const int n = std::stoi(value);
+        if(n < 0){
+            throw std::runtime_error(arg + " must not be negative");
+        }
+        return n;
+    };
+
+    try{
+        for(int i = 1; i < argc; i++){
+
+            const std::string arg = argv[i];
+
+            if(arg == "--pipelined"){
+                pipelined = true;
+            }else if(arg == "--integer"){
+                integer_input = 1;
+            }else if(arg == "--incremental"){
+                incremental = 1;
+            }else if(arg == "--drop-oldest"){
+                queue_policy = SpscRingBuffer<Frame>::DROP_OLDEST;
+            }else if(arg == "--trace" && i + 1 < argc){
+                trace_file_name = argv[++i];
+            }else if(arg == "--video" && i + 1 < argc){
+                video_file_name = argv[++i];
+            }else if(arg == "--images" && i + 1 < argc){
+                image_dir_name = argv[++i];
+            }else if(arg == "--raw" && i + 1 < argc){
+                raw_file_name = argv[++i];
+            }else if(arg == "--corners" && i + 1 < argc){
+                corners_file_name = argv[++i];
+            }else if(arg == "--record" && i + 1 < argc){
+                record_file_name = argv[++i];
+            }else if(arg == "--stream" && i + 1 < argc){
+                stream_specs.push_back(argv[++i]);
+            }else if(arg == "--max-frames" && i + 1 < argc){
+                max_frames = parse_value(arg, argv[++i]);
+            }else if(arg == "--response" && i + 1 < argc){
+                response_type = parse_value(arg, argv[++i]);
+                if(response_type >= harris_kernels::kNumResponses){
+                    throw std::runtime_error(arg + " must be below "
+                                             + std::to_string(harris_kernels::kNumResponses));
+                }
+            }else if(arg == "--harris-k" && i + 1 < argc){
+                harris_k = parse_value(arg, argv[++i]);
+            }else if(arg == "--harris-window-size" && i + 1 < argc){
+                harris_window_size = parse_value(arg, argv[++i]);
+            }else if(arg == "--binarization-thresh" && i + 1 < argc){
+                binarization_thresh = parse_value(arg, argv[++i]);
+            }else if(arg == "--nms-window-size" && i + 1 < argc){
+                nms_window_size_ = parse_value(arg, argv[++i]);
+            }else if(arg == "--track" && i + 1 < argc){
+                track_interval = parse_value(arg, argv[++i]);
+            }else if(arg == "--target-fps" && i + 1 < argc){
+                target_fps = parse_value(arg, argv[++i]);
+            }else if(arg == "--debug" && i + 1 < argc){
+                debug_plane_names = argv[++i];
+            }else if(arg == "--debug-every" && i + 1 < argc){
+                debug_refresh_interval = std::stoi(argv[++i]);
+                if(debug_refresh_interval <= 0){
+                    throw std::runtime_error(arg + " must be positive");
+                }
+            }else if(arg == "--debug-color"){
+                debug_color_map = true;
+            }else if(arg == "--queue-size" && i + 1 < argc){
+                queue_size = std::stoi(argv[++i]);
+                if(queue_size <= 0){
+                    throw std::runtime_error("queue size must be positive");
+                }
+            }else if(! camera_id_specified && arg.compare(0, 1, "-") != 0){
+                camera_id = std::stoi(arg);
+                camera_id_specified = true;
+            }else{
+                printUsage(argv[0]);
+                return 1;
+            }
+        }
+    }catch(const std::exception& e){
+        std::cout << e.what() << std::endl;
+        return 1;
+    }
+
+    // planes of the open debug windows, which the GUI thread clears as
+    // they are closed
+    unsigned debug_planes = 0;
+    {
+        std::stringstream names(debug_plane_names);
+        std::string name;
+        while(std::getline(names, name, ',')){
+            int p = 0;
+            while(p < HarrisCorner::kNumPlanes
+                  && name != HarrisCorner::planeName(static_cast<HarrisCorner::Plane>(p))){
+                p++;
+            }
+            if(p == HarrisCorner::kNumPlanes){
+                std::cout << "Unknown plane " << name << std::endl;
+                return 1;
+            }
+            debug_planes |= HarrisCorner::planeBit(static_cast<HarrisCorner::Plane>(p));
+        }
+    }
+
+    const int num_file_inputs = ! video_file_name.empty() + ! image_dir_name.empty()
+        + ! raw_file_name.empty();
+    const bool multi_stream = ! stream_specs.empty();
+    const bool headless = num_file_inputs > 0 || multi_stream;
+
+    if(num_file_inputs > 1
+       || (headless && camera_id_specified)
+       || (! headless && ! corners_file_name.empty())
+       || (multi_stream && (num_file_inputs > 0 || pipelined || ! record_file_name.empty()
+                            || incremental || track_interval > 0 || target_fps > 0))
+       || (! multi_stream && max_frames > 0)){
+        printUsage(argv[0]);
+        return 1;
+    }
+
+    if(! trace_file_name.empty()){
+        my_utils_kk4::Tracer::getInstance().setEnabled(true);
+        my_utils_kk4::Tracer::getInstance().setThreadName("main");
+    }
+
+    auto write_trace = [&](){
+        if(trace_file_name.empty()){
+            return;
+        }
+        if(my_utils_kk4::Tracer::getInstance().writeChromeTrace(trace_file_name)){
+            std::cout << "[ INFO] Wrote trace to " << trace_file_name << std::endl;
+        }else{
+            std::cout << "[ERROR] Could not write trace to " << trace_file_name << std::endl;
+        }
+    };
+
+    DetectorSettings settings;
+
+    auto update_settings = [&](){
+        settings.harris_k = harris_k;
+        settings.response_type = response_type;
+        settings.harris_window_size = harris_window_size;
+        settings.binarization_thresh = binarization_thresh;
+        settings.nms_window_size = nms_window_size_;
+        settings.integer_input = integer_input;
+        settings.incremental = incremental;
+        settings.track_interval = track_interval;
+        settings.target_fps = target_fps;
+        settings.debug_planes = debug_planes;
+    };
+    update_settings();
+
+    if(multi_stream){
+        const int result = runStreams(stream_specs, settings, max_frames, corners_file_name);
+        write_trace();
+        return result;
+    }
+
+    if(! camera_id_specified && ! headless){
         std::cout << "[ INFO] No camera ID specified. Default ID ("
                   << camera_id
                   << ") will be used." << std::endl;
-        break;
-        
-    case 2:
-        try{
-            camera_id = std::stoi(argv[1]);
-        }catch(const std::exception& e){
-            std::cout << e.what() << std::endl;
-            return 1;
-        }
-            
-        break;
-        
-    default:
-        std::cout << "Usage: "
-                  << argv[0] << " <(optional) camera ID integer>" << std::endl;
-        return 1;
     }
 
     const std::string window_name = argv[0];
     const std::string window_name_harris_response = "Harris corner response";
-    const std::string window_name_debug = "Debug";
+    auto debug_window_name = [](const int plane){
+        return std::string("Debug: ")
+            + HarrisCorner::planeName(static_cast<HarrisCorner::Plane>(plane));
+    };
     
 
-    cv::VideoCapture video(camera_id);
+    FrameSource source;
 
-    if(video.isOpened()){
-        std::cout << "[ INFO] Successfully opened video device "
-                  << camera_id << std::endl;
-    }else{
-        std::cout << "[ERROR] Could not open video device "
-                  << camera_id << std::endl;
+    if(! raw_file_name.empty()){
+        if(! source.openRaw(raw_file_name)){
+            return 1;
+        }
+    }else if(! image_dir_name.empty()){
+        if(! source.openImages(image_dir_name)){
+            return 1;
+        }
+    }else if(! video_file_name.empty()){
+        if(! source.openVideo(video_file_name)){
+            return 1;
+        }
+    }else if(! source.openCamera(camera_id)){
         return 1;
     }
 
-    cv::namedWindow(window_name, cv::WINDOW_NORMAL);
-    cv::namedWindow(window_name_debug, cv::WINDOW_NORMAL);
-    cv::namedWindow(window_name_harris_response,
-                    cv::WINDOW_NORMAL | cv::WINDOW_GUI_EXPANDED);
-    
-    cv::createTrackbar("harris_k (<set val> / 100)", window_name_harris_response,
-                       &harris_k, 100, nullptr);
-    cv::createTrackbar("binarization_thresh (<set val> / 1e6)", window_name_harris_response,
-                       &binarization_thresh, 1000, nullptr);
-    cv::createTrackbar("non maximum suppresion window size (<set val> * 2 + 1)",
-                       window_name_harris_response,
-                       &nms_window_size_, 15, nullptr);
+    std::ofstream corners_file;
+    if(! corners_file_name.empty()){
+        corners_file.open(corners_file_name);
+        if(! corners_file){
+            std::cout << "[ERROR] Could not open " << corners_file_name << std::endl;
+            return 1;
+        }
+        corners_file << "frame,x,y,response" << std::endl;
+    }
+
+    RawFrameWriter raw_writer;
+    if(! record_file_name.empty()){
+        try{
+            raw_writer.open(record_file_name);
+        }catch(const std::exception& e){
+            std::cout << "[ERROR] " << e.what() << std::endl;
+            return 1;
+        }
+    }
+    std::chrono::steady_clock::time_point record_start;
+
+    // Completes the recording
+    auto close_recording = [&](){
+        if(! raw_writer.isOpen()){
+            return;
+        }
+        const int num_recorded_frames = raw_writer.getNumFrames();
+        try{
+            raw_writer.close();
+            std::cout << "[ INFO] Recorded " << num_recorded_frames << " frame(s) to "
+                      << record_file_name << std::endl;
+        }catch(const std::exception& e){
+            std::cout << "[ERROR] " << e.what() << std::endl;
+        }
+    };
+
+    // Appends a captured frame to the recording, if any. Only the
+    // capturing thread calls it.
+    auto record_frame = [&](const cv::Mat& image){
+        if(! raw_writer.isOpen()){
+            return;
+        }
+        MY_UTILS_KK4_TRACE_SPAN("record");
+        const std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+        if(raw_writer.getNumFrames() == 0){
+            record_start = now;
+        }
+        try{
+            raw_writer.write(image, std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                 now - record_start).count());
+        }catch(const std::exception& e){
+            // e.g. a full disk: keep what was recorded and go on
+            std::cout << "[ERROR] " << e.what() << ", recording stopped" << std::endl;
+            close_recording();
+        }
+    };
+
+    if(! headless){
+        cv::namedWindow(window_name, cv::WINDOW_NORMAL);
+        for(int p = 0; p < HarrisCorner::kNumPlanes; p++){
+            if(debug_planes & (1u << p)){
+                cv::namedWindow(debug_window_name(p), cv::WINDOW_NORMAL);
+            }
+        }
+        cv::namedWindow(window_name_harris_response,
+                        cv::WINDOW_NORMAL | cv::WINDOW_GUI_EXPANDED);
+
+        cv::createTrackbar("response (0: Harris, 1: Shi-Tomasi, 2: Noble)",
+                           window_name_harris_response,
+                           &response_type, harris_kernels::kNumResponses - 1, nullptr);
+        cv::createTrackbar("harris_k (<set val> / 100)", window_name_harris_response,
+                           &harris_k, 100, nullptr);
+        cv::createTrackbar("harris window size (<set val> * 2 + 1)",
+                           window_name_harris_response,
+                           &harris_window_size, 7, nullptr);
+        // The threshold is in units of HarrisCorner's response, not of
+        // the cv::cornerHarris() (blockSize 2, ksize 3) this tool used
+        // before, whose trackbar was <set val> / 1e6. HarrisCorner takes
+        // unnormalized central differences of the image / 255 (twice the
+        // derivative) and unnormalized sums over a W x W window, W odd,
+        // where cv::cornerHarris() normalizes its 3x3 Sobel to the
+        // derivative and sums 2x2 pixels. On the same gradient its
+        // response is thus W^4 times larger, 625 times for the default
+        // W = 5, so the scale became / 1e3, and an old value N is about
+        // N * W^4 / 1000 here.
+        cv::createTrackbar("binarization_thresh (<set val> / 1e3)", window_name_harris_response,
+                           &binarization_thresh, 1000, nullptr);
+        cv::createTrackbar("non maximum suppresion window size (<set val> * 2 + 1)",
+                           window_name_harris_response,
+                           &nms_window_size_, 15, nullptr);
+        cv::createTrackbar("8-bit input (0: float, 1: integer)", window_name_harris_response,
+                           &integer_input, 1, nullptr);
+        cv::createTrackbar("incremental (0: off, 1: changed tiles only)", window_name_harris_response,
+                           &incremental, 1, nullptr);
+        cv::createTrackbar("tracking (0: off, N: detect every N frames)",
+                           window_name_harris_response,
+                           &track_interval, 30, nullptr);
+        cv::createTrackbar("latency governor target fps (0: off)", window_name_harris_response,
+                           &target_fps, 120, nullptr);
+    }
 
     my_utils_kk4::Fps fps;
     my_utils_kk4::StopWatch fps_stop_watch;
     const double fps_show_interval = 1; // sec
     
     const char quit_key = 'q';
-    std::cout << "[ INFO] Started main loop. Press "
-              << quit_key << " to quit." << std::endl;
+    if(! headless){
+        std::cout << "[ INFO] Started main loop. Press "
+                  << quit_key << " to quit." << std::endl;
+    }
 
-    cv::Mat image;
-    cv::Mat gray_image;
-    cv::Mat harris_response;
-    cv::Mat harris_response_binary;
+    HarrisCorner harris_corner(harris_k / 100.0, harris_window_size * 2 + 1,
+                               0);  // use all cores
+    harris_corner.setPipelineMode(HarrisCorner::PIPELINE_STREAMING);
 
-    fps_stop_watch.start();
-    while(true){
+    // only the detecting thread uses the tracker, its tracks and the
+    // governor
+    HarrisTracker tracker(harris_corner);
+    std::vector<HarrisTracker::Track> tracks;
+    LatencyGovernor governor;
+    DebugVisualizer visualizer(debug_refresh_interval);
+    if(debug_color_map){
+        visualizer.setDisplay(DebugVisualizer::DISPLAY_COLOR_MAP);
+    }
+
+    StageTimes capture_times;       // of the capturing thread
+    StageTimes detection_times;     // of the detecting thread
+    StageTimes present_times;       // of the presenting thread
+    int num_frames = 0;
+    long num_corners = 0;
+    my_utils_kk4::StopWatch total_stop_watch;
+
+    // Headless, writes the corners of a processed frame. Returns true.
+    auto output = [&](const Frame& frame){
+
+        MY_UTILS_KK4_TRACE_SPAN("output");
+        StageTimer timer(present_times.output);
+
+        if(corners_file.is_open()){
+            for(const HarrisCorner::Keypoint& keypoint : frame.keypoints){
+                corners_file << num_frames << "," << keypoint.x << "," << keypoint.y
+                             << "," << keypoint.score << "\n";
+            }
+        }
+        num_corners += static_cast<long>(frame.keypoints.size());
+        num_frames++;
+
+        return true;
+    };
+
+    // Shows a processed frame, updates the FPS and handles key input.
+    // Returns false to quit.
+    auto present = [&](const Frame& frame){
+
+        if(headless){
+            return output(frame);
+        }
+
+        num_frames++;
 
         {  // calc and show FPS
             fps.trigger();
@@ -99,46 +976,225 @@ int main(int argc, char** argv){
             }
         }
 
-        video >> image;
+        {
+            MY_UTILS_KK4_TRACE_SPAN("imshow");
 
-        cv::cvtColor(image, gray_image, cv::COLOR_BGR2GRAY);
+            for(int p = 0; p < HarrisCorner::kNumPlanes; p++){
+                if(frame.debug_views_refreshed & debug_planes & (1u << p)){
+                    cv::imshow(debug_window_name(p), frame.debug_views[p]);
+                }
+            }
 
-        {  // Harris corner detection
-            harris_response = cv::Mat::zeros(image.size(), CV_32FC1);
-            const int harris_block_size = 2;
-            const int harris_aperture_size = 3;
-            
-            
-            cv::cornerHarris(gray_image, harris_response, harris_block_size,
-                             harris_aperture_size, harris_k / 100.0);
-            // cv::threshold(harris_response, harris_response_binary,
-            //               binarization_thresh / 10000.0, 255, cv::THRESH_BINARY);
-            HarrisCorner::nonMaximumSuppression(
-                harris_response, harris_response_binary,
-                static_cast<double>(binarization_thresh) / 1e6,
-                nms_window_size_ * 2 + 1
-            );
+            cv::imshow(window_name, frame.image);
+            cv::imshow(window_name_harris_response, frame.harris_response_binary);
         }
 
-        cv::Mat grad_x, grad_x_normalized;
-        cv::Sobel(gray_image, grad_x, CV_32F, 1, 0, 3, 1, 0, cv::BORDER_DEFAULT);
+        {  // Process key input
+            MY_UTILS_KK4_TRACE_SPAN("waitKey");
 
-        cv::normalize(grad_x, grad_x_normalized, 0.0, 1.0, cv::NORM_MINMAX);
-        cv::imshow(window_name_debug, grad_x_normalized);
+            const int key = cv::waitKey(1);
 
-        cv::imshow(window_name, image);
-        cv::imshow(window_name_harris_response, harris_response_binary);
+            // closed debug windows are not made any more
+            for(int p = 0; p < HarrisCorner::kNumPlanes; p++){
+                if((debug_planes & (1u << p))
+                   && cv::getWindowProperty(debug_window_name(p), cv::WND_PROP_VISIBLE) < 1.0){
+                    debug_planes &= ~(1u << p);
+                }
+            }
 
-        {  // Process key input
-            const int key = cv::waitKey(1);
+            update_settings();
 
             if(key == quit_key){
                 std::cout << std::endl
                           << "[ INFO] Quit" << std::endl;
+                return false;
+            }
+        }
+
+        return true;
+    };
+
+    // throughput and mean time per frame of each stage
+    auto print_summary = [&](){
+
+        const double total = total_stop_watch.stop();
+        const double ms_per_frame = num_frames > 0 ? 1e3 / num_frames : 0.0;
+
+        std::cout << std::endl
+                  << "[ INFO] " << num_frames << " frame(s) in " << total << " s, "
+                  << (total > 0.0 ? num_frames / total : 0.0) << " fps" << std::endl;
+        if(headless){
+            std::cout << "[ INFO] " << num_corners << " corner(s)";
+            if(corners_file.is_open()){
+                std::cout << " written to " << corners_file_name;
+            }
+            std::cout << std::endl;
+        }
+
+        std::cout << "[ INFO] ms per frame:"
+                  << " capture " << capture_times.capture * ms_per_frame;
+        if(! record_file_name.empty()){
+            std::cout << ", record " << capture_times.record * ms_per_frame;
+        }
+        std::cout << ", cvtColor " << detection_times.cvt_color * ms_per_frame
+                  << ", convertTo " << detection_times.convert_to * ms_per_frame
+                  << ", detection " << detection_times.detection * ms_per_frame;
+        if(headless){
+            std::cout << ", output " << present_times.output * ms_per_frame;
+        }else{
+            std::cout << ", debug images " << detection_times.debug_images * ms_per_frame;
+        }
+        std::cout << std::endl;
+
+        const HarrisTracker::Stats& stats = tracker.getStats();
+        if(stats.tracking_frames > 0){
+            std::cout << "[ INFO] tracking: " << stats.detection_frames << " detection frame(s) at "
+                      << stats.detection_seconds * 1e3 / std::max(1, stats.detection_frames)
+                      << " ms, " << stats.tracking_frames << " tracked frame(s) at "
+                      << stats.tracking_seconds * 1e3 / stats.tracking_frames << " ms"
+                      << std::endl;
+        }
+
+        if(settings.target_fps > 0){
+            std::cout << "[ INFO] governor: " << governor.getNumDecisions()
+                      << " decision(s), frames per level:";
+            for(size_t level = 0; level < governor.getLevels().size(); level++){
+                std::cout << (level > 0 ? ", " : " ") << level << ": "
+                          << governor.getFramesAtLevel(static_cast<int>(level));
+            }
+            std::cout << ", ending at level " << governor.getLevel() << std::endl;
+        }
+    };
+
+    fps_stop_watch.start();
+    total_stop_watch.start();
+
+    if(! pipelined){
+
+        Frame frame;
+
+        while(true){
+
+            MY_UTILS_KK4_TRACE_SPAN("frame");
+
+            {
+                MY_UTILS_KK4_TRACE_SPAN("capture");
+                StageTimer timer(capture_times.capture);
+                if(! source.read(frame.image)){
+                    break;
+                }
+            }
+            {
+                StageTimer timer(capture_times.record);
+                record_frame(frame.image);
+            }
+
+            detect(harris_corner, tracker, tracks, governor, visualizer, settings, headless,
+                   frame, detection_times);
+
+            if(! present(frame)){
+                break;
+            }
+        }
+
+        close_recording();
+        print_summary();
+        write_trace();
+
+        return 0;
+    }
+
+    // Pipelined mode: capture and detection run on their own threads
+    // and the main thread (which HighGUI needs) presents. Frames move
+    // through two ring buffers whose images are allocated up front.
+
+    const int frame_width = source.getFrameSize().width;
+    const int frame_height = source.getFrameSize().height;
+
+    auto init_frame = [&](Frame& frame){
+        if(frame_width > 0 && frame_height > 0){
+            frame.image.create(frame_height, frame_width, CV_8UC3);
+            frame.gray_image.create(frame_height, frame_width, CV_8UC1);
+            frame.gray_image_float.create(frame_height, frame_width, CV_32FC1);
+            frame.harris_response_binary.create(frame_height, frame_width, CV_8UC1);
+        }
+    };
+
+    SpscRingBuffer<Frame> captured_frames(queue_size, queue_policy, init_frame);
+    SpscRingBuffer<Frame> detected_frames(queue_size, queue_policy, init_frame);
+
+    std::cout << "[ INFO] Pipelined mode, " << queue_size << " frame(s) per queue, "
+              << (queue_policy == SpscRingBuffer<Frame>::BLOCK ? "block" : "drop-oldest")
+              << " policy" << std::endl;
+
+    std::thread capture_thread([&](){
+            if(my_utils_kk4::Tracer::isEnabled()){
+                my_utils_kk4::Tracer::getInstance().setThreadName("capture");
+            }
+            Frame frame;
+            init_frame(frame);
+            while(true){
+                {
+                    MY_UTILS_KK4_TRACE_SPAN("capture");
+                    StageTimer timer(capture_times.capture);
+                    if(! source.read(frame.image)){
+                        break;
+                    }
+                }
+                {
+                    StageTimer timer(capture_times.record);
+                    record_frame(frame.image);
+                }
+                MY_UTILS_KK4_TRACE_SPAN("push captured frame");
+                if(! captured_frames.push(frame)){
+                    break;
+                }
+            }
+            captured_frames.close();
+        });
+
+    std::thread detection_thread([&](){
+            if(my_utils_kk4::Tracer::isEnabled()){
+                my_utils_kk4::Tracer::getInstance().setThreadName("detection");
+            }
+            Frame frame;
+            init_frame(frame);
+            while(captured_frames.pop(frame)){
+                detect(harris_corner, tracker, tracks, governor, visualizer, settings, headless,
+                       frame, detection_times);
+                MY_UTILS_KK4_TRACE_SPAN("push detected frame");
+                if(! detected_frames.push(frame)){
+                    break;
+                }
+            }
+            detected_frames.close();
+        });
+
+    {
+        Frame frame;
+        init_frame(frame);
+        while(detected_frames.pop(frame)){
+            if(! present(frame)){
                 break;
             }
         }
     }
 
+    captured_frames.close();
+    detected_frames.close();
+
+    capture_thread.join();
+    detection_thread.join();
+
+    if(queue_policy == SpscRingBuffer<Frame>::DROP_OLDEST){
+        std::cout << "[ INFO] Dropped " << captured_frames.getDroppedCount()
+                  << " captured and " << detected_frames.getDroppedCount()
+                  << " detected frame(s)" << std::endl;
+    }
+
+    close_recording();
+    print_summary();
+    write_trace();
+
     return 0;
 }
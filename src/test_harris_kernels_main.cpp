@@ -0,0 +1,217 @@
+/*
+  Checks the row kernels of every ISA the running CPU supports against
+  the scalar ones, on lengths that leave every SIMD tail, and
+  HarrisCorner::calcResponse() of every ISA against the scalar ISA.
+  Exits non-zero on any mismatch.
+ */
+
+#include <opencv2/opencv.hpp>
+
+#include <harris_corner.hpp>
+#include <harris_kernels.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+
+namespace{
+
+// arithmetic kernels may round differently in SIMD, e.g. through the
+// order of a prefix sum; comparisons and maxima are exact
+const double kTolerance = 1e-5;
+
+const int kMaxLength = 67;
+
+std::vector<float> randomRow(cv::RNG& rng, const int n){
+
+    std::vector<float> row(n);
+    for(float& v : row){
+        v = rng.uniform(0.0f, 1.0f);
+    }
+    return row;
+}
+
+// largest difference over the largest magnitude of reference
+double relativeError(const std::vector<float>& a, const std::vector<float>& reference){
+
+    double max_abs = 0.0;
+    double max_diff = 0.0;
+    for(size_t i = 0; i < reference.size(); i++){
+        max_abs = std::max(max_abs, static_cast<double>(std::abs(reference[i])));
+        max_diff = std::max(max_diff, static_cast<double>(std::abs(a[i] - reference[i])));
+    }
+    return max_diff / std::max(max_abs, 1e-30);
+}
+
+bool report(const std::string& name, const bool passed){
+
+    std::cout << (passed ? "[  OK ] " : "[FAIL ] ") << name << std::endl;
+    return passed;
+}
+
+bool checkKernels(const harris_kernels::KernelTable& kernels,
+                  const harris_kernels::KernelTable& scalar){
+
+    const std::string tag = harris_kernels::isaName(kernels.isa);
+
+    cv::RNG rng(1);
+    double max_error = 0.0;
+    int num_exact_mismatches = 0;
+
+    for(int n = 0; n <= kMaxLength; n++){
+
+        const std::vector<float> a = randomRow(rng, n);
+        const std::vector<float> b = randomRow(rng, n);
+
+        std::vector<float> out(n), expected(n);
+        kernels.subtract(a.data(), b.data(), out.data(), n);
+        scalar.subtract(a.data(), b.data(), expected.data(), n);
+        max_error = std::max(max_error, relativeError(out, expected));
+
+        std::vector<float> gxx(n), gyy(n), gxy(n), e_gxx(n), e_gyy(n), e_gxy(n);
+        kernels.tensorProducts(a.data(), b.data(), gxx.data(), gyy.data(), gxy.data(), n);
+        scalar.tensorProducts(a.data(), b.data(), e_gxx.data(), e_gyy.data(), e_gxy.data(), n);
+        max_error = std::max(max_error, relativeError(gxx, e_gxx));
+        max_error = std::max(max_error, relativeError(gyy, e_gyy));
+        max_error = std::max(max_error, relativeError(gxy, e_gxy));
+
+        out = a;
+        expected = a;
+        kernels.addRow(out.data(), b.data(), n);
+        scalar.addRow(expected.data(), b.data(), n);
+        max_error = std::max(max_error, relativeError(out, expected));
+
+        kernels.subtractRow(out.data(), b.data(), n);
+        scalar.subtractRow(expected.data(), b.data(), n);
+        max_error = std::max(max_error, relativeError(out, expected));
+
+        kernels.maxRow(a.data(), b.data(), out.data(), n);
+        scalar.maxRow(a.data(), b.data(), expected.data(), n);
+        num_exact_mismatches += out != expected;
+
+        std::vector<uint8_t> mask(n), expected_mask(n);
+        kernels.nmsCompare(a.data(), b.data(), 0.25f, mask.data(), n);
+        scalar.nmsCompare(a.data(), b.data(), 0.25f, expected_mask.data(), n);
+        num_exact_mismatches += mask != expected_mask;
+
+        std::vector<uint8_t> query(harris_kernels::kDescriptorBytes);
+        std::vector<uint8_t> train(harris_kernels::kDescriptorBytes * n);
+        for(uint8_t& byte : query){
+            byte = static_cast<uint8_t>(rng.uniform(0, 256));
+        }
+        for(uint8_t& byte : train){
+            byte = static_cast<uint8_t>(rng.uniform(0, 256));
+        }
+        std::vector<uint16_t> distances(n), expected_distances(n);
+        kernels.hammingDistances(query.data(), train.data(), n, distances.data());
+        scalar.hammingDistances(query.data(), train.data(), n, expected_distances.data());
+        num_exact_mismatches += distances != expected_distances;
+
+        if(n > 0){
+            num_exact_mismatches += kernels.argminU16(distances.data(), n)
+                != scalar.argminU16(distances.data(), n);
+        }
+
+        std::vector<uint16_t> min(n, 128), expected_min(n, 128);
+        std::vector<int32_t> min_idx(n, -1), expected_min_idx(n, -1);
+        kernels.updateMinU16(distances.data(), 3, min.data(), min_idx.data(), n);
+        scalar.updateMinU16(distances.data(), 3, expected_min.data(), expected_min_idx.data(), n);
+        num_exact_mismatches += min != expected_min || min_idx != expected_min_idx;
+
+        // v readable on [begin - half_w_size - 1, end + half_w_size)
+        for(const int half_w_size : {1, 2, 3, 7}){
+            const int begin = half_w_size + 1;
+            const std::vector<float> v = randomRow(rng, begin + n + half_w_size);
+            std::vector<float> sums(begin + n), expected_sums(begin + n);
+            kernels.runningSum(v.data(), sums.data(), begin, begin + n, half_w_size);
+            scalar.runningSum(v.data(), expected_sums.data(), begin, begin + n, half_w_size);
+            max_error = std::max(max_error,
+                                 relativeError(std::vector<float>(sums.begin() + begin,
+                                                                  sums.end()),
+                                               std::vector<float>(expected_sums.begin() + begin,
+                                                                  expected_sums.end())));
+        }
+    }
+
+    std::cout << "[ INFO] " << tag << " kernels: relative error " << max_error << std::endl;
+
+    return report(tag + " kernels vs scalar", max_error <= kTolerance && num_exact_mismatches == 0);
+}
+
+bool checkResponse(const harris_kernels::Isa isa){
+
+    const std::string tag = harris_kernels::isaName(isa);
+
+    cv::Mat image(97, 333, CV_32FC1);
+    cv::RNG rng(2);
+    rng.fill(image, cv::RNG::UNIFORM, cv::Scalar(0.0), cv::Scalar(1.0));
+
+    bool ok = true;
+
+    for(const int window_size : {3, 5, 7}){
+
+        HarrisCorner reference(0.04, window_size);
+        reference.setIsa(harris_kernels::ISA_SCALAR);
+        HarrisCorner harris_corner(0.04, window_size);
+        harris_corner.setIsa(isa);
+
+        cv::Mat expected, response;
+        reference.calcResponse(image, expected);
+        harris_corner.calcResponse(image, response);
+
+        double min_val = 0.0;
+        double max_val = 0.0;
+        cv::minMaxLoc(expected, &min_val, &max_val);
+        const double max_abs = std::max(std::abs(min_val), std::abs(max_val));
+
+        cv::Mat diff;
+        cv::absdiff(response, expected, diff);
+        double max_diff = 0.0;
+        cv::minMaxLoc(diff, nullptr, &max_diff);
+
+        // the running sums add up the round-off of many products
+        const double error = max_diff / std::max(max_abs, 1e-30);
+        std::ostringstream name;
+        name << tag << " calcResponse w" << window_size << " vs scalar, relative error "
+             << error;
+        ok &= report(name.str(), error <= 1e-4);
+    }
+
+    return ok;
+}
+
+}
+
+
+int main(){
+
+    const harris_kernels::Isa isas[] = {
+        harris_kernels::ISA_SSE41, harris_kernels::ISA_AVX2, harris_kernels::ISA_AVX512
+    };
+
+    const harris_kernels::KernelTable& scalar =
+        harris_kernels::getKernels(harris_kernels::ISA_SCALAR);
+
+    bool ok = true;
+
+    for(const harris_kernels::Isa isa : isas){
+
+        if(! harris_kernels::isSupported(isa)){
+            std::cout << "[ INFO] " << harris_kernels::isaName(isa)
+                      << " not supported here, skipped" << std::endl;
+            continue;
+        }
+
+        ok &= checkKernels(harris_kernels::getKernels(isa), scalar);
+        ok &= checkResponse(isa);
+    }
+
+    std::cout << (ok ? "[ INFO] All checks passed" : "[ERROR] Some checks failed") << std::endl;
+
+    return ok ? 0 : 1;
+}
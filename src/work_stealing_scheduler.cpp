@@ -0,0 +1,238 @@
+#include <work_stealing_scheduler.hpp>
+
+#include "my_utils_kk4.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+
+
+namespace{
+
+// the scheduler and worker of the calling thread, if it is a worker
+thread_local WorkStealingScheduler const * current_scheduler = nullptr;
+thread_local int current_worker_idx = -1;
+
+}
+
+
+WorkStealingScheduler::WorkStealingScheduler(const int num_workers)
+    : num_queued_(0),
+      num_pending_(0),
+      quit_(false){
+
+    int n = num_workers;
+    if(n <= 0){
+        n = std::max(1, static_cast<int>(std::thread::hardware_concurrency()));
+    }
+
+    for(int i = 0; i < n; i++){
+        workers_.emplace_back(new Worker());
+    }
+
+    // all deques exist before any worker looks into them
+    for(int i = 0; i < n; i++){
+        workers_[i]->thread = std::thread(&WorkStealingScheduler::run, this, i);
+    }
+}
+
+WorkStealingScheduler::~WorkStealingScheduler(){
+
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        quit_ = true;
+    }
+    work_condition_.notify_all();
+
+    for(std::unique_ptr<Worker>& worker : workers_){
+        worker->thread.join();
+    }
+}
+
+void WorkStealingScheduler::submit(const int stream_idx, Task task){
+
+    if(stream_idx < 0){
+        throw std::runtime_error("stream_idx must not be negative");
+    }
+
+    const bool from_task = current_scheduler == this;
+    const int worker_idx = from_task ? current_worker_idx : getHomeWorker(stream_idx);
+
+    {
+        std::lock_guard<std::mutex> lock(stats_mutex_);
+        if(stream_stats_.size() <= static_cast<size_t>(stream_idx)){
+            stream_stats_.resize(stream_idx + 1);
+        }
+    }
+
+    QueuedTask queued_task;
+    queued_task.task = std::move(task);
+    queued_task.stream_idx = stream_idx;
+    queued_task.worker_idx = worker_idx;
+    queued_task.submit_time = Clock::now();
+
+    Worker& worker = *workers_[worker_idx];
+    {
+        std::lock_guard<std::mutex> lock(worker.mutex);
+        if(from_task){
+            worker.tasks.push_front(std::move(queued_task));
+        }else{
+            worker.tasks.push_back(std::move(queued_task));
+        }
+        num_queued_++;
+        num_pending_++;
+    }
+
+    // a sleeping worker either sees the count or gets the notification
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+    }
+    work_condition_.notify_one();
+}
+
+void WorkStealingScheduler::waitIdle(){
+
+    std::unique_lock<std::mutex> lock(mutex_);
+    idle_condition_.wait(lock, [&]{
+            return num_pending_ == 0;
+        });
+
+    if(exception_){
+        std::exception_ptr e = exception_;
+        exception_ = nullptr;
+        std::rethrow_exception(e);
+    }
+}
+
+int WorkStealingScheduler::getNumStreams()const{
+
+    std::lock_guard<std::mutex> lock(stats_mutex_);
+    return static_cast<int>(stream_stats_.size());
+}
+
+WorkStealingScheduler::StreamStats
+WorkStealingScheduler::getStreamStats(const int stream_idx)const{
+
+    std::lock_guard<std::mutex> lock(stats_mutex_);
+    if(stream_idx < 0 || static_cast<size_t>(stream_idx) >= stream_stats_.size()){
+        return StreamStats();
+    }
+    return stream_stats_[stream_idx];
+}
+
+double WorkStealingScheduler::getFairnessIndex()const{
+
+    std::lock_guard<std::mutex> lock(stats_mutex_);
+
+    double sum = 0.0;
+    double sum_sq = 0.0;
+    int n = 0;
+    for(const StreamStats& stats : stream_stats_){
+        if(stats.num_tasks > 0){
+            const double x = stats.queue_seconds / stats.num_tasks;
+            sum += x;
+            sum_sq += x * x;
+            n++;
+        }
+    }
+
+    return sum_sq > 0.0 ? sum * sum / (n * sum_sq) : 1.0;
+}
+
+void WorkStealingScheduler::resetStats(){
+
+    std::lock_guard<std::mutex> lock(stats_mutex_);
+    std::fill(stream_stats_.begin(), stream_stats_.end(), StreamStats());
+}
+
+void WorkStealingScheduler::run(const int worker_idx){
+
+    current_scheduler = this;
+    current_worker_idx = worker_idx;
+
+    if(my_utils_kk4::Tracer::isEnabled()){
+        my_utils_kk4::Tracer::getInstance().setThreadName(
+            "scheduler worker " + std::to_string(worker_idx));
+    }
+
+    while(true){
+
+        QueuedTask task;
+
+        if(take(worker_idx, task)){
+
+            const Clock::time_point start_time = Clock::now();
+            try{
+                task.task(worker_idx);
+            }catch(...){
+                std::lock_guard<std::mutex> lock(mutex_);
+                if(! exception_){
+                    exception_ = std::current_exception();
+                }
+            }
+            finish(task, worker_idx, start_time, Clock::now());
+            continue;
+        }
+
+        // the queued tasks are finished before quitting
+        std::unique_lock<std::mutex> lock(mutex_);
+        work_condition_.wait(lock, [&]{
+                return quit_ || num_queued_ > 0;
+            });
+        if(quit_ && num_queued_ == 0){
+            return;
+        }
+    }
+}
+
+bool WorkStealingScheduler::take(const int worker_idx, QueuedTask& task){
+
+    if(num_queued_ == 0){
+        return false;
+    }
+
+    const int num_workers = getNumWorkers();
+
+    for(int i = 0; i < num_workers; i++){
+        Worker& worker = *workers_[(worker_idx + i) % num_workers];
+        std::lock_guard<std::mutex> lock(worker.mutex);
+        if(! worker.tasks.empty()){
+            task = std::move(worker.tasks.front());
+            worker.tasks.pop_front();
+            num_queued_--;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void WorkStealingScheduler::finish(const QueuedTask& task,
+                                   const int worker_idx,
+                                   const Clock::time_point start_time,
+                                   const Clock::time_point end_time){
+
+    const double queue_seconds =
+        std::chrono::duration<double>(start_time - task.submit_time).count();
+    const double run_seconds =
+        std::chrono::duration<double>(end_time - start_time).count();
+
+    {
+        std::lock_guard<std::mutex> lock(stats_mutex_);
+        StreamStats& stats = stream_stats_[task.stream_idx];
+        stats.num_tasks++;
+        if(task.worker_idx != worker_idx){
+            stats.num_stolen++;
+        }
+        stats.queue_seconds += queue_seconds;
+        stats.max_queue_seconds = std::max(stats.max_queue_seconds, queue_seconds);
+        stats.run_seconds += run_seconds;
+    }
+
+    if(--num_pending_ == 0){
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+        }
+        idle_condition_.notify_all();
+    }
+}